@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 8
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+struct chunk
+{
+    struct chunk *next;
+    size_t sz;
+    size_t used;
+    char data[];
+};
+
+struct arena
+{
+    size_t chunk_sz;
+    size_t used;
+    struct chunk *head; /* 当前分配的 chunk */
+    struct chunk *first;
+};
+
+static struct chunk *chunk_create(size_t sz)
+{
+    struct chunk *c = malloc(sizeof(*c) + sz);
+    if (c == NULL)
+    {
+        return NULL;
+    }
+    c->next = NULL;
+    c->sz = sz;
+    c->used = 0;
+    return c;
+}
+
+struct arena *arena_create(size_t chunk_sz)
+{
+    assert(chunk_sz > 0);
+    struct arena *a = malloc(sizeof(*a));
+    if (a == NULL)
+    {
+        return NULL;
+    }
+    a->chunk_sz = ALIGN_UP(chunk_sz);
+    a->used = 0;
+    a->first = chunk_create(a->chunk_sz);
+    if (a->first == NULL)
+    {
+        free(a);
+        return NULL;
+    }
+    a->head = a->first;
+    return a;
+}
+
+static void free_chunks(struct chunk *c)
+{
+    while (c)
+    {
+        struct chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+void arena_release(struct arena *a)
+{
+    free_chunks(a->first);
+    free(a);
+}
+
+void *arena_alloc(struct arena *a, size_t sz)
+{
+    sz = ALIGN_UP(sz ? sz : 1);
+
+    struct chunk *c = a->head;
+    if (c->used + sz > c->sz)
+    {
+        // 大块单独分配, 挂在当前 chunk 之后, 不浪费当前 chunk 剩余空间
+        if (sz > a->chunk_sz / 4)
+        {
+            struct chunk *big = chunk_create(sz);
+            if (big == NULL)
+            {
+                return NULL;
+            }
+            big->used = sz;
+            big->next = c->next;
+            c->next = big;
+            a->used += sz;
+            return big->data;
+        }
+
+        struct chunk *nc = chunk_create(a->chunk_sz);
+        if (nc == NULL)
+        {
+            return NULL;
+        }
+        nc->next = c->next;
+        c->next = nc;
+        a->head = c = nc;
+    }
+
+    void *p = c->data + c->used;
+    c->used += sz;
+    a->used += sz;
+    return p;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len)
+{
+    char *p = arena_alloc(a, len + 1);
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+void arena_reset(struct arena *a)
+{
+    free_chunks(a->first->next);
+    a->first->next = NULL;
+    a->first->used = 0;
+    a->head = a->first;
+    a->used = 0;
+}
+
+size_t arena_used(const struct arena *a)
+{
+    return a->used;
+}
@@ -0,0 +1,22 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// bump 分配器, 只分配不单独释放, arena_reset/arena_release 一次性回收
+
+struct arena;
+
+struct arena *arena_create(size_t chunk_sz);
+void arena_release(struct arena *);
+
+// 8 字节对齐, 失败返回 NULL
+void *arena_alloc(struct arena *, size_t sz);
+// 复制 len 字节并追加 '\0'
+char *arena_strndup(struct arena *, const char *s, size_t len);
+
+// 保留第一个 chunk, 其余全部释放
+void arena_reset(struct arena *);
+size_t arena_used(const struct arena *);
+
+#endif
@@ -103,6 +103,26 @@ typedef struct internal_hooks
 
 static internal_hooks global_hooks = { malloc, free, realloc };
 
+/* arena mode: nodes and strings come from a caller supplied allocator and are never freed one by one.
+ * The allocator is reached through a thread local context because internal_hooks carry no user data. */
+static __thread struct
+{
+    cJSON_AllocFn alloc_fn;
+    void *ctx;
+} arena_ctx;
+
+static void *arena_allocate(size_t size)
+{
+    return arena_ctx.alloc_fn(arena_ctx.ctx, size);
+}
+
+static void arena_deallocate(void *pointer)
+{
+    (void)pointer;
+}
+
+static const internal_hooks arena_hooks = { arena_allocate, arena_deallocate, NULL };
+
 static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
 {
     size_t length = 0;
@@ -166,30 +186,39 @@ static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
     return node;
 }
 
-/* Delete a cJSON structure. */
-CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+static void delete_with_hooks(cJSON *item, const internal_hooks * const hooks)
 {
     cJSON *next = NULL;
+    if (hooks->deallocate == arena_deallocate)
+    {
+        return;
+    }
     while (item != NULL)
     {
         next = item->next;
         if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
-            cJSON_Delete(item->child);
+            delete_with_hooks(item->child, hooks);
         }
         if (!(item->type & cJSON_IsReference) && (item->valuestring != NULL))
         {
-            global_hooks.deallocate(item->valuestring);
+            hooks->deallocate(item->valuestring);
         }
         if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
         {
-            global_hooks.deallocate(item->string);
+            hooks->deallocate(item->string);
         }
-        global_hooks.deallocate(item);
+        hooks->deallocate(item);
         item = next;
     }
 }
 
+/* Delete a cJSON structure. */
+CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
+{
+    delete_with_hooks(item, &global_hooks);
+}
+
 /* get the decimal point character of the current locale */
 static unsigned char get_decimal_point(void)
 {
@@ -933,8 +962,7 @@ static parse_buffer *buffer_skip_whitespace(parse_buffer * const buffer)
     return buffer;
 }
 
-/* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated)
+static cJSON *parse_with_hooks(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated, const internal_hooks * const hooks)
 {
     parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
     cJSON *item = NULL;
@@ -951,9 +979,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
     buffer.content = (const unsigned char*)value;
     buffer.length = strlen((const char*)value) + sizeof("");
     buffer.offset = 0;
-    buffer.hooks = global_hooks;
+    buffer.hooks = *hooks;
 
-    item = cJSON_New_Item(&global_hooks);
+    item = cJSON_New_Item(hooks);
     if (item == NULL) /* memory fail */
     {
         goto fail;
@@ -984,7 +1012,7 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 fail:
     if (item != NULL)
     {
-        cJSON_Delete(item);
+        delete_with_hooks(item, hooks);
     }
 
     if (value != NULL)
@@ -1015,6 +1043,27 @@ fail:
     return NULL;
 }
 
+/* Parse an object - create a new root, and populate. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_with_hooks(value, return_parse_end, require_null_terminated, &global_hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseInArena(const char *value, cJSON_AllocFn alloc_fn, void *ctx)
+{
+    cJSON *item = NULL;
+    if (alloc_fn == NULL)
+    {
+        return NULL;
+    }
+    arena_ctx.alloc_fn = alloc_fn;
+    arena_ctx.ctx = ctx;
+    item = parse_with_hooks(value, 0, 0, &arena_hooks);
+    arena_ctx.alloc_fn = NULL;
+    arena_ctx.ctx = NULL;
+    return item;
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
 {
@@ -1096,6 +1145,21 @@ CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
     return (char*)print(item, false, &global_hooks);
 }
 
+CJSON_PUBLIC(char *) cJSON_PrintUnformattedInArena(const cJSON *item, cJSON_AllocFn alloc_fn, void *ctx)
+{
+    char *printed = NULL;
+    if (alloc_fn == NULL)
+    {
+        return NULL;
+    }
+    arena_ctx.alloc_fn = alloc_fn;
+    arena_ctx.ctx = ctx;
+    printed = (char*)print(item, false, &arena_hooks);
+    arena_ctx.alloc_fn = NULL;
+    arena_ctx.ctx = NULL;
+    return printed;
+}
+
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
     printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
@@ -1367,7 +1431,7 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_Delete(head);
+        delete_with_hooks(head, &(input_buffer->hooks));
     }
 
     return false;
@@ -1538,7 +1602,7 @@ success:
 fail:
     if (head != NULL)
     {
-        cJSON_Delete(head);
+        delete_with_hooks(head, &(input_buffer->hooks));
     }
 
     return false;
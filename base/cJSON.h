@@ -142,6 +142,12 @@ CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value);
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error. If not, then cJSON_GetErrorPtr() does the job. */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 
+/* Arena mode: every node and string is obtained from alloc_fn(ctx, size) and never freed individually.
+ * Do not call cJSON_Delete on the result (or modify it with the allocating helpers); release the arena in one shot instead. */
+typedef void *(*cJSON_AllocFn)(void *ctx, size_t size);
+CJSON_PUBLIC(cJSON *) cJSON_ParseInArena(const char *value, cJSON_AllocFn alloc_fn, void *ctx);
+CJSON_PUBLIC(char *) cJSON_PrintUnformattedInArena(const cJSON *item, cJSON_AllocFn alloc_fn, void *ctx);
+
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. */
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "thread.h"
+#include "ctable.h"
+
+/*
+ * 每个 shard 一个分代 slot map (参见 table.c), slot 按 chunk 分配, chunk 一经发布永不移动,
+ * 读者无需加锁即可定位 slot; slot 上 gen 充当 seqlock, 读前后两次比对 gen 确认 ud 属于该 handle
+ */
+
+#define CT_SHARD_BITS 4
+#define CT_IDX_BITS 18
+#define CT_SHARD_MASK ((1u << CT_SHARD_BITS) - 1)
+#define CT_IDX_MASK ((1u << CT_IDX_BITS) - 1)
+#define CT_GEN_MASK (~0u >> (CT_SHARD_BITS + CT_IDX_BITS))
+
+#define CT_CHUNK_BITS 10
+#define CT_CHUNK_SZ (1 << CT_CHUNK_BITS)
+#define CT_MAX_CHUNKS ((1 << CT_IDX_BITS) / CT_CHUNK_SZ)
+// handle 中存 idx + 1, 最后一个下标不可用
+#define CT_MAX_SLOTS (CT_IDX_MASK - 1)
+
+struct ct_slot
+{
+    unsigned int gen;
+    int next; /* 空闲链表, 仅写者访问 */
+    void *ud;
+};
+
+struct shard
+{
+    pthread_mutex_t mtx;
+    int free;
+    int nchunk;
+    int sz;
+    struct ct_slot *chunks[CT_MAX_CHUNKS];
+    char pad[64];
+};
+
+struct ctable
+{
+    int nshard;
+    struct shard *shards;
+};
+
+static int g_shard_seq = 0;
+static __thread int t_shard = -1;
+
+static inline handle mk_handle(int shard, int idx, unsigned int gen)
+{
+    return (gen << (CT_SHARD_BITS + CT_IDX_BITS)) | ((unsigned int)(idx + 1) << CT_SHARD_BITS) | (unsigned int)shard;
+}
+
+static inline struct ct_slot *slot_at(struct shard *sh, int idx)
+{
+    struct ct_slot *chunk = __atomic_load_n(&sh->chunks[idx >> CT_CHUNK_BITS], __ATOMIC_ACQUIRE);
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+    return &chunk[idx & (CT_CHUNK_SZ - 1)];
+}
+
+static bool shard_expand(struct shard *sh)
+{
+    if (sh->nchunk >= CT_MAX_CHUNKS)
+    {
+        return false;
+    }
+
+    struct ct_slot *chunk = calloc(CT_CHUNK_SZ, sizeof(struct ct_slot));
+    if (chunk == NULL)
+    {
+        return false;
+    }
+
+    int base = sh->nchunk * CT_CHUNK_SZ;
+    int i, n = CT_CHUNK_SZ;
+    if (base + n > CT_MAX_SLOTS)
+    {
+        n = CT_MAX_SLOTS - base;
+    }
+    for (i = 0; i < n; i++)
+    {
+        chunk[i].gen = 1;
+        chunk[i].next = i + 1 < n ? base + i + 1 : sh->free;
+    }
+    sh->free = base;
+
+    // chunk 初始化完毕后再对读者可见
+    __atomic_store_n(&sh->chunks[sh->nchunk], chunk, __ATOMIC_RELEASE);
+    sh->nchunk++;
+    return true;
+}
+
+struct ctable *ctable_create(int nshard)
+{
+    assert(nshard > 0 && nshard <= CTABLE_MAX_SHARDS);
+    assert((nshard & (nshard - 1)) == 0);
+
+    struct ctable *t = malloc(sizeof(*t));
+    if (t == NULL)
+    {
+        return NULL;
+    }
+    t->nshard = nshard;
+    t->shards = calloc(nshard, sizeof(struct shard));
+    if (t->shards == NULL)
+    {
+        free(t);
+        return NULL;
+    }
+
+    int i;
+    for (i = 0; i < nshard; i++)
+    {
+        t->shards[i].free = -1;
+        RETCHECK(pthread_mutex_init(&t->shards[i].mtx, NULL));
+    }
+    return t;
+}
+
+void ctable_release(struct ctable *t)
+{
+    int i, j;
+    for (i = 0; i < t->nshard; i++)
+    {
+        struct shard *sh = &t->shards[i];
+        for (j = 0; j < sh->nchunk; j++)
+        {
+            free(sh->chunks[j]);
+        }
+        RETCHECK(pthread_mutex_destroy(&sh->mtx));
+    }
+    free(t->shards);
+    free(t);
+}
+
+handle ctable_set(struct ctable *t, void *ud)
+{
+    if (ud == NULL)
+    {
+        return 0;
+    }
+
+    // 每个写线程固定落在一个 shard 上
+    if (t_shard < 0)
+    {
+        t_shard = __atomic_fetch_add(&g_shard_seq, 1, __ATOMIC_RELAXED) & (CTABLE_MAX_SHARDS - 1);
+    }
+    int si = t_shard & (t->nshard - 1);
+    struct shard *sh = &t->shards[si];
+
+    RETCHECK(pthread_mutex_lock(&sh->mtx));
+    if (sh->free == -1 && !shard_expand(sh))
+    {
+        RETCHECK(pthread_mutex_unlock(&sh->mtx));
+        return 0;
+    }
+
+    int idx = sh->free;
+    struct ct_slot *s = slot_at(sh, idx);
+    sh->free = s->next;
+    s->next = -1;
+    __atomic_store_n(&s->ud, ud, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&sh->sz, 1, __ATOMIC_RELAXED);
+    handle id = mk_handle(si, idx, s->gen);
+    RETCHECK(pthread_mutex_unlock(&sh->mtx));
+    return id;
+}
+
+static inline struct ct_slot *ctable_slot(struct ctable *t, handle id, struct shard **out)
+{
+    int si = id & CT_SHARD_MASK;
+    int idx = (int)((id >> CT_SHARD_BITS) & CT_IDX_MASK) - 1;
+    if (si >= t->nshard || idx < 0)
+    {
+        return NULL;
+    }
+    *out = &t->shards[si];
+    return slot_at(*out, idx);
+}
+
+void *ctable_get(struct ctable *t, handle id)
+{
+    struct shard *sh;
+    struct ct_slot *s = ctable_slot(t, id, &sh);
+    if (s == NULL)
+    {
+        return NULL;
+    }
+
+    unsigned int gen = id >> (CT_SHARD_BITS + CT_IDX_BITS);
+    if (__atomic_load_n(&s->gen, __ATOMIC_ACQUIRE) != gen)
+    {
+        return NULL;
+    }
+    void *ud = __atomic_load_n(&s->ud, __ATOMIC_ACQUIRE);
+    // 期间被 del (或 del 后重新 set) 则 gen 已变化
+    if (__atomic_load_n(&s->gen, __ATOMIC_RELAXED) != gen)
+    {
+        return NULL;
+    }
+    return ud;
+}
+
+void *ctable_del(struct ctable *t, handle id)
+{
+    struct shard *sh;
+    struct ct_slot *s = ctable_slot(t, id, &sh);
+    if (s == NULL)
+    {
+        return NULL;
+    }
+
+    void *ud = NULL;
+    unsigned int gen = id >> (CT_SHARD_BITS + CT_IDX_BITS);
+
+    RETCHECK(pthread_mutex_lock(&sh->mtx));
+    if (s->gen == gen && s->ud != NULL)
+    {
+        ud = s->ud;
+
+        unsigned int ngen = (gen + 1) & CT_GEN_MASK;
+        __atomic_store_n(&s->gen, ngen ? ngen : 1, __ATOMIC_RELAXED);
+        // 先让 gen 变化可见, 再清 ud
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&s->ud, NULL, __ATOMIC_RELAXED);
+
+        s->next = sh->free;
+        sh->free = (int)((id >> CT_SHARD_BITS) & CT_IDX_MASK) - 1;
+        __atomic_sub_fetch(&sh->sz, 1, __ATOMIC_RELAXED);
+    }
+    RETCHECK(pthread_mutex_unlock(&sh->mtx));
+    return ud;
+}
+
+int ctable_size(struct ctable *t)
+{
+    int i, sz = 0;
+    for (i = 0; i < t->nshard; i++)
+    {
+        sz += __atomic_load_n(&t->shards[i].sz, __ATOMIC_RELAXED);
+    }
+    return sz;
+}
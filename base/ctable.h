@@ -0,0 +1,25 @@
+#ifndef CTABLE_H
+#define CTABLE_H
+
+#include "table.h"
+
+// 并发版 table, handle 语义同 table.h
+// 写操作按 shard 加锁, 不同线程的写分散到不同 shard
+// ctable_get 无锁, 必须在 epoch_enter/epoch_leave 之间调用, 返回的 ud 在 leave 之前有效
+// ctable_del 返回的 ud 可能仍被其他线程的读者引用, 需通过 epoch_retire 延迟释放
+
+// handle: [gen:10][idx:18][shard:4]
+#define CTABLE_MAX_SHARDS 16
+
+struct ctable;
+
+// nshard 取 2 的幂, <= CTABLE_MAX_SHARDS
+struct ctable *ctable_create(int nshard);
+void ctable_release(struct ctable *);
+
+handle ctable_set(struct ctable *, void *ud);
+void *ctable_get(struct ctable *, handle);
+void *ctable_del(struct ctable *, handle);
+int ctable_size(struct ctable *);
+
+#endif
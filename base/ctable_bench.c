@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "table.h"
+#include "ctable.h"
+#include "epoch.h"
+
+// 事件循环线程持续增删连接, N 个 worker 线程随机查找
+// 对比 全局锁 + table 与 ctable (shard 写锁 + epoch 无锁读)
+
+#define N_CONN 50000
+#define N_LOOKUP 2000000
+#define MAX_THREADS 16
+
+static handle g_ids[N_CONN];
+static volatile bool g_stop;
+
+static struct table *g_table;
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct ctable *g_ctable;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void noop_free(void *ud)
+{
+}
+
+static void *table_reader(void *ud)
+{
+    unsigned int seed = (unsigned int)(long)ud;
+    long i, hit = 0;
+    for (i = 0; i < N_LOOKUP; i++)
+    {
+        handle id = __atomic_load_n(&g_ids[rand_r(&seed) % N_CONN], __ATOMIC_RELAXED);
+        pthread_mutex_lock(&g_mtx);
+        if (table_get(g_table, id))
+        {
+            hit++;
+        }
+        pthread_mutex_unlock(&g_mtx);
+    }
+    return (void *)hit;
+}
+
+static void *table_writer(void *ud)
+{
+    unsigned int seed = 42;
+    while (!g_stop)
+    {
+        int j = rand_r(&seed) % N_CONN;
+        pthread_mutex_lock(&g_mtx);
+        void *c = table_del(g_table, g_ids[j]);
+        g_ids[j] = table_set(g_table, c);
+        pthread_mutex_unlock(&g_mtx);
+    }
+    return NULL;
+}
+
+static void *ctable_reader(void *ud)
+{
+    unsigned int seed = (unsigned int)(long)ud;
+    long i, hit = 0;
+    for (i = 0; i < N_LOOKUP; i++)
+    {
+        handle id = __atomic_load_n(&g_ids[rand_r(&seed) % N_CONN], __ATOMIC_RELAXED);
+        epoch_enter();
+        if (ctable_get(g_ctable, id))
+        {
+            hit++;
+        }
+        epoch_leave();
+    }
+    return (void *)hit;
+}
+
+static void *ctable_writer(void *ud)
+{
+    unsigned int seed = 42;
+    while (!g_stop)
+    {
+        int j = rand_r(&seed) % N_CONN;
+        void *c = ctable_del(g_ctable, g_ids[j]);
+        epoch_retire(c, noop_free);
+        __atomic_store_n(&g_ids[j], ctable_set(g_ctable, c), __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static double run(int nthread, void *(*reader)(void *), void *(*writer)(void *))
+{
+    pthread_t w, rs[MAX_THREADS];
+    long i;
+
+    g_stop = false;
+    pthread_create(&w, NULL, writer, NULL);
+
+    double start = now();
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_create(&rs[i], NULL, reader, (void *)(i + 1));
+    }
+    for (i = 0; i < nthread; i++)
+    {
+        pthread_join(rs[i], NULL);
+    }
+    double cost = now() - start;
+
+    g_stop = true;
+    pthread_join(w, NULL);
+
+    return (double)nthread * N_LOOKUP / cost / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    long i;
+    int n;
+
+    g_table = table_create();
+    for (i = 0; i < N_CONN; i++)
+    {
+        g_ids[i] = table_set(g_table, (void *)(i + 1));
+    }
+    printf("%-8s %16s %16s\n", "threads", "mutex+table Mops", "ctable Mops");
+
+    double mtx[MAX_THREADS + 1];
+    for (n = 1; n <= MAX_THREADS; n *= 2)
+    {
+        mtx[n] = run(n, table_reader, table_writer);
+    }
+    table_release(g_table);
+
+    g_ctable = ctable_create(CTABLE_MAX_SHARDS);
+    for (i = 0; i < N_CONN; i++)
+    {
+        g_ids[i] = ctable_set(g_ctable, (void *)(i + 1));
+    }
+    for (n = 1; n <= MAX_THREADS; n *= 2)
+    {
+        printf("%-8d %16.2f %16.2f\n", n, mtx[n], run(n, ctable_reader, ctable_writer));
+    }
+    epoch_barrier();
+    ctable_release(g_ctable);
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include "ctable.h"
+#include "epoch.h"
+
+#define ALIVE 0x600d
+#define DEAD 0xdead
+
+struct conn
+{
+    int magic;
+    handle id;
+};
+
+static int freed = 0;
+
+static void conn_free(void *ud)
+{
+    struct conn *c = (struct conn *)ud;
+    c->magic = DEAD;
+    free(c);
+    __atomic_add_fetch(&freed, 1, __ATOMIC_RELAXED);
+}
+
+void test_CTable_basic()
+{
+    struct ctable *t = ctable_create(4);
+
+    handle id1 = ctable_set(t, (void *)1);
+    handle id2 = ctable_set(t, (void *)2);
+    assert(id1 != 0 && id2 != 0 && id1 != id2);
+    assert(ctable_size(t) == 2);
+
+    epoch_enter();
+    assert((long)ctable_get(t, id1) == 1);
+    assert((long)ctable_get(t, id2) == 2);
+    epoch_leave();
+
+    assert((long)ctable_del(t, id1) == 1);
+    assert(ctable_del(t, id1) == NULL);
+    assert(ctable_size(t) == 1);
+
+    // slot 复用后旧 handle 失效
+    handle id3 = ctable_set(t, (void *)3);
+    assert(id3 != id1);
+
+    epoch_enter();
+    assert(ctable_get(t, id1) == NULL);
+    assert((long)ctable_get(t, id3) == 3);
+    assert(ctable_get(t, 0) == NULL);
+    assert(ctable_get(t, ~0u) == NULL);
+    epoch_leave();
+
+    ctable_release(t);
+}
+
+void test_CTable_expand()
+{
+    struct ctable *t = ctable_create(1);
+    int n = 10000;
+    handle *ids = malloc(n * sizeof(handle));
+    long i;
+    for (i = 0; i < n; i++)
+    {
+        ids[i] = ctable_set(t, (void *)(i + 1));
+        assert(ids[i]);
+    }
+    epoch_enter();
+    for (i = 0; i < n; i++)
+    {
+        assert((long)ctable_get(t, ids[i]) == i + 1);
+    }
+    epoch_leave();
+    free(ids);
+    ctable_release(t);
+}
+
+#define N_CONN 1024
+#define N_READER 4
+#define N_WRITER 2
+#define N_ROUND 20000
+
+static struct ctable *g_t;
+static handle g_ids[N_WRITER][N_CONN];
+
+static void *reader(void *ud)
+{
+    unsigned int seed = (unsigned int)(long)ud;
+    int i, hit = 0;
+    for (i = 0; i < N_ROUND * 10; i++)
+    {
+        int w = rand_r(&seed) % N_WRITER;
+        int j = rand_r(&seed) % N_CONN;
+        handle id = __atomic_load_n(&g_ids[w][j], __ATOMIC_ACQUIRE);
+
+        epoch_enter();
+        struct conn *c = ctable_get(g_t, id);
+        if (c)
+        {
+            // 未被 epoch 保护的话这里会读到已释放的对象
+            assert(c->magic == ALIVE);
+            assert(c->id == id);
+            hit++;
+        }
+        epoch_leave();
+    }
+    return (void *)(long)hit;
+}
+
+static struct conn *conn_new(struct ctable *t)
+{
+    struct conn *c = malloc(sizeof(*c));
+    c->magic = ALIVE;
+    c->id = 0;
+    handle id = ctable_set(t, c);
+    assert(id);
+    // 发布给读者之前写入 id
+    c->id = id;
+    return c;
+}
+
+static void *writer(void *ud)
+{
+    int w = (int)(long)ud;
+    unsigned int seed = w;
+    int i;
+    for (i = 0; i < N_CONN; i++)
+    {
+        struct conn *c = conn_new(g_t);
+        __atomic_store_n(&g_ids[w][i], c->id, __ATOMIC_RELEASE);
+    }
+    for (i = 0; i < N_ROUND; i++)
+    {
+        int j = rand_r(&seed) % N_CONN;
+        struct conn *old = ctable_del(g_t, g_ids[w][j]);
+        assert(old && old->magic == ALIVE);
+        epoch_retire(old, conn_free);
+
+        struct conn *c = conn_new(g_t);
+        __atomic_store_n(&g_ids[w][j], c->id, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+void test_CTable_concurrent()
+{
+    g_t = ctable_create(4);
+
+    pthread_t ws[N_WRITER], rs[N_READER];
+    long i;
+    for (i = 0; i < N_WRITER; i++)
+    {
+        pthread_create(&ws[i], NULL, writer, (void *)i);
+    }
+    for (i = 0; i < N_READER; i++)
+    {
+        pthread_create(&rs[i], NULL, reader, (void *)(i + 1));
+    }
+    for (i = 0; i < N_WRITER; i++)
+    {
+        pthread_join(ws[i], NULL);
+    }
+    for (i = 0; i < N_READER; i++)
+    {
+        void *hit;
+        pthread_join(rs[i], &hit);
+        printf("reader %ld hit %ld\n", i, (long)hit);
+    }
+
+    assert(ctable_size(g_t) == N_WRITER * N_CONN);
+
+    epoch_barrier();
+    assert(freed == N_WRITER * N_ROUND);
+
+    int w, j;
+    for (w = 0; w < N_WRITER; w++)
+    {
+        for (j = 0; j < N_CONN; j++)
+        {
+            free(ctable_del(g_t, g_ids[w][j]));
+        }
+    }
+    assert(ctable_size(g_t) == 0);
+    ctable_release(g_t);
+}
+
+int main(void)
+{
+    test_CTable_basic();
+    test_CTable_expand();
+    test_CTable_concurrent();
+    return 0;
+}
@@ -19,9 +19,11 @@ void bin2hex(const char *bin, size_t sz);
 
 #define UNUSED(x) ((void)(x))
 
+#undef LOG_INFO
 #define LOG_INFO(fmt, ...) \
     fprintf(stderr, "\x1B[1;32m[INFO] " fmt "\x1B[0m in function %s %s:%d\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 
+#undef LOG_ERROR
 #define LOG_ERROR(fmt, ...) \
     fprintf(stderr, "\x1B[1;31m[ERROR] " fmt "\x1B[0m in function %s %s:%d\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 
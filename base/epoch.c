@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+#include "thread.h"
+#include "epoch.h"
+
+#define EPOCH_LIMBO_N 3
+// 每累计这么多待回收对象尝试推进一次
+#define EPOCH_POLL_THRESHOLD 64
+
+struct retired
+{
+    void *p;
+    void (*fn)(void *);
+};
+
+struct limbo
+{
+    int sz;
+    int cap;
+    struct retired *q;
+};
+
+struct record
+{
+    // (epoch << 1) | active
+    uint64_t state;
+    int used;
+    char pad[64 - sizeof(uint64_t) - sizeof(int)];
+};
+
+static uint64_t g_epoch = 0;
+static struct record g_records[EPOCH_MAX_THREADS];
+
+static pthread_mutex_t g_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct limbo g_limbo[EPOCH_LIMBO_N];
+static int g_pending = 0;
+
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_key;
+
+static __thread struct record *t_rec = NULL;
+static __thread int t_depth = 0;
+
+static void record_free(void *ud)
+{
+    struct record *rec = (struct record *)ud;
+    __atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->used, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_init()
+{
+    RETCHECK(pthread_key_create(&g_key, record_free));
+}
+
+static struct record *record_get()
+{
+    if (t_rec)
+    {
+        return t_rec;
+    }
+
+    pthread_once(&g_once, epoch_init);
+
+    int i;
+    for (i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        int unused = 0;
+        if (__atomic_compare_exchange_n(&g_records[i].used, &unused, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            t_rec = &g_records[i];
+            RETCHECK(pthread_setspecific(g_key, t_rec));
+            return t_rec;
+        }
+    }
+
+    fprintf(stderr, "epoch: too many threads (max %d)\n", EPOCH_MAX_THREADS);
+    abort();
+}
+
+void epoch_enter()
+{
+    if (t_depth++)
+    {
+        return;
+    }
+
+    struct record *rec = record_get();
+    uint64_t e = __atomic_load_n(&g_epoch, __ATOMIC_ACQUIRE);
+    // seq_cst: 之后对共享指针的读取不能重排到 store 之前
+    __atomic_store_n(&rec->state, (e << 1) | 1, __ATOMIC_SEQ_CST);
+}
+
+void epoch_leave()
+{
+    assert(t_depth > 0);
+    if (--t_depth)
+    {
+        return;
+    }
+    __atomic_store_n(&t_rec->state, 0, __ATOMIC_RELEASE);
+}
+
+static void limbo_push(struct limbo *l, void *p, void (*fn)(void *))
+{
+    if (l->sz == l->cap)
+    {
+        l->cap = l->cap ? l->cap * 2 : EPOCH_POLL_THRESHOLD;
+        l->q = realloc(l->q, l->cap * sizeof(struct retired));
+        assert(l->q);
+    }
+    l->q[l->sz].p = p;
+    l->q[l->sz].fn = fn;
+    l->sz++;
+}
+
+static void limbo_drain(struct retired *q, int sz)
+{
+    int i;
+    for (i = 0; i < sz; i++)
+    {
+        q[i].fn(q[i].p);
+    }
+    free(q);
+}
+
+// 持锁调用, 推进成功时将需要回收的队列摘出, 由调用者在锁外释放
+static bool try_advance(struct limbo *out)
+{
+    uint64_t e = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+
+    int i;
+    for (i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        if (!__atomic_load_n(&g_records[i].used, __ATOMIC_ACQUIRE))
+        {
+            continue;
+        }
+        uint64_t st = __atomic_load_n(&g_records[i].state, __ATOMIC_SEQ_CST);
+        if ((st & 1) && (st >> 1) != e)
+        {
+            return false;
+        }
+    }
+
+    // 推进到 e + 1, 回收 e - 1 时 retire 的对象
+    __atomic_store_n(&g_epoch, e + 1, __ATOMIC_SEQ_CST);
+    struct limbo *l = &g_limbo[(e + 2) % EPOCH_LIMBO_N];
+    *out = *l;
+    g_pending -= l->sz;
+    l->sz = 0;
+    l->cap = 0;
+    l->q = NULL;
+    return true;
+}
+
+void epoch_retire(void *p, void (*fn)(void *))
+{
+    struct limbo out = {0, 0, NULL};
+    bool advanced = false;
+
+    RETCHECK(pthread_mutex_lock(&g_mtx));
+    uint64_t e = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+    limbo_push(&g_limbo[e % EPOCH_LIMBO_N], p, fn);
+    if (++g_pending >= EPOCH_POLL_THRESHOLD)
+    {
+        advanced = try_advance(&out);
+    }
+    RETCHECK(pthread_mutex_unlock(&g_mtx));
+
+    if (advanced)
+    {
+        limbo_drain(out.q, out.sz);
+    }
+}
+
+bool epoch_poll()
+{
+    struct limbo out = {0, 0, NULL};
+
+    RETCHECK(pthread_mutex_lock(&g_mtx));
+    bool advanced = try_advance(&out);
+    RETCHECK(pthread_mutex_unlock(&g_mtx));
+
+    if (advanced)
+    {
+        limbo_drain(out.q, out.sz);
+    }
+    return advanced;
+}
+
+void epoch_barrier()
+{
+    assert(t_depth == 0);
+
+    // 连续推进 EPOCH_LIMBO_N 次, 三个队列都被清空
+    int n = 0;
+    while (n < EPOCH_LIMBO_N)
+    {
+        if (epoch_poll())
+        {
+            n++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
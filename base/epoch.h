@@ -0,0 +1,25 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdbool.h>
+
+// 基于 epoch 的内存回收 (EBR), 进程全局
+// 读者在 epoch_enter/epoch_leave 之间访问共享指针, 无锁
+// 写者摘除对象后 epoch_retire, 等所有读者离开当前 epoch 后才真正释放
+
+#define EPOCH_MAX_THREADS 128
+
+// 可嵌套
+void epoch_enter();
+void epoch_leave();
+
+// p 已对新读者不可见, 两个 epoch 之后调用 fn(p)
+void epoch_retire(void *p, void (*fn)(void *));
+
+// 尝试推进 epoch 并回收, 返回是否推进成功
+bool epoch_poll();
+
+// 阻塞直到此前 retire 的对象全部回收, 调用线程不能处于 enter 状态
+void epoch_barrier();
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// 按 8 字节一组处理的字符串 hash (murmur3 风格 mix), 供 strtab/intern 使用
+
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+static inline uint64_t hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline uint64_t hash_bytes(const void *data, size_t len)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = HASH_SEED ^ (len * c1);
+    uint64_t k;
+
+    while (len >= 8)
+    {
+        memcpy(&k, p, 8);
+        k *= c1;
+        k = hash_rotl(k, 31);
+        k *= c2;
+        h ^= k;
+        h = hash_rotl(h, 27) * 5 + 0x52dce729;
+        p += 8;
+        len -= 8;
+    }
+
+    if (len)
+    {
+        k = 0;
+        memcpy(&k, p, len);
+        k *= c1;
+        k = hash_rotl(k, 31);
+        k *= c2;
+        h ^= k;
+    }
+
+    return hash_fmix(h);
+}
+
+#endif
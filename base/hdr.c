@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <inttypes.h>
+#include "hdr.h"
+
+// counts 按 bucket 排列: bucket 0 有 sub_bucket_count 个格子, 宽度 1
+// 之后每个 bucket 只用后一半格子 (前一半与上一个 bucket 重合), 宽度依次翻倍
+struct hdr
+{
+    int64_t highest;
+    int sigfigs;
+    int half_mag;       // log2(sub_bucket_count / 2)
+    int64_t half_count; // sub_bucket_count / 2
+    int64_t sub_mask;   // sub_bucket_count - 1
+    int bucket_n;
+    int counts_len;
+
+    // 以下原子更新
+    int64_t total;
+    int64_t sum;
+    int64_t min;
+    int64_t max;
+    int64_t counts[];
+};
+
+static inline int bucket_index(const struct hdr *h, int64_t v)
+{
+    int pow2ceiling = 64 - __builtin_clzll((uint64_t)(v | h->sub_mask));
+    return pow2ceiling - (h->half_mag + 1);
+}
+
+static inline int counts_index(const struct hdr *h, int64_t v)
+{
+    int bi = bucket_index(h, v);
+    int64_t sbi = v >> bi;
+    return (int)(((int64_t)(bi + 1) << h->half_mag) + (sbi - h->half_count));
+}
+
+static inline int64_t value_from_index(const struct hdr *h, int idx)
+{
+    int bi = (idx >> h->half_mag) - 1;
+    int64_t sbi = (idx & (h->half_count - 1)) + h->half_count;
+    if (bi < 0)
+    {
+        sbi -= h->half_count;
+        bi = 0;
+    }
+    return sbi << bi;
+}
+
+// 与 v 落在同一格子的最大值
+static inline int64_t highest_equivalent(const struct hdr *h, int64_t v)
+{
+    int bi = bucket_index(h, v);
+    int64_t lowest = (v >> bi) << bi;
+    return lowest + ((int64_t)1 << bi) - 1;
+}
+
+// 与 v 落在同一格子的中间值
+static inline int64_t median_equivalent(const struct hdr *h, int64_t v)
+{
+    int bi = bucket_index(h, v);
+    int64_t lowest = (v >> bi) << bi;
+    return lowest + (((int64_t)1 << bi) >> 1);
+}
+
+struct hdr *hdr_create(int64_t highest, int sigfigs)
+{
+    assert(highest >= 2 && sigfigs >= 1 && sigfigs <= 5);
+
+    // 单位精度能表示的最大值 2 * 10^sigfigs, sub_bucket_count 为不小于它的 2 的幂
+    int64_t largest = 2;
+    int i;
+    for (i = 0; i < sigfigs; i++)
+    {
+        largest *= 10;
+    }
+    int mag = 0;
+    while (((int64_t)1 << mag) < largest)
+    {
+        mag++;
+    }
+    int64_t sub_count = (int64_t)1 << mag;
+
+    int bucket_n = 1;
+    int64_t untrackable = sub_count;
+    while (untrackable <= highest)
+    {
+        if (untrackable > INT64_MAX / 2)
+        {
+            bucket_n++;
+            break;
+        }
+        untrackable <<= 1;
+        bucket_n++;
+    }
+
+    int counts_len = (bucket_n + 1) * (int)(sub_count / 2);
+    struct hdr *h = calloc(1, sizeof(*h) + counts_len * sizeof(int64_t));
+    assert(h);
+    h->highest = highest;
+    h->sigfigs = sigfigs;
+    h->half_mag = mag - 1;
+    h->half_count = sub_count / 2;
+    h->sub_mask = sub_count - 1;
+    h->bucket_n = bucket_n;
+    h->counts_len = counts_len;
+    h->min = INT64_MAX;
+    h->max = 0;
+    return h;
+}
+
+void hdr_release(struct hdr *h)
+{
+    free(h);
+}
+
+static void update_min(int64_t *min, int64_t v)
+{
+    int64_t cur = __atomic_load_n(min, __ATOMIC_RELAXED);
+    while (v < cur && !__atomic_compare_exchange_n(min, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void update_max(int64_t *max, int64_t v)
+{
+    int64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(max, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+bool hdr_record(struct hdr *h, int64_t value)
+{
+    if (value < 0)
+    {
+        return false;
+    }
+    bool ok = true;
+    if (value > h->highest)
+    {
+        value = h->highest;
+        ok = false;
+    }
+    __atomic_fetch_add(&h->counts[counts_index(h, value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+    update_min(&h->min, value);
+    update_max(&h->max, value);
+    return ok;
+}
+
+int64_t hdr_count(const struct hdr *h)
+{
+    return __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+}
+
+int64_t hdr_min(const struct hdr *h)
+{
+    int64_t min = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+    return min == INT64_MAX ? 0 : min;
+}
+
+int64_t hdr_max(const struct hdr *h)
+{
+    return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+double hdr_mean(const struct hdr *h)
+{
+    int64_t total = hdr_count(h);
+    return total ? (double)__atomic_load_n(&h->sum, __ATOMIC_RELAXED) / total : 0;
+}
+
+double hdr_stddev(const struct hdr *h)
+{
+    int64_t total = hdr_count(h);
+    if (total == 0)
+    {
+        return 0;
+    }
+    double mean = hdr_mean(h);
+    double geometric_dev_total = 0;
+    int i;
+    for (i = 0; i < h->counts_len; i++)
+    {
+        int64_t c = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (c)
+        {
+            double dev = median_equivalent(h, value_from_index(h, i)) - mean;
+            geometric_dev_total += dev * dev * c;
+        }
+    }
+    return sqrt(geometric_dev_total / total);
+}
+
+int64_t hdr_value_at_percentile(const struct hdr *h, double percentile)
+{
+    int64_t total = hdr_count(h);
+    if (total == 0)
+    {
+        return 0;
+    }
+    if (percentile < 0)
+    {
+        percentile = 0;
+    }
+    if (percentile > 100)
+    {
+        percentile = 100;
+    }
+
+    int64_t target = (int64_t)(percentile / 100 * total + 0.5);
+    if (target < 1)
+    {
+        target = 1;
+    }
+
+    int64_t cum = 0, v = 0;
+    int i;
+    for (i = 0; i < h->counts_len; i++)
+    {
+        cum += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (cum >= target)
+        {
+            v = highest_equivalent(h, value_from_index(h, i));
+            break;
+        }
+    }
+    // 不超过实际记录到的最大值
+    int64_t max = hdr_max(h);
+    return v > max ? max : v;
+}
+
+void hdr_add(struct hdr *dst, const struct hdr *src)
+{
+    assert(dst->counts_len == src->counts_len && dst->half_mag == src->half_mag);
+    int64_t moved = 0;
+    int i;
+    for (i = 0; i < src->counts_len; i++)
+    {
+        int64_t c = __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+        if (c)
+        {
+            __atomic_fetch_add(&dst->counts[i], c, __ATOMIC_RELAXED);
+            moved += c;
+        }
+    }
+    __atomic_fetch_add(&dst->total, moved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dst->sum, __atomic_load_n(&src->sum, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    if (moved)
+    {
+        update_min(&dst->min, __atomic_load_n(&src->min, __ATOMIC_RELAXED));
+        update_max(&dst->max, __atomic_load_n(&src->max, __ATOMIC_RELAXED));
+    }
+}
+
+void hdr_take(struct hdr *src, struct hdr *dst)
+{
+    assert(dst->counts_len == src->counts_len && dst->half_mag == src->half_mag);
+    int64_t moved = 0;
+    int i;
+    for (i = 0; i < src->counts_len; i++)
+    {
+        if (__atomic_load_n(&src->counts[i], __ATOMIC_RELAXED) == 0)
+        {
+            continue;
+        }
+        int64_t c = __atomic_exchange_n(&src->counts[i], 0, __ATOMIC_RELAXED);
+        if (c)
+        {
+            __atomic_fetch_add(&dst->counts[i], c, __ATOMIC_RELAXED);
+            moved += c;
+        }
+    }
+    // total 只减去实际移走的计数, 期间新记录的仍留在 src
+    __atomic_fetch_sub(&src->total, moved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dst->total, moved, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dst->sum, __atomic_exchange_n(&src->sum, 0, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    int64_t min = __atomic_exchange_n(&src->min, INT64_MAX, __ATOMIC_RELAXED);
+    int64_t max = __atomic_exchange_n(&src->max, 0, __ATOMIC_RELAXED);
+    if (moved)
+    {
+        update_min(&dst->min, min);
+        update_max(&dst->max, max);
+    }
+}
+
+void hdr_reset(struct hdr *h)
+{
+    memset(h->counts, 0, h->counts_len * sizeof(int64_t));
+    h->total = 0;
+    h->sum = 0;
+    h->min = INT64_MAX;
+    h->max = 0;
+}
+
+void hdr_percentiles_print(const struct hdr *h, FILE *out, int ticks, double scale)
+{
+    int64_t total = hdr_count(h);
+    fprintf(out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    // 同 HdrHistogram 的 percentile iterator: 每把剩余比例减半, 输出 ticks 行
+    double next = 0;
+    int64_t cum = 0, v = 0;
+    int i;
+    for (i = 0; i < h->counts_len && cum < total; i++)
+    {
+        int64_t c = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (c == 0)
+        {
+            continue;
+        }
+        cum += c;
+        v = highest_equivalent(h, value_from_index(h, i));
+        double pct = 100.0 * cum / total;
+        while (next <= pct)
+        {
+            fprintf(out, "%12.3f %2.12f %10" PRId64 " %14.2f\n", v / scale, next / 100, cum, 1 / (1 - next / 100));
+            double half_distance = 1;
+            while (half_distance <= 100 / (100 - next))
+            {
+                half_distance *= 2;
+            }
+            next += 100 / (ticks * half_distance);
+            if (cum >= total)
+            {
+                break;
+            }
+        }
+    }
+    if (total)
+    {
+        fprintf(out, "%12.3f %2.12f %10" PRId64 "\n", v / scale, 1.0, total);
+    }
+
+    fprintf(out, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", hdr_mean(h) / scale, hdr_stddev(h) / scale);
+    fprintf(out, "#[Max     = %12.3f, Total count    = %12" PRId64 "]\n", hdr_max(h) / scale, total);
+    fprintf(out, "#[Buckets = %12d, SubBuckets     = %12" PRId64 "]\n", h->bucket_n, h->half_count * 2);
+}
@@ -0,0 +1,38 @@
+#ifndef HDR_H
+#define HDR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// HDR 直方图, 桶划分同 HdrHistogram: 最小可分辨值 1, sigfigs 位有效数字的相对精度
+// 记录为原子操作, 无锁, 多线程可同时 hdr_record; 读取时其它线程仍在记录则为近似值
+
+struct hdr;
+
+// 可记录 [0, highest], sigfigs 取 1..5
+struct hdr *hdr_create(int64_t highest, int sigfigs);
+void hdr_release(struct hdr *);
+
+// 超过 highest 按 highest 计入并返回 false, 负数不记录
+bool hdr_record(struct hdr *, int64_t value);
+
+int64_t hdr_count(const struct hdr *);
+int64_t hdr_min(const struct hdr *);
+int64_t hdr_max(const struct hdr *);
+double hdr_mean(const struct hdr *);
+double hdr_stddev(const struct hdr *);
+// percentile 取 0..100, 返回等价区间的上界, 无记录返回 0
+int64_t hdr_value_at_percentile(const struct hdr *, double percentile);
+
+// 两者须以相同参数创建
+void hdr_add(struct hdr *dst, const struct hdr *src);
+// 把 src 的计数原子地移到 dst, src 清零, 用于记录线程不停的区间统计
+void hdr_take(struct hdr *src, struct hdr *dst);
+void hdr_reset(struct hdr *);
+
+// HdrHistogram 的 percentile distribution (.hgrm) 文本格式, 可直接用 HdrHistogram 的 plotter 作图对比
+// 每个半程 ticks 行, 值除以 scale 输出 (如 us 记录, scale 1000 输出 ms)
+void hdr_percentiles_print(const struct hdr *, FILE *out, int ticks, double scale);
+
+#endif
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include "hdr.h"
+
+// 相对误差不超过 10^-sigfigs
+static void assert_near(int64_t v, int64_t expected, int sigfigs)
+{
+    double tolerance = expected;
+    int i;
+    for (i = 0; i < sigfigs; i++)
+    {
+        tolerance /= 10;
+    }
+    if (llabs(v - expected) > tolerance + 1)
+    {
+        fprintf(stderr, "%lld, expected %lld\n", (long long)v, (long long)expected);
+        assert(0);
+    }
+}
+
+void test_Hdr_record()
+{
+    struct hdr *h = hdr_create(3600LL * 1000 * 1000, 3);
+    assert(hdr_count(h) == 0 && hdr_min(h) == 0 && hdr_max(h) == 0);
+    assert(hdr_value_at_percentile(h, 50) == 0);
+
+    // 单位精度区间内精确
+    int64_t v;
+    for (v = 0; v < 2048; v++)
+    {
+        assert(hdr_record(h, v));
+    }
+    assert(hdr_count(h) == 2048);
+    assert(hdr_min(h) == 0 && hdr_max(h) == 2047);
+    assert(hdr_value_at_percentile(h, 50) == 1023);
+    assert(hdr_value_at_percentile(h, 100) == 2047);
+    assert(hdr_value_at_percentile(h, 0) == 0);
+    assert(hdr_mean(h) == 1023.5);
+
+    hdr_reset(h);
+    assert(hdr_count(h) == 0);
+
+    // 1..1000000 各一次
+    for (v = 1; v <= 1000000; v++)
+    {
+        hdr_record(h, v);
+    }
+    assert_near(hdr_value_at_percentile(h, 50), 500000, 3);
+    assert_near(hdr_value_at_percentile(h, 90), 900000, 3);
+    assert_near(hdr_value_at_percentile(h, 99), 990000, 3);
+    assert_near(hdr_value_at_percentile(h, 99.9), 999000, 3);
+    assert(hdr_value_at_percentile(h, 100) == 1000000);
+    assert(hdr_min(h) == 1 && hdr_max(h) == 1000000);
+    assert_near(hdr_stddev(h), 288675, 3);
+
+    // 越界
+    assert(!hdr_record(h, -1));
+    assert(!hdr_record(h, 3600LL * 1000 * 1000 + 1));
+    assert(hdr_max(h) == 3600LL * 1000 * 1000);
+    hdr_release(h);
+}
+
+void test_Hdr_take()
+{
+    struct hdr *live = hdr_create(1000000, 3);
+    struct hdr *interval = hdr_create(1000000, 3);
+    struct hdr *total = hdr_create(1000000, 3);
+
+    int64_t v;
+    for (v = 1; v <= 100; v++)
+    {
+        hdr_record(live, v);
+    }
+    hdr_take(live, interval);
+    assert(hdr_count(live) == 0 && hdr_max(live) == 0);
+    assert(hdr_count(interval) == 100 && hdr_min(interval) == 1 && hdr_max(interval) == 100);
+    assert(hdr_value_at_percentile(interval, 50) == 50);
+    hdr_add(total, interval);
+    hdr_reset(interval);
+
+    for (v = 1000; v < 2000; v++)
+    {
+        hdr_record(live, v);
+    }
+    hdr_take(live, interval);
+    assert(hdr_count(interval) == 1000 && hdr_min(interval) == 1000);
+    hdr_add(total, interval);
+
+    assert(hdr_count(total) == 1100 && hdr_min(total) == 1 && hdr_max(total) == 1999);
+    assert(hdr_value_at_percentile(total, 50) == 1449);
+
+    hdr_release(live);
+    hdr_release(interval);
+    hdr_release(total);
+}
+
+struct recorder
+{
+    struct hdr *h;
+    int n;
+};
+
+static void *record_main(void *ud)
+{
+    struct recorder *r = ud;
+    int i;
+    for (i = 0; i < r->n; i++)
+    {
+        hdr_record(r->h, i % 1000 + 1);
+    }
+    return NULL;
+}
+
+void test_Hdr_concurrent()
+{
+    // 多线程记录同时不断取走, 计数不丢
+    struct hdr *live = hdr_create(1000000, 3);
+    struct hdr *total = hdr_create(1000000, 3);
+    struct recorder r = {live, 200000};
+    pthread_t tids[4];
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        assert(pthread_create(&tids[i], NULL, record_main, &r) == 0);
+    }
+    for (i = 0; i < 100; i++)
+    {
+        hdr_take(live, total);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    hdr_take(live, total);
+    assert(hdr_count(live) == 0);
+    assert(hdr_count(total) == 4 * 200000);
+    assert(hdr_min(total) == 1 && hdr_max(total) == 1000);
+    assert(hdr_value_at_percentile(total, 50) == 500);
+    hdr_release(live);
+    hdr_release(total);
+}
+
+void test_Hdr_print()
+{
+    struct hdr *h = hdr_create(1000000, 3);
+    int64_t v;
+    for (v = 1; v <= 10000; v++)
+    {
+        hdr_record(h, v);
+    }
+
+    char *text = NULL;
+    size_t sz = 0;
+    FILE *out = open_memstream(&text, &sz);
+    hdr_percentiles_print(h, out, 5, 1000);
+    fclose(out);
+
+    const char *header = "       Value     Percentile TotalCount 1/(1-Percentile)\n\n";
+    assert(strncmp(text, header, strlen(header)) == 0);
+    assert(strstr(text, "       0.001 0.000000000000          1           1.00\n"));
+    assert(strstr(text, "       5.003 0.500000000000       5003           2.00\n"));
+    assert(strstr(text, "      10.007 1.000000000000      10000\n"));
+    assert(strstr(text, "#[Max     =       10.000, Total count    =        10000]\n"));
+    assert(strstr(text, "#[Buckets =           10, SubBuckets     =         2048]\n"));
+    free(text);
+    hdr_release(h);
+}
+
+void test_Hdr_bench()
+{
+    struct hdr *h = hdr_create(3600LL * 1000 * 1000, 3);
+    int n = 10000000, i;
+    clock_t start = clock();
+    for (i = 0; i < n; i++)
+    {
+        hdr_record(h, (i * 2654435761u) % 1000000);
+    }
+    double ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / n;
+    printf("hdr_record: %.1f ns\n", ns);
+
+    start = clock();
+    int64_t p = 0;
+    for (i = 0; i < 1000; i++)
+    {
+        p += hdr_value_at_percentile(h, 99.9);
+    }
+    ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / 1000;
+    printf("hdr_value_at_percentile: %.1f ns (p99.9 %lld)\n", ns, (long long)(p / 1000));
+    hdr_release(h);
+}
+
+int main(void)
+{
+    test_Hdr_record();
+    test_Hdr_take();
+    test_Hdr_concurrent();
+    test_Hdr_print();
+    test_Hdr_bench();
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "arena.h"
+#include "hash.h"
+#include "intern.h"
+
+#define INIT_CAP 256
+#define ARENA_CHUNK 8192
+
+// 字符串前面紧挨着头部, 由字符串指针反推
+struct istr
+{
+    uint64_t hash;
+    uint32_t id;
+    uint32_t len;
+    char s[];
+};
+
+struct intern_tab
+{
+    pthread_mutex_t mtx;
+    struct arena *arena;
+    // 线性探测, 保存 hash 避免重复计算
+    struct istr **slots;
+    uint32_t cap;
+    // id -> istr
+    struct istr **ids;
+    uint32_t n;
+    uint32_t ids_cap;
+};
+
+static struct intern_tab g_tab = {PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, NULL, 0, 0};
+
+static inline struct istr *to_istr(const char *s)
+{
+    return (struct istr *)(s - offsetof(struct istr, s));
+}
+
+static void tab_init(struct intern_tab *t)
+{
+    t->arena = arena_create(ARENA_CHUNK);
+    t->cap = INIT_CAP;
+    t->slots = calloc(t->cap, sizeof(struct istr *));
+    t->ids_cap = INIT_CAP;
+    t->ids = malloc(t->ids_cap * sizeof(struct istr *));
+    assert(t->arena && t->slots && t->ids);
+}
+
+static void tab_expand(struct intern_tab *t)
+{
+    uint32_t ncap = t->cap * 2;
+    struct istr **nslots = calloc(ncap, sizeof(struct istr *));
+    assert(nslots);
+
+    uint32_t i;
+    for (i = 0; i < t->cap; i++)
+    {
+        struct istr *e = t->slots[i];
+        if (e)
+        {
+            uint32_t j = e->hash & (ncap - 1);
+            while (nslots[j])
+            {
+                j = (j + 1) & (ncap - 1);
+            }
+            nslots[j] = e;
+        }
+    }
+    free(t->slots);
+    t->slots = nslots;
+    t->cap = ncap;
+}
+
+// 持锁调用, 找到返回 istr, 否则返回 NULL, *slot 为可插入的空槽
+static struct istr *tab_find(struct intern_tab *t, const char *s, size_t len, uint64_t hash, uint32_t *slot)
+{
+    uint32_t i = hash & (t->cap - 1);
+    struct istr *e;
+    while ((e = t->slots[i]))
+    {
+        if (e->hash == hash && e->len == len && memcmp(e->s, s, len) == 0)
+        {
+            return e;
+        }
+        i = (i + 1) & (t->cap - 1);
+    }
+    *slot = i;
+    return NULL;
+}
+
+const char *intern(const char *s, size_t len)
+{
+    struct intern_tab *t = &g_tab;
+    uint64_t hash = hash_bytes(s, len);
+
+    pthread_mutex_lock(&t->mtx);
+    if (t->arena == NULL)
+    {
+        tab_init(t);
+    }
+
+    uint32_t i;
+    struct istr *e = tab_find(t, s, len, hash, &i);
+    if (e)
+    {
+        pthread_mutex_unlock(&t->mtx);
+        return e->s;
+    }
+
+    e = arena_alloc(t->arena, sizeof(struct istr) + len + 1);
+    assert(e);
+    e->hash = hash;
+    e->len = len;
+    e->id = ++t->n;
+    memcpy(e->s, s, len);
+    e->s[len] = '\0';
+    t->slots[i] = e;
+
+    if (t->n >= t->ids_cap)
+    {
+        t->ids_cap *= 2;
+        t->ids = realloc(t->ids, t->ids_cap * sizeof(struct istr *));
+        assert(t->ids);
+    }
+    t->ids[e->id] = e;
+
+    // 负载 1/2
+    if (t->n * 2 > t->cap)
+    {
+        tab_expand(t);
+    }
+    pthread_mutex_unlock(&t->mtx);
+    return e->s;
+}
+
+const char *intern_cstr(const char *s)
+{
+    return intern(s, strlen(s));
+}
+
+const char *intern_lookup(const char *s, size_t len)
+{
+    struct intern_tab *t = &g_tab;
+    uint64_t hash = hash_bytes(s, len);
+    const char *r = NULL;
+
+    pthread_mutex_lock(&t->mtx);
+    if (t->arena != NULL)
+    {
+        uint32_t i;
+        struct istr *e = tab_find(t, s, len, hash, &i);
+        r = e ? e->s : NULL;
+    }
+    pthread_mutex_unlock(&t->mtx);
+    return r;
+}
+
+uint32_t intern_id(const char *istr)
+{
+    return to_istr(istr)->id;
+}
+
+size_t intern_len(const char *istr)
+{
+    return to_istr(istr)->len;
+}
+
+uint64_t intern_hash(const char *istr)
+{
+    return to_istr(istr)->hash;
+}
+
+const char *intern_get(uint32_t id)
+{
+    const char *s = NULL;
+    pthread_mutex_lock(&g_tab.mtx);
+    if (id > 0 && id <= g_tab.n)
+    {
+        s = g_tab.ids[id]->s;
+    }
+    pthread_mutex_unlock(&g_tab.mtx);
+    return s;
+}
+
+int intern_count()
+{
+    pthread_mutex_lock(&g_tab.mtx);
+    int n = g_tab.n;
+    pthread_mutex_unlock(&g_tab.mtx);
+    return n;
+}
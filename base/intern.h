@@ -0,0 +1,25 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 进程全局字符串驻留表, 线程安全
+// 相同内容返回同一指针 ('\0' 结尾, 进程内永久有效, 不可释放), 驻留字符串之间可直接比较指针
+// hash 只在首次驻留时计算一次, 之后 intern_hash 直接读取
+
+const char *intern(const char *s, size_t len);
+const char *intern_cstr(const char *s);
+// 只查不插入, 未驻留返回 NULL; 用于外部输入 (如网络上收到的名字), 避免驻留表无限增长
+const char *intern_lookup(const char *s, size_t len);
+
+// 以下参数必须是 intern 返回的指针
+uint32_t intern_id(const char *istr);
+size_t intern_len(const char *istr);
+uint64_t intern_hash(const char *istr);
+
+// id 从 1 开始, 不存在返回 NULL
+const char *intern_get(uint32_t id);
+int intern_count();
+
+#endif
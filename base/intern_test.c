@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "intern.h"
+
+void test_Intern_same()
+{
+    char buf[64];
+    strcpy(buf, "com.youzan.DemoService");
+
+    const char *a = intern_cstr("com.youzan.DemoService");
+    const char *b = intern(buf, strlen(buf));
+    assert(a == b);
+    assert(a != buf);
+    assert(strcmp(a, buf) == 0);
+    assert(intern_len(a) == strlen(buf));
+    assert(intern_get(intern_id(a)) == a);
+
+    // 前缀不同长度是不同字符串
+    const char *c = intern(buf, 10);
+    assert(c != a);
+    assert(strcmp(c, "com.youzan") == 0);
+    assert(intern_id(c) != intern_id(a));
+    assert(intern_hash(c) != intern_hash(a));
+
+    // 只查不插入
+    int n = intern_count();
+    assert(intern_lookup(buf, strlen(buf)) == a);
+    assert(intern_lookup(buf, 11) == NULL);
+    assert(intern_count() == n);
+
+    assert(intern_get(0) == NULL);
+    assert(intern_get(intern_count() + 1) == NULL);
+}
+
+void test_Intern_many()
+{
+    char buf[64];
+    const char *ptrs[5000];
+    int i, n0 = intern_count();
+    for (i = 0; i < 5000; i++)
+    {
+        sprintf(buf, "method-%d", i);
+        ptrs[i] = intern_cstr(buf);
+    }
+    assert(intern_count() == n0 + 5000);
+
+    // 扩容后指针不变
+    for (i = 0; i < 5000; i++)
+    {
+        sprintf(buf, "method-%d", i);
+        assert(intern_cstr(buf) == ptrs[i]);
+    }
+}
+
+static void *worker(void *ud)
+{
+    char buf[64];
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        sprintf(buf, "shared-%d", i);
+        const char *s = intern_cstr(buf);
+        assert(strcmp(s, buf) == 0);
+    }
+    return (void *)intern_cstr("shared-0");
+}
+
+void test_Intern_threads()
+{
+    pthread_t ts[4];
+    void *ret[4];
+    int i;
+    for (i = 0; i < 4; i++)
+    {
+        pthread_create(&ts[i], NULL, worker, NULL);
+    }
+    for (i = 0; i < 4; i++)
+    {
+        pthread_join(ts[i], &ret[i]);
+    }
+    for (i = 1; i < 4; i++)
+    {
+        assert(ret[i] == ret[0]);
+    }
+}
+
+int main(void)
+{
+    test_Intern_same();
+    test_Intern_many();
+    test_Intern_threads();
+    return 0;
+}
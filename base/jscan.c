@@ -0,0 +1,388 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "jscan.h"
+
+#define BLOCK 16
+
+struct jscan
+{
+    const char *json;
+    size_t len;
+    // 结构字符与字符串两端引号的位置, 按出现顺序
+    uint32_t *tok;
+    // 括号配对的 token 下标, 其它 token 无意义
+    uint32_t *match;
+    uint32_t n;
+    uint32_t cap;
+};
+
+// 16 字节中 " \ { } [ ] : , 的位置掩码
+static inline uint32_t block_mask(const char *p)
+{
+#ifdef __SSE2__
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    __m128i m = _mm_cmpeq_epi8(b, _mm_set1_epi8('"'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(b, _mm_set1_epi8('\\')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(b, _mm_set1_epi8(':')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(b, _mm_set1_epi8(',')));
+    // '[' 0x5b ']' 0x5d '{' 0x7b '}' 0x7d: 清掉 0x20 位后为 0x5b 或 0x5d
+    __m128i u = _mm_andnot_si128(_mm_set1_epi8(0x20), b);
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(u, _mm_set1_epi8('[')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(u, _mm_set1_epi8(']')));
+    return (uint32_t)_mm_movemask_epi8(m);
+#else
+    uint32_t m = 0;
+    int i;
+    for (i = 0; i < BLOCK; i++)
+    {
+        char c = p[i];
+        m |= (uint32_t)(c == '"' || c == '\\' || c == ':' || c == ',' ||
+                        c == '[' || c == ']' || c == '{' || c == '}')
+             << i;
+    }
+    return m;
+#endif
+}
+
+static inline uint32_t tail_mask(const char *p, size_t n)
+{
+    char block[BLOCK];
+    memset(block, ' ', BLOCK);
+    memcpy(block, p, n);
+    return block_mask(block);
+}
+
+static void push_tok(struct jscan *s, size_t pos)
+{
+    if (s->n == s->cap)
+    {
+        s->cap *= 2;
+        s->tok = realloc(s->tok, s->cap * sizeof(uint32_t));
+        s->match = realloc(s->match, s->cap * sizeof(uint32_t));
+        assert(s->tok && s->match);
+    }
+    s->tok[s->n++] = pos;
+}
+
+static bool build(struct jscan *s)
+{
+    const char *json = s->json;
+    size_t len = s->len;
+    bool in_str = false;
+    size_t skip = 0; // 转义字符, 位置小于 skip 的忽略
+
+    uint32_t *stack = NULL;
+    uint32_t depth = 0, stack_cap = 0;
+    bool ok = true;
+
+    size_t base;
+    for (base = 0; base < len && ok; base += BLOCK)
+    {
+        uint32_t m = base + BLOCK <= len ? block_mask(json + base) : tail_mask(json + base, len - base);
+        while (m)
+        {
+            size_t p = base + __builtin_ctz(m);
+            m &= m - 1;
+            if (p < skip)
+            {
+                continue;
+            }
+            char c = json[p];
+            if (in_str)
+            {
+                if (c == '\\')
+                {
+                    skip = p + 2;
+                }
+                else if (c == '"')
+                {
+                    push_tok(s, p);
+                    in_str = false;
+                }
+                continue;
+            }
+
+            switch (c)
+            {
+            case '"':
+                push_tok(s, p);
+                in_str = true;
+                break;
+            case '{':
+            case '[':
+                if (depth == stack_cap)
+                {
+                    stack_cap = stack_cap ? stack_cap * 2 : 64;
+                    stack = realloc(stack, stack_cap * sizeof(uint32_t));
+                    assert(stack);
+                }
+                stack[depth++] = s->n;
+                push_tok(s, p);
+                break;
+            case '}':
+            case ']':
+            {
+                char open = c == '}' ? '{' : '[';
+                if (depth == 0 || json[s->tok[stack[depth - 1]]] != open)
+                {
+                    ok = false;
+                    break;
+                }
+                uint32_t o = stack[--depth];
+                s->match[o] = s->n;
+                s->match[s->n] = o;
+                push_tok(s, p);
+                break;
+            }
+            case '\\':
+                // 字符串外的反斜杠
+                ok = false;
+                break;
+            default:
+                push_tok(s, p);
+                break;
+            }
+            if (!ok)
+            {
+                break;
+            }
+        }
+    }
+    free(stack);
+    return ok && !in_str && depth == 0;
+}
+
+struct jscan *jscan_create(const char *json, size_t len)
+{
+    // 位置用 uint32 保存
+    if (len > UINT32_MAX)
+    {
+        return NULL;
+    }
+    struct jscan *s = malloc(sizeof(*s));
+    assert(s);
+    s->json = json;
+    s->len = len;
+    s->n = 0;
+    s->cap = len / 8 + 16;
+    s->tok = malloc(s->cap * sizeof(uint32_t));
+    s->match = malloc(s->cap * sizeof(uint32_t));
+    assert(s->tok && s->match);
+
+    if (!build(s))
+    {
+        jscan_release(s);
+        return NULL;
+    }
+    return s;
+}
+
+void jscan_release(struct jscan *s)
+{
+    free(s->tok);
+    free(s->match);
+    free(s);
+}
+
+// ****************************************************************************************************
+// 查找
+
+static inline bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+struct value
+{
+    size_t beg;
+    size_t end;
+    long open; // 对象/数组的起始 token, 否则 -1
+    long next; // 值之后的第一个 token
+};
+
+// 紧接 token prev 之后的值 (prev 为 -1 表示从头开始)
+static bool value_at(const struct jscan *s, long prev, struct value *v)
+{
+    const char *json = s->json;
+    size_t p = prev < 0 ? 0 : s->tok[prev] + 1;
+    while (p < s->len && is_ws(json[p]))
+    {
+        p++;
+    }
+    if (p >= s->len)
+    {
+        return false;
+    }
+
+    long t = prev + 1;
+    v->beg = p;
+    v->open = -1;
+    if (t < s->n && s->tok[t] == p)
+    {
+        char c = json[p];
+        if (c == '{' || c == '[')
+        {
+            v->open = t;
+            v->end = s->tok[s->match[t]] + 1;
+            v->next = s->match[t] + 1;
+        }
+        else if (c == '"')
+        {
+            v->end = s->tok[t + 1] + 1;
+            v->next = t + 2;
+        }
+        else
+        {
+            // 空值
+            return false;
+        }
+        return true;
+    }
+
+    // 数字 true false null, 到下一个 token 为止
+    size_t e = t < s->n ? s->tok[t] : s->len;
+    while (e > p && is_ws(json[e - 1]))
+    {
+        e--;
+    }
+    v->end = e;
+    v->next = t;
+    return true;
+}
+
+// pointer 段与 key 比较, 段内 ~0 ~1 转义
+static bool seg_eq(const char *key, size_t klen, const char *seg, size_t slen)
+{
+    size_t i = 0, j = 0;
+    while (j < slen)
+    {
+        char c = seg[j++];
+        if (c == '~' && j < slen)
+        {
+            c = seg[j] == '1' ? '/' : seg[j] == '0' ? '~' : 0;
+            if (c == 0)
+            {
+                return false;
+            }
+            j++;
+        }
+        if (i == klen || key[i++] != c)
+        {
+            return false;
+        }
+    }
+    return i == klen;
+}
+
+static bool find_key(const struct jscan *s, struct value *v, const char *seg, size_t slen)
+{
+    const char *json = s->json;
+    long k = v->open + 1;
+    while (k + 2 < (long)s->n && json[s->tok[k]] == '"')
+    {
+        const char *key = json + s->tok[k] + 1;
+        size_t klen = s->tok[k + 1] - s->tok[k] - 1;
+        struct value kv;
+        if (json[s->tok[k + 2]] != ':' || !value_at(s, k + 2, &kv))
+        {
+            return false;
+        }
+        if (seg_eq(key, klen, seg, slen))
+        {
+            *v = kv;
+            return true;
+        }
+        if (kv.next >= s->n || json[s->tok[kv.next]] != ',')
+        {
+            return false;
+        }
+        k = kv.next + 1;
+    }
+    return false;
+}
+
+static bool find_index(const struct jscan *s, struct value *v, const char *seg, size_t slen)
+{
+    size_t idx = 0, j;
+    if (slen == 0 || (slen > 1 && seg[0] == '0'))
+    {
+        return false;
+    }
+    for (j = 0; j < slen; j++)
+    {
+        if (seg[j] < '0' || seg[j] > '9')
+        {
+            return false;
+        }
+        idx = idx * 10 + (seg[j] - '0');
+    }
+
+    const char *json = s->json;
+    long prev = v->open;
+    struct value ev;
+    for (;;)
+    {
+        if (!value_at(s, prev, &ev))
+        {
+            return false;
+        }
+        if (idx-- == 0)
+        {
+            *v = ev;
+            return true;
+        }
+        if (ev.next >= s->n || json[s->tok[ev.next]] != ',')
+        {
+            return false;
+        }
+        prev = ev.next;
+    }
+}
+
+bool jscan_get(const struct jscan *s, const char *pointer, const char **val, size_t *len)
+{
+    struct value v;
+    if (!value_at(s, -1, &v))
+    {
+        return false;
+    }
+
+    const char *p = pointer;
+    while (*p)
+    {
+        if (*p != '/' || v.open < 0)
+        {
+            return false;
+        }
+        const char *seg = ++p;
+        while (*p && *p != '/')
+        {
+            p++;
+        }
+        bool found = s->json[v.beg] == '{' ? find_key(s, &v, seg, p - seg) : find_index(s, &v, seg, p - seg);
+        if (!found)
+        {
+            return false;
+        }
+    }
+    *val = s->json + v.beg;
+    *len = v.end - v.beg;
+    return true;
+}
+
+bool jscan_lookup(const char *json, size_t len, const char *pointer, const char **val, size_t *vlen)
+{
+    struct jscan *s = jscan_create(json, len);
+    if (s == NULL)
+    {
+        return false;
+    }
+    bool ok = jscan_get(s, pointer, val, vlen);
+    jscan_release(s);
+    return ok;
+}
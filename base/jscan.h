@@ -0,0 +1,27 @@
+#ifndef JSCAN_H
+#define JSCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 惰性 JSON 字段提取, 不建树
+// jscan_create 一遍扫描 (SSE2 每次 16 字节定位引号/反斜杠/结构字符) 建立结构索引:
+// 字符串外的 { } [ ] : , 与字符串两端引号的位置, 并记录括号配对
+// 查找按 JSON pointer 逐层在兄弟节点间跳转, 嵌套的对象/数组按配对直接跳过
+// 只检查括号配对与字符串闭合, 不做完整的 JSON 校验; json 须在 jscan 释放前保持有效
+
+struct jscan;
+
+// 括号不配对或字符串未闭合返回 NULL
+struct jscan *jscan_create(const char *json, size_t len);
+void jscan_release(struct jscan *);
+
+// JSON pointer (RFC 6901): "" 为根, "/a/0/b", 段内 ~1 表示 '/', ~0 表示 '~'
+// key 按原始字节比较 (不处理 key 中的 \ 转义)
+// 找到返回 true, *val 指向 json 中的值原文 (字符串含引号), *len 为长度
+bool jscan_get(const struct jscan *, const char *pointer, const char **val, size_t *len);
+
+// 一次性查找
+bool jscan_lookup(const char *json, size_t len, const char *pointer, const char **val, size_t *vlen);
+
+#endif
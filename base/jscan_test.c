@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "jscan.h"
+
+static void expect(const struct jscan *s, const char *pointer, const char *expected)
+{
+    const char *val;
+    size_t len;
+    bool found = jscan_get(s, pointer, &val, &len);
+    if (expected == NULL)
+    {
+        if (found)
+        {
+            fprintf(stderr, "%s => %.*s, expected not found\n", pointer, (int)len, val);
+            assert(0);
+        }
+        return;
+    }
+    if (!found || len != strlen(expected) || memcmp(val, expected, len) != 0)
+    {
+        fprintf(stderr, "%s => %.*s, expected %s\n", pointer, found ? (int)len : 0, found ? val : "", expected);
+        assert(0);
+    }
+}
+
+void test_Jscan_get()
+{
+    const char *json = " { \"a\" : 1 , \"b\":{\"c\":[true, \"x,]}\\\"\", {\"d\" : null } , [ ] ]},"
+                       "\"e\":\"\\\\\", \"a/b\": -2.5e3 , \"m~n\":{}, \"\":\"empty\", \"f\": [ 10 ,20] } ";
+    struct jscan *s = jscan_create(json, strlen(json));
+    assert(s);
+
+    const char *val;
+    size_t len;
+    assert(jscan_get(s, "", &val, &len));
+    assert(val == strchr(json, '{') && val + len == strrchr(json, '}') + 1);
+    expect(s, "/a", "1");
+    expect(s, "/b/c/0", "true");
+    expect(s, "/b/c/1", "\"x,]}\\\"\"");
+    expect(s, "/b/c/2", "{\"d\" : null }");
+    expect(s, "/b/c/2/d", "null");
+    expect(s, "/b/c/3", "[ ]");
+    expect(s, "/e", "\"\\\\\"");
+    expect(s, "/a~1b", "-2.5e3");
+    expect(s, "/m~0n", "{}");
+    expect(s, "/", "\"empty\"");
+    expect(s, "/f/1", "20");
+
+    expect(s, "/x", NULL);
+    expect(s, "/a/0", NULL);
+    expect(s, "/b/c/4", NULL);
+    expect(s, "/b/c/01", NULL);
+    expect(s, "/b/c/-", NULL);
+    expect(s, "/b/c/3/0", NULL);
+    expect(s, "/m~0n/a", NULL);
+    expect(s, "a", NULL);
+    jscan_release(s);
+
+    assert(jscan_lookup(" 42 ", 4, "", &val, &len) && len == 2 && memcmp(val, "42", 2) == 0);
+    assert(!jscan_lookup("42", 2, "/a", &val, &len));
+    assert(!jscan_lookup("", 0, "", &val, &len));
+}
+
+void test_Jscan_invalid()
+{
+    const char *bad[] = {"[1, 2", "{\"a\": [1}", "[1]]", "\"abc", "{\"a\": \"b\\\"}", "[1, \\n]"};
+    size_t i;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        assert(jscan_create(bad[i], strlen(bad[i])) == NULL);
+    }
+}
+
+void test_Jscan_bench()
+{
+    // 大响应体中查找末尾的 key
+    int n = 20000, i;
+    size_t cap = n * 64 + 64, len = 0;
+    char *json = malloc(cap);
+    len += sprintf(json + len, "{\"response\":{\"items\":[");
+    for (i = 0; i < n; i++)
+    {
+        len += sprintf(json + len, "%s{\"id\":%d,\"name\":\"item %d [x]\"}", i ? "," : "", i, i);
+    }
+    len += sprintf(json + len, "],\"total\":%d},\"trace\":\"t-1\"}", n);
+
+    struct jscan *s = jscan_create(json, len);
+    assert(s);
+    expect(s, "/trace", "\"t-1\"");
+    expect(s, "/response/total", "20000");
+    expect(s, "/response/items/19999/id", "19999");
+
+    int loops = 1000000;
+    const char *val;
+    size_t vlen;
+    clock_t start = clock();
+    for (i = 0; i < loops; i++)
+    {
+        assert(jscan_get(s, "/trace", &val, &vlen));
+    }
+    double ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / loops;
+    printf("jscan_get /trace on %zu bytes: %.1f ns\n", len, ns);
+
+    jscan_release(s);
+    free(json);
+}
+
+int main(void)
+{
+    test_Jscan_get();
+    test_Jscan_invalid();
+    test_Jscan_bench();
+    return 0;
+}
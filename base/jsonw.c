@@ -0,0 +1,695 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "jsonw.h"
+#include "utf8.h"
+
+struct jsonw
+{
+    struct buffer *buf;
+    int flags;
+    int depth;
+    bool err;
+    bool after_key;
+    char type[JW_MAX_DEPTH]; // '{' 或 '['
+    bool has[JW_MAX_DEPTH];  // 当前层已有元素
+};
+
+static const char hex[] = "0123456789abcdef";
+
+struct jsonw *jw_create(struct buffer *out, int flags)
+{
+    struct jsonw *jw = malloc(sizeof(*jw));
+    assert(jw);
+    jw->buf = out;
+    jw->flags = flags;
+    jw->depth = 0;
+    jw->err = false;
+    jw->after_key = false;
+    return jw;
+}
+
+void jw_release(struct jsonw *jw)
+{
+    free(jw);
+}
+
+bool jw_ok(const struct jsonw *jw)
+{
+    return !jw->err && jw->depth == 0 && !jw->after_key;
+}
+
+// ****************************************************************************************************
+// 分隔符
+
+static void indent(struct jsonw *jw, int n)
+{
+    char *p;
+    buf_ensureWritable(jw->buf, n + 1);
+    p = buf_beginWrite(jw->buf);
+    *p++ = '\n';
+    memset(p, '\t', n);
+    buf_has_written(jw->buf, n + 1);
+}
+
+static bool before_value(struct jsonw *jw)
+{
+    if (jw->err)
+    {
+        return false;
+    }
+    if (jw->depth == 0)
+    {
+        return true;
+    }
+
+    int d = jw->depth - 1;
+    if (jw->type[d] == '{')
+    {
+        if (!jw->after_key)
+        {
+            jw->err = true;
+            return false;
+        }
+        jw->after_key = false;
+        return true;
+    }
+
+    if (jw->has[d])
+    {
+        if (jw->flags & JW_PRETTY)
+        {
+            buf_append(jw->buf, ", ", 2);
+        }
+        else
+        {
+            buf_appendInt8(jw->buf, ',');
+        }
+    }
+    jw->has[d] = true;
+    return true;
+}
+
+static void begin(struct jsonw *jw, char type)
+{
+    if (!before_value(jw))
+    {
+        return;
+    }
+    if (jw->depth == JW_MAX_DEPTH)
+    {
+        jw->err = true;
+        return;
+    }
+    jw->type[jw->depth] = type;
+    jw->has[jw->depth] = false;
+    jw->depth++;
+    buf_appendInt8(jw->buf, type);
+}
+
+static void end(struct jsonw *jw, char type)
+{
+    if (jw->err)
+    {
+        return;
+    }
+    if (jw->depth == 0 || jw->type[jw->depth - 1] != type || jw->after_key)
+    {
+        jw->err = true;
+        return;
+    }
+    jw->depth--;
+    if (type == '{' && (jw->flags & JW_PRETTY) && jw->has[jw->depth])
+    {
+        indent(jw, jw->depth);
+    }
+    buf_appendInt8(jw->buf, type == '{' ? '}' : ']');
+}
+
+void jw_object_begin(struct jsonw *jw)
+{
+    begin(jw, '{');
+}
+
+void jw_object_end(struct jsonw *jw)
+{
+    end(jw, '{');
+}
+
+void jw_array_begin(struct jsonw *jw)
+{
+    begin(jw, '[');
+}
+
+void jw_array_end(struct jsonw *jw)
+{
+    end(jw, '[');
+}
+
+// ****************************************************************************************************
+// 字符串
+
+static char *put_u(char *p, uint32_t c)
+{
+    *p++ = '\\';
+    *p++ = 'u';
+    *p++ = hex[(c >> 12) & 0xf];
+    *p++ = hex[(c >> 8) & 0xf];
+    *p++ = hex[(c >> 4) & 0xf];
+    *p++ = hex[c & 0xf];
+    return p;
+}
+
+static bool write_str(struct jsonw *jw, const char *str, size_t len)
+{
+    const uint8_t *s = (const uint8_t *)str;
+    uint8_t hi = (jw->flags & JW_ASCII) ? 0x80 : 0xFF;
+    size_t i = 0, run = 0;
+
+    buf_appendInt8(jw->buf, '"');
+    while (i < len)
+    {
+        uint8_t c = s[i];
+        // 无需转义的连续字节整段写入
+        if (c >= 0x20 && c != '"' && c != '\\' && c < hi)
+        {
+            i++;
+            continue;
+        }
+        if (i > run)
+        {
+            buf_append(jw->buf, str + run, i - run);
+        }
+
+        char esc[12], *p = esc;
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            *p++ = '\\';
+            *p++ = c;
+            break;
+        case '\b':
+            *p++ = '\\';
+            *p++ = 'b';
+            break;
+        case '\f':
+            *p++ = '\\';
+            *p++ = 'f';
+            break;
+        case '\n':
+            *p++ = '\\';
+            *p++ = 'n';
+            break;
+        case '\r':
+            *p++ = '\\';
+            *p++ = 'r';
+            break;
+        case '\t':
+            *p++ = '\\';
+            *p++ = 't';
+            break;
+        default:
+            if (c < 0x20)
+            {
+                p = put_u(p, c);
+            }
+            else
+            {
+                uint32_t cp;
+                int n = utf8_decode(str + i, len - i, &cp);
+                if (n == 0)
+                {
+                    return false;
+                }
+                i += n - 1;
+                if (cp >= 0x10000)
+                {
+                    cp -= 0x10000;
+                    p = put_u(p, 0xD800 | (cp >> 10));
+                    cp = 0xDC00 | (cp & 0x3FF);
+                }
+                p = put_u(p, cp);
+            }
+            break;
+        }
+        buf_append(jw->buf, esc, p - esc);
+        run = ++i;
+    }
+    if (i > run)
+    {
+        buf_append(jw->buf, str + run, i - run);
+    }
+    buf_appendInt8(jw->buf, '"');
+    return true;
+}
+
+void jw_key(struct jsonw *jw, const char *key, size_t len)
+{
+    if (jw->err)
+    {
+        return;
+    }
+    int d = jw->depth - 1;
+    if (d < 0 || jw->type[d] != '{' || jw->after_key)
+    {
+        jw->err = true;
+        return;
+    }
+    if (jw->has[d])
+    {
+        buf_appendInt8(jw->buf, ',');
+    }
+    jw->has[d] = true;
+    if (jw->flags & JW_PRETTY)
+    {
+        indent(jw, jw->depth);
+    }
+    if (!write_str(jw, key, len))
+    {
+        jw->err = true;
+        return;
+    }
+    if (jw->flags & JW_PRETTY)
+    {
+        buf_append(jw->buf, ":\t", 2);
+    }
+    else
+    {
+        buf_appendInt8(jw->buf, ':');
+    }
+    jw->after_key = true;
+}
+
+void jw_string(struct jsonw *jw, const char *str, size_t len)
+{
+    if (before_value(jw) && !write_str(jw, str, len))
+    {
+        jw->err = true;
+    }
+}
+
+void jw_raw(struct jsonw *jw, const char *json, size_t len)
+{
+    if (before_value(jw))
+    {
+        buf_append(jw->buf, json, len);
+    }
+}
+
+void jw_bool(struct jsonw *jw, bool b)
+{
+    jw_raw(jw, b ? "true" : "false", b ? 4 : 5);
+}
+
+void jw_null(struct jsonw *jw)
+{
+    jw_raw(jw, "null", 4);
+}
+
+// ****************************************************************************************************
+// 数字
+
+void jw_int(struct jsonw *jw, int64_t i)
+{
+    char tmp[20], *p = tmp + sizeof(tmp);
+    uint64_t u = i < 0 ? -(uint64_t)i : (uint64_t)i;
+    do
+    {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+    if (i < 0)
+    {
+        *--p = '-';
+    }
+    jw_raw(jw, p, tmp + sizeof(tmp) - p);
+}
+
+void jw_double(struct jsonw *jw, double d)
+{
+    char tmp[25];
+    jw_raw(jw, tmp, jw_dtoa(d, tmp));
+}
+
+// Grisu2, Florian Loitsch "Printing Floating-Point Numbers Quickly and Accurately with Integers"
+// 结果为最短且可往返的十进制表示
+
+typedef struct
+{
+    uint64_t f;
+    int e;
+} diyfp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_EXPONENT_BIAS (0x3FF + 52)
+
+// 10^k 的归一化 64 位有效数字与二进制指数, k = -348, -340, ..., 340
+static const uint64_t pow10_f[87] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const int16_t pow10_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066,
+};
+
+static const uint64_t pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+    1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+static diyfp diyfp_mul(diyfp x, diyfp y)
+{
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & M32;
+    uint64_t c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1ULL << 31; // 四舍五入
+    diyfp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static diyfp diyfp_normalize(diyfp x)
+{
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+    return x;
+}
+
+// 相邻 double 的中点 m-, m+, 指数对齐到 m+
+static void boundaries(diyfp v, diyfp *mi, diyfp *pl)
+{
+    diyfp p = {(v.f << 1) + 1, v.e - 1};
+    p = diyfp_normalize(p);
+    diyfp m;
+    if (v.f == DP_HIDDEN_BIT)
+    {
+        m.f = (v.f << 2) - 1;
+        m.e = v.e - 2;
+    }
+    else
+    {
+        m.f = (v.f << 1) - 1;
+        m.e = v.e - 1;
+    }
+    m.f <<= m.e - p.e;
+    m.e = p.e;
+    *mi = m;
+    *pl = p;
+}
+
+static diyfp cached_power(int e, int *K)
+{
+    // 选 10^k 使乘积的二进制指数落在 [-60, -32]
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (k != dk)
+    {
+        k++;
+    }
+    unsigned idx = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)idx * 8);
+    diyfp r = {pow10_f[idx], pow10_e[idx]};
+    return r;
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits(uint32_t n)
+{
+    int d = 1;
+    while (d < 10 && n >= pow10_u64[d])
+    {
+        d++;
+    }
+    return d;
+}
+
+static void digit_gen(diyfp W, diyfp Mp, uint64_t delta, char *buf, int *len, int *K)
+{
+    const int shift = -Mp.e;
+    const uint64_t one = 1ULL << shift;
+    const uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> shift);
+    uint64_t p2 = Mp.f & (one - 1);
+    int kappa = count_digits(p1);
+    *len = 0;
+
+    while (kappa > 0)
+    {
+        uint32_t div = (uint32_t)pow10_u64[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || *len)
+        {
+            buf[(*len)++] = '0' + d;
+        }
+        kappa--;
+        uint64_t tmp = ((uint64_t)p1 << shift) + p2;
+        if (tmp <= delta)
+        {
+            *K += kappa;
+            grisu_round(buf, *len, delta, tmp, pow10_u64[kappa] << shift, wp_w);
+            return;
+        }
+    }
+
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> shift);
+        if (d || *len)
+        {
+            buf[(*len)++] = '0' + d;
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *K += kappa;
+            grisu_round(buf, *len, delta, p2, one, -kappa < 20 ? wp_w * pow10_u64[-kappa] : 0);
+            return;
+        }
+    }
+}
+
+static void grisu2(double value, char *buf, int *len, int *K)
+{
+    union
+    {
+        double d;
+        uint64_t u;
+    } u = {value};
+    int biased_e = (int)((u.u >> 52) & 0x7FF);
+    diyfp v;
+    v.f = u.u & DP_SIGNIFICAND_MASK;
+    if (biased_e)
+    {
+        v.f += DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    }
+    else
+    {
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    diyfp w_m, w_p;
+    boundaries(v, &w_m, &w_p);
+    diyfp c_mk = cached_power(w_p.e, K);
+    diyfp W = diyfp_mul(diyfp_normalize(v), c_mk);
+    diyfp Wp = diyfp_mul(w_p, c_mk);
+    diyfp Wm = diyfp_mul(w_m, c_mk);
+    Wm.f++;
+    Wp.f--;
+    digit_gen(W, Wp, Wp.f - Wm.f, buf, len, K);
+}
+
+static int write_exp(int K, char *p)
+{
+    char *s = p;
+    if (K < 0)
+    {
+        *p++ = '-';
+        K = -K;
+    }
+    if (K >= 100)
+    {
+        *p++ = '0' + K / 100;
+        K %= 100;
+        *p++ = '0' + K / 10;
+        *p++ = '0' + K % 10;
+    }
+    else if (K >= 10)
+    {
+        *p++ = '0' + K / 10;
+        *p++ = '0' + K % 10;
+    }
+    else
+    {
+        *p++ = '0' + K;
+    }
+    return p - s;
+}
+
+// digits * 10^k 转为 JSON 数字
+static int prettify(char *buf, int len, int k)
+{
+    int kk = len + k; // 10^(kk-1) <= v < 10^kk
+    int i;
+    if (k >= 0 && kk <= 21)
+    {
+        // 1234e3 -> 1234000
+        for (i = len; i < kk; i++)
+        {
+            buf[i] = '0';
+        }
+        return kk;
+    }
+    else if (kk > 0 && kk <= 21)
+    {
+        // 1234e-2 -> 12.34
+        memmove(buf + kk + 1, buf + kk, len - kk);
+        buf[kk] = '.';
+        return len + 1;
+    }
+    else if (kk > -6 && kk <= 0)
+    {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(buf + offset, buf, len);
+        buf[0] = '0';
+        buf[1] = '.';
+        for (i = 2; i < offset; i++)
+        {
+            buf[i] = '0';
+        }
+        return len + offset;
+    }
+    else if (len == 1)
+    {
+        // 1e30
+        buf[1] = 'e';
+        return 2 + write_exp(kk - 1, buf + 2);
+    }
+    else
+    {
+        // 1234e30 -> 1.234e33
+        memmove(buf + 2, buf + 1, len - 1);
+        buf[1] = '.';
+        buf[len + 1] = 'e';
+        return len + 2 + write_exp(kk - 1, buf + len + 2);
+    }
+}
+
+size_t jw_dtoa(double d, char *out)
+{
+    if (d != d || d - d != 0)
+    {
+        memcpy(out, "null", 4);
+        return 4;
+    }
+    char *p = out;
+    if (__builtin_signbit(d))
+    {
+        *p++ = '-';
+        d = -d;
+    }
+    if (d == 0)
+    {
+        *p++ = '0';
+        return p - out;
+    }
+    int len, K;
+    grisu2(d, p, &len, &K);
+    return (p - out) + prettify(p, len, K);
+}
+
+// ****************************************************************************************************
+// cJSON
+
+void jw_cjson(struct jsonw *jw, const cJSON *item)
+{
+    const cJSON *child;
+    switch (item->type & 0xFF)
+    {
+    case cJSON_False:
+        jw_bool(jw, false);
+        break;
+    case cJSON_True:
+        jw_bool(jw, true);
+        break;
+    case cJSON_NULL:
+        jw_null(jw);
+        break;
+    case cJSON_Number:
+        jw_double(jw, item->valuedouble);
+        break;
+    case cJSON_String:
+        jw_string(jw, item->valuestring, strlen(item->valuestring));
+        break;
+    case cJSON_Raw:
+        jw_raw(jw, item->valuestring, strlen(item->valuestring));
+        break;
+    case cJSON_Array:
+        jw_array_begin(jw);
+        for (child = item->child; child && !jw->err; child = child->next)
+        {
+            jw_cjson(jw, child);
+        }
+        jw_array_end(jw);
+        break;
+    case cJSON_Object:
+        jw_object_begin(jw);
+        for (child = item->child; child && !jw->err; child = child->next)
+        {
+            jw_key(jw, child->string, strlen(child->string));
+            jw_cjson(jw, child);
+        }
+        jw_object_end(jw);
+        break;
+    default:
+        jw->err = true;
+        break;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef JSONW_H
+#define JSONW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "cJSON.h"
+
+// JSON 直接序列化到 struct buffer, 按需扩容, 不生成中间字符串
+// 逗号/冒号/缩进由 writer 维护, 调用方只需按顺序写 key 与 value
+// 顺序错误 (对象内缺 key, 嵌套过深, 多余的 end) 或 JW_ASCII 下遇到非法 utf8 时置错, 之后的写入全部忽略
+
+#define JW_ASCII 1  // 非 ASCII 字符转 \uXXXX (4 字节字符转代理对)
+#define JW_PRETTY 2 // 缩进格式化, 同 cJSON_Print
+
+#define JW_MAX_DEPTH 128
+
+struct jsonw;
+
+struct jsonw *jw_create(struct buffer *out, int flags);
+void jw_release(struct jsonw *);
+
+void jw_object_begin(struct jsonw *);
+void jw_object_end(struct jsonw *);
+void jw_array_begin(struct jsonw *);
+void jw_array_end(struct jsonw *);
+
+void jw_key(struct jsonw *, const char *key, size_t len);
+void jw_string(struct jsonw *, const char *str, size_t len);
+void jw_int(struct jsonw *, int64_t i);
+void jw_double(struct jsonw *, double d);
+void jw_bool(struct jsonw *, bool b);
+void jw_null(struct jsonw *);
+// 已序列化好的 JSON 值, 原样写入
+void jw_raw(struct jsonw *, const char *json, size_t len);
+// 序列化 cJSON 树
+void jw_cjson(struct jsonw *, const cJSON *item);
+
+// 未出错且所有对象/数组都已闭合
+bool jw_ok(const struct jsonw *);
+
+// 最短往返表示 (grisu2), NaN/Inf 输出 null, out 至少 25 字节, 不写 '\0', 返回长度
+size_t jw_dtoa(double d, char *out);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "jsonw.h"
+
+static void expect_buf(struct buffer *buf, const char *expected)
+{
+    if (buf_readable(buf) != strlen(expected) || memcmp(buf_peek(buf), expected, buf_readable(buf)) != 0)
+    {
+        fprintf(stderr, "%.*s, expected %s\n", (int)buf_readable(buf), buf_peek(buf), expected);
+        assert(0);
+    }
+}
+
+static void expect_dtoa(double d, const char *expected)
+{
+    char out[25];
+    size_t len = jw_dtoa(d, out);
+    if (len != strlen(expected) || memcmp(out, expected, len) != 0)
+    {
+        fprintf(stderr, "%.17g => %.*s, expected %s\n", d, (int)len, out, expected);
+        assert(0);
+    }
+}
+
+void test_Jsonw_write()
+{
+    struct buffer *buf = buf_create(4);
+    struct jsonw *jw = jw_create(buf, 0);
+    jw_object_begin(jw);
+    jw_key(jw, "a", 1);
+    jw_int(jw, -9223372036854775807LL - 1);
+    jw_key(jw, "b", 1);
+    jw_array_begin(jw);
+    jw_bool(jw, true);
+    jw_null(jw);
+    jw_double(jw, 0.5);
+    jw_string(jw, "q\"\\\n\x01/中", 9);
+    jw_array_begin(jw);
+    jw_array_end(jw);
+    jw_object_begin(jw);
+    jw_object_end(jw);
+    jw_array_end(jw);
+    jw_key(jw, "c", 1);
+    jw_raw(jw, "{\"x\":1}", 7);
+    jw_object_end(jw);
+    assert(jw_ok(jw));
+    jw_release(jw);
+    expect_buf(buf, "{\"a\":-9223372036854775808,\"b\":[true,null,0.5,\"q\\\"\\\\\\n\\u0001/中\",[],{}],\"c\":{\"x\":1}}");
+
+    // ascii
+    buf_retrieveAll(buf);
+    jw = jw_create(buf, JW_ASCII);
+    jw_string(jw, "a中é😀", 10);
+    assert(jw_ok(jw));
+    jw_release(jw);
+    expect_buf(buf, "\"a\\u4e2d\\u00e9\\ud83d\\ude00\"");
+
+    // 错误
+    const char *bad[] = {"\xc3", "\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xff"};
+    size_t i;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        jw = jw_create(buf, JW_ASCII);
+        jw_string(jw, bad[i], strlen(bad[i]));
+        assert(!jw_ok(jw));
+        jw_release(jw);
+    }
+    jw = jw_create(buf, 0);
+    jw_object_begin(jw);
+    jw_int(jw, 1);
+    assert(!jw_ok(jw));
+    jw_release(jw);
+    jw = jw_create(buf, 0);
+    jw_array_begin(jw);
+    jw_object_end(jw);
+    assert(!jw_ok(jw));
+    jw_release(jw);
+    jw = jw_create(buf, 0);
+    jw_array_begin(jw);
+    assert(!jw_ok(jw));
+    jw_release(jw);
+
+    buf_release(buf);
+}
+
+void test_Jsonw_cjson()
+{
+    const char *json = "{\"name\":\"中文\",\"list\":[1,2.5,-3e-10,true,false,null,{}],\"obj\":{\"k\":\"v\"},\"empty\":[]}";
+    cJSON *root = cJSON_Parse(json);
+    assert(root);
+
+    struct buffer *buf = buf_create(16);
+    struct jsonw *jw = jw_create(buf, 0);
+    jw_cjson(jw, root);
+    assert(jw_ok(jw));
+    jw_release(jw);
+    expect_buf(buf, "{\"name\":\"中文\",\"list\":[1,2.5,-3e-10,true,false,null,{}],\"obj\":{\"k\":\"v\"},\"empty\":[]}");
+
+    // 格式与 cJSON_Print 一致
+    buf_retrieveAll(buf);
+    jw = jw_create(buf, JW_PRETTY);
+    jw_cjson(jw, root);
+    assert(jw_ok(jw));
+    jw_release(jw);
+    char *printed = cJSON_Print(root);
+    expect_buf(buf, "{\n\t\"name\":\t\"中文\",\n\t\"list\":\t[1, 2.5, -3e-10, true, false, null, {}],\n\t\"obj\":\t{\n\t\t\"k\":\t\"v\"\n\t},\n\t\"empty\":\t[]\n}");
+    assert(strstr(printed, "\"obj\":\t{\n\t\t\"k\":\t\"v\"\n\t}") != NULL);
+    free(printed);
+
+    cJSON_Delete(root);
+    buf_release(buf);
+}
+
+void test_Jsonw_dtoa()
+{
+    expect_dtoa(0, "0");
+    expect_dtoa(-0.0, "-0");
+    expect_dtoa(1, "1");
+    expect_dtoa(-1.5, "-1.5");
+    expect_dtoa(0.1, "0.1");
+    expect_dtoa(1.0 / 3, "0.3333333333333333");
+    expect_dtoa(123456789012, "123456789012");
+    expect_dtoa(1e21, "1e21");
+    expect_dtoa(1e20, "100000000000000000000");
+    expect_dtoa(1.5e300, "1.5e300");
+    expect_dtoa(0.000001, "0.000001");
+    expect_dtoa(1e-7, "1e-7");
+    expect_dtoa(1.7976931348623157e308, "1.7976931348623157e308");
+    expect_dtoa(5e-324, "5e-324");
+    expect_dtoa(NAN, "null");
+    expect_dtoa(INFINITY, "null");
+
+    // 随机位模式往返
+    int i;
+    srand(1);
+    for (i = 0; i < 1000000; i++)
+    {
+        union
+        {
+            double d;
+            uint64_t u;
+        } u;
+        u.u = ((uint64_t)rand() << 42) ^ ((uint64_t)rand() << 21) ^ (uint64_t)rand() ^ ((uint64_t)rand() << 62);
+        if (u.d != u.d || u.d - u.d != 0)
+        {
+            continue;
+        }
+        char out[26];
+        size_t len = jw_dtoa(u.d, out);
+        out[len] = '\0';
+        assert(strtod(out, NULL) == u.d);
+    }
+}
+
+int main(void)
+{
+    test_Jsonw_write();
+    test_Jsonw_cjson();
+    test_Jsonw_dtoa();
+    return 0;
+}
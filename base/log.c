@@ -1,16 +1,922 @@
 #include <time.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
 #include "log.h"
 
-static int log_level = 0;
+// 每线程 SPSC 环形队列, 记录定长
+// 调用线程只做: 解析 fmt 的转换说明, 按类型取出参数原样保存 (字符串拷贝), 不做格式化
+// 刷写线程按 fmt 逐个转换说明还原格式化, 时间戳字符串按秒缓存
+// 二进制格式下刷写线程也不格式化, 直接写出调用点 id + 时间戳 + 原始参数, 由 log_decode 离线还原
+
+// 二进制格式 (本机字节序, 文件头带字节序标记), str 为 u16 长度 + 内容
+// 文件头 "WLOG" u8 版本 u32 0x01020304
+// 'D' u32 id u8 level u32 line str func str file str fmt    调用点定义, 每个 id 在首条记录前写一次
+// 'R' u32 id i64 ts u8 nargs u8 kinds[nargs] 参数...        数值参数 8 字节, 字符串参数为 str
+// 'E' u32 id i64 ts str msg                                 无法延迟格式化的记录
+// 'M' u8 level u32 line str func str file i64 ts str msg    无调用点 id 的记录 (直接调用 log_log)
+// 'X' i64 ts u64 n                                          丢弃条数
+// ts 为微秒
+
+#define RING_CAP 512 // 必须为 2 的幂
+#define REC_ARGS 16
+#define REC_DATA 768
+#define TRUNC_MARK "...(truncated %zu bytes)"
+#define LINE_MAX_SZ 2048
+#define IDLE_WAIT_MS 10
+
+#define BIN_MAGIC "WLOG"
+#define BIN_VERSION 1
+#define BIN_BOM 0x01020304
+
+enum
+{
+    A_INT,
+    A_UINT,
+    A_CHAR,
+    A_DBL,
+    A_PTR,
+    A_STR,
+};
+
+union arg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+    struct
+    {
+        uint16_t off;
+        uint16_t len;
+    } s;
+};
+
+struct rec
+{
+    uint8_t level;
+    uint8_t nargs;
+    // fmt 无法延迟格式化 (参数过多/不支持的转换说明), data 中为已格式化的消息
+    uint8_t eager;
+    uint16_t used;
+    // 调用点 id, 0 为未注册
+    uint32_t id;
+    int line;
+    int64_t ts;
+    const char *fmt;
+    const char *func;
+    const char *file;
+    uint8_t kinds[REC_ARGS];
+    union arg args[REC_ARGS];
+    char data[REC_DATA];
+};
+
+struct ring
+{
+    struct rec recs[RING_CAP];
+    // head 只由生产线程写, tail/done 只由刷写线程写
+    unsigned head;
+    unsigned tail;
+    // 已 fflush 的位置, log_flush 据此等待
+    unsigned done;
+    int closed;
+    struct ring *next;
+};
+
+int log_level = LOG_TRACE;
+static int log_policy = LOG_POLICY_DROP;
 
 static const char *level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
 static const char *level_colors[] = {"\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"};
 
+static struct
+{
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    pthread_key_t key;
+    pthread_once_t once;
+    pthread_t thread;
+    struct ring *rings;
+    FILE *out;
+    int running;
+    int stop;
+    int format;
+    // 已分配的调用点 id
+    int sites;
+    // 二进制格式下本次输出已写过定义的 id
+    uint8_t *defined;
+    uint32_t defined_cap;
+    unsigned long dropped;
+    // 已报告的丢弃条数
+    unsigned long reported;
+} g_log = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, PTHREAD_ONCE_INIT};
+
+static __thread struct ring *tl_ring;
+
 void log_setlevel(int level)
 {
-    level = level;
+    log_level = level;
+}
+
+void log_setpolicy(int policy)
+{
+    log_policy = policy;
+}
+
+void log_setformat(int format)
+{
+    g_log.format = format;
+}
+
+unsigned long log_dropped()
+{
+    return __atomic_load_n(&g_log.dropped, __ATOMIC_RELAXED);
+}
+
+// 按秒缓存 HH:MM:SS, localtime_r 每秒最多一次
+struct ts_cache
+{
+    time_t sec;
+    char buf[16];
+};
+
+static const char *ts_format(struct ts_cache *c, time_t t)
+{
+    if (t != c->sec)
+    {
+        struct tm lt;
+        localtime_r(&t, &lt);
+        c->buf[strftime(c->buf, sizeof(c->buf), "%H:%M:%S", &lt)] = '\0';
+        c->sec = t;
+    }
+    return c->buf;
+}
+
+// ****************************************************************************************************
+// 转换说明解析
+
+struct spec
+{
+    const char *beg;
+    const char *end; // 指向转换字符之后
+    int nstar;
+    bool prec_star;
+    bool has_prec;
+    int prec;
+    int width_len; // '%' 之后 flags + width 的长度
+    char len_mod[3];
+    char conv;
+};
+
+// 返回 false 表示不支持延迟格式化
+static bool parse_spec(const char *p, struct spec *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->beg = p++;
+    while (*p && strchr("-+ #0'", *p))
+    {
+        p++;
+    }
+    if (*p == '*')
+    {
+        s->nstar++;
+        p++;
+    }
+    else
+    {
+        while (*p >= '0' && *p <= '9')
+        {
+            p++;
+        }
+        // 位置参数 %1$d
+        if (*p == '$')
+        {
+            return false;
+        }
+    }
+    s->width_len = p - s->beg - 1;
+    if (*p == '.')
+    {
+        p++;
+        s->has_prec = true;
+        if (*p == '*')
+        {
+            s->nstar++;
+            s->prec_star = true;
+            p++;
+        }
+        else
+        {
+            while (*p >= '0' && *p <= '9')
+            {
+                s->prec = s->prec * 10 + (*p++ - '0');
+            }
+        }
+    }
+    int n = 0;
+    while (*p && strchr("hljzt", *p) && n < 2)
+    {
+        s->len_mod[n++] = *p++;
+    }
+    s->conv = *p;
+    if (*p == '\0' || strchr("diuoxXcfFeEgGaAsp", *p) == NULL)
+    {
+        return false;
+    }
+    s->end = p + 1;
+    return true;
+}
+
+static int spec_kind(const struct spec *s)
+{
+    switch (s->conv)
+    {
+    case 'd':
+    case 'i':
+        return A_INT;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        return A_UINT;
+    case 'c':
+        return A_CHAR;
+    case 'p':
+        return A_PTR;
+    case 's':
+        return A_STR;
+    default:
+        return A_DBL;
+    }
+}
+
+static void capture_int(struct spec *s, va_list *ap, union arg *a)
+{
+    const char *m = s->len_mod;
+    bool sign = s->conv == 'd' || s->conv == 'i';
+    if (m[0] == 'l' && m[1] == 'l')
+    {
+        a->i = va_arg(*ap, long long);
+    }
+    else if (m[0] == 'l')
+    {
+        a->i = sign ? (long long)va_arg(*ap, long) : (long long)va_arg(*ap, unsigned long);
+    }
+    else if (m[0] == 'j')
+    {
+        a->i = sign ? (long long)va_arg(*ap, intmax_t) : (long long)va_arg(*ap, uintmax_t);
+    }
+    else if (m[0] == 'z')
+    {
+        a->i = sign ? (long long)va_arg(*ap, ssize_t) : (long long)va_arg(*ap, size_t);
+    }
+    else if (m[0] == 't')
+    {
+        a->i = va_arg(*ap, ptrdiff_t);
+    }
+    else
+    {
+        int v = va_arg(*ap, int);
+        if (m[0] == 'h' && m[1] == 'h')
+        {
+            a->i = sign ? (long long)(signed char)v : (long long)(unsigned char)v;
+        }
+        else if (m[0] == 'h')
+        {
+            a->i = sign ? (long long)(short)v : (long long)(unsigned short)v;
+        }
+        else
+        {
+            a->i = sign ? (long long)v : (long long)(unsigned int)v;
+        }
+    }
+}
+
+// 解析 fmt 保存参数, 失败 (需 eager 格式化) 返回 false
+static bool capture(struct rec *r, const char *fmt, va_list ap)
+{
+    va_list cp;
+    va_copy(cp, ap);
+    const char *p = fmt;
+    struct spec s;
+    int n = 0;
+    r->used = 0;
+
+    while ((p = strchr(p, '%')))
+    {
+        if (p[1] == '%')
+        {
+            p += 2;
+            continue;
+        }
+        if (!parse_spec(p, &s) || n + s.nstar + 1 > REC_ARGS)
+        {
+            va_end(cp);
+            return false;
+        }
+        int i;
+        for (i = 0; i < s.nstar; i++)
+        {
+            r->kinds[n] = A_INT;
+            r->args[n++].i = va_arg(cp, int);
+        }
+        // %.*s 的精度参数
+        if (s.prec_star)
+        {
+            s.prec = r->args[n - 1].i;
+            s.has_prec = s.prec >= 0;
+        }
+
+        union arg *a = &r->args[n];
+        r->kinds[n] = spec_kind(&s);
+        switch (r->kinds[n])
+        {
+        case A_INT:
+        case A_UINT:
+            capture_int(&s, &cp, a);
+            break;
+        case A_CHAR:
+            if (s.len_mod[0])
+            {
+                va_end(cp);
+                return false;
+            }
+            a->i = va_arg(cp, int);
+            break;
+        case A_PTR:
+            a->p = va_arg(cp, void *);
+            break;
+        case A_STR:
+        {
+            if (s.len_mod[0])
+            {
+                va_end(cp);
+                return false;
+            }
+            const char *str = va_arg(cp, const char *);
+            if (str == NULL)
+            {
+                str = "(null)";
+            }
+            size_t len = s.has_prec ? strnlen(str, s.prec) : strlen(str);
+            size_t room = REC_DATA - r->used;
+            a->s.off = r->used;
+            if (len <= room)
+            {
+                memcpy(r->data + r->used, str, len);
+                r->used += len;
+                a->s.len = len;
+                break;
+            }
+            // 空间不足截断, 末尾标出截掉的字节数 (按最长的标记预留)
+            char mark[48];
+            size_t mark_max = snprintf(mark, sizeof(mark), TRUNC_MARK, len);
+            size_t keep = room > mark_max ? room - mark_max : room;
+            memcpy(r->data + r->used, str, keep);
+            r->used += keep;
+            if (keep < room)
+            {
+                size_t m = snprintf(mark, sizeof(mark), TRUNC_MARK, len - keep);
+                memcpy(r->data + r->used, mark, m);
+                r->used += m;
+            }
+            a->s.len = r->used - a->s.off;
+            break;
+        }
+        default:
+            // 浮点, 'L' 修饰不支持
+            if (s.len_mod[0] && s.len_mod[0] != 'l')
+            {
+                va_end(cp);
+                return false;
+            }
+            a->d = va_arg(cp, double);
+            break;
+        }
+        n++;
+        p = s.end;
+    }
+    va_end(cp);
+    r->nargs = n;
+    return true;
+}
+
+#define SNPRINTF_STARS(out, sz, f, st, v)                  \
+    (nstar == 0 ? snprintf(out, sz, f, v)                  \
+                : nstar == 1 ? snprintf(out, sz, f, st[0], v) \
+                             : snprintf(out, sz, f, st[0], st[1], v))
+
+// 按 fmt 还原, 返回写入长度 (不超过 sz - 1)
+// 参数个数/类型与 fmt 不符 (损坏的二进制日志) 时停止还原
+static int render_msg(const struct rec *r, char *out, int sz)
+{
+    if (r->eager)
+    {
+        int len = r->used < sz ? r->used : sz - 1;
+        memcpy(out, r->data, len);
+        out[len] = '\0';
+        return len;
+    }
+
+    const char *p = r->fmt;
+    char f[32];
+    struct spec s;
+    int n = 0, w = 0;
+
+    while (*p && w < sz - 1)
+    {
+        if (*p != '%')
+        {
+            out[w++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[w++] = '%';
+            p += 2;
+            continue;
+        }
+        if (!parse_spec(p, &s) || n + s.nstar >= r->nargs || r->kinds[n + s.nstar] != spec_kind(&s))
+        {
+            break;
+        }
+        int st[2];
+        int nstar = s.nstar, i;
+        for (i = 0; i < nstar; i++)
+        {
+            st[i] = r->args[n++].i;
+        }
+        const union arg *a = &r->args[n++];
+        int ret;
+        switch (r->kinds[n - 1])
+        {
+        case A_INT:
+        case A_UINT:
+            // 修饰统一为 ll
+            snprintf(f, sizeof(f), "%.*sll%c", (int)(s.end - s.beg - 1 - strlen(s.len_mod)), s.beg, s.conv);
+            ret = SNPRINTF_STARS(out + w, sz - w, f, st, a->i);
+            break;
+        case A_CHAR:
+            snprintf(f, sizeof(f), "%.*s", (int)(s.end - s.beg), s.beg);
+            ret = SNPRINTF_STARS(out + w, sz - w, f, st, (int)a->i);
+            break;
+        case A_DBL:
+            snprintf(f, sizeof(f), "%.*s", (int)(s.end - s.beg), s.beg);
+            ret = SNPRINTF_STARS(out + w, sz - w, f, st, a->d);
+            break;
+        case A_PTR:
+            snprintf(f, sizeof(f), "%.*s", (int)(s.end - s.beg), s.beg);
+            ret = SNPRINTF_STARS(out + w, sz - w, f, st, a->p);
+            break;
+        default:
+            // 字符串已按精度截断保存, 以 %.*s 输出, 原精度 * 已消耗
+            snprintf(f, sizeof(f), "%.*s.*s", s.width_len + 1, s.beg);
+            if (s.prec_star)
+            {
+                nstar--;
+            }
+            st[nstar++] = a->s.len;
+            ret = SNPRINTF_STARS(out + w, sz - w, f, st, r->data + a->s.off);
+            break;
+        }
+        if (ret > 0)
+        {
+            w += ret < sz - w ? ret : sz - w - 1;
+        }
+        p = s.end;
+    }
+    out[w] = '\0';
+    return w;
+}
+
+static int render_line(const struct rec *r, const char *ts, bool color, char *out, int sz)
+{
+    int n;
+    if (color)
+    {
+        n = snprintf(out, sz, "[%s %s%5s]\x1b[0m ", ts, level_colors[r->level], level_names[r->level]);
+    }
+    else
+    {
+        n = snprintf(out, sz, "[%s %5s] ", ts, level_names[r->level]);
+    }
+    n += render_msg(r, out + n, sz - n);
+    n += snprintf(out + n, sz - n, color ? " \x1b[2;90min func %s %s:%d\x1b[0m\n" : " in func %s %s:%d\n", r->func, r->file, r->line);
+    if (n >= sz)
+    {
+        n = sz - 1;
+        out[n - 1] = '\n';
+    }
+    return n;
+}
+
+static void ring_close(void *ud)
+{
+    struct ring *r = ud;
+    __atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+}
+
+static void key_init()
+{
+    pthread_key_create(&g_log.key, ring_close);
+}
+
+static struct ring *ring_get()
+{
+    if (tl_ring)
+    {
+        return tl_ring;
+    }
+    struct ring *r = calloc(1, sizeof(*r));
+    assert(r);
+    pthread_once(&g_log.once, key_init);
+    pthread_setspecific(g_log.key, r);
+
+    pthread_mutex_lock(&g_log.mtx);
+    r->next = g_log.rings;
+    g_log.rings = r;
+    pthread_mutex_unlock(&g_log.mtx);
+    tl_ring = r;
+    return r;
+}
+
+// ****************************************************************************************************
+// 二进制写出, 调用方持有 g_log.mtx
+
+static void put(const void *p, size_t n)
+{
+    fwrite(p, 1, n, g_log.out);
+}
+
+static void put_u8(uint8_t v)
+{
+    put(&v, 1);
+}
+
+static void put_u32(uint32_t v)
+{
+    put(&v, 4);
+}
+
+static void put_i64(int64_t v)
+{
+    put(&v, 8);
+}
+
+static void put_str(const char *str, size_t len)
+{
+    uint16_t l = len > UINT16_MAX ? UINT16_MAX : len;
+    put(&l, 2);
+    put(str, l);
+}
+
+static void put_cstr(const char *str)
+{
+    put_str(str, strlen(str));
+}
+
+static void bin_define(const struct rec *r)
+{
+    if (r->id >= g_log.defined_cap)
+    {
+        uint32_t cap = g_log.defined_cap ? g_log.defined_cap : 256;
+        while (cap <= r->id)
+        {
+            cap *= 2;
+        }
+        g_log.defined = realloc(g_log.defined, cap);
+        assert(g_log.defined);
+        memset(g_log.defined + g_log.defined_cap, 0, cap - g_log.defined_cap);
+        g_log.defined_cap = cap;
+    }
+    if (g_log.defined[r->id])
+    {
+        return;
+    }
+    g_log.defined[r->id] = 1;
+    put_u8('D');
+    put_u32(r->id);
+    put_u8(r->level);
+    put_u32(r->line);
+    put_cstr(r->func);
+    put_cstr(r->file);
+    put_cstr(r->fmt);
+}
+
+static void bin_write(const struct rec *r)
+{
+    if (r->id == 0)
+    {
+        char msg[LINE_MAX_SZ];
+        int len = render_msg(r, msg, sizeof(msg));
+        put_u8('M');
+        put_u8(r->level);
+        put_u32(r->line);
+        put_cstr(r->func);
+        put_cstr(r->file);
+        put_i64(r->ts);
+        put_str(msg, len);
+        return;
+    }
+
+    bin_define(r);
+    if (r->eager)
+    {
+        put_u8('E');
+        put_u32(r->id);
+        put_i64(r->ts);
+        put_str(r->data, r->used);
+        return;
+    }
+
+    put_u8('R');
+    put_u32(r->id);
+    put_i64(r->ts);
+    put_u8(r->nargs);
+    put(r->kinds, r->nargs);
+    int i;
+    for (i = 0; i < r->nargs; i++)
+    {
+        if (r->kinds[i] == A_STR)
+        {
+            put_str(r->data + r->args[i].s.off, r->args[i].s.len);
+        }
+        else
+        {
+            put(&r->args[i], 8);
+        }
+    }
+}
+
+static void bin_header()
+{
+    put(BIN_MAGIC, 4);
+    put_u8(BIN_VERSION);
+    put_u32(BIN_BOM);
+}
+
+// ****************************************************************************************************
+// 刷写线程
+
+// 返回输出条数
+static int drain(struct ts_cache *tc)
+{
+    char line[LINE_MAX_SZ];
+    int n = 0;
+    struct ring *r, **pp;
+    bool binary = g_log.format == LOG_FORMAT_BINARY;
+
+    pthread_mutex_lock(&g_log.mtx);
+    flockfile(g_log.out);
+    for (pp = &g_log.rings; (r = *pp);)
+    {
+        int closed = __atomic_load_n(&r->closed, __ATOMIC_ACQUIRE);
+        unsigned head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned t;
+        for (t = r->tail; t != head; t++)
+        {
+            const struct rec *rec = &r->recs[t & (RING_CAP - 1)];
+            if (binary)
+            {
+                bin_write(rec);
+            }
+            else
+            {
+                int len = render_line(rec, ts_format(tc, rec->ts / 1000000), true, line, sizeof(line));
+                fwrite(line, 1, len, g_log.out);
+            }
+            __atomic_store_n(&r->tail, t + 1, __ATOMIC_RELEASE);
+            n++;
+        }
+        // 线程已退出且已刷完
+        if (closed)
+        {
+            *pp = r->next;
+            free(r);
+            continue;
+        }
+        pp = &r->next;
+    }
+
+    unsigned long dropped = log_dropped();
+    if (dropped != g_log.reported)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (binary)
+        {
+            put_u8('X');
+            put_i64(tv.tv_sec * 1000000LL + tv.tv_usec);
+            put_i64(dropped - g_log.reported);
+        }
+        else
+        {
+            fprintf(g_log.out, "[%s %s%5s]\x1b[0m %lu log records dropped\n",
+                    ts_format(tc, tv.tv_sec), level_colors[LOG_WARN], level_names[LOG_WARN], dropped - g_log.reported);
+        }
+        g_log.reported = dropped;
+    }
+    fflush(g_log.out);
+    funlockfile(g_log.out);
+
+    for (r = g_log.rings; r; r = r->next)
+    {
+        __atomic_store_n(&r->done, r->tail, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&g_log.mtx);
+    return n;
+}
+
+static void *flusher(void *ud)
+{
+    struct ts_cache tc = {0};
+
+    for (;;)
+    {
+        int n = drain(&tc);
+
+        pthread_mutex_lock(&g_log.mtx);
+        if (g_log.stop)
+        {
+            pthread_mutex_unlock(&g_log.mtx);
+            break;
+        }
+        if (n == 0)
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += IDLE_WAIT_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&g_log.cond, &g_log.mtx, &ts);
+        }
+        pthread_mutex_unlock(&g_log.mtx);
+    }
+    // stop 之前写入的全部刷完
+    drain(&tc);
+    return NULL;
+}
+
+static void wakeup()
+{
+    pthread_mutex_lock(&g_log.mtx);
+    pthread_cond_signal(&g_log.cond);
+    pthread_mutex_unlock(&g_log.mtx);
+}
+
+bool log_async_start(FILE *out)
+{
+    if (g_log.running)
+    {
+        return false;
+    }
+    g_log.out = out ? out : stderr;
+    g_log.stop = 0;
+    g_log.reported = log_dropped();
+    if (g_log.format == LOG_FORMAT_BINARY)
+    {
+        // 每次输出的定义独立, 文件可单独解码
+        if (g_log.defined)
+        {
+            memset(g_log.defined, 0, g_log.defined_cap);
+        }
+        bin_header();
+    }
+    if (pthread_create(&g_log.thread, NULL, flusher, NULL) != 0)
+    {
+        return false;
+    }
+    __atomic_store_n(&g_log.running, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+void log_async_stop()
+{
+    if (!g_log.running)
+    {
+        return;
+    }
+    // 之后的日志走同步路径
+    __atomic_store_n(&g_log.running, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&g_log.mtx);
+    g_log.stop = 1;
+    pthread_cond_signal(&g_log.cond);
+    pthread_mutex_unlock(&g_log.mtx);
+    pthread_join(g_log.thread, NULL);
+    // 在 running 清零前读到 1 的生产者可能在刷写线程最后一次 drain 之后才写入
+    struct ts_cache tc = {0};
+    drain(&tc);
+}
+
+void log_flush()
+{
+    if (!__atomic_load_n(&g_log.running, __ATOMIC_ACQUIRE))
+    {
+        fflush(stderr);
+        return;
+    }
+    struct ring *r = tl_ring;
+    if (r == NULL)
+    {
+        return;
+    }
+    unsigned head = r->head;
+    wakeup();
+    while ((int)(__atomic_load_n(&r->done, __ATOMIC_ACQUIRE) - head) < 0)
+    {
+        sched_yield();
+    }
+}
+
+// ****************************************************************************************************
+
+static void log_sync(int level, const char *func, const char *file, int line, const char *fmt, va_list ap)
+{
+    static __thread struct ts_cache tc;
+    char buf[LINE_MAX_SZ];
+
+    int n = snprintf(buf, sizeof(buf), "[%s %s%5s]\x1b[0m ", ts_format(&tc, time(NULL)), level_colors[level], level_names[level]);
+    int m = vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
+    n += m < (int)sizeof(buf) - n ? m : (int)sizeof(buf) - n - 1;
+    n += snprintf(buf + n, sizeof(buf) - n, " \x1b[2;90min func %s %s:%d\x1b[0m\n", func, file, line);
+    if (n >= (int)sizeof(buf))
+    {
+        buf[sizeof(buf) - 2] = '\n';
+    }
+    // 一次写入, 多线程不交错
+    fputs(buf, stderr);
+}
+
+static int site_id(int *site)
+{
+    int id = __atomic_load_n(site, __ATOMIC_ACQUIRE);
+    if (id == 0)
+    {
+        int nid = __atomic_add_fetch(&g_log.sites, 1, __ATOMIC_RELAXED);
+        // 并发首次注册以先完成者为准
+        if (__atomic_compare_exchange_n(site, &id, nid, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            id = nid;
+        }
+    }
+    return id;
+}
+
+static void log_vlog(int *site, int level, const char *func, const char *file, int line, const char *fmt, va_list args)
+{
+    if (!__atomic_load_n(&g_log.running, __ATOMIC_ACQUIRE))
+    {
+        log_sync(level, func, file, line, fmt, args);
+        return;
+    }
+
+    struct ring *r = ring_get();
+    unsigned head = r->head;
+    while (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= RING_CAP)
+    {
+        if (log_policy == LOG_POLICY_DROP && level < LOG_FATAL)
+        {
+            __atomic_add_fetch(&g_log.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        wakeup();
+        sched_yield();
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    struct rec *rec = &r->recs[head & (RING_CAP - 1)];
+    rec->level = level;
+    rec->id = site ? site_id(site) : 0;
+    rec->line = line;
+    rec->ts = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    rec->func = func;
+    rec->file = file;
+    rec->fmt = fmt;
+    rec->eager = !capture(rec, fmt, args);
+    if (rec->eager)
+    {
+        int m = vsnprintf(rec->data, REC_DATA, fmt, args);
+        rec->used = m < REC_DATA ? m : REC_DATA - 1;
+    }
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+    if (level >= LOG_FATAL)
+    {
+        log_flush();
+    }
 }
 
 void log_log(int level, const char *func, const char *file, int line, const char *fmt, ...)
@@ -19,18 +925,362 @@ void log_log(int level, const char *func, const char *file, int line, const char
     {
         return;
     }
+    va_list args;
+    va_start(args, fmt);
+    log_vlog(NULL, level, func, file, line, fmt, args);
+    va_end(args);
+}
 
-    time_t t = time(NULL);
-    struct tm *lt = localtime(&t);
-    char buf[16];
-    buf[strftime(buf, sizeof(buf), "%H:%M:%S", lt)] = '\0';
-    
-    fprintf(stderr, "[%s %s%5s]\x1b[0m ", buf, level_colors[level], level_names[level]);
-    
+void log_site_log(int *site, int level, const char *func, const char *file, int line, const char *fmt, ...)
+{
+    if (level < log_level)
+    {
+        return;
+    }
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    log_vlog(site, level, func, file, line, fmt, args);
     va_end(args);
-    
-    fprintf(stderr, " \x1b[2;90min func %s %s:%d\x1b[0m\n", func, file, line);
-}
\ No newline at end of file
+}
+
+// ****************************************************************************************************
+// 二进制日志解码
+
+struct site_def
+{
+    int level;
+    int line;
+    char *func;
+    char *file;
+    char *fmt;
+};
+
+struct decoder
+{
+    FILE *in;
+    FILE *out;
+    bool json;
+    bool color;
+    struct site_def *defs;
+    uint32_t ndef;
+};
+
+static bool get(struct decoder *d, void *p, size_t n)
+{
+    return fread(p, 1, n, d->in) == n;
+}
+
+// 读入 str (不加 '\0'), 超出 cap 的部分丢弃, 返回保留长度, 失败 -1
+static int get_str(struct decoder *d, char *buf, size_t cap)
+{
+    uint16_t len;
+    if (!get(d, &len, 2))
+    {
+        return -1;
+    }
+    size_t keep = len < cap ? len : cap;
+    if (!get(d, buf, keep))
+    {
+        return -1;
+    }
+    // 输入可能是管道, 不用 fseek
+    size_t skip;
+    for (skip = len - keep; skip > 0; skip--)
+    {
+        if (fgetc(d->in) == EOF)
+        {
+            return -1;
+        }
+    }
+    return keep;
+}
+
+static char *get_dup(struct decoder *d)
+{
+    char buf[UINT16_MAX + 1];
+    int len = get_str(d, buf, UINT16_MAX);
+    if (len < 0)
+    {
+        return NULL;
+    }
+    buf[len] = '\0';
+    return strdup(buf);
+}
+
+static void json_str(FILE *out, const char *s, size_t len)
+{
+    size_t i;
+    fputc('"', out);
+    for (i = 0; i < len; i++)
+    {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if (c == '\n')
+        {
+            fputs("\\n", out);
+        }
+        else if (c == '\t')
+        {
+            fputs("\\t", out);
+        }
+        else if (c == '\r')
+        {
+            fputs("\\r", out);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void emit(struct decoder *d, const struct rec *r)
+{
+    char line[LINE_MAX_SZ];
+    if (!d->json)
+    {
+        char ts[32];
+        struct tm lt;
+        time_t sec = r->ts / 1000000;
+        localtime_r(&sec, &lt);
+        int n = strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &lt);
+        snprintf(ts + n, sizeof(ts) - n, ".%06d", (int)(r->ts % 1000000));
+        int len = render_line(r, ts, d->color, line, sizeof(line));
+        fwrite(line, 1, len, d->out);
+        return;
+    }
+
+    int len = render_msg(r, line, sizeof(line));
+    fprintf(d->out, "{\"ts\":%lld.%06d,\"level\":\"%s\",\"func\":", (long long)(r->ts / 1000000), (int)(r->ts % 1000000), level_names[r->level]);
+    json_str(d->out, r->func, strlen(r->func));
+    fputs(",\"file\":", d->out);
+    json_str(d->out, r->file, strlen(r->file));
+    fprintf(d->out, ",\"line\":%d,\"msg\":", r->line);
+    json_str(d->out, line, len);
+    if (!r->eager)
+    {
+        int i;
+        fputs(",\"args\":[", d->out);
+        for (i = 0; i < r->nargs; i++)
+        {
+            const union arg *a = &r->args[i];
+            fputs(i ? "," : "", d->out);
+            switch (r->kinds[i])
+            {
+            case A_INT:
+            case A_CHAR:
+                fprintf(d->out, "%lld", a->i);
+                break;
+            case A_UINT:
+                fprintf(d->out, "%llu", a->u);
+                break;
+            case A_DBL:
+                fprintf(d->out, "%.17g", a->d);
+                break;
+            case A_PTR:
+                fprintf(d->out, "\"%p\"", a->p);
+                break;
+            default:
+                json_str(d->out, r->data + a->s.off, a->s.len);
+                break;
+            }
+        }
+        fputc(']', d->out);
+    }
+    fputs("}\n", d->out);
+}
+
+static bool decode_record(struct decoder *d, struct rec *r)
+{
+    uint32_t id;
+    if (!get(d, &id, 4) || !get(d, &r->ts, 8))
+    {
+        return false;
+    }
+    if (id == 0 || id >= d->ndef || d->defs[id].fmt == NULL)
+    {
+        return false;
+    }
+    const struct site_def *def = &d->defs[id];
+    r->id = id;
+    r->level = def->level;
+    r->line = def->line;
+    r->func = def->func;
+    r->file = def->file;
+    r->fmt = def->fmt;
+    r->used = 0;
+
+    if (r->eager)
+    {
+        int len = get_str(d, r->data, REC_DATA);
+        r->used = len;
+        return len >= 0;
+    }
+
+    if (!get(d, &r->nargs, 1) || r->nargs > REC_ARGS || !get(d, r->kinds, r->nargs))
+    {
+        return false;
+    }
+    int i;
+    for (i = 0; i < r->nargs; i++)
+    {
+        if (r->kinds[i] > A_STR)
+        {
+            return false;
+        }
+        if (r->kinds[i] != A_STR)
+        {
+            if (!get(d, &r->args[i], 8))
+            {
+                return false;
+            }
+            continue;
+        }
+        int len = get_str(d, r->data + r->used, REC_DATA - r->used);
+        if (len < 0 || r->used + len > REC_DATA)
+        {
+            return false;
+        }
+        r->args[i].s.off = r->used;
+        r->args[i].s.len = len;
+        r->used += len;
+    }
+    return true;
+}
+
+static bool decode_define(struct decoder *d)
+{
+    uint32_t id, line;
+    uint8_t level;
+    if (!get(d, &id, 4) || !get(d, &level, 1) || !get(d, &line, 4) || id == 0 || level > LOG_FATAL)
+    {
+        return false;
+    }
+    if (id >= d->ndef)
+    {
+        uint32_t n = d->ndef ? d->ndef : 256;
+        while (n <= id)
+        {
+            n *= 2;
+        }
+        d->defs = realloc(d->defs, n * sizeof(struct site_def));
+        assert(d->defs);
+        memset(d->defs + d->ndef, 0, (n - d->ndef) * sizeof(struct site_def));
+        d->ndef = n;
+    }
+    struct site_def *def = &d->defs[id];
+    free(def->func);
+    free(def->file);
+    free(def->fmt);
+    def->level = level;
+    def->line = line;
+    def->func = get_dup(d);
+    def->file = get_dup(d);
+    def->fmt = get_dup(d);
+    return def->func && def->file && def->fmt;
+}
+
+static bool decode_frames(struct decoder *d)
+{
+    // 记录较大, 不放栈上
+    static __thread struct rec r;
+    int type;
+    while ((type = fgetc(d->in)) != EOF)
+    {
+        memset(&r, 0, offsetof(struct rec, args));
+        switch (type)
+        {
+        case 'D':
+            if (!decode_define(d))
+            {
+                return false;
+            }
+            break;
+        case 'R':
+        case 'E':
+            r.eager = type == 'E';
+            if (!decode_record(d, &r))
+            {
+                return false;
+            }
+            emit(d, &r);
+            break;
+        case 'M':
+        {
+            static __thread char func[256], file[256];
+            uint32_t line;
+            int len, flen, llen;
+            if (!get(d, &r.level, 1) || r.level > LOG_FATAL || !get(d, &line, 4) ||
+                (flen = get_str(d, func, sizeof(func) - 1)) < 0 || (llen = get_str(d, file, sizeof(file) - 1)) < 0 ||
+                !get(d, &r.ts, 8) || (len = get_str(d, r.data, REC_DATA)) < 0)
+            {
+                return false;
+            }
+            func[flen] = '\0';
+            file[llen] = '\0';
+            r.eager = 1;
+            r.used = len;
+            r.line = line;
+            r.func = func;
+            r.file = file;
+            emit(d, &r);
+            break;
+        }
+        case 'X':
+        {
+            int64_t ts, n;
+            if (!get(d, &ts, 8) || !get(d, &n, 8))
+            {
+                return false;
+            }
+            r.eager = 1;
+            r.level = LOG_WARN;
+            r.ts = ts;
+            r.func = "";
+            r.file = "";
+            r.used = snprintf(r.data, REC_DATA, "%lld log records dropped", (long long)n);
+            emit(d, &r);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool log_decode(FILE *in, FILE *out, bool json)
+{
+    char magic[4];
+    uint8_t ver;
+    uint32_t bom;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, BIN_MAGIC, 4) != 0 ||
+        fread(&ver, 1, 1, in) != 1 || ver != BIN_VERSION ||
+        fread(&bom, 1, 4, in) != 4 || bom != BIN_BOM)
+    {
+        return false;
+    }
+
+    struct decoder d = {in, out, json, !json && isatty(fileno(out)), NULL, 0};
+    bool ok = decode_frames(&d);
+
+    uint32_t i;
+    for (i = 0; i < d.ndef; i++)
+    {
+        free(d.defs[i].func);
+        free(d.defs[i].file);
+        free(d.defs[i].fmt);
+    }
+    free(d.defs);
+    fflush(out);
+    return ok;
+}
@@ -2,6 +2,7 @@
 #define LOG_H
 
 #include <stdio.h>
+#include <stdbool.h>
 
 enum
 {
@@ -13,21 +14,83 @@ enum
     LOG_FATAL
 };
 
+// 编译期级别, 低于该级别的 log_xxx 调用整体编译掉: cc -DLOG_COMPILE_LEVEL=LOG_INFO
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_TRACE
+#endif
+
+// 异步模式下本线程队列满时: 丢弃 (计数) 或 等待刷写线程腾出空间
+enum
+{
+    LOG_POLICY_DROP,
+    LOG_POLICY_BLOCK
+};
+
+// 异步模式的输出格式
+// 二进制: 调用点首次输出时分配 id 并写一次定义, 之后每条记录只有 id + 时间戳 + 原始参数, 由 log_decode (logcat) 离线还原
+// 同步模式总是输出文本
+enum
+{
+    LOG_FORMAT_TEXT,
+    LOG_FORMAT_BINARY
+};
+
+// 运行期级别, 调用点内联判断
+extern int log_level;
+
 void log_setlevel(int level);
-void log_log(int level, const char *func, const char *file, int line, const char *fmt, ...);
+void log_setpolicy(int policy);
+// 在 log_async_start 之前设置
+void log_setformat(int format);
+
+// 启动后台刷写线程: 各线程只把 fmt 与参数拷贝进本线程无锁环形队列, 格式化与输出在刷写线程完成
+// 未启动 (或 stop 之后) 同步格式化输出
+bool log_async_start(FILE *out);
+// 刷完全部队列后退出刷写线程
+void log_async_stop();
+// 等待调用线程已写入的日志全部输出
+void log_flush();
+unsigned long log_dropped();
+
+// 二进制日志还原为文本 (或每行一个 json 对象), 格式错误返回 false
+bool log_decode(FILE *in, FILE *out, bool json);
+
+// fmt 必须为字符串字面量 (异步模式只保存指针)
+// 异步模式下一条记录的字符串参数合计最多保存 768 字节, 超出的部分截断, 以 "...(truncated N bytes)" 结尾
+// 更长的内容 (如完整的响应) 直接写文件, 不要经过日志
+void log_log(int level, const char *func, const char *file, int line, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+// site 为调用点静态变量, 保存调用点 id
+void log_site_log(int *site, int level, const char *func, const char *file, int line, const char *fmt, ...)
+    __attribute__((format(printf, 6, 7)));
+
+#define log_at(lv, fmt, ...)                                                                    \
+    do                                                                                          \
+    {                                                                                           \
+        if ((lv) >= LOG_COMPILE_LEVEL && (lv) >= log_level)                                     \
+        {                                                                                       \
+            static int log_site_;                                                               \
+            log_site_log(&log_site_, (lv), __func__, __FILE__, __LINE__, "" fmt, ##__VA_ARGS__); \
+        }                                                                                       \
+    } while (0)
 
-#define log_trace(...) log_log(LOG_TRACE, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_debug(...) log_log(LOG_DEBUG, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...) log_log(LOG_INFO, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...) log_log(LOG_WARN, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) log_log(LOG_ERROR, __func__, __FILE__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) log_log(LOG_FATAL, __func__, __FILE__, __LINE__, __VA_ARGS__)
+#define log_trace(...) log_at(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) log_at(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) log_at(LOG_WARN, __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) log_at(LOG_FATAL, __VA_ARGS__)
 
+// dbg.h 中同名宏优先
 #define LOG_TRACE(fmt, ...) fprintf(stderr, "\x1B[1;94m[TRACE]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 #define LOG_DEBUG(fmt, ...) fprintf(stderr, "\x1B[1;36m[DEBUG]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
+#ifndef LOG_INFO
 #define LOG_INFO(fmt, ...)  fprintf(stderr, "\x1B[1;32m[ INFO]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
+#endif
 #define LOG_WARN(fmt, ...)  fprintf(stderr, "\x1B[1;33m[ WARN]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
+#ifndef LOG_ERROR
 #define LOG_ERROR(fmt, ...) fprintf(stderr, "\x1B[1;31m[ERROR]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
+#endif
 #define LOG_FATAL(fmt, ...) fprintf(stderr, "\x1B[1;35m[FATAL]\x1B[0m " fmt " \x1b[2;90min func %s %s:%d\x1b[0m\n", ##__VA_ARGS__, __func__, __FILE__, __LINE__);
 
-#endif
\ No newline at end of file
+#endif
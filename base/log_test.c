@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "log.h"
+
+static char *slurp(FILE *f)
+{
+    long sz = ftell(f);
+    char *buf = malloc(sz + 1);
+    assert(buf);
+    rewind(f);
+    buf[fread(buf, 1, sz, f)] = '\0';
+    return buf;
+}
+
+void test_Log_format()
+{
+    FILE *f = tmpfile();
+    assert(f);
+    log_setlevel(LOG_TRACE);
+    assert(log_async_start(f));
+
+    char tmp[8] = "abcdefg";
+    log_info("int %d %5u %-3hhd| %lx %lld %zu", -42, 7u, 300, 255ul, -1234567890123ll, (size_t)99);
+    log_info("dbl %.3f %g %e", 3.14159, 0.5, 1e10);
+    log_info("str [%s] [%.3s] [%-6s] [%*s] [%.*s]", "hello", "abcdef", "ab", 4, "x", 2, tmp);
+    log_info("chr %c%c 100%%", 'o', 'k');
+    // 栈上字符串在返回前被改写, 异步输出仍是调用时的内容
+    tmp[0] = 'Z';
+    log_info("ptr %p", (void *)0x1234);
+    // 位置参数不支持延迟格式化, 退化为同步格式化
+    log_info("pos %2$s %1$s", "world", "hello");
+    log_debug("filtered %d", 1);
+    log_setlevel(LOG_INFO);
+    log_debug("filtered %d", 2);
+    log_flush();
+
+    char *out = slurp(f);
+    assert(strstr(out, "int -42     7 44 | ff -1234567890123 99"));
+    assert(strstr(out, "dbl 3.142 0.5 1.000000e+10"));
+    assert(strstr(out, "str [hello] [abc] [ab    ] [   x] [ab]"));
+    assert(strstr(out, "chr ok 100%"));
+    assert(strstr(out, "ptr 0x1234"));
+    assert(strstr(out, "pos hello world"));
+    assert(strstr(out, "filtered 1"));
+    assert(strstr(out, "filtered 2") == NULL);
+    assert(strstr(out, "in func test_Log_format"));
+    free(out);
+
+    log_async_stop();
+    fclose(f);
+}
+
+// 超长字符串参数截断并标出截掉的字节数
+void test_Log_truncate()
+{
+    FILE *f = tmpfile();
+    assert(f);
+    log_setlevel(LOG_TRACE);
+    assert(log_async_start(f));
+
+    size_t sz = 5000;
+    char *big = malloc(sz + 1);
+    memset(big, 'x', sz);
+    big[sz] = '\0';
+    log_info("big [%.*s]", (int)sz, big);
+    log_info("short [%s]", "ok");
+    free(big);
+    log_async_stop();
+
+    char *out = slurp(f);
+    char *p = strstr(out, "big [");
+    assert(p);
+    p += 5;
+    size_t kept = strspn(p, "x");
+    char mark[64];
+    snprintf(mark, sizeof(mark), "...(truncated %zu bytes)]", sz - kept);
+    assert(kept > 0 && kept < sz && strncmp(p + kept, mark, strlen(mark)) == 0);
+    assert(strstr(out, "short [ok]"));
+    free(out);
+    fclose(f);
+}
+
+#define N_THREAD 4
+#define N_LOG 10000
+
+static void *worker(void *ud)
+{
+    int i;
+    for (i = 0; i < N_LOG; i++)
+    {
+        log_info("thread %ld seq %d", (long)ud, i);
+    }
+    log_flush();
+    return NULL;
+}
+
+void test_Log_threads()
+{
+    FILE *f = tmpfile();
+    assert(f);
+    log_setlevel(LOG_TRACE);
+    log_setpolicy(LOG_POLICY_BLOCK);
+    assert(log_async_start(f));
+
+    pthread_t ts[N_THREAD];
+    long i;
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_create(&ts[i], NULL, worker, (void *)i);
+    }
+    for (i = 0; i < N_THREAD; i++)
+    {
+        pthread_join(ts[i], NULL);
+    }
+    log_async_stop();
+    assert(log_dropped() == 0);
+
+    char *out = slurp(f);
+    int lines = 0;
+    char *p;
+    for (p = out; (p = strchr(p, '\n')); p++)
+    {
+        lines++;
+    }
+    assert(lines == N_THREAD * N_LOG);
+    // 单线程内有序
+    char *a = strstr(out, "thread 2 seq 9998 ");
+    char *b = strstr(out, "thread 2 seq 9999 ");
+    assert(a && b && a < b);
+    free(out);
+    fclose(f);
+}
+
+void test_Log_drop()
+{
+    FILE *f = tmpfile();
+    assert(f);
+    log_setpolicy(LOG_POLICY_DROP);
+    assert(log_async_start(f));
+
+    // 远超队列容量, 丢弃的条数 + 输出的条数 = 总数
+    unsigned long d0 = log_dropped();
+    int i;
+    for (i = 0; i < 100000; i++)
+    {
+        log_info("burst %d", i);
+    }
+    log_async_stop();
+    unsigned long dropped = log_dropped() - d0;
+
+    char *out = slurp(f);
+    int lines = 0;
+    char *p;
+    for (p = out; (p = strstr(p, "burst ")); p++)
+    {
+        lines++;
+    }
+    assert(lines + dropped == 100000);
+    if (dropped)
+    {
+        assert(strstr(out, "log records dropped"));
+    }
+    free(out);
+    fclose(f);
+}
+
+static int count(const char *s, const char *sub)
+{
+    int n = 0;
+    for (; (s = strstr(s, sub)); s++)
+    {
+        n++;
+    }
+    return n;
+}
+
+void test_Log_binary()
+{
+    FILE *f = tmpfile();
+    assert(f);
+    log_setlevel(LOG_TRACE);
+    log_setpolicy(LOG_POLICY_BLOCK);
+    log_setformat(LOG_FORMAT_BINARY);
+    assert(log_async_start(f));
+
+    int i;
+    for (i = 0; i < 100; i++)
+    {
+        log_debug("seq %d name %s ratio %.2f", i, "svc\"x\"", i / 4.0);
+    }
+    log_warn("pos %2$s %1$s", "world", "hello");
+    log_log(LOG_ERROR, "fn", "file.c", 7, "direct %d", 42);
+    log_async_stop();
+    log_setformat(LOG_FORMAT_TEXT);
+
+    // 每个调用点只有一次定义, fmt 只出现一次
+    char *bin = slurp(f);
+    assert(memcmp(bin, "WLOG", 4) == 0);
+    long sz = ftell(f);
+    int nfmt = 0;
+    long j;
+    for (j = 0; j + 4 < sz; j++)
+    {
+        nfmt += memcmp(bin + j, "seq ", 4) == 0;
+    }
+    assert(nfmt == 1);
+    free(bin);
+
+    FILE *txt = tmpfile();
+    rewind(f);
+    assert(log_decode(f, txt, false));
+    char *out = slurp(txt);
+    assert(count(out, "\n") == 102);
+    assert(strstr(out, "DEBUG] seq 0 name svc\"x\" ratio 0.00 in func test_Log_binary"));
+    assert(strstr(out, "seq 99 name svc\"x\" ratio 24.75"));
+    assert(strstr(out, "WARN] pos hello world"));
+    assert(strstr(out, "ERROR] direct 42 in func fn file.c:7"));
+    free(out);
+    fclose(txt);
+
+    FILE *js = tmpfile();
+    rewind(f);
+    assert(log_decode(f, js, true));
+    out = slurp(js);
+    assert(strstr(out, "\"level\":\"DEBUG\""));
+    assert(strstr(out, "\"msg\":\"seq 3 name svc\\\"x\\\" ratio 0.75\",\"args\":[3,\"svc\\\"x\\\"\",0.75]}"));
+    free(out);
+    fclose(js);
+
+    // 截断的文件
+    rewind(f);
+    FILE *cut = tmpfile();
+    char buf[64];
+    size_t n = fread(buf, 1, sizeof(buf), f);
+    fwrite(buf, 1, n, cut);
+    rewind(cut);
+    FILE *null = fopen("/dev/null", "w");
+    assert(!log_decode(cut, null, false));
+    fclose(null);
+    fclose(cut);
+    fclose(f);
+}
+
+int main(void)
+{
+    test_Log_format();
+    test_Log_truncate();
+    test_Log_threads();
+    test_Log_drop();
+    test_Log_binary();
+    return 0;
+}
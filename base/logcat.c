@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+
+// 还原 LOG_FORMAT_BINARY 输出的日志
+// logcat [-j] [file], 缺省读 stdin
+
+static void usage()
+{
+    fprintf(stderr, "Usage: logcat [-j] [file]\n");
+    fprintf(stderr, "  -j  每行输出一个 json 对象\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "j?")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            json = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    FILE *in = stdin;
+    if (optind < argc && strcmp(argv[optind], "-") != 0)
+    {
+        in = fopen(argv[optind], "rb");
+        if (in == NULL)
+        {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    bool ok = log_decode(in, stdout, json);
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "logcat: 日志格式错误\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "arena.h"
+#include "hash.h"
+#include "strtab.h"
+
+#define GROUP 16
+#define MIN_CAP 16
+#define ARENA_CHUNK 4096
+
+// 控制字节: FULL 为 hash 低 7 bit (0~127), 空位与删除标记最高位为 1
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+struct slot
+{
+    uint64_t hash;
+    const char *key;
+    const char *val;
+    uint32_t klen;
+    uint32_t vlen;
+};
+
+struct strtab
+{
+    uint32_t cap;  /* pow of 2 */
+    uint32_t count;
+    uint32_t used; /* count + 删除标记 */
+    // ctrl 长度 cap + GROUP, 尾部镜像前 GROUP 个, 任意位置起读一组都不越界
+    int8_t *ctrl;
+    struct slot *slots;
+    struct arena *arena;
+};
+
+#define H1(h) ((uint32_t)((h) >> 7))
+#define H2(h) ((int8_t)((h)&0x7f))
+
+static inline uint32_t group_match(const int8_t *ctrl, int8_t b)
+{
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(b)));
+#else
+    uint32_t m = 0;
+    int i;
+    for (i = 0; i < GROUP; i++)
+    {
+        m |= (uint32_t)(ctrl[i] == b) << i;
+    }
+    return m;
+#endif
+}
+
+// EMPTY 或 DELETED
+static inline uint32_t group_match_free(const int8_t *ctrl)
+{
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), g));
+#else
+    uint32_t m = 0;
+    int i;
+    for (i = 0; i < GROUP; i++)
+    {
+        m |= (uint32_t)(ctrl[i] < -1) << i;
+    }
+    return m;
+#endif
+}
+
+static inline void set_ctrl(struct strtab *t, uint32_t i, int8_t c)
+{
+    t->ctrl[i] = c;
+    if (i < GROUP)
+    {
+        t->ctrl[t->cap + i] = c;
+    }
+}
+
+static inline uint32_t max_used(uint32_t cap)
+{
+    return cap - cap / 8;
+}
+
+static bool alloc_slots(struct strtab *t, uint32_t cap)
+{
+    int8_t *ctrl = malloc(cap + GROUP);
+    struct slot *slots = malloc(cap * sizeof(struct slot));
+    if (ctrl == NULL || slots == NULL)
+    {
+        free(ctrl);
+        free(slots);
+        return false;
+    }
+    memset(ctrl, CTRL_EMPTY, cap + GROUP);
+    t->ctrl = ctrl;
+    t->slots = slots;
+    t->cap = cap;
+    t->used = t->count;
+    return true;
+}
+
+struct strtab *strtab_create(unsigned int capacity)
+{
+    struct strtab *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+    {
+        return NULL;
+    }
+
+    uint32_t cap = MIN_CAP;
+    while (max_used(cap) < capacity)
+    {
+        cap <<= 1;
+    }
+
+    t->arena = arena_create(ARENA_CHUNK);
+    if (t->arena == NULL || !alloc_slots(t, cap))
+    {
+        if (t->arena)
+        {
+            arena_release(t->arena);
+        }
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void strtab_release(struct strtab *t)
+{
+    arena_release(t->arena);
+    free(t->ctrl);
+    free(t->slots);
+    free(t);
+}
+
+static int64_t find(const struct strtab *t, uint64_t hash, const char *key, size_t klen)
+{
+    uint32_t mask = t->cap - 1;
+    uint32_t pos = H1(hash) & mask;
+    uint32_t stride = 0;
+    int8_t h2 = H2(hash);
+
+    for (;;)
+    {
+        const int8_t *g = t->ctrl + pos;
+        uint32_t m = group_match(g, h2);
+        while (m)
+        {
+            uint32_t i = (pos + __builtin_ctz(m)) & mask;
+            const struct slot *s = &t->slots[i];
+            if (s->hash == hash && s->klen == klen && memcmp(s->key, key, klen) == 0)
+            {
+                return i;
+            }
+            m &= m - 1;
+        }
+        if (group_match(g, CTRL_EMPTY))
+        {
+            return -1;
+        }
+        stride += GROUP;
+        pos = (pos + stride) & mask;
+    }
+}
+
+static uint32_t find_free(const struct strtab *t, uint64_t hash)
+{
+    uint32_t mask = t->cap - 1;
+    uint32_t pos = H1(hash) & mask;
+    uint32_t stride = 0;
+
+    for (;;)
+    {
+        uint32_t m = group_match_free(t->ctrl + pos);
+        if (m)
+        {
+            return (pos + __builtin_ctz(m)) & mask;
+        }
+        stride += GROUP;
+        pos = (pos + stride) & mask;
+    }
+}
+
+// 使用保存的 hash 重新分布, 同时清理删除标记
+static bool rehash(struct strtab *t, uint32_t ncap)
+{
+    int8_t *octrl = t->ctrl;
+    struct slot *oslots = t->slots;
+    uint32_t ocap = t->cap;
+
+    if (!alloc_slots(t, ncap))
+    {
+        return false;
+    }
+
+    uint32_t i;
+    for (i = 0; i < ocap; i++)
+    {
+        if (octrl[i] >= 0)
+        {
+            uint32_t j = find_free(t, oslots[i].hash);
+            set_ctrl(t, j, H2(oslots[i].hash));
+            t->slots[j] = oslots[i];
+        }
+    }
+
+    free(octrl);
+    free(oslots);
+    return true;
+}
+
+bool strtab_put(struct strtab *t, const char *key, size_t klen, const char *val, size_t vlen)
+{
+    uint64_t hash = hash_bytes(key, klen);
+    int64_t i = find(t, hash, key, klen);
+
+    const char *v = arena_strndup(t->arena, val, vlen);
+    if (v == NULL)
+    {
+        return false;
+    }
+
+    if (i >= 0)
+    {
+        t->slots[i].val = v;
+        t->slots[i].vlen = vlen;
+        return true;
+    }
+
+    if (t->used + 1 > max_used(t->cap))
+    {
+        // 删除标记较多时原地整理, 否则翻倍
+        uint32_t ncap = t->count + 1 > max_used(t->cap) / 2 ? t->cap * 2 : t->cap;
+        if (!rehash(t, ncap))
+        {
+            return false;
+        }
+    }
+
+    const char *k = arena_strndup(t->arena, key, klen);
+    if (k == NULL)
+    {
+        return false;
+    }
+
+    uint32_t j = find_free(t, hash);
+    if (t->ctrl[j] == CTRL_EMPTY)
+    {
+        t->used++;
+    }
+    set_ctrl(t, j, H2(hash));
+    struct slot *s = &t->slots[j];
+    s->hash = hash;
+    s->key = k;
+    s->klen = klen;
+    s->val = v;
+    s->vlen = vlen;
+    t->count++;
+    return true;
+}
+
+bool strtab_get(const struct strtab *t, const char *key, size_t klen, const char **val, size_t *vlen)
+{
+    int64_t i = find(t, hash_bytes(key, klen), key, klen);
+    if (i < 0)
+    {
+        return false;
+    }
+    if (val)
+    {
+        *val = t->slots[i].val;
+    }
+    if (vlen)
+    {
+        *vlen = t->slots[i].vlen;
+    }
+    return true;
+}
+
+bool strtab_exists(const struct strtab *t, const char *key, size_t klen)
+{
+    return find(t, hash_bytes(key, klen), key, klen) >= 0;
+}
+
+bool strtab_del(struct strtab *t, const char *key, size_t klen)
+{
+    int64_t i = find(t, hash_bytes(key, klen), key, klen);
+    if (i < 0)
+    {
+        return false;
+    }
+    set_ctrl(t, i, CTRL_DELETED);
+    t->count--;
+    return true;
+}
+
+int strtab_count(const struct strtab *t)
+{
+    return t->count;
+}
+
+void strtab_enum(const struct strtab *t, strtab_enum_func fn, void *ud)
+{
+    uint32_t i;
+    for (i = 0; i < t->cap; i++)
+    {
+        if (t->ctrl[i] >= 0)
+        {
+            const struct slot *s = &t->slots[i];
+            fn(s->key, s->klen, s->val, s->vlen, ud);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 开放寻址字符串 map (swiss table), 替代 strmap
+// 每个 slot 对应一个控制字节 (hash 低 7 bit), 16 个一组 SSE2 并行比对
+// slot 保存完整 hash, 扩容时无需重新计算
+// key/value 复制到内部 arena ('\0' 结尾), 查询直接返回内部指针, 不复制
+// 内部指针在 strtab_release 之前有效 (put 覆盖/del 不回收旧内存)
+// 非线程安全
+
+struct strtab;
+
+typedef void (*strtab_enum_func)(const char *key, size_t klen, const char *val, size_t vlen, void *ud);
+
+struct strtab *strtab_create(unsigned int capacity);
+void strtab_release(struct strtab *);
+
+// 已存在则覆盖 value
+bool strtab_put(struct strtab *, const char *key, size_t klen, const char *val, size_t vlen);
+// val/vlen 可以为 NULL
+bool strtab_get(const struct strtab *, const char *key, size_t klen, const char **val, size_t *vlen);
+bool strtab_exists(const struct strtab *, const char *key, size_t klen);
+bool strtab_del(struct strtab *, const char *key, size_t klen);
+int strtab_count(const struct strtab *);
+void strtab_enum(const struct strtab *, strtab_enum_func, void *ud);
+
+#endif
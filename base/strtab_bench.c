@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "strtab.h"
+#include "strmap.h"
+#include "khash.h"
+
+// 以 service.method 为 key 的典型负载: key 50~90 字节, 前缀高度重复
+// 对比 strtab / strmap / khash 的 put 与 get (命中/未命中)
+
+#define N_KEY 4096
+#define N_GET 4000000
+
+KHASH_MAP_INIT_STR(str, char *)
+
+static const char *domains[] = {"trade", "item", "user", "pay", "logistics", "material", "scrm", "uic"};
+static const char *methods[] = {"get", "getAll", "create", "update", "del", "expire", "setObj", "complexMethod"};
+
+static char *keys[N_KEY];
+static char *miss[N_KEY];
+static char *vals[N_KEY];
+static int order[N_GET];
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void gen()
+{
+    char buf[256];
+    int i;
+    for (i = 0; i < N_KEY; i++)
+    {
+        snprintf(buf, sizeof(buf), "com.youzan.%s.core.service.Api%dService.%s",
+                 domains[i % 8], i / 64, methods[(i / 8) % 8]);
+        keys[i] = strdup(buf);
+        snprintf(buf, sizeof(buf), "com.youzan.%s.core.service.Api%dService.%sX",
+                 domains[i % 8], i / 64, methods[(i / 8) % 8]);
+        miss[i] = strdup(buf);
+        snprintf(buf, sizeof(buf), "10.9.%d.%d:%d", i / 256, i % 256, 20880 + i % 16);
+        vals[i] = strdup(buf);
+    }
+
+    unsigned int seed = 1;
+    for (i = 0; i < N_GET; i++)
+    {
+        order[i] = rand_r(&seed) % N_KEY;
+    }
+}
+
+static void report(const char *name, double put, double hit, double miss)
+{
+    printf("%-8s %10.1f %10.1f %10.1f\n", name, put * 1e9 / N_KEY, hit * 1e9 / N_GET, miss * 1e9 / N_GET);
+}
+
+static void bench_strtab()
+{
+    size_t sum = 0;
+    int i;
+    double t0 = now();
+    struct strtab *t = strtab_create(0);
+    for (i = 0; i < N_KEY; i++)
+    {
+        strtab_put(t, keys[i], strlen(keys[i]), vals[i], strlen(vals[i]));
+    }
+    double t1 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        const char *k = keys[order[i]];
+        const char *v;
+        size_t vlen;
+        if (strtab_get(t, k, strlen(k), &v, &vlen))
+        {
+            sum += vlen;
+        }
+    }
+    double t2 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        const char *k = miss[order[i]];
+        sum += strtab_exists(t, k, strlen(k));
+    }
+    double t3 = now();
+    strtab_release(t);
+    report("strtab", t1 - t0, t2 - t1, t3 - t2);
+    if (sum == 0)
+    {
+        puts("");
+    }
+}
+
+static void bench_strmap()
+{
+    size_t sum = 0;
+    char out[64];
+    int i;
+    double t0 = now();
+    StrMap *m = sm_new(N_KEY);
+    for (i = 0; i < N_KEY; i++)
+    {
+        sm_put(m, keys[i], vals[i]);
+    }
+    double t1 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        if (sm_get(m, keys[order[i]], out, sizeof(out)))
+        {
+            sum += out[0];
+        }
+    }
+    double t2 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        sum += sm_exists(m, miss[order[i]]);
+    }
+    double t3 = now();
+    sm_delete(m);
+    report("strmap", t1 - t0, t2 - t1, t3 - t2);
+    if (sum == 0)
+    {
+        puts("");
+    }
+}
+
+static void bench_khash()
+{
+    size_t sum = 0;
+    int i, ret;
+    khiter_t k;
+    double t0 = now();
+    khash_t(str) *h = kh_init(str);
+    for (i = 0; i < N_KEY; i++)
+    {
+        k = kh_put(str, h, strdup(keys[i]), &ret);
+        kh_value(h, k) = strdup(vals[i]);
+    }
+    double t1 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        k = kh_get(str, h, keys[order[i]]);
+        if (k != kh_end(h))
+        {
+            sum += kh_value(h, k)[0];
+        }
+    }
+    double t2 = now();
+    for (i = 0; i < N_GET; i++)
+    {
+        sum += kh_get(str, h, miss[order[i]]) != kh_end(h);
+    }
+    double t3 = now();
+    for (k = kh_begin(h); k != kh_end(h); ++k)
+    {
+        if (kh_exist(h, k))
+        {
+            free((char *)kh_key(h, k));
+            free(kh_value(h, k));
+        }
+    }
+    kh_destroy(str, h);
+    report("khash", t1 - t0, t2 - t1, t3 - t2);
+    if (sum == 0)
+    {
+        puts("");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    gen();
+    printf("%d keys, %d lookups, ns/op\n", N_KEY, N_GET);
+    printf("%-8s %10s %10s %10s\n", "", "put", "get-hit", "get-miss");
+    bench_strtab();
+    bench_strmap();
+    bench_khash();
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "strtab.h"
+
+#define PUTS(t, k, v) strtab_put((t), (k), strlen(k), (v), strlen(v))
+
+void test_Strtab_get_put()
+{
+    struct strtab *t = strtab_create(0);
+    const char *v;
+    size_t vlen;
+
+    assert(PUTS(t, "service", "com.youzan.DemoService"));
+    assert(PUTS(t, "method", "complexMethod"));
+    assert(strtab_count(t) == 2);
+
+    assert(strtab_get(t, "service", 7, &v, &vlen));
+    assert(vlen == strlen("com.youzan.DemoService"));
+    assert(memcmp(v, "com.youzan.DemoService", vlen) == 0);
+    assert(v[vlen] == '\0');
+
+    // 覆盖
+    assert(PUTS(t, "method", "simpleMethod"));
+    assert(strtab_count(t) == 2);
+    assert(strtab_get(t, "method", 6, &v, &vlen));
+    assert(strcmp(v, "simpleMethod") == 0);
+
+    assert(!strtab_get(t, "meth", 4, &v, &vlen));
+    assert(!strtab_exists(t, "methodx", 7));
+    assert(strtab_exists(t, "method", 6));
+
+    strtab_release(t);
+}
+
+void test_Strtab_binary_key()
+{
+    struct strtab *t = strtab_create(4);
+    const char k1[] = {'a', 0, 'b'};
+    const char k2[] = {'a', 0, 'c'};
+    assert(strtab_put(t, k1, 3, "1", 1));
+    assert(strtab_put(t, k2, 3, "2", 1));
+    assert(strtab_put(t, "", 0, "empty", 5));
+
+    const char *v;
+    assert(strtab_get(t, k1, 3, &v, NULL) && *v == '1');
+    assert(strtab_get(t, k2, 3, &v, NULL) && *v == '2');
+    assert(strtab_get(t, "", 0, &v, NULL) && strcmp(v, "empty") == 0);
+    assert(!strtab_exists(t, k1, 2));
+
+    strtab_release(t);
+}
+
+void test_Strtab_del()
+{
+    struct strtab *t = strtab_create(0);
+    char k[32], val[32];
+    int i, n = 10000;
+
+    for (i = 0; i < n; i++)
+    {
+        sprintf(k, "key-%d", i);
+        sprintf(val, "val-%d", i);
+        assert(PUTS(t, k, val));
+    }
+    assert(strtab_count(t) == n);
+
+    for (i = 0; i < n; i += 2)
+    {
+        sprintf(k, "key-%d", i);
+        assert(strtab_del(t, k, strlen(k)));
+        assert(!strtab_del(t, k, strlen(k)));
+    }
+    assert(strtab_count(t) == n / 2);
+
+    for (i = 0; i < n; i++)
+    {
+        const char *v;
+        sprintf(k, "key-%d", i);
+        sprintf(val, "val-%d", i);
+        if (i % 2)
+        {
+            assert(strtab_get(t, k, strlen(k), &v, NULL));
+            assert(strcmp(v, val) == 0);
+        }
+        else
+        {
+            assert(!strtab_exists(t, k, strlen(k)));
+        }
+    }
+
+    // 反复增删, 删除标记不能耗尽空位
+    for (i = 0; i < n * 10; i++)
+    {
+        sprintf(k, "tmp-%d", i);
+        assert(PUTS(t, k, "x"));
+        assert(strtab_del(t, k, strlen(k)));
+    }
+    assert(strtab_count(t) == n / 2);
+
+    strtab_release(t);
+}
+
+static void count_enum(const char *key, size_t klen, const char *val, size_t vlen, void *ud)
+{
+    assert(key[klen] == '\0');
+    assert(val[vlen] == '\0');
+    (*(int *)ud)++;
+}
+
+void test_Strtab_enum()
+{
+    struct strtab *t = strtab_create(0);
+    char k[32];
+    int i, n = 100, cnt = 0;
+    for (i = 0; i < n; i++)
+    {
+        sprintf(k, "%d", i);
+        PUTS(t, k, k);
+    }
+    strtab_enum(t, count_enum, &cnt);
+    assert(cnt == n);
+    strtab_release(t);
+}
+
+int main(void)
+{
+    test_Strtab_get_put();
+    test_Strtab_binary_key();
+    test_Strtab_del();
+    test_Strtab_enum();
+    return 0;
+}
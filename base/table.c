@@ -1,11 +1,29 @@
 #include <stdlib.h>
+#include <string.h>
 #include "table.h"
 
-/* 必须 pow of 2, 因为要-1所有bit变为1, &运算做hash */
-#define INIT_SZ 16;
-#define EXPAND_THRESHOLD 0.75
+/*
+ * 分代 slot map
+ * handle = (gen << TABLE_IDX_BITS) | (idx + 1)
+ *
+ * slots 稀疏数组, 通过空闲链表 O(1) 分配/回收下标, gen 每次回收 +1, 用来识别过期 handle
+ * dense 稠密数组保存全部存活元素, 删除时与末尾交换, table_list 只遍历存活元素
+ */
+
+#define INIT_SZ 16
+#define TABLE_IDX_BITS 20
+#define TABLE_IDX_MASK ((1u << TABLE_IDX_BITS) - 1)
+#define TABLE_MAX_SZ TABLE_IDX_MASK
+#define TABLE_GEN_MASK (~0u >> TABLE_IDX_BITS)
 
 struct slot
+{
+    unsigned int gen;
+    /* 存活: 在 dense 中的下标; 空闲: 下一个空闲 slot 下标 */
+    int next;
+};
+
+struct dense
 {
     handle id;
     void *ud;
@@ -13,15 +31,37 @@ struct slot
 
 struct table
 {
-    handle last;
     int cap;
     int sz;
+    int free; /* 空闲链表头, -1 为空 */
     struct slot *slots;
+    struct dense *dense;
 };
 
-static inline int hash(struct table *t, int id)
+static inline int handle_idx(handle id)
 {
-    return id & (t->cap - 1);
+    return (int)(id & TABLE_IDX_MASK) - 1;
+}
+
+static inline unsigned int handle_gen(handle id)
+{
+    return id >> TABLE_IDX_BITS;
+}
+
+static inline handle mk_handle(int idx, unsigned int gen)
+{
+    return (gen << TABLE_IDX_BITS) | (unsigned int)(idx + 1);
+}
+
+static void link_free(struct table *t, int from, int to)
+{
+    int i;
+    for (i = from; i < to; i++)
+    {
+        t->slots[i].gen = 1;
+        t->slots[i].next = i + 1 < to ? i + 1 : t->free;
+    }
+    t->free = from;
 }
 
 struct table *table_create()
@@ -31,45 +71,78 @@ struct table *table_create()
     {
         return t;
     }
-    t->last = 0;
     t->sz = 0;
     t->cap = INIT_SZ;
-    t->slots = (struct slot *)calloc(t->cap, sizeof(struct slot));
-    if (t->slots == NULL)
+    t->free = -1;
+    t->slots = malloc(t->cap * sizeof(struct slot));
+    t->dense = malloc(t->cap * sizeof(struct dense));
+    if (t->slots == NULL || t->dense == NULL)
     {
+        free(t->slots);
+        free(t->dense);
         free(t);
         return NULL;
     }
+    link_free(t, 0, t->cap);
     return t;
 }
 
 void table_release(struct table *t)
 {
     free(t->slots);
+    free(t->dense);
     free(t);
 }
 
+/* 已分配的 slot 下标不变, 存量 handle 扩容后依然有效 */
 static struct table *table_expand(struct table *t)
 {
+    if (t->cap >= TABLE_MAX_SZ)
+    {
+        return NULL;
+    }
+
     int ncap = t->cap * 2;
-    struct slot *nslots = (struct slot *)calloc(ncap, sizeof(struct slot));
+    if (ncap > TABLE_MAX_SZ)
+    {
+        ncap = TABLE_MAX_SZ;
+    }
+
+    struct slot *nslots = realloc(t->slots, ncap * sizeof(struct slot));
     if (nslots == NULL)
     {
         return NULL;
     }
+    t->slots = nslots;
 
-    int i;
-    for (i = 0; i < t->cap; i++)
+    struct dense *ndense = realloc(t->dense, ncap * sizeof(struct dense));
+    if (ndense == NULL)
     {
-        nslots[i] = t->slots[i];
+        return NULL;
     }
+    t->dense = ndense;
 
-    free(t->slots);
-    t->slots = nslots;
+    link_free(t, t->cap, ncap);
     t->cap = ncap;
     return t;
 }
 
+static inline struct slot *table_slot(struct table *t, handle id)
+{
+    int idx = handle_idx(id);
+    if (idx < 0 || idx >= t->cap)
+    {
+        return NULL;
+    }
+
+    struct slot *s = &t->slots[idx];
+    if (s->gen != handle_gen(id) || s->next < 0 || s->next >= t->sz || t->dense[s->next].id != id)
+    {
+        return NULL;
+    }
+    return s;
+}
+
 handle table_set(struct table *t, void *ud)
 {
     if (ud == NULL)
@@ -77,7 +150,7 @@ handle table_set(struct table *t, void *ud)
         return 0;
     }
 
-    if (t->sz >= t->cap * EXPAND_THRESHOLD)
+    if (t->free == -1)
     {
         if (table_expand(t) == NULL)
         {
@@ -85,68 +158,56 @@ handle table_set(struct table *t, void *ud)
         }
     }
 
-    handle id;
-    struct slot *s;
-    for (;;)
-    {
-        id = ++t->last;
-        if (id == 0)
-        {
-            id = ++t->last;
-        }
+    int idx = t->free;
+    struct slot *s = &t->slots[idx];
+    t->free = s->next;
 
-        s = &t->slots[hash(t, id)];
-        if (s->id != 0)
-        {
-            continue;
-        }
-
-        ++t->sz;
-        s->id = id;
-        s->ud = ud;
-        return id;
-    }
+    handle id = mk_handle(idx, s->gen);
+    s->next = t->sz;
+    t->dense[t->sz].id = id;
+    t->dense[t->sz].ud = ud;
+    t->sz++;
+    return id;
 }
 
 void *table_get(struct table *t, handle id)
 {
-    if (id == 0 || t->sz == 0)
-    {
-        return NULL;
-    }
-
-    struct slot *s = &t->slots[hash(t, id)];
-    if (s->id != id)
+    struct slot *s = table_slot(t, id);
+    if (s == NULL)
     {
         return NULL;
     }
-    else
-    {
-        return s->ud;
-    }
+    return t->dense[s->next].ud;
 }
 
 void *table_del(struct table *t, handle id)
 {
-    if (id == 0 || t->sz == 0)
+    struct slot *s = table_slot(t, id);
+    if (s == NULL)
     {
         return NULL;
     }
 
-    struct slot *s = &t->slots[hash(t, id)];
-    void *ud;
-    if (s->id != id)
+    int di = s->next;
+    void *ud = t->dense[di].ud;
+
+    // 末尾元素填补空洞
+    int last = --t->sz;
+    if (di != last)
     {
-        return NULL;
+        t->dense[di] = t->dense[last];
+        t->slots[handle_idx(t->dense[di].id)].next = di;
     }
-    else
+
+    // gen 跳过 0, 保证 handle 永不为 0
+    s->gen = (s->gen + 1) & TABLE_GEN_MASK;
+    if (s->gen == 0)
     {
-        s->id = 0;
-        t->sz--;
-        ud = s->ud;
-        s->ud = NULL;
-        return ud;
+        s->gen = 1;
     }
+    s->next = t->free;
+    t->free = handle_idx(id);
+    return ud;
 }
 
 int table_size(struct table *t)
@@ -156,15 +217,23 @@ int table_size(struct table *t)
 
 int table_list(struct table *t, handle *ids, int sz)
 {
-    int i, j;
-    for (i = 0, j = 0; i < t->cap && j < sz; i++)
+    int i, n = sz < t->sz ? sz : t->sz;
+    for (i = 0; i < n; i++)
     {
-        if (t->slots[i].id == 0)
-        {
-            continue;
-        }
-        ids[j++] = t->slots[i].id;
+        ids[i] = t->dense[i].id;
     }
+    return n;
+}
 
-    return j;
-}
\ No newline at end of file
+void *table_at(struct table *t, int i, handle *id)
+{
+    if (i < 0 || i >= t->sz)
+    {
+        return NULL;
+    }
+    if (id)
+    {
+        *id = t->dense[i].id;
+    }
+    return t->dense[i].ud;
+}
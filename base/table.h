@@ -1,6 +1,7 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+/* handle 低 20 bit 为 slot 下标 + 1, 高 12 bit 为 generation, 0 为非法 handle */
 typedef unsigned int handle;
 
 struct table;
@@ -14,5 +15,7 @@ void *table_del(struct table *, handle);
 int table_size(struct table *t);
 /* 返回实际往ids填充handle数量 */
 int table_list(struct table *t, handle *ids, int sz);
+/* 稠密遍历: i in [0, table_size), 遍历过程中不能 set/del */
+void *table_at(struct table *t, int i, handle *id);
 
 #endif
\ No newline at end of file
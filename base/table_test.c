@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "table.h"
 
@@ -94,11 +95,87 @@ void test_Table_list()
     table_release(t);
 }
 
+void test_Table_stale()
+{
+    struct table *t = table_create();
+
+    handle id1 = table_set(t, (void *)1);
+    table_del(t, id1);
+
+    // slot 复用, generation 不同, 旧 handle 失效
+    handle id2 = table_set(t, (void *)2);
+    assert(id2 != id1);
+    assert(table_get(t, id1) == NULL);
+    assert(table_del(t, id1) == NULL);
+    assert((long)table_get(t, id2) == 2);
+    assert(table_size(t) == 1);
+
+    assert(table_get(t, 0) == NULL);
+    assert(table_get(t, ~0u) == NULL);
+
+    table_release(t);
+}
+
+void test_Table_many()
+{
+    struct table *t = table_create();
+
+    // 扩容之后所有 handle 依然有效, 删除一半后剩余的依然有效
+    int n = 50000;
+    handle *ids = malloc(n * sizeof(handle));
+    long i;
+    for (i = 0; i < n; i++)
+    {
+        ids[i] = table_set(t, (void *)(i + 1));
+        assert(ids[i] != 0);
+    }
+    assert(table_size(t) == n);
+
+    for (i = 0; i < n; i++)
+    {
+        assert((long)table_get(t, ids[i]) == i + 1);
+    }
+
+    for (i = 0; i < n; i += 2)
+    {
+        assert((long)table_del(t, ids[i]) == i + 1);
+    }
+    assert(table_size(t) == n / 2);
+
+    for (i = 0; i < n; i++)
+    {
+        if (i % 2)
+        {
+            assert((long)table_get(t, ids[i]) == i + 1);
+        }
+        else
+        {
+            assert(table_get(t, ids[i]) == NULL);
+        }
+    }
+
+    // 稠密遍历只看到存活元素
+    long sum = 0;
+    handle id;
+    for (i = 0; i < table_size(t); i++)
+    {
+        void *ud = table_at(t, i, &id);
+        assert(table_get(t, id) == ud);
+        sum += (long)ud;
+    }
+    assert(sum == (long)(n / 2) * (n / 2 + 1));
+
+    free(ids);
+    table_release(t);
+}
+
 int main(void)
 {
     test_Table_get_set();
     test_Table_get_set2();
     test_Table_del();
     test_Table_list();
+    test_Table_stale();
+    test_Table_many();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "timewheel.h"
+#include "queue.h"
+#include "khash.h"
+
+// 登记项, 挂在到期 tick 对应的槽上, 到期或取消后放回 free_list 复用
+struct tw_entry
+{
+    QUEUE node;
+    int64_t key;
+    int64_t tick; // 到期 tick, 可能在之后若干轮
+};
+
+KHASH_MAP_INIT_INT64(tw, struct tw_entry *)
+
+struct timewheel
+{
+    int tick_ms;
+    uint32_t mask;
+    QUEUE *slots;
+    int64_t cur; // 已推进到的 tick
+    khash_t(tw) * entries;
+    QUEUE free_list;
+};
+
+struct timewheel *tw_create(int tick_ms, int slot_n)
+{
+    assert(tick_ms > 0 && slot_n > 0);
+    struct timewheel *tw = calloc(1, sizeof(*tw));
+    assert(tw);
+    uint32_t cap = 1;
+    while (cap < (uint32_t)slot_n)
+    {
+        cap <<= 1;
+    }
+    tw->tick_ms = tick_ms;
+    tw->mask = cap - 1;
+    tw->slots = malloc(cap * sizeof(QUEUE));
+    assert(tw->slots);
+    uint32_t i;
+    for (i = 0; i < cap; i++)
+    {
+        QUEUE_INIT(&tw->slots[i]);
+    }
+    tw->entries = kh_init(tw);
+    assert(tw->entries);
+    QUEUE_INIT(&tw->free_list);
+    return tw;
+}
+
+static void free_queue(QUEUE *h)
+{
+    while (!QUEUE_EMPTY(h))
+    {
+        QUEUE *q = QUEUE_HEAD(h);
+        QUEUE_REMOVE(q);
+        free(QUEUE_DATA(q, struct tw_entry, node));
+    }
+}
+
+void tw_release(struct timewheel *tw)
+{
+    uint32_t i;
+    for (i = 0; i <= tw->mask; i++)
+    {
+        free_queue(&tw->slots[i]);
+    }
+    free_queue(&tw->free_list);
+    kh_destroy(tw, tw->entries);
+    free(tw->slots);
+    free(tw);
+}
+
+void tw_add(struct timewheel *tw, int64_t key, int64_t deadline_ms)
+{
+    int ret;
+    khiter_t k = kh_put(tw, tw->entries, key, &ret);
+    assert(ret >= 0);
+    struct tw_entry *e;
+    if (ret == 0)
+    {
+        e = kh_value(tw->entries, k);
+        QUEUE_REMOVE(&e->node);
+    }
+    else if (QUEUE_EMPTY(&tw->free_list))
+    {
+        e = malloc(sizeof(*e));
+        assert(e);
+        kh_value(tw->entries, k) = e;
+    }
+    else
+    {
+        QUEUE *q = QUEUE_HEAD(&tw->free_list);
+        QUEUE_REMOVE(q);
+        e = QUEUE_DATA(q, struct tw_entry, node);
+        kh_value(tw->entries, k) = e;
+    }
+    e->key = key;
+    // 向上取整, 不早于 deadline; 已过期的在下一个 tick 到期
+    e->tick = (deadline_ms + tw->tick_ms - 1) / tw->tick_ms;
+    if (e->tick <= tw->cur)
+    {
+        e->tick = tw->cur + 1;
+    }
+    QUEUE_INSERT_TAIL(&tw->slots[e->tick & tw->mask], &e->node);
+}
+
+bool tw_del(struct timewheel *tw, int64_t key)
+{
+    khiter_t k = kh_get(tw, tw->entries, key);
+    if (k == kh_end(tw->entries))
+    {
+        return false;
+    }
+    struct tw_entry *e = kh_value(tw->entries, k);
+    kh_del(tw, tw->entries, k);
+    QUEUE_REMOVE(&e->node);
+    QUEUE_INSERT_HEAD(&tw->free_list, &e->node);
+    return true;
+}
+
+void tw_clear(struct timewheel *tw)
+{
+    uint32_t i;
+    for (i = 0; i <= tw->mask; i++)
+    {
+        while (!QUEUE_EMPTY(&tw->slots[i]))
+        {
+            QUEUE *q = QUEUE_HEAD(&tw->slots[i]);
+            QUEUE_REMOVE(q);
+            QUEUE_INSERT_HEAD(&tw->free_list, q);
+        }
+    }
+    kh_clear(tw, tw->entries);
+}
+
+int tw_size(const struct timewheel *tw)
+{
+    return kh_size(tw->entries);
+}
+
+int tw_advance(struct timewheel *tw, int64_t now_ms, tw_expire_cb cb, void *ud)
+{
+    int64_t now = now_ms / tw->tick_ms;
+    if (now <= tw->cur)
+    {
+        return 0;
+    }
+    // 先把经过的槽里到期的项摘到 expired, 再逐个回调; 落后超过一轮时每个槽扫一遍即可
+    int64_t from = tw->cur + 1;
+    if (now - tw->cur > (int64_t)tw->mask + 1)
+    {
+        from = now - tw->mask;
+    }
+    QUEUE expired;
+    QUEUE_INIT(&expired);
+    int64_t t;
+    for (t = from; t <= now; t++)
+    {
+        QUEUE *slot = &tw->slots[t & tw->mask];
+        QUEUE *q = QUEUE_NEXT(slot);
+        while (q != slot)
+        {
+            struct tw_entry *e = QUEUE_DATA(q, struct tw_entry, node);
+            q = QUEUE_NEXT(q);
+            if (e->tick <= now)
+            {
+                QUEUE_REMOVE(&e->node);
+                QUEUE_INSERT_TAIL(&expired, &e->node);
+            }
+        }
+    }
+    // 回调中新登记的项从 now + 1 开始
+    tw->cur = now;
+
+    // 回调中 tw_del 会把项从 expired 摘走, tw_clear 后剩下的项已不在 entries 中
+    int n = 0;
+    while (!QUEUE_EMPTY(&expired))
+    {
+        QUEUE *q = QUEUE_HEAD(&expired);
+        QUEUE_REMOVE(q);
+        QUEUE_INSERT_HEAD(&tw->free_list, q);
+        struct tw_entry *e = QUEUE_DATA(q, struct tw_entry, node);
+        int64_t key = e->key;
+        khiter_t k = kh_get(tw, tw->entries, key);
+        if (k == kh_end(tw->entries) || kh_value(tw->entries, k) != e)
+        {
+            continue;
+        }
+        kh_del(tw, tw->entries, k);
+        cb(ud, key);
+        n++;
+    }
+    return n;
+}
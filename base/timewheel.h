@@ -0,0 +1,31 @@
+#ifndef TIMEWHEEL_H
+#define TIMEWHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 哈希时间轮: 以 key (如 reqid) 登记到期时间, 按到期 tick 散列到 slot_n 个槽, 每槽一个双向链表
+// 登记与取消都是 O(1) (一次 hash 查找 + 链表增删), 推进时只扫经过的槽, 适合大量在途请求各自超时
+// 到期时间为调用方的单调时钟毫秒, 精度为 tick_ms, 只会晚到不会早到; 非线程安全
+
+struct timewheel;
+
+// slot_n 向上取 2 的幂, slot_n * tick_ms 应不小于常见超时, 否则一个槽里积压多轮未到期的项
+struct timewheel *tw_create(int tick_ms, int slot_n);
+void tw_release(struct timewheel *);
+
+// key 在 deadline_ms 到期, key 已登记时改为新的到期时间
+void tw_add(struct timewheel *, int64_t key, int64_t deadline_ms);
+// 取消, key 未登记 (已到期或已取消) 返回 false
+bool tw_del(struct timewheel *, int64_t key);
+// 全部取消, 不回调
+void tw_clear(struct timewheel *);
+int tw_size(const struct timewheel *);
+
+typedef void (*tw_expire_cb)(void *ud, int64_t key);
+
+// 推进到 now_ms, 每个到期的 key 回调一次, 返回回调次数
+// 回调前 key 已移除; 回调中可以 tw_add/tw_del/tw_clear, 被取消的其它到期 key 不再回调
+int tw_advance(struct timewheel *, int64_t now_ms, tw_expire_cb cb, void *ud);
+
+#endif
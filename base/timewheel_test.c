@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "timewheel.h"
+
+#define MAX_KEYS 1024
+
+struct fired
+{
+    int64_t keys[MAX_KEYS];
+    int n;
+    // 回调中的操作
+    struct timewheel *tw;
+    int64_t del_key;
+    bool clear;
+    int64_t add_key;
+    int64_t add_deadline;
+};
+
+static void on_expire(void *ud, int64_t key)
+{
+    struct fired *f = ud;
+    assert(f->n < MAX_KEYS);
+    f->keys[f->n++] = key;
+    if (f->del_key)
+    {
+        tw_del(f->tw, f->del_key);
+        f->del_key = 0;
+    }
+    if (f->clear)
+    {
+        tw_clear(f->tw);
+        f->clear = false;
+    }
+    if (f->add_key)
+    {
+        tw_add(f->tw, f->add_key, f->add_deadline);
+        f->add_key = 0;
+    }
+}
+
+static bool fired_has(const struct fired *f, int64_t key)
+{
+    int i;
+    for (i = 0; i < f->n; i++)
+    {
+        if (f->keys[i] == key)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_Tw_expire()
+{
+    struct timewheel *tw = tw_create(10, 8);
+    struct fired f = {.tw = tw};
+    int64_t now = 100000;
+    tw_add(tw, 1, now + 25);
+    tw_add(tw, 2, now + 10);
+    tw_add(tw, 3, now + 1000); // 多轮之后, 与 now + 200 等同一槽
+    assert(tw_size(tw) == 3);
+
+    // 不早于到期时间
+    assert(tw_advance(tw, now + 9, on_expire, &f) == 0);
+    assert(tw_advance(tw, now + 10, on_expire, &f) == 1 && f.keys[0] == 2);
+    assert(tw_advance(tw, now + 29, on_expire, &f) == 0);
+    assert(tw_advance(tw, now + 30, on_expire, &f) == 1 && f.keys[1] == 1);
+    assert(tw_advance(tw, now + 200, on_expire, &f) == 0);
+    assert(tw_size(tw) == 1);
+    // 一次跳过多轮
+    assert(tw_advance(tw, now + 5000, on_expire, &f) == 1 && f.keys[2] == 3);
+    assert(tw_size(tw) == 0);
+
+    // 已过期的在下一个 tick 到期
+    tw_add(tw, 4, now);
+    assert(tw_advance(tw, now + 5000, on_expire, &f) == 0);
+    assert(tw_advance(tw, now + 5010, on_expire, &f) == 1 && f.keys[3] == 4);
+    tw_release(tw);
+}
+
+void test_Tw_del()
+{
+    struct timewheel *tw = tw_create(1, 64);
+    struct fired f = {.tw = tw};
+    tw_add(tw, 1, 10);
+    tw_add(tw, 2, 10);
+    assert(tw_del(tw, 1));
+    assert(!tw_del(tw, 1));
+    assert(!tw_del(tw, 3));
+    // 重新登记改到期时间
+    tw_add(tw, 2, 20);
+    assert(tw_size(tw) == 1);
+    assert(tw_advance(tw, 15, on_expire, &f) == 0);
+    assert(tw_advance(tw, 20, on_expire, &f) == 1 && f.keys[0] == 2);
+    assert(!tw_del(tw, 2));
+
+    tw_add(tw, 5, 30);
+    tw_add(tw, 6, 40);
+    tw_clear(tw);
+    assert(tw_size(tw) == 0);
+    assert(tw_advance(tw, 100, on_expire, &f) == 0);
+    tw_release(tw);
+}
+
+void test_Tw_callback()
+{
+    struct timewheel *tw = tw_create(1, 16);
+    struct fired f = {.tw = tw};
+    tw_add(tw, 1, 5);
+    tw_add(tw, 2, 5);
+    tw_add(tw, 3, 6);
+    // 第一个回调取消另一个已到期的, 并登记一个已过期的
+    f.del_key = 2;
+    f.add_key = 4;
+    f.add_deadline = 0;
+    assert(tw_advance(tw, 6, on_expire, &f) == 2);
+    assert(fired_has(&f, 1) && fired_has(&f, 3) && !fired_has(&f, 2));
+    // 回调中登记的不在同一次推进里到期
+    assert(tw_size(tw) == 1 && !fired_has(&f, 4));
+    assert(tw_advance(tw, 7, on_expire, &f) == 1 && f.keys[2] == 4);
+
+    // 回调中全部取消, 其余到期的不再回调, 之后仍可登记
+    f.n = 0;
+    tw_add(tw, 5, 10);
+    tw_add(tw, 6, 10);
+    tw_add(tw, 7, 10);
+    tw_add(tw, 8, 50);
+    f.clear = true;
+    f.add_key = 9;
+    f.add_deadline = 20;
+    assert(tw_advance(tw, 10, on_expire, &f) == 1 && tw_size(tw) == 1);
+    assert(tw_advance(tw, 100, on_expire, &f) == 1 && f.keys[1] == 9);
+    tw_release(tw);
+}
+
+void test_Tw_many()
+{
+    struct timewheel *tw = tw_create(10, 512);
+    struct fired f = {.tw = tw};
+    int64_t key;
+    for (key = 1; key <= 100000; key++)
+    {
+        tw_add(tw, key, key % 1000);
+    }
+    for (key = 2; key <= 100000; key += 2)
+    {
+        assert(tw_del(tw, key));
+    }
+    assert(tw_size(tw) == 50000);
+    int64_t now, total = 0;
+    for (now = 0; now <= 1000; now++)
+    {
+        int n = tw_advance(tw, now, on_expire, &f);
+        total += n;
+        f.n = 0;
+    }
+    assert(total == 50000 && tw_size(tw) == 0);
+    tw_release(tw);
+}
+
+int main(void)
+{
+    test_Tw_expire();
+    test_Tw_del();
+    test_Tw_callback();
+    test_Tw_many();
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include <string.h>
+#include "utf8.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// SSSE3 版本用 target 属性单独编译, 运行时按 CPU 选择
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#define BLOCK 16
+
+static const char hex[] = "0123456789abcdef";
+
+// 首字节对应的字符长度, 非法首字节返回 0
+static inline int seq_len(uint8_t c)
+{
+    if (c < 0x80)
+    {
+        return 1;
+    }
+    else if (c < 0xC0)
+    {
+        return 0;
+    }
+    else if (c < 0xE0)
+    {
+        return 2;
+    }
+    else if (c < 0xF0)
+    {
+        return 3;
+    }
+    else if (c < 0xF8)
+    {
+        return 4;
+    }
+    return 0;
+}
+
+int utf8_decode(const char *str, size_t len, uint32_t *cp)
+{
+    const uint8_t *s = (const uint8_t *)str;
+    static const uint32_t min[] = {0, 0, 0x80, 0x800, 0x10000};
+    int n = seq_len(s[0]), i;
+    if (n == 1)
+    {
+        *cp = s[0];
+        return 1;
+    }
+    if (n == 0 || (size_t)n > len)
+    {
+        return 0;
+    }
+    uint32_t c = s[0] & (0x7F >> n);
+    for (i = 1; i < n; i++)
+    {
+        if ((s[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    if (c < min[n] || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+    {
+        return 0;
+    }
+    *cp = c;
+    return n;
+}
+
+size_t utf8_ascii_span(const char *s, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + BLOCK <= len; i += BLOCK)
+    {
+        int m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)));
+        if (m)
+        {
+            return i + __builtin_ctz(m);
+        }
+    }
+#endif
+    while (i < len && (uint8_t)s[i] < 0x80)
+    {
+        i++;
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+// 非 continuation 字节 (字符首字节) 的位置掩码, 有符号比较 > (int8)0xBF
+static inline uint32_t lead_mask(const char *p)
+{
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(b, _mm_set1_epi8((char)0xBF)));
+}
+#endif
+
+size_t utf8_count(const char *s, size_t len)
+{
+    size_t i = 0, n = 0;
+#ifdef __SSE2__
+    for (; i + BLOCK <= len; i += BLOCK)
+    {
+        n += __builtin_popcount(lead_mask(s + i));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        n += ((uint8_t)s[i] & 0xC0) != 0x80;
+    }
+    return n;
+}
+
+size_t utf8_count_utf16(const char *s, size_t len, size_t *chars)
+{
+    size_t i = 0, n = 0, n4 = 0;
+#ifdef __SSE2__
+    for (; i + BLOCK <= len; i += BLOCK)
+    {
+        // 4 字节字符的首字节 (无符号 >= 0xF0) 再计一次
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i f0 = _mm_set1_epi8((char)0xF0);
+        n += __builtin_popcount(lead_mask(s + i));
+        n4 += __builtin_popcount((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(b, f0), b)));
+    }
+#endif
+    for (; i < len; i++)
+    {
+        n += ((uint8_t)s[i] & 0xC0) != 0x80;
+        n4 += (uint8_t)s[i] >= 0xF0;
+    }
+    if (chars)
+    {
+        *chars = n;
+    }
+    return n + n4;
+}
+
+// ****************************************************************************************************
+// 校验
+
+static bool valid_scalar(const char *s, size_t len)
+{
+    size_t i = 0;
+    uint32_t cp;
+    while (i < len)
+    {
+        if ((uint8_t)s[i] < 0x80)
+        {
+            i += utf8_ascii_span(s + i, len - i);
+            continue;
+        }
+        int n = utf8_decode(s + i, len - i, &cp);
+        if (n == 0)
+        {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+#ifdef UTF8_SSSE3
+// Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"
+// 相邻两字节 (前一字节高/低 4 位, 当前字节高 4 位) 三次查表, 结果按位与得到错误类别
+// 第 3/4 字节的 continuation 由前 2/3 字节是否为 3/4 字节首字节单独判断
+
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+__attribute__((target("ssse3"))) static inline __m128i check_block(__m128i in, __m128i prev)
+{
+    const __m128i byte_1_high_tbl = _mm_setr_epi8(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m128i byte_1_low_tbl = _mm_setr_epi8(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m128i byte_2_high_tbl = _mm_setr_epi8(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    const __m128i lo4 = _mm_set1_epi8(0x0F);
+
+    __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+    __m128i b1h = _mm_shuffle_epi8(byte_1_high_tbl, _mm_and_si128(_mm_srli_epi16(prev1, 4), lo4));
+    __m128i b1l = _mm_shuffle_epi8(byte_1_low_tbl, _mm_and_si128(prev1, lo4));
+    __m128i b2h = _mm_shuffle_epi8(byte_2_high_tbl, _mm_and_si128(_mm_srli_epi16(in, 4), lo4));
+    __m128i special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+    // 只有 111xxxxx / 1111xxxx 减去后 >= 0x80
+    __m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+    __m128i must23_80 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must23_80, special);
+}
+
+__attribute__((target("ssse3"))) static bool valid_ssse3(const char *s, size_t len)
+{
+    // 块末尾 3 字节是否为未完成字符的首字节
+    const __m128i incomplete = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m128i prev = _mm_setzero_si128();
+    __m128i err = _mm_setzero_si128();
+    size_t i;
+    for (i = 0; i + BLOCK <= len; i += BLOCK)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(s + i));
+        if (_mm_movemask_epi8(in) == 0)
+        {
+            err = _mm_or_si128(err, _mm_subs_epu8(prev, incomplete));
+        }
+        else
+        {
+            err = _mm_or_si128(err, check_block(in, prev));
+        }
+        prev = in;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128())) != 0xFFFF)
+    {
+        return false;
+    }
+
+    // 剩余部分从最后一个可能未完成的字符开始标量校验
+    size_t k = i, j;
+    for (j = 1; j <= 3 && j <= i; j++)
+    {
+        uint8_t c = s[i - j];
+        if (c >= 0xC0)
+        {
+            k = i - j;
+            break;
+        }
+        if (c < 0x80)
+        {
+            break;
+        }
+    }
+    return valid_scalar(s + k, len - k);
+}
+#endif
+
+bool utf8_valid(const char *s, size_t len)
+{
+#ifdef UTF8_SSSE3
+    if (len >= BLOCK && __builtin_cpu_supports("ssse3"))
+    {
+        return valid_ssse3(s, len);
+    }
+#endif
+    return valid_scalar(s, len);
+}
+
+ssize_t utf8_skip(const char *s, size_t len, size_t n)
+{
+    size_t i = 0, seen = 0;
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    // 定位第 n 个字符的首字节
+#ifdef __SSE2__
+    for (; i + BLOCK <= len; i += BLOCK)
+    {
+        uint32_t m = lead_mask(s + i);
+        size_t c = __builtin_popcount(m);
+        if (seen + c >= n)
+        {
+            for (; seen + 1 < n; seen++)
+            {
+                m &= m - 1;
+            }
+            i += __builtin_ctz(m);
+            goto found;
+        }
+        seen += c;
+    }
+#endif
+    for (; i < len; i++)
+    {
+        if (((uint8_t)s[i] & 0xC0) != 0x80 && ++seen == n)
+        {
+            goto found;
+        }
+    }
+    return -1;
+
+found:
+    {
+        size_t end = i + seq_len(s[i]);
+        if (end == i || end > len || !utf8_valid(s, end))
+        {
+            return -1;
+        }
+        return end;
+    }
+}
+
+// ****************************************************************************************************
+// 转义
+
+static char *put_u(char *p, uint32_t c)
+{
+    *p++ = '\\';
+    *p++ = 'u';
+    *p++ = hex[(c >> 12) & 0xf];
+    *p++ = hex[(c >> 8) & 0xf];
+    *p++ = hex[(c >> 4) & 0xf];
+    *p++ = hex[c & 0xf];
+    return p;
+}
+
+bool utf8_escape(struct buffer *out, const char *s, size_t len)
+{
+    size_t start = buf_readable(out);
+    size_t i = 0;
+    buf_ensureWritable(out, len);
+    while (i < len)
+    {
+        size_t n = utf8_ascii_span(s + i, len - i);
+        if (n)
+        {
+            buf_append(out, s + i, n);
+            i += n;
+        }
+        while (i < len && (uint8_t)s[i] >= 0x80)
+        {
+            uint32_t cp;
+            int k = utf8_decode(s + i, len - i, &cp);
+            if (k == 0)
+            {
+                buf_unwrite(out, buf_readable(out) - start);
+                return false;
+            }
+            i += k;
+
+            char esc[12], *p = esc;
+            if (cp >= 0x10000)
+            {
+                cp -= 0x10000;
+                p = put_u(p, 0xD800 | (cp >> 10));
+                cp = 0xDC00 | (cp & 0x3FF);
+            }
+            p = put_u(p, cp);
+            buf_append(out, esc, p - esc);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h> /*ssize_t*/
+#include "buffer.h"
+
+// utf8 校验/计数/转义, 无全局状态, 可重入
+// 按 16 字节整块处理: ASCII 块直接跳过, 校验在支持 SSSE3 的 CPU 上走查表向量算法 (运行时检测), 否则标量
+// 合法: 无截断, 无 overlong, 无代理 (U+D800..U+DFFF), 不超过 U+10FFFF
+
+// 解码一个字符, 返回字节数, 非法返回 0
+int utf8_decode(const char *s, size_t len, uint32_t *cp);
+
+bool utf8_valid(const char *s, size_t len);
+
+// 字符数, 不校验 (非 continuation 字节个数)
+size_t utf8_count(const char *s, size_t len);
+// UTF-16 码元数 (java String.length()), 4 字节字符计 2, 不校验; chars 非 NULL 时同时给出字符数
+size_t utf8_count_utf16(const char *s, size_t len, size_t *chars);
+
+// 开头连续 ASCII 字节数
+size_t utf8_ascii_span(const char *s, size_t len);
+
+// 前 n 个字符占的字节数, 同时校验这些字符, 不足 n 个字符或非法返回 -1
+// s 之后可以有其它数据 (如后续的 hessian 字段)
+ssize_t utf8_skip(const char *s, size_t len, size_t n);
+
+// 非 ASCII 字符转 \uXXXX (4 字节字符转代理对) 追加到 out, ASCII 原样
+// 非法 utf8 时回滚 out 并返回 false
+bool utf8_escape(struct buffer *out, const char *s, size_t len);
+
+#endif
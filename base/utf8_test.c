@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "utf8.h"
+
+// 逐字符参照实现
+static bool ref_valid(const uint8_t *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        uint32_t c = s[i], cp;
+        int n, k;
+        if (c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        else if (c >= 0xC2 && c <= 0xDF)
+        {
+            n = 2;
+            cp = c & 0x1F;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            n = 3;
+            cp = c & 0x0F;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            n = 4;
+            cp = c & 0x07;
+        }
+        else
+        {
+            return false;
+        }
+        if (i + n > len)
+        {
+            return false;
+        }
+        for (k = 1; k < n; k++)
+        {
+            if ((s[i + k] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+        if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000) || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+        {
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+static void expect_escape(const char *s, const char *expected)
+{
+    struct buffer *buf = buf_create(4);
+    assert(utf8_escape(buf, s, strlen(s)));
+    assert(buf_readable(buf) == strlen(expected) && memcmp(buf_peek(buf), expected, buf_readable(buf)) == 0);
+    buf_release(buf);
+}
+
+void test_Utf8_basic()
+{
+    uint32_t cp;
+    assert(utf8_decode("a", 1, &cp) == 1 && cp == 'a');
+    assert(utf8_decode("中", 3, &cp) == 3 && cp == 0x4e2d);
+    assert(utf8_decode("😀", 4, &cp) == 4 && cp == 0x1f600);
+    assert(utf8_decode("中", 2, &cp) == 0);
+    assert(utf8_decode("\xc0\x80", 2, &cp) == 0);
+    assert(utf8_decode("\xed\xa0\x80", 3, &cp) == 0);
+    assert(utf8_decode("\xf4\x90\x80\x80", 4, &cp) == 0);
+
+    const char *s = "ab中文éé😀 0123456789abcdef中";
+    assert(utf8_count(s, strlen(s)) == 25);
+    size_t chars;
+    assert(utf8_count_utf16(s, strlen(s), &chars) == 26 && chars == 25);
+    assert(utf8_count_utf16("😀😀😀😀😀", 20, NULL) == 10);
+    assert(utf8_ascii_span(s, strlen(s)) == 2);
+    assert(utf8_ascii_span("0123456789abcdefgh", 18) == 18);
+    assert(utf8_skip(s, strlen(s), 0) == 0);
+    assert(utf8_skip(s, strlen(s), 3) == 5);
+    assert(utf8_skip(s, strlen(s), 7) == 16);
+    assert(utf8_skip(s, strlen(s), 25) == (ssize_t)strlen(s));
+    assert(utf8_skip(s, strlen(s), 26) == -1);
+    // 截断的最后一个字符
+    assert(utf8_skip(s, strlen(s) - 1, 25) == -1);
+    // 后面跟着其它数据
+    assert(utf8_skip("中\x91\x92", 5, 1) == 3);
+
+    expect_escape("", "");
+    expect_escape("abc", "abc");
+    expect_escape("a中é😀\"\\", "a\\u4e2d\\u00e9\\ud83d\\ude00\"\\");
+    struct buffer *buf = buf_create(4);
+    buf_append(buf, "xx", 2);
+    assert(!utf8_escape(buf, "abc\xff", 4));
+    assert(buf_readable(buf) == 2);
+    buf_release(buf);
+}
+
+void test_Utf8_valid_fuzz()
+{
+    // 合法文本上随机改写字节, 与参照实现对比, 覆盖块边界与各类错误
+    const char *seed = "hello 中文 é 😀 test 0123456789 ñ 日本語 \xf4\x8f\xbf\xbf end";
+    size_t seed_len = strlen(seed);
+    uint8_t buf[256];
+    int i, j;
+    srand(1);
+    for (i = 0; i < 200000; i++)
+    {
+        size_t len = rand() % sizeof(buf);
+        for (j = 0; j < (int)len; j++)
+        {
+            buf[j] = seed[(j + i) % seed_len];
+        }
+        int flips = rand() % 3;
+        for (j = 0; j < flips && len; j++)
+        {
+            static const uint8_t bytes[] = {0x80, 0xBF, 0xC0, 0xC2, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF5, 0xFF, 'a', 0xA0, 0x90, 0x8F};
+            buf[rand() % len] = bytes[rand() % sizeof(bytes)];
+        }
+        bool expected = ref_valid(buf, len);
+        if (utf8_valid((const char *)buf, len) != expected)
+        {
+            fprintf(stderr, "mismatch len=%zu expected=%d\n", len, expected);
+            assert(0);
+        }
+    }
+}
+
+void test_Utf8_bench()
+{
+    // 中文文本
+    size_t n = 1 << 20, i;
+    char *s = malloc(n);
+    for (i = 0; i + 3 <= n; i += 3)
+    {
+        memcpy(s + i, "中", 3);
+    }
+    n = i;
+
+    int loops = 200, k;
+    size_t count = 0;
+    clock_t start = clock();
+    for (k = 0; k < loops; k++)
+    {
+        assert(utf8_valid(s, n));
+    }
+    double valid_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (k = 0; k < loops; k++)
+    {
+        count += utf8_count(s, n);
+    }
+    double count_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    assert(count == n / 3 * loops);
+    printf("utf8_valid: %.0f MB/s, utf8_count: %.0f MB/s\n",
+           n * loops / 1e6 / valid_s, n * loops / 1e6 / count_s);
+    free(s);
+}
+
+int main(void)
+{
+    test_Utf8_basic();
+    test_Utf8_valid_fuzz();
+    test_Utf8_bench();
+    return 0;
+}
@@ -10,11 +10,12 @@
 
 #include "dubbo_client.h"
 #include "cJSON.h"
+#include "arena.h"
 #include "dbg.h"
-#include "ae.h"
+#include "log.h"
 
 extern char *optarg;
-static const char *optString = "h:p:m:a:e:t:c:n:v?";
+static const char *optString = "h:p:m:a:T:e:t:c:n:d:W:R:o:C:j:i:L:r:f:Av?";
 
 #define ASSERT_OPT(assert, reason, ...)                                  \
     if (!(assert))                                                       \
@@ -23,15 +24,27 @@ static const char *optString = "h:p:m:a:e:t:c:n:v?";
         usage();                                                         \
     }
 
-// fixme support attach
 static void
 usage()
 {
     static const char *usage =
         "\nUsage:\n"
-        "   dubbo_test -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5> -c<CONCURRENCY> -n<REQUESTS> -v<VERBOS>]\n\n"
+        "   dubbo_test -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-T<JAVA_TYPES> -e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5> -c<CONCURRENCY> -n<REQUESTS> -d<DURATION_SEC> -W<WARMUP_SEC> -R<RAMPUP_SEC> -o<SERIES_CSV> -C<CONNECTIONS=1> -j<THREADS=1> -i<REPORT_INTERVAL_SEC> -L<HGRM_FILE> -r<QPS> -A -f<WORKLOAD_FILE> -v<VERBOS>]\n\n"
         "Example:\n"
-        "   dubbo_test -h10.9.172.41  -p 20983  -mcom.youzan.generic.service.DemoService.complexMethod -a '[true,1,3.1400000000000001,\"hello\",{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],{\"hello\":{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}},\"WARN\"]'\n";
+        "   dubbo_test -h10.9.172.41  -p 20983  -mcom.youzan.generic.service.DemoService.complexMethod -a '[true,1,3.1400000000000001,\"hello\",{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],[{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null},{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}],{\"hello\":{\"propBool\":null,\"propByte\":null,\"propI16\":null,\"propI32\":null,\"propI64\":null,\"propDouble\":null,\"propString\":null,\"errorLevel\":null}},\"WARN\"]'\n"
+        "   dubbo_test -h127.0.0.1 -p20880 -mcom.youzan.DemoService.find -T'int,java.lang.String,java.util.List<java.lang.Long>' -a '[1,\"hello\",[2,3]]'\n\n"
+        "-T: 逗号分隔的 java 参数类型, 按类型编码参数直接调用方法, 不走 $invokeWithJsonArgs 泛化调用\n"
+        "-t: 连接与请求的超时; 压测中在途请求超时计为失败并让出 pipeline, 之后到达的响应丢弃\n"
+        "-c: 每个连接的 pipeline 深度, -C 个连接分布在 -j 个事件循环线程上\n"
+        "-i: 每隔几秒输出该区间的 QPS 与延迟分位数\n"
+        "-L: 结束时把延迟分布写成 HdrHistogram 的 .hgrm 文本 (单位 ms), 可用其 plotter 对比多次压测\n"
+        "-r: 开环定速压测, 按总 QPS 定时发送, 不等响应; 延迟从计划发送时间算起, 服务端卡顿不会被掩盖; 此时 -c 为每个连接的在途上限, 可省略\n"
+        "-A: 配合 -r, 泊松到达 (指数分布间隔), 默认均匀间隔\n"
+        "-d: 按时长压测, 预热之后运行 d 秒结束, 丢弃在途请求; 同时给出 -n 时先到者为准\n"
+        "-W: 预热 W 秒, 其间的响应不计入汇总 (冷 JVM 的前几秒), -R: 连接在 R 秒内依次建立\n"
+        "-o: 每秒一行 CSV: 秒, 阶段, 成功, 失败, QPS, P50/P90/P99/MAX (ms)\n"
+        "-f: 压测负载文件 (JSON), 按权重混合多个方法, 参数模板用 CSV/JSONL 数据逐行展开, 启动时全部预编码; 给出时不需要 -m -a\n"
+        "-v: 逐条输出请求与响应, 经异步日志输出, 响应内容超过约 700 字节时截断并标出截掉的字节数\n";
     puts(usage);
     exit(1);
 }
@@ -62,12 +75,19 @@ static char *trim_opt(char *opt)
     return opt;
 }
 
+static void *json_alloc(void *ud, size_t sz)
+{
+    return arena_alloc(ud, sz);
+}
+
 int main(int argc, char **argv)
 {
     struct dubbo_async_args async_args;
     memset(&async_args, 0, sizeof(async_args));
     async_args.req_n = 0;
     async_args.pipe_n = 0;
+    async_args.conn_n = 1;
+    async_args.thread_n = 1;
     async_args.verbos = false;
 
     struct dubbo_args args;
@@ -101,6 +121,9 @@ int main(int argc, char **argv)
         case 'a':
             args.args = optarg;
             break;
+        case 'T':
+            args.types = optarg;
+            break;
         case 'e':
             args.attach = optarg;
             break;
@@ -113,6 +136,39 @@ int main(int argc, char **argv)
         case 'n':
             async_args.req_n = atoi(optarg);
             break;
+        case 'd':
+            async_args.duration_sec = atoi(optarg);
+            break;
+        case 'W':
+            async_args.warmup_sec = atoi(optarg);
+            break;
+        case 'R':
+            async_args.rampup_sec = atoi(optarg);
+            break;
+        case 'o':
+            async_args.series = optarg;
+            break;
+        case 'C':
+            async_args.conn_n = atoi(optarg);
+            break;
+        case 'j':
+            async_args.thread_n = atoi(optarg);
+            break;
+        case 'i':
+            async_args.interval_sec = atoi(optarg);
+            break;
+        case 'L':
+            async_args.hgrm = optarg;
+            break;
+        case 'r':
+            async_args.rate = atof(optarg);
+            break;
+        case 'A':
+            async_args.poisson = true;
+            break;
+        case 'f':
+            async_args.workload = optarg;
+            break;
         case 'v':
             async_args.verbos = true;
             break;
@@ -128,35 +184,43 @@ int main(int argc, char **argv)
 
     ASSERT_OPT(args.host, "Missing Host -h=${host}");
     ASSERT_OPT(args.port, "Missing Port -p=${port}");
-    ASSERT_OPT(args.service, "Missing Service -m=${service}.${method}");
-    ASSERT_OPT(args.method, "Missing Method -m=${service}.${method}");
-    ASSERT_OPT(args.args, "Missing Arguments -a'${jsonargs}'");
+    bool bench = (async_args.req_n > 0 || async_args.duration_sec > 0) && (async_args.pipe_n > 0 || async_args.rate > 0);
+    ASSERT_OPT(async_args.workload == NULL || bench, "Workload file -f requires -n or -d with -c or -r");
+    if (async_args.workload == NULL)
+    {
+        ASSERT_OPT(args.service, "Missing Service -m=${service}.${method}");
+        ASSERT_OPT(args.method, "Missing Method -m=${service}.${method}");
+        ASSERT_OPT(args.args, "Missing Arguments -a'${jsonargs}'");
+    }
     ASSERT_OPT(args.timeout.tv_sec > 0, "Timeout must be positive");
+    ASSERT_OPT(async_args.conn_n > 0, "Connections must be positive");
+    ASSERT_OPT(async_args.thread_n > 0, "Threads must be positive");
+    ASSERT_OPT(async_args.interval_sec >= 0, "Report interval must not be negative");
+    ASSERT_OPT(async_args.rate >= 0, "Rate must not be negative");
+    ASSERT_OPT(async_args.duration_sec >= 0 && async_args.warmup_sec >= 0 && async_args.rampup_sec >= 0,
+               "Duration, warmup and rampup must not be negative");
+
+    // 只做校验, 解析树整体丢弃; 负载文件中的调用加载时再校验
+    if (async_args.workload == NULL)
+    {
+        struct arena *arena = arena_create(4096);
+        cJSON *json_args = cJSON_ParseInArena(args.args, json_alloc, arena);
+        ASSERT_OPT(json_args && (cJSON_IsObject(json_args) || cJSON_IsArray(json_args)), "Invalid Arguments JSON Format : %s", args.args);
 
-    cJSON *json_args = cJSON_Parse(args.args);
-    ASSERT_OPT(json_args && (cJSON_IsObject(json_args) || cJSON_IsArray(json_args)), "Invalid Arguments JSON Format : %s", args.args);
-    cJSON_Delete(json_args);
-
-    cJSON *json_attach = cJSON_Parse(args.attach);
-    ASSERT_OPT(json_attach && cJSON_IsObject(json_attach), "Invalid Attach JSON Format as %s", args.attach);
-    cJSON_Delete(json_attach);
+        cJSON *json_attach = cJSON_ParseInArena(args.attach, json_alloc, arena);
+        ASSERT_OPT(json_attach && cJSON_IsObject(json_attach), "Invalid Attach JSON Format as %s", args.attach);
+        arena_release(arena);
+    }
 
     // fprintf(stderr, "Invoking dubbo://%s:%s/%s.%s?args=%s&attach=%s\n", args.host, args.port, args.service, args.method, args.args, args.attach);
 
-    if (async_args.req_n > 0 && async_args.pipe_n > 0)
+    if (bench)
     {
-        async_args.el = aeCreateEventLoop(1024);
-        if (dubbo_bench_async(&args, &async_args))
-        {
-            aeMain(async_args.el);
-            aeDeleteEventLoop(async_args.el);
-            return 0;
-        }
-        else
-        {
-            aeDeleteEventLoop(async_args.el);
-            return 1;
-        }
+        // 压测期间日志异步输出, 不阻塞事件循环
+        log_async_start(stdout);
+        bool ok = dubbo_bench_async(&args, &async_args);
+        log_async_stop();
+        return ok ? 0 : 1;
     }
     else
     {
@@ -3,30 +3,114 @@
 #include <errno.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
 #include <inttypes.h> /* PRId64 */
+#include <limits.h>
+#include <math.h>
 
 #include "dubbo_codec.h"
 #include "dubbo_client.h"
+#include "dubbo_workload.h"
 
 #include "ae.h"
 #include "socket.h"
 #include "sa.h"
 #include "buffer.h"
 #include "cJSON.h"
+#include "jsonw.h"
 #include "dbg.h"
+#include "log.h"
+#include "hdr.h"
+#include "timewheel.h"
 
 #define CLI_INIT_BUF_SZ 1024
+// 请求超时的检查间隔, 时间轮一轮 1024 * 10ms
+#define CLI_TICK_MS 10
+#define CLI_WHEEL_SLOTS 1024
+// 延迟以 us 记录, 最大 1 小时, 3 位有效数字
+#define BENCH_LATENCY_MAX_US (3600LL * 1000 * 1000)
+#define BENCH_LATENCY_SIGFIGS 3
 
-static struct dubbo_client *g_cli;
+struct bench_thread;
+
+// 压测: conn_n 个连接分布在 thread_n 个线程上, 每个线程一个 aeEventLoop
+struct dubbo_bench
+{
+    struct dubbo_args *args;
+    struct dubbo_workload *wl; // 预编码的请求帧, 所有连接共用, 发送时只改写 reqid
+    struct dubbo_client **clis;
+    int conn_n;
+    struct bench_thread *threads;
+    int thread_n;
+    int req_n;
+    int64_t ok_n; // 各阶段收到的成功/失败响应数, 原子更新
+    int64_t ko_n;
+    int64_t timeout_n; // 超时的请求数, 也计入 ko_n
+    int alive_thread_n;
+    bool run;
+    bool stop; // 时长已到, 各线程结束连接, 原子读写
+
+    // 各线程无锁记录到 live, 主线程每秒取走到 tick, 预热之后的再并入 interval 与 total
+    struct hdr *live;
+    struct hdr *tick;
+    struct hdr *interval;
+    struct hdr *total;
+    int64_t tick_ns;
+    int tick_seq;
+    int64_t tick_ok; // 上一秒末的 ok_n/ko_n
+    int64_t tick_ko;
+    int64_t warm_n;  // 预热期的响应数
+    int64_t meas_ok; // 预热之后的成功/失败数
+    int64_t meas_ko;
+    int interval_seq;
+    int interval_ticks;
+    double interval_elapsed;
+
+    int interval_sec;
+    int duration_sec; // 0 为按请求数结束
+    int warmup_sec;
+    int rampup_sec;
+    bool warm; // 预热中
+    const char *hgrm;
+    FILE *series; // 每秒一行的 CSV
+
+    double rate; // 定速模式的目标 QPS, 0 为闭环 (收到响应才补发)
+
+    struct timeval start;
+    struct timeval end;
+};
+
+struct bench_thread
+{
+    struct dubbo_bench *bench;
+    struct aeEventLoop *el;
+    pthread_t tid;
+    int cli_n;   // 本线程的连接数
+    int alive_n; // 未完成的连接数, 为 0 时结束事件循环
+};
+
+static struct dubbo_bench *g_bench;
+
+// 在途请求的发送时间, reqid 为 key 的开放寻址表 (0 为空), 线性探测, 删除时后移填补
+// 容量为 2 的幂, 负载超过一半时翻倍 (定速模式下在途请求数不受 pipeline 限制)
+struct inflight
+{
+    int64_t *reqids;
+    int64_t *sent_ns;
+    uint32_t mask;
+    uint32_t n;
+};
 
 struct dubbo_client
 {
+    struct bench_thread *thread;
     struct aeEventLoop *el;
     struct dubbo_args *args;
     union sockaddr_all addr;
@@ -35,20 +119,31 @@ struct dubbo_client
 
     struct buffer *rcv_buf;
     struct buffer *snd_buf;
+    const struct dubbo_workload *wl;
     int pipe_n;
     int pipe_left;
     int req_n;
     int req_left;
-    int ok_n;
-    int ko_n;
+    int sent_n;
+    long read_n;  // 可读事件中读到数据的次数
+    long frame_n; // 收到的响应帧数
+    struct inflight inflight;
+    struct timewheel *wheel; // 在途请求以 reqid 登记超时, 到期计为失败并让出 pipeline
+    long long tick_timerid;
+    int64_t recv_ns; // 本次可读事件的时间
+
+    // 定速模式
+    double rate;        // 本连接的目标 QPS, 0 为闭环
+    bool poisson;       // 泊松到达 (指数分布间隔), 否则均匀间隔
+    uint64_t rnd;       // xorshift 状态
+    int64_t next_ns;    // 下一个请求的计划发送时间
+    int64_t lag_max_ns; // 实际发送落后计划的最大值
+    long long rate_timerid;
 
     int fd;
     bool connected;
     bool run;
     bool verbos;
-
-    struct timeval start;
-    struct timeval end;
 };
 
 static void cli_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask);
@@ -56,24 +151,126 @@ static void cli_on_read(struct aeEventLoop *el, int fd, void *ud, int mask);
 static void cli_on_write(struct aeEventLoop *el, int fd, void *ud, int mask);
 
 static void cli_pipe_send(struct dubbo_client *cli);
-static bool cli_start(struct dubbo_client *cli);
+static void cli_rate_send(struct dubbo_client *cli);
+static int64_t cli_next_gap(struct dubbo_client *cli);
 static void cli_end(struct dubbo_client *cli);
 
-static bool cli_decode_resp(struct dubbo_client *cli);
+static bool cli_decode_resp(struct dubbo_client *cli, bool *done);
 static void cli_reconnect(struct dubbo_client *cli);
 
-static struct buffer *cli_encode_req(struct dubbo_client *cli)
+static inline int64_t now_ns()
 {
-    struct dubbo_req *req = dubbo_req_create(cli->args->service, cli->args->method, cli->args->args, cli->args->attach);
-    if (req == NULL)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void inflight_init(struct inflight *fl, int pipe_n)
+{
+    uint32_t cap = 16;
+    while (cap < 2 * (uint32_t)pipe_n)
     {
-        return false;
+        cap <<= 1;
     }
-    if (cli->verbos)
+    fl->reqids = calloc(cap, sizeof(int64_t));
+    fl->sent_ns = malloc(cap * sizeof(int64_t));
+    assert(fl->reqids && fl->sent_ns);
+    fl->mask = cap - 1;
+    fl->n = 0;
+}
+
+static void inflight_free(struct inflight *fl)
+{
+    free(fl->reqids);
+    free(fl->sent_ns);
+}
+
+static void inflight_clear(struct inflight *fl)
+{
+    memset(fl->reqids, 0, (fl->mask + 1) * sizeof(int64_t));
+    fl->n = 0;
+}
+
+static inline uint32_t inflight_slot(const struct inflight *fl, int64_t reqid)
+{
+    return (uint32_t)(((uint64_t)reqid * 0x9E3779B97F4A7C15ULL) >> 32) & fl->mask;
+}
+
+static void inflight_put(struct inflight *fl, int64_t reqid, int64_t ns);
+
+static void inflight_grow(struct inflight *fl)
+{
+    struct inflight old = *fl;
+    inflight_init(fl, old.mask + 1);
+    uint32_t i;
+    for (i = 0; i <= old.mask; i++)
     {
-        printf("<req>[seq=%" PRId64 "]\n", dubbo_req_getid(req));
+        if (old.reqids[i])
+        {
+            inflight_put(fl, old.reqids[i], old.sent_ns[i]);
+        }
     }
-    return dubbo_encode(req);
+    inflight_free(&old);
+}
+
+static void inflight_put(struct inflight *fl, int64_t reqid, int64_t ns)
+{
+    if ((fl->n + 1) * 2 > fl->mask + 1)
+    {
+        inflight_grow(fl);
+    }
+    fl->n++;
+    uint32_t i = inflight_slot(fl, reqid);
+    while (fl->reqids[i])
+    {
+        i = (i + 1) & fl->mask;
+    }
+    fl->reqids[i] = reqid;
+    fl->sent_ns[i] = ns;
+}
+
+// 取出并删除, 不存在 (如事件帧) 返回 false
+static bool inflight_take(struct inflight *fl, int64_t reqid, int64_t *ns)
+{
+    uint32_t i = inflight_slot(fl, reqid);
+    while (fl->reqids[i] != reqid)
+    {
+        if (fl->reqids[i] == 0)
+        {
+            return false;
+        }
+        i = (i + 1) & fl->mask;
+    }
+    *ns = fl->sent_ns[i];
+    fl->n--;
+
+    // 之后同一探测链上的项, 若其初始位置不在 (i, j] 内, 移到空位 i
+    uint32_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & fl->mask;
+        if (fl->reqids[j] == 0)
+        {
+            break;
+        }
+        uint32_t k = inflight_slot(fl, fl->reqids[j]);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+        {
+            fl->reqids[i] = fl->reqids[j];
+            fl->sent_ns[i] = fl->sent_ns[j];
+            i = j;
+        }
+    }
+    fl->reqids[i] = 0;
+    return true;
+}
+
+static inline uint64_t cli_rand(struct dubbo_client *cli)
+{
+    cli->rnd ^= cli->rnd << 13;
+    cli->rnd ^= cli->rnd >> 7;
+    cli->rnd ^= cli->rnd << 17;
+    return cli->rnd;
 }
 
 static void cli_clear_timer(struct dubbo_client *cli)
@@ -91,40 +288,51 @@ static void cli_reset(struct dubbo_client *cli)
     cli_clear_timer(cli);
     cli->fd = -1;
     cli->pipe_left = cli->pipe_n;
+    // 断开时未收到响应的请求重新发送 (新的 reqid)
+    cli->sent_n = cli->req_n - cli->req_left;
+    inflight_clear(&cli->inflight);
+    tw_clear(cli->wheel);
     buf_retrieveAll(cli->rcv_buf);
     buf_retrieveAll(cli->snd_buf);
 }
 
-static struct dubbo_client *cli_create(struct dubbo_args *args, struct dubbo_async_args *async_args)
+static struct dubbo_client *cli_create(struct dubbo_bench *bench, struct bench_thread *thread, int req_n, struct dubbo_async_args *async_args)
 {
     struct dubbo_client *cli = calloc(1, sizeof(*cli));
     assert(cli);
 
-    cli->el = async_args->el;
+    cli->thread = thread;
+    cli->el = thread->el;
+    cli->wl = bench->wl;
 
     cli->verbos = async_args->verbos;
 
     cli->rcv_buf = buf_create(CLI_INIT_BUF_SZ);
     cli->snd_buf = buf_create(CLI_INIT_BUF_SZ);
 
-    cli->req_n = async_args->req_n;
-    cli->req_left = async_args->req_n;
+    cli->req_n = req_n;
+    cli->req_left = req_n;
 
     cli->pipe_n = async_args->pipe_n;
     if (cli->pipe_n > cli->req_n)
     {
         cli->pipe_n = cli->req_n;
     }
-    cli->pipe_left = async_args->pipe_n;
+    inflight_init(&cli->inflight, cli->pipe_n);
+    cli->wheel = tw_create(CLI_TICK_MS, CLI_WHEEL_SLOTS);
+    cli->tick_timerid = AE_NOMORE;
 
     cli->run = false;
-    cli->ok_n = 0;
-    cli->ko_n = 0;
 
-    cli->timeout_ms = args->timeout.tv_sec * 1000;
+    cli->timeout_ms = bench->args->timeout.tv_sec * 1000;
     cli->timerid = AE_NOMORE;
 
-    cli->args = args;
+    cli->rate = async_args->rate / bench->conn_n;
+    cli->poisson = async_args->poisson;
+    cli->rnd = (uint64_t)now_ns() ^ ((uint64_t)(uintptr_t)cli << 16) ^ 0x9E3779B97F4A7C15ULL;
+    cli->rate_timerid = AE_NOMORE;
+
+    cli->args = bench->args;
     cli_reset(cli);
 
     if (!sa_resolve(cli->args->host, &cli->addr))
@@ -144,7 +352,14 @@ static bool cli_connected(struct dubbo_client *cli)
     {
         return false;
     }
-    cli_pipe_send(cli);
+    if (cli->rate > 0)
+    {
+        cli_rate_send(cli);
+    }
+    else
+    {
+        cli_pipe_send(cli);
+    }
     return true;
 }
 
@@ -198,13 +413,17 @@ bool cli_connect(struct dubbo_client *cli)
 
 close:
     close(fd);
+    cli->fd = -1;
     return false;
 }
 
 static void cli_close(struct dubbo_client *cli)
 {
-    aeDeleteFileEvent(cli->el, cli->fd, AE_READABLE | AE_WRITABLE);
-    close(cli->fd);
+    if (cli->fd >= 0)
+    {
+        aeDeleteFileEvent(cli->el, cli->fd, AE_READABLE | AE_WRITABLE);
+        close(cli->fd);
+    }
     cli_reset(cli);
 }
 
@@ -212,64 +431,399 @@ static void cli_release(struct dubbo_client *cli)
 {
     buf_release(cli->rcv_buf);
     buf_release(cli->snd_buf);
+    inflight_free(&cli->inflight);
+    tw_release(cli->wheel);
     free(cli);
 }
 
-void exit_handler()
+// 连接完成全部请求, 本线程的连接都完成后结束事件循环
+static void cli_end(struct dubbo_client *cli)
+{
+    if (cli->run)
+    {
+        cli_close(cli);
+        cli_clear_timer(cli);
+        if (cli->rate_timerid != AE_NOMORE)
+        {
+            aeDeleteTimeEvent(cli->el, cli->rate_timerid);
+            cli->rate_timerid = AE_NOMORE;
+        }
+        if (cli->tick_timerid != AE_NOMORE)
+        {
+            aeDeleteTimeEvent(cli->el, cli->tick_timerid);
+            cli->tick_timerid = AE_NOMORE;
+        }
+        cli->run = false;
+        if (--cli->thread->alive_n == 0)
+        {
+            aeStop(cli->el);
+        }
+    }
+}
+
+// ****************************************************************************************************
+// 压测
+
+static void bench_summary(struct dubbo_bench *bench)
+{
+    int i;
+    long read_n = 0, frame_n = 0;
+    int64_t lag_max_ns = 0;
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        struct dubbo_client *cli = bench->clis[i];
+        read_n += cli->read_n;
+        frame_n += cli->frame_n;
+        if (cli->lag_max_ns > lag_max_ns)
+        {
+            lag_max_ns = cli->lag_max_ns;
+        }
+    }
+
+    // 只统计预热之后的部分
+    int64_t reqs = bench->meas_ok + bench->meas_ko;
+    double elapsed_sec = ((double)bench->end.tv_sec + 1.0e-6 * bench->end.tv_usec) -
+                         ((double)bench->start.tv_sec + 1.0e-6 * bench->start.tv_usec);
+    double qps = elapsed_sec < 0.001 ? 0 : reqs / elapsed_sec;
+    double per_read = read_n ? (double)frame_n / read_n : 0;
+    log_flush();
+    if (bench->warmup_sec > 0)
+    {
+        fprintf(stderr, "\x1B[1;32m[WARMUP]\x1B[0m %ds, RESP %" PRId64 "%s\n", bench->warmup_sec, bench->warm_n,
+                bench->warm ? ", 预热期内结束, 无统计结果" : ", 不计入统计");
+    }
+    if (bench->warm)
+    {
+        return;
+    }
+    int64_t timeout_n = __atomic_load_n(&bench->timeout_n, __ATOMIC_RELAXED);
+    fprintf(stderr, "\x1B[1;32m[SUMMARY]\x1B[0m COST %.2fs, CONN %d, THREAD %d, REQ %" PRId64 ", SUCC %" PRId64 ", FAIL %" PRId64 ", QPS %.f, RESP/READ %.2f\n",
+            elapsed_sec, bench->conn_n, bench->thread_n, reqs, bench->meas_ok, bench->meas_ko, qps, per_read);
+    if (timeout_n > 0)
+    {
+        fprintf(stderr, "\x1B[1;31m[TIMEOUT]\x1B[0m %" PRId64 " 个请求 %lds 内未收到响应 (含预热期), 计为失败\n",
+                timeout_n, (long)bench->args->timeout.tv_sec);
+    }
+    if (bench->rate > 0)
+    {
+        // 落后过多说明压测端自身跟不上, 实际到达率低于目标
+        fprintf(stderr, "\x1B[1;32m[RATE]\x1B[0m TARGET %.f, ACHIEVED %.f, MAX SEND LAG %.3fms\n",
+                bench->rate, qps, lag_max_ns / 1e6);
+    }
+
+    struct hdr *h = bench->total;
+    fprintf(stderr, "\x1B[1;32m[LATENCY]\x1B[0m MIN %.3fms, P50 %.3fms, P90 %.3fms, P99 %.3fms, P99.9 %.3fms, MAX %.3fms, MEAN %.3fms\n",
+            hdr_min(h) / 1000.0, hdr_value_at_percentile(h, 50) / 1000.0, hdr_value_at_percentile(h, 90) / 1000.0,
+            hdr_value_at_percentile(h, 99) / 1000.0, hdr_value_at_percentile(h, 99.9) / 1000.0,
+            hdr_max(h) / 1000.0, hdr_mean(h) / 1000.0);
+
+    if (bench->hgrm)
+    {
+        FILE *f = fopen(bench->hgrm, "w");
+        if (f == NULL)
+        {
+            LOG_ERROR("写入 %s 失败: %s", bench->hgrm, strerror(errno));
+            return;
+        }
+        hdr_percentiles_print(h, f, 5, 1000);
+        fclose(f);
+    }
+}
+
+// 输出区间内的分位数
+static void bench_interval(struct dubbo_bench *bench)
 {
-    if (g_cli && g_cli->run)
+    struct hdr *h = bench->interval;
+    int64_t n = hdr_count(h);
+    double sec = bench->interval_elapsed;
+    fprintf(stderr, "[INTERVAL %d] %.2fs, RESP %" PRId64 ", QPS %.f, P50 %.3fms, P90 %.3fms, P99 %.3fms, P99.9 %.3fms, MAX %.3fms\n",
+            ++bench->interval_seq, sec, n, sec > 0 ? n / sec : 0,
+            hdr_value_at_percentile(h, 50) / 1000.0, hdr_value_at_percentile(h, 90) / 1000.0,
+            hdr_value_at_percentile(h, 99) / 1000.0, hdr_value_at_percentile(h, 99.9) / 1000.0,
+            hdr_max(h) / 1000.0);
+    hdr_reset(h);
+    bench->interval_elapsed = 0;
+    bench->interval_ticks = 0;
+}
+
+// 每秒一次 (最后一次可能不足一秒), 只在主线程调用
+// 取走这一秒的记录与计数写入时间序列, 预热之后的再并入区间与总计
+static void bench_tick(struct dubbo_bench *bench)
+{
+    int64_t now = now_ns();
+    double tick_sec = (now - bench->tick_ns) / 1e9;
+    bench->tick_ns = now;
+    bench->tick_seq++;
+
+    struct hdr *h = bench->tick;
+    hdr_reset(h);
+    hdr_take(bench->live, h);
+    int64_t ok_n = __atomic_load_n(&bench->ok_n, __ATOMIC_RELAXED);
+    int64_t ko_n = __atomic_load_n(&bench->ko_n, __ATOMIC_RELAXED);
+    int64_t ok = ok_n - bench->tick_ok;
+    int64_t ko = ko_n - bench->tick_ko;
+    bench->tick_ok = ok_n;
+    bench->tick_ko = ko_n;
+
+    if (bench->series)
+    {
+        fprintf(bench->series, "%d,%s,%" PRId64 ",%" PRId64 ",%.f,%.3f,%.3f,%.3f,%.3f\n",
+                bench->tick_seq, bench->warm ? "warmup" : "run", ok, ko, tick_sec > 0 ? (ok + ko) / tick_sec : 0,
+                hdr_value_at_percentile(h, 50) / 1000.0, hdr_value_at_percentile(h, 90) / 1000.0,
+                hdr_value_at_percentile(h, 99) / 1000.0, hdr_max(h) / 1000.0);
+    }
+
+    if (bench->warm)
+    {
+        bench->warm_n += ok + ko;
+        if (bench->tick_seq >= bench->warmup_sec)
+        {
+            bench->warm = false;
+            gettimeofday(&bench->start, NULL);
+        }
+        return;
+    }
+
+    bench->meas_ok += ok;
+    bench->meas_ko += ko;
+    hdr_add(bench->total, h);
+    if (bench->interval_sec > 0)
     {
-        cli_end(g_cli);
+        hdr_add(bench->interval, h);
+        bench->interval_elapsed += tick_sec;
+        if (++bench->interval_ticks >= bench->interval_sec)
+        {
+            bench_interval(bench);
+        }
     }
 }
 
-void sig_handler(int dummy)
+// 所有线程结束后 (或中途退出时) 取走剩余部分
+static void bench_flush(struct dubbo_bench *bench)
 {
-    if (g_cli && g_cli->run)
+    bench_tick(bench);
+    if (bench->interval_ticks > 0)
     {
-        cli_end(g_cli);
-        exit(0);
+        bench_interval(bench);
+    }
+    if (bench->series)
+    {
+        fclose(bench->series);
+        bench->series = NULL;
     }
 }
 
-static bool cli_start(struct dubbo_client *cli)
+// 主线程按秒采样, 直到所有线程结束; 预热加时长到后通知各线程结束
+static void bench_sample_loop(struct dubbo_bench *bench)
 {
-    if (cli->run)
+    int64_t begin = bench->tick_ns;
+    while (__atomic_load_n(&bench->alive_thread_n, __ATOMIC_ACQUIRE) > 0)
     {
-        return false;
+        usleep(10 * 1000);
+        if (now_ns() - begin < (int64_t)(bench->tick_seq + 1) * 1000000000)
+        {
+            continue;
+        }
+        bench_tick(bench);
+        if (bench->duration_sec > 0 && bench->tick_seq >= bench->warmup_sec + bench->duration_sec)
+        {
+            __atomic_store_n(&bench->stop, true, __ATOMIC_RELEASE);
+        }
     }
+}
 
-    atexit(exit_handler);
-    signal(SIGINT, sig_handler);
-    signal(SIGTERM, sig_handler);
-    gettimeofday(&cli->start, NULL);
+// 中途退出时输出已完成部分的统计 (其它线程仍在运行, 计数为近似值)
+static void exit_handler()
+{
+    if (g_bench && g_bench->run)
+    {
+        g_bench->run = false;
+        bench_flush(g_bench);
+        gettimeofday(&g_bench->end, NULL);
+        bench_summary(g_bench);
+    }
+}
 
-    g_cli = cli;
-    cli->run = true;
+static void sig_handler(int dummy)
+{
+    UNUSED(dummy);
+    exit(0);
+}
 
-    return cli_connect(cli);
+// 定速模式的发送定时器, 与连接状态无关, 断线期间到期的请求在重连后立即补发
+static int cli_on_rate_timer(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_client *cli = ud;
+    cli_rate_send(cli);
+    int64_t wait_ms = (cli->next_ns - now_ns()) / 1000000;
+    return wait_ms > 1 ? (int)wait_ms : 1;
 }
 
-static void cli_end(struct dubbo_client *cli)
+static void cli_rate_start(struct dubbo_client *cli)
 {
-    if (cli->run)
+    // 各连接起点错开, 避免同时发送
+    cli->next_ns = now_ns() + cli_next_gap(cli);
+    cli->rate_timerid = aeCreateTimeEvent(cli->el, 1, cli_on_rate_timer, cli, NULL);
+    if (AE_ERR == cli->rate_timerid)
     {
-        cli_close(cli);
-        cli_clear_timer(cli);
+        PANIC("创建定时器失败");
+    }
+}
 
-        gettimeofday(&cli->end, NULL);
-        g_cli = NULL;
-        cli->run = false;
-        aeStop(cli->el);
+// 在途请求到期: 计为失败, 让出 pipeline, 之后到达的响应丢弃
+static void cli_on_req_timeout(void *ud, int64_t reqid)
+{
+    struct dubbo_client *cli = ud;
+    int64_t sent_ns;
+    if (!inflight_take(&cli->inflight, reqid, &sent_ns))
+    {
+        return;
+    }
+    struct dubbo_bench *bench = cli->thread->bench;
+    __atomic_fetch_add(&bench->ko_n, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&bench->timeout_n, 1, __ATOMIC_RELAXED);
+    if (cli->verbos)
+    {
+        log_info("<res seq=%" PRId64 "> [\x1B[1;31mTIMEOUT\x1B[0m]", reqid);
+    }
+    cli->pipe_left++;
+    cli->req_left--;
+    if (cli->req_left <= 0)
+    {
+        cli_end(cli);
+    }
+}
+
+static int cli_on_tick(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_client *cli = ud;
+    int n = tw_advance(cli->wheel, now_ns() / 1000000, cli_on_req_timeout, cli);
+    // 已结束 (cli_end 删除了本定时器)
+    if (cli->tick_timerid == AE_NOMORE)
+    {
+        return AE_NOMORE;
+    }
+    if (n > 0 && cli->connected)
+    {
+        if (cli->rate > 0)
+        {
+            cli_rate_send(cli);
+        }
+        else
+        {
+            cli_pipe_send(cli);
+        }
+    }
+    return CLI_TICK_MS;
+}
+
+static void cli_start(struct dubbo_client *cli)
+{
+    cli->run = true;
+    cli->tick_timerid = aeCreateTimeEvent(cli->el, CLI_TICK_MS, cli_on_tick, cli, NULL);
+    if (AE_ERR == cli->tick_timerid)
+    {
+        PANIC("创建定时器失败");
+    }
+    if (cli->rate > 0)
+    {
+        cli_rate_start(cli);
+    }
+    if (!cli_connect(cli))
+    {
+        LOG_ERROR("连接失败");
+        cli_end(cli);
+    }
+}
+
+// 爬坡期间延迟启动的连接
+static int cli_on_start(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_client *cli = ud;
+    cli->timerid = AE_NOMORE;
+    cli_start(cli);
+    return AE_NOMORE;
+}
+
+// 时长已到: 结束本线程的连接, 丢弃在途请求, 尚未启动的不再启动
+static int bench_thread_tick(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct bench_thread *t = ud;
+    struct dubbo_bench *bench = t->bench;
+    if (!__atomic_load_n(&bench->stop, __ATOMIC_ACQUIRE))
+    {
+        return 10;
+    }
+    int i;
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        struct dubbo_client *cli = bench->clis[i];
+        if (cli->thread != t)
+        {
+            continue;
+        }
+        if (cli->run)
+        {
+            cli_end(cli);
+        }
+        else if (cli->timerid != AE_NOMORE)
+        {
+            cli_clear_timer(cli);
+            if (--t->alive_n == 0)
+            {
+                aeStop(t->el);
+            }
+        }
+    }
+    return AE_NOMORE;
+}
 
-        double elapsed_sec = ((double)cli->end.tv_sec + 1.0e-6 * cli->end.tv_usec) -
-                             ((double)cli->start.tv_sec + 1.0e-6 * cli->start.tv_usec);
-        int reqs = cli->req_n - cli->req_left;
-        double qps = elapsed_sec < 0.001 ? 0 : reqs / elapsed_sec;
-        fprintf(stderr, "\x1B[1;32m[SUMMARY]\x1B[0m COST %.2fs, REQ %d, SUCC %d, FAIL %d, QPS %.f\n", elapsed_sec, reqs, cli->ok_n, cli->ko_n, qps);
+static void *bench_thread_main(void *ud)
+{
+    struct bench_thread *t = ud;
+    struct dubbo_bench *bench = t->bench;
+    if (AE_ERR == aeCreateTimeEvent(t->el, 10, bench_thread_tick, t, NULL))
+    {
+        PANIC("创建定时器失败");
+    }
 
-        cli_release(cli);
+    // 爬坡: 第 i 个连接在 i * rampup / conn_n 之后启动
+    int i;
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        struct dubbo_client *cli = bench->clis[i];
+        if (cli->thread != t)
+        {
+            continue;
+        }
+        long long delay_ms = (long long)bench->rampup_sec * 1000 * i / bench->conn_n;
+        if (delay_ms == 0)
+        {
+            cli_start(cli);
+        }
+        else
+        {
+            cli->timerid = aeCreateTimeEvent(t->el, delay_ms, cli_on_start, cli, NULL);
+            if (AE_ERR == cli->timerid)
+            {
+                PANIC("创建定时器失败");
+            }
+        }
     }
+    if (t->alive_n > 0)
+    {
+        aeMain(t->el);
+    }
+    __atomic_sub_fetch(&bench->alive_thread_n, 1, __ATOMIC_RELEASE);
+    return NULL;
 }
 
 static void cli_reconnect(struct dubbo_client *cli)
@@ -331,30 +885,88 @@ static bool cli_write(struct dubbo_client *cli)
     return true;
 }
 
-static void cli_send_req(struct dubbo_client *cli)
+// 从负载中选一个预编码的帧复制到 snd_buf 并改写 reqid, 不重新编码
+// deadline_ms 从实际发送时间算起, 与 sent_ns (定速模式为计划时间) 无关
+static void cli_append_req(struct dubbo_client *cli, int64_t sent_ns, int64_t deadline_ms)
 {
-    struct buffer *buf = cli_encode_req(cli);
-    if (buf == NULL)
+    const char *tpl;
+    size_t sz;
+    dubbo_workload_pick(cli->wl, cli_rand(cli), &tpl, &sz);
+    int64_t reqid = dubbo_next_reqid();
+    inflight_put(&cli->inflight, reqid, sent_ns);
+    tw_add(cli->wheel, reqid, deadline_ms);
+    buf_ensureWritable(cli->snd_buf, sz);
+    char *frame = buf_beginWrite(cli->snd_buf);
+    memcpy(frame, tpl, sz);
+    dubbo_set_reqid(frame, reqid);
+    buf_has_written(cli->snd_buf, sz);
+    if (cli->verbos)
     {
-        PANIC("Dubbo 请求失败: 编码失败");
-        return;
+        log_info("<req>[seq=%" PRId64 "]", reqid);
     }
+}
 
-    buf_append(cli->snd_buf, buf_peek(buf), buf_readable(buf));
-    buf_release(buf);
+// 补满 pipeline 后一次写出
+static void cli_pipe_send(struct dubbo_client *cli)
+{
+    if (cli->pipe_left <= 0)
+    {
+        return;
+    }
+    // 同一批一起写出, 共用一个发送时间
+    int64_t sent_ns = now_ns();
+    int64_t deadline_ms = sent_ns / 1000000 + cli->timeout_ms;
+    while (cli->pipe_left > 0 && cli->sent_n < cli->req_n)
+    {
+        cli_append_req(cli, sent_ns, deadline_ms);
+        cli->pipe_left--;
+        cli->sent_n++;
+    }
     if (!cli_write(cli))
     {
         cli_reconnect(cli);
     }
 }
 
-static void cli_pipe_send(struct dubbo_client *cli)
+// 下一个请求与上一个的计划间隔
+static int64_t cli_next_gap(struct dubbo_client *cli)
 {
-    while (cli->pipe_left--)
+    double gap = 1e9 / cli->rate;
+    if (cli->poisson)
     {
-        cli_send_req(cli);
+        double u = (cli_rand(cli) >> 11) * (1.0 / 9007199254740992.0); // [0, 1)
+        gap *= -log(1 - u);
+    }
+    return (int64_t)gap;
+}
+
+// 定速模式: 发出计划时间已到的请求, 延迟从计划时间算起 (修正 coordinated omission)
+// -c 限制在途请求数时, 到期而未能发出的请求等待空位, 等待时间同样计入延迟
+static void cli_rate_send(struct dubbo_client *cli)
+{
+    if (!cli->connected)
+    {
+        return;
+    }
+    int64_t now = now_ns();
+    int64_t deadline_ms = now / 1000000 + cli->timeout_ms;
+    int n = 0;
+    while (cli->next_ns <= now && cli->sent_n < cli->req_n &&
+           (cli->pipe_n == 0 || cli->inflight.n < (uint32_t)cli->pipe_n))
+    {
+        if (now - cli->next_ns > cli->lag_max_ns)
+        {
+            cli->lag_max_ns = now - cli->next_ns;
+        }
+        cli_append_req(cli, cli->next_ns, deadline_ms);
+        cli->next_ns += cli_next_gap(cli);
+        cli->sent_n++;
+        n++;
+    }
+    if (n > 0 && !cli_write(cli))
+    {
+        cli_reconnect(cli);
     }
-    cli->pipe_left++;
 }
 
 static void cli_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask)
@@ -426,45 +1038,74 @@ static void cli_on_read(struct aeEventLoop *el, int fd, void *ud, int mask)
         break;
     }
 
-    if (!is_dubbo_pkt(cli->rcv_buf))
-    {
-        LOG_ERROR("接收到非 dubbo 数据包");
-        cli_reconnect(cli);
-    }
+    cli->read_n++;
+    cli->recv_ns = now_ns();
 
-    if (!is_completed_dubbo_pkt(cli->rcv_buf, NULL))
+    // 一次读到的所有完整帧都处理掉, 最后统一补满 pipeline
+    int frames = 0;
+    bool ok = true;
+    for (;;)
     {
-        return;
-    }
+        int len = dubbo_frame_len(cli->rcv_buf);
+        if (len == 0)
+        {
+            break;
+        }
+        if (len < 0)
+        {
+            LOG_ERROR("接收到非 dubbo 数据包");
+            ok = false;
+            break;
+        }
 
-    cli->pipe_left++;
-    cli->req_left--;
+        bool done;
+        if (!cli_decode_resp(cli, &done))
+        {
+            ok = false;
+            break;
+        }
+        // 心跳等事件与超时之后迟到的响应不占 pipeline, 不计入请求
+        if (!done)
+        {
+            continue;
+        }
+        frames++;
+        cli->frame_n++;
+        cli->pipe_left++;
+        cli->req_left--;
 
-    if (((cli->req_n - cli->req_left) % 1000) == 0)
-    {
-        fprintf(stderr, "已发送请求 %d\n", cli->req_n - cli->req_left);
+        if (cli->req_left <= 0)
+        {
+            cli_end(cli);
+            return;
+        }
     }
 
-    bool ok = cli_decode_resp(cli);
-
-    if (cli->req_left <= 0)
+    if (!ok)
     {
-        cli_end(cli);
+        cli_reconnect(cli);
+        return;
     }
-    else
+    if (frames > 0)
     {
-        if (ok)
+        if (cli->rate > 0)
         {
-            cli_pipe_send(cli);
+            cli_rate_send(cli);
         }
         else
         {
-            cli_reconnect(cli);
+            cli_pipe_send(cli);
         }
     }
+    // 心跳回复追加在 snd_buf, 本次没有补发请求 (或定速模式未到发送时间) 时也要写出
+    if (cli->connected && buf_readable(cli->snd_buf) && !cli_write(cli))
+    {
+        cli_reconnect(cli);
+    }
 }
 
-static bool cli_decode_resp(struct dubbo_client *cli)
+// 解码一个响应帧, 对应在途请求时 done 为 true
+static bool cli_decode_resp(struct dubbo_client *cli, bool *done)
 {
     struct buffer *buf = cli->rcv_buf;
     struct dubbo_res *res = dubbo_decode(buf);
@@ -473,58 +1114,53 @@ static bool cli_decode_resp(struct dubbo_client *cli)
         return false;
     }
 
-    if (res->ok)
+    *done = false;
+    if (res->is_evt)
     {
-        cli->ok_n++;
+        // provider 的心跳请求须回复, 随下一批请求一起写出
+        if (res->is_req)
+        {
+            struct buffer *reply = dubbo_encode_heartbeat_res(res->reqid);
+            buf_append(cli->snd_buf, buf_peek(reply), buf_readable(reply));
+            buf_release(reply);
+        }
+        if (cli->verbos)
+        {
+            log_info("<res seq=%" PRId64 "> [EVT]", res->reqid);
+        }
+        dubbo_res_release(res);
+        return true;
     }
-    else
+
+    int64_t sent_ns;
+    if (!inflight_take(&cli->inflight, res->reqid, &sent_ns))
     {
-        cli->ok_n++;
+        if (cli->verbos)
+        {
+            log_info("<res seq=%" PRId64 "> [LATE]", res->reqid);
+        }
+        dubbo_res_release(res);
+        return true;
     }
+    *done = true;
+    tw_del(cli->wheel, res->reqid);
+
+    struct dubbo_bench *bench = cli->thread->bench;
+    __atomic_fetch_add(res->ok ? &bench->ok_n : &bench->ko_n, 1, __ATOMIC_RELAXED);
+    hdr_record(bench->live, (cli->recv_ns - sent_ns) / 1000);
 
+    // 压测中只把原始返回交给异步日志, 不在事件循环里解析/格式化 json
     if (cli->verbos)
     {
-        if (res->is_evt)
+        int data_sz = res->data_sz ? (int)res->data_sz : 4;
+        const char *data = res->data_sz ? res->data : "NULL";
+        if (res->ok)
         {
-            printf("<res seq=%" PRId64 "> [EVT]", res->reqid);
-        }
-        else if (res->data_sz)
-        {
-            // 返回 json, 不应该有 NULL 存在, 且非 NULL 结尾
-            char *json = malloc(res->data_sz + 1);
-            assert(json);
-            memcpy(json, res->data, res->data_sz);
-            json[res->data_sz] = '\0';
-
-            cJSON *resp = NULL;
-            if ((json[0] == '[' || json[0] == '{') && (resp = cJSON_Parse(json)))
-            {
-                if (res->ok)
-                {
-                    printf("<res seq=%" PRId64 "> [\x1B[1;32mSUCC\x1B[0m] %s\n", res->reqid, cJSON_Print(resp));
-                }
-                else
-                {
-                    printf("<res seq=%" PRId64 "> [\x1B[1;31mFAIL\x1B[0m] [\x1B[1;31m%s\x1B[0m] %s\n", res->reqid, res->desc, cJSON_Print(resp));
-                }
-                cJSON_Delete(resp);
-            }
-            else
-            {
-                if (res->ok)
-                {
-                    printf("<res seq=%" PRId64 "> [\x1B[1;32mSUCC\x1B[0m] %s\n", res->reqid, json);
-                }
-                else
-                {
-                    printf("<res seq=%" PRId64 "> [\x1B[1;31mFAIL\x1B[0m] %s\n", res->reqid, json);
-                }
-            }
-            free(json);
+            log_info("<res seq=%" PRId64 "> [\x1B[1;32mSUCC\x1B[0m] %.*s", res->reqid, data_sz, data);
         }
-        else if (res->data_sz == 0)
+        else
         {
-            printf("<res seq=%" PRId64 "> [\x1B[1;32mSUCC\x1B[0m] NULL\n", res->reqid);
+            log_info("<res seq=%" PRId64 "> [\x1B[1;31mFAIL\x1B[0m] [\x1B[1;31m%s\x1B[0m] %.*s", res->reqid, res->desc, data_sz, data);
         }
     }
 
@@ -534,19 +1170,140 @@ static bool cli_decode_resp(struct dubbo_client *cli)
 
 bool dubbo_bench_async(struct dubbo_args *args, struct dubbo_async_args *async_args)
 {
-    struct dubbo_client *cli = cli_create(args, async_args);
-    if (cli == NULL)
+    struct dubbo_workload *wl = async_args->workload ? dubbo_workload_load(async_args->workload) : dubbo_workload_single(args);
+    if (wl == NULL)
     {
+        LOG_ERROR("Dubbo 请求编码失败");
         return false;
     }
-    return cli_start(cli);
+
+    FILE *series = NULL;
+    if (async_args->series)
+    {
+        series = fopen(async_args->series, "w");
+        if (series == NULL)
+        {
+            LOG_ERROR("打开 %s 失败: %s", async_args->series, strerror(errno));
+            dubbo_workload_release(wl);
+            return false;
+        }
+        fprintf(series, "second,phase,succ,fail,qps,p50_ms,p90_ms,p99_ms,max_ms\n");
+    }
+
+    struct dubbo_bench *bench = calloc(1, sizeof(*bench));
+    assert(bench);
+    bench->args = args;
+    bench->wl = wl;
+    bench->series = series;
+    // 按时长运行时不限请求数
+    bench->req_n = async_args->req_n > 0 ? async_args->req_n : INT_MAX;
+    bench->conn_n = async_args->conn_n > 0 ? async_args->conn_n : 1;
+    if (bench->conn_n > bench->req_n)
+    {
+        bench->conn_n = bench->req_n;
+    }
+    bench->thread_n = async_args->thread_n > 0 ? async_args->thread_n : 1;
+    if (bench->thread_n > bench->conn_n)
+    {
+        bench->thread_n = bench->conn_n;
+    }
+    bench->alive_thread_n = bench->thread_n;
+    bench->live = hdr_create(BENCH_LATENCY_MAX_US, BENCH_LATENCY_SIGFIGS);
+    bench->tick = hdr_create(BENCH_LATENCY_MAX_US, BENCH_LATENCY_SIGFIGS);
+    bench->interval = hdr_create(BENCH_LATENCY_MAX_US, BENCH_LATENCY_SIGFIGS);
+    bench->total = hdr_create(BENCH_LATENCY_MAX_US, BENCH_LATENCY_SIGFIGS);
+    bench->interval_sec = async_args->interval_sec;
+    bench->duration_sec = async_args->duration_sec;
+    bench->warmup_sec = async_args->warmup_sec;
+    bench->rampup_sec = async_args->rampup_sec;
+    bench->warm = bench->warmup_sec > 0;
+    bench->hgrm = async_args->hgrm;
+    bench->rate = async_args->rate;
+
+    int i;
+    bench->threads = calloc(bench->thread_n, sizeof(struct bench_thread));
+    assert(bench->threads);
+    for (i = 0; i < bench->thread_n; i++)
+    {
+        struct bench_thread *t = &bench->threads[i];
+        t->bench = bench;
+        // setsize 是能登记的最大 fd 而非连接数, fd 在所有线程间共用编号, 每个事件循环都按全部连接留足
+        t->el = aeCreateEventLoop(bench->conn_n + 1024);
+        assert(t->el);
+    }
+
+    // 连接轮流分配到各线程, 请求数均分
+    bench->clis = calloc(bench->conn_n, sizeof(struct dubbo_client *));
+    assert(bench->clis);
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        struct bench_thread *t = &bench->threads[i % bench->thread_n];
+        int req_n = bench->req_n / bench->conn_n + (i < bench->req_n % bench->conn_n);
+        bench->clis[i] = cli_create(bench, t, req_n, async_args);
+        t->cli_n++;
+        t->alive_n++;
+    }
+
+    g_bench = bench;
+    atexit(exit_handler);
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+    gettimeofday(&bench->start, NULL);
+    bench->tick_ns = now_ns();
+    bench->run = true;
+
+    for (i = 0; i < bench->thread_n; i++)
+    {
+        if (pthread_create(&bench->threads[i].tid, NULL, bench_thread_main, &bench->threads[i]) != 0)
+        {
+            PANIC("创建线程失败");
+        }
+    }
+    bench_sample_loop(bench);
+    for (i = 0; i < bench->thread_n; i++)
+    {
+        pthread_join(bench->threads[i].tid, NULL);
+    }
+
+    // 按时长结束的视为完成
+    bool ok = true;
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        ok = ok && (bench->stop || bench->clis[i]->req_left <= 0);
+    }
+    if (bench->run)
+    {
+        bench->run = false;
+        gettimeofday(&bench->end, NULL);
+        bench_flush(bench);
+        bench_summary(bench);
+    }
+
+    g_bench = NULL;
+    for (i = 0; i < bench->conn_n; i++)
+    {
+        cli_release(bench->clis[i]);
+    }
+    for (i = 0; i < bench->thread_n; i++)
+    {
+        aeDeleteEventLoop(bench->threads[i].el);
+    }
+    free(bench->clis);
+    free(bench->threads);
+    hdr_release(bench->live);
+    hdr_release(bench->tick);
+    hdr_release(bench->interval);
+    hdr_release(bench->total);
+    dubbo_workload_release(bench->wl);
+    free(bench);
+    return ok;
 }
 
 bool dubbo_invoke_sync(struct dubbo_args *args)
 {
     bool ret = false;
 
-    struct dubbo_req *req = dubbo_req_create(args->service, args->method, args->args, args->attach);
+    struct dubbo_req *req = dubbo_req_create(args->service, args->method, args->types, args->args, args->attach);
     if (req == NULL)
     {
         return false;
@@ -580,8 +1337,9 @@ bool dubbo_invoke_sync(struct dubbo_args *args)
     // reset buffer
     buf_retrieveAll(buf);
 
-    int errno_ = 0;
-    for (;;)
+    // 读到一个完整帧为止
+    int errno_ = 0, len;
+    while ((len = dubbo_frame_len(buf)) == 0)
     {
         ssize_t recv_n = buf_readFd(buf, sockfd, &errno_);
         if (recv_n < 0)
@@ -590,43 +1348,21 @@ bool dubbo_invoke_sync(struct dubbo_args *args)
             {
                 continue;
             }
-            else
-            {
-                perror("ERROR readv");
-                goto release;
-            }
+            perror("ERROR receiving");
+            goto release;
         }
-        else if (!is_dubbo_pkt(buf))
+        else if (recv_n == 0)
         {
+            LOG_ERROR("Dubbo 服务端断开连接");
             goto release;
         }
-        break;
     }
-
-    int remaining = 0;
-    if (!is_completed_dubbo_pkt(buf, &remaining))
+    if (len < 0)
     {
+        LOG_ERROR("接收到非 dubbo 数据包");
         goto release;
     }
 
-    while (remaining < 0)
-    {
-        ssize_t recv_n = buf_readFd(buf, sockfd, &errno_);
-        if (recv_n < 0)
-        {
-            if (errno_ == EINTR)
-            {
-                continue;
-            }
-            else
-            {
-                perror("ERROR receiving");
-                goto release;
-            }
-        }
-        remaining += recv_n;
-    }
-
     {
         struct dubbo_res *res = dubbo_decode(buf);
         if (res == NULL)
@@ -649,15 +1385,20 @@ bool dubbo_invoke_sync(struct dubbo_args *args)
             cJSON *resp = NULL;
             if ((json[0] == '[' || json[0] == '{') && (resp = cJSON_Parse(json)))
             {
+                struct buffer *out = buf_create(res->data_sz * 2);
+                struct jsonw *jw = jw_create(out, JW_PRETTY);
+                jw_cjson(jw, resp);
+                jw_release(jw);
                 if (res->ok)
                 {
-                    printf("\x1B[1;32m%s\x1B[0m\n", cJSON_Print(resp));
+                    printf("\x1B[1;32m%.*s\x1B[0m\n", (int)buf_readable(out), buf_peek(out));
                 }
                 else
                 {
                     printf("\x1B[1;31m%s\x1B[0m\n", res->desc);
-                    printf("\x1B[1;31m%s\x1B[0m\n", cJSON_Print(resp));
+                    printf("\x1B[1;31m%.*s\x1B[0m\n", (int)buf_readable(out), buf_peek(out));
                 }
+                buf_release(out);
                 cJSON_Delete(resp);
             }
             else
@@ -677,12 +1418,14 @@ bool dubbo_invoke_sync(struct dubbo_args *args)
         {
             printf("\x1B[1;32m%s\x1B[0m\n", "NULL");
         }
+        if (res->attach)
+        {
+            printf("attachments: %.*s\n", (int)res->attach_sz, res->attach);
+        }
 
         dubbo_res_release(res);
     }
 
-// fimxe print attach
-
 release:
     dubbo_req_release(req);
     buf_release(buf);
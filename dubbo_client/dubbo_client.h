@@ -10,6 +10,7 @@ struct dubbo_args
     char *port;
     char *service;
     char *method;
+    char *types;  /* 逗号分隔的 java 参数类型, NULL 为泛化调用 */
     char *args;   /* JSON */
     char *attach; /* JSON */
     struct timeval timeout;
@@ -17,13 +18,24 @@ struct dubbo_args
 
 struct dubbo_async_args
 {
-    struct aeEventLoop *el;
-    int pipe_n;
-    int req_n;
+    int pipe_n;           // 每个连接的 pipeline 深度
+    int req_n;            // 总请求数, 均分到各连接, 0 为不限 (按时长结束)
+    int conn_n;           // 连接数
+    int thread_n;         // 事件循环线程数, 连接轮流分配
+    int interval_sec;     // 大于 0 时每隔 interval_sec 秒输出区间延迟
+    int duration_sec;     // 大于 0 时预热之后再运行 duration_sec 秒结束
+    int warmup_sec;       // 预热秒数, 其间的响应不计入统计
+    int rampup_sec;       // 连接在 rampup_sec 秒内依次启动
+    const char *hgrm;     // 非 NULL 时结束后把延迟分布 (.hgrm) 写入该文件
+    const char *series;   // 非 NULL 时把每秒的吞吐/错误/延迟写入该 CSV 文件
+    const char *workload; // 非 NULL 时按该负载文件混合调用, 忽略 dubbo_args 中的调用 (见 dubbo_workload.h)
+    double rate;          // 大于 0 时按该总 QPS 定速发送 (开环), pipe_n 为在途上限, 0 不限
+    bool poisson;         // 定速模式下泊松到达, 否则均匀间隔
     bool verbos;
 };
 
 bool dubbo_invoke_sync(struct dubbo_args *);
+// 阻塞到所有请求完成, 输出汇总统计
 bool dubbo_bench_async(struct dubbo_args *, struct dubbo_async_args *);
 
 #endif
\ No newline at end of file
@@ -8,12 +8,13 @@
 #include "endian.h"
 #include "buffer.h"
 #include "cJSON.h"
+#include "intern.h"
 #include "dbg.h"
 
 #include "dubbo_codec.h"
 #include "dubbo_hessian.h"
+#include "dubbo_transcode.h"
 
-#define DUBBO_BUF_LEN 8192
 #define DUBBO_MAX_PKT_SZ (1024 * 1024 * 4)
 #define DUBBO_HDR_LEN 16
 #define DUBBO_MAGIC 0xdabb
@@ -35,12 +36,10 @@ public interface GenericService {
 #define DUBBO_GENERIC_METHOD_NAME "$invokeWithJsonArgs"
 #define DUBBO_GENERIC_METHOD_VER "0.0.0"
 #define DUBBO_GENERIC_METHOD_PARA_TYPES "Ljava/lang/String;[Ljava/lang/String;Ljava/lang/String;"
-#define DUBBO_GENERIC_METHOD_ARGC 3
-#define DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX 0
-#define DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX 1
-#define DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX 2
 
 #define DUBBO_HESSIAN2_SERI_ID 2
+// 心跳事件的数据: hessian null
+#define DUBBO_HEARTBEAT_DATA "N"
 
 #define DUBBO_FLAG_REQ 0x80
 #define DUBBO_FLAG_TWOWAY 0x40
@@ -48,6 +47,9 @@ public interface GenericService {
 
 #define DUBBO_SERI_MASK 0x1f
 
+// 响应体第一个值, 3 4 5 为 dubbo 2.6.3 之后带 attachments 的形式
+#define DUBBO_RES_FLAG_WITH_ATTACH 3
+
 #define DUBBO_RES_T_OK 20
 #define DUBBO_RES_T_CLIENT_TIMEOUT 30
 #define DUBBO_RES_T_SERVER_TIMEOUT 31
@@ -64,11 +66,13 @@ struct dubbo_req
     bool is_twoway;
     bool is_evt;
 
-    char *service; // java string -> hessian string
-    char *method;  // java string -> hessian string
-    char **argv;   // java string[] -> hessian string[]
-    int argc;
-    char *attach; // java map<string, string> -> hessian map<string, string>
+    const char *service; // java string -> hessian string, 驻留
+    const char *method;  // java string -> hessian string, 驻留
+    // 泛化调用: $invokeWithJsonArgs(method, null, jsonArgs), args 为已编码的三个参数
+    // 按类型调用 (-T): 直接调用 method, desc 为参数的 JVM 描述符, args 为按类型编码的参数
+    char *desc;
+    struct buffer *args;
+    struct buffer *attach; // java map<string, string>, 已编码为 hessian map
 
     // for evt
     char *data;
@@ -83,7 +87,7 @@ struct dubbo_hdr
     int64_t reqid;
 };
 
-static char *get_res_status_desc(int8_t status)
+static const char *get_res_status_desc(int8_t status)
 {
     switch (status)
     {
@@ -110,42 +114,12 @@ static char *get_res_status_desc(int8_t status)
     }
 }
 
-static int64_t next_reqid()
-{
-    static int64_t id = 0;
-    if (++id == 0x7fffffffffffffff)
-    {
-        id = 1;
-    }
-    return id;
-}
-
-static char *rebuild_json_args(const char *json_str)
+int64_t dubbo_next_reqid()
 {
-    cJSON *root = cJSON_Parse(json_str);
-    if (root == NULL)
-    {
-        return NULL;
-    }
-    if (!cJSON_IsArray(root) && !cJSON_IsObject(root))
-    {
-        cJSON_Delete(root);
-        return NULL;
-    }
-
-    cJSON *arr = cJSON_CreateArray();
-    cJSON *el;
-    cJSON_ArrayForEach(el, root)
-    {
-        cJSON_AddItemToArray(arr, cJSON_Duplicate(el, true));
-    }
-    cJSON_Delete(root);
-
-    // fixme 消除内存 copy
-    char *utf8_json = cJSON_PrintUnformatted(arr);
-    char *ascii_s = utf82ascii(utf8_json);
-    free(utf8_json);
-    return ascii_s;
+    // 多线程压测共用, 原子自增, 回绕后跳过 0
+    static uint64_t id = 0;
+    int64_t r = (int64_t)(__atomic_add_fetch(&id, 1, __ATOMIC_RELAXED) & 0x7fffffffffffffff);
+    return r ? r : dubbo_next_reqid();
 }
 
 // fixme
@@ -187,6 +161,11 @@ static bool decode_res_hdr(struct buffer *buf, struct dubbo_hdr *hdr)
         LOG_ERROR("too big dubbo pkt body size: %d", hdr->body_sz);
         return false;
     }
+    if (hdr->body_sz < 0 || (size_t)hdr->body_sz > buf_readable(buf))
+    {
+        LOG_ERROR("incomplete dubbo pkt body, size %d, readable %zu", hdr->body_sz, buf_readable(buf));
+        return false;
+    }
 
     int8_t seria_id = hdr->flag & DUBBO_SERI_MASK;
     if (seria_id != DUBBO_HESSIAN2_SERI_ID)
@@ -200,6 +179,11 @@ static bool decode_res_hdr(struct buffer *buf, struct dubbo_hdr *hdr)
         // decode response
         return true;
     }
+    else if (hdr->flag & DUBBO_FLAG_EVT)
+    {
+        // provider 发来的心跳请求
+        return true;
+    }
     else
     {
         // decode request
@@ -208,42 +192,102 @@ static bool decode_res_hdr(struct buffer *buf, struct dubbo_hdr *hdr)
     }
 }
 
-#define write_hs_str(buf, s)                                             \
-    {                                                                    \
-        int n = hs_encode_string((s), (uint8_t *)buf_beginWrite((buf))); \
-        if (n == -1)                                                     \
-        {                                                                \
-            return false;                                                \
-        }                                                                \
-        buf_has_written(buf, n);                                         \
+// 请求体中的字符串字段, 按顺序
+static int req_strs(const struct dubbo_req *req, const char *strs[5])
+{
+    strs[0] = DUBBO_VER;
+    strs[1] = req->service;
+    strs[2] = DUBBO_GENERIC_METHOD_VER;
+    strs[3] = req->desc ? req->method : DUBBO_GENERIC_METHOD_NAME;
+    strs[4] = req->desc ? req->desc : DUBBO_GENERIC_METHOD_PARA_TYPES;
+    return 5;
+}
+
+// 编码后的请求体字节数, 用于一次分配
+static size_t req_body_size(const struct dubbo_req *req)
+{
+    const char *strs[5];
+    int n = req_strs(req, strs), i;
+    size_t sz = buf_readable(req->args) + buf_readable(req->attach);
+    for (i = 0; i < n; i++)
+    {
+        size_t len = strlen(strs[i]);
+        sz += hs_string_size(strs[i], len);
     }
+    return sz;
+}
 
 static bool encode_req_data(struct buffer *buf, const struct dubbo_req *req)
 {
-    write_hs_str(buf, DUBBO_VER);
-    write_hs_str(buf, req->service);
-    write_hs_str(buf, DUBBO_GENERIC_METHOD_VER);
-    write_hs_str(buf, DUBBO_GENERIC_METHOD_NAME);
-    write_hs_str(buf, DUBBO_GENERIC_METHOD_PARA_TYPES);
-
-    // args
-    write_hs_str(buf, req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX]);
-    buf_has_written(buf, hs_encode_null((uint8_t *)buf_beginWrite(buf))); // 方法类型提示 NULL, 不支持重载方法
-    write_hs_str(buf, req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX]);
-
-    // fixme :  attach NULL
-    buf_has_written(buf, hs_encode_null((uint8_t *)buf_beginWrite(buf)));
+    const char *strs[5];
+    int n = req_strs(req, strs), i;
+    for (i = 0; i < n; i++)
+    {
+        if (!hs_buf_write_string(buf, strs[i], strlen(strs[i])))
+        {
+            return false;
+        }
+    }
+    buf_append(buf, buf_peek(req->args), buf_readable(req->args));
+    buf_append(buf, buf_peek(req->attach), buf_readable(req->attach));
+    return true;
+}
 
+// 不复制, 单 chunk 时指向 buf 内部
+#define read_hs_str(buf, res)                                                                                     \
+    {                                                                                                             \
+        size_t consumed;                                                                                          \
+        if (!hs_decode_string_view((uint8_t *)buf_peek((buf)), buf_readable((buf)), &(res)->data, &(res)->data_sz, \
+                                   &consumed, &(res)->owned))                                                     \
+        {                                                                                                         \
+            LOG_ERROR("failed to decode hessian string");                                                         \
+            return false;                                                                                         \
+        }                                                                                                         \
+        buf_retrieve(buf, consumed);                                                                              \
+    }
+
+// 非字符串的返回值 (按类型调用) 与异常对象转为 JSON
+static bool read_hs_json(struct hs_reader *r, char **json, size_t *json_sz)
+{
+    struct buffer *out = buf_create(256);
+    struct jsonw *jw = jw_create(out, 0);
+    bool ok = hs_to_json(r, jw) && jw_ok(jw);
+    jw_release(jw);
+    if (!ok)
+    {
+        LOG_ERROR("failed to decode hessian value: %s", hs_reader_error(r));
+        buf_release(out);
+        return false;
+    }
+    *json_sz = buf_readable(out);
+    *json = buf_dupStr(out, *json_sz);
+    assert(*json);
+    buf_release(out);
     return true;
 }
 
-#define read_hs_str(buf, out, out_sz)                                                        \
-    if (!hs_decode_string((uint8_t *)buf_peek((buf)), buf_readable((buf)), (out), (out_sz))) \
-    {                                                                                        \
-        LOG_ERROR("failed to decode hessian string");                                        \
-        return false;                                                                        \
-    }                                                                                        \
-    buf_retrieve(buf, *(out_sz));
+static bool decode_res_value(struct buffer *buf, struct hs_reader *r, struct dubbo_res *res)
+{
+    if (buf_readable(buf) == 0)
+    {
+        LOG_ERROR("missing response value");
+        return false;
+    }
+    uint8_t code = (uint8_t)buf_peek(buf)[0];
+    if (code <= 0x1f || (code >= 0x30 && code <= 0x33) || code == 'S' || code == 'R')
+    {
+        read_hs_str(buf, res);
+        return true;
+    }
+    char *json;
+    if (!read_hs_json(r, &json, &res->data_sz))
+    {
+        return false;
+    }
+    res->data = json;
+    res->owned = true;
+    return true;
+}
 
 static bool decode_res_data(struct buffer *buf, const struct dubbo_hdr *hdr, struct dubbo_res *res)
 {
@@ -256,34 +300,42 @@ static bool decode_res_data(struct buffer *buf, const struct dubbo_hdr *hdr, str
     }
     flag -= 0x90;
 
+    bool with_attach = flag >= DUBBO_RES_FLAG_WITH_ATTACH;
+    if (with_attach)
+    {
+        flag -= DUBBO_RES_FLAG_WITH_ATTACH;
+    }
+
+    struct hs_reader *r = hs_reader_create(buf);
+    bool ok = true;
     switch (flag)
     {
     case DUBBO_RES_NULL:
         break;
     case DUBBO_RES_EX:
-        read_hs_str(buf, &res->data, &res->data_sz);
-        break;
     case DUBBO_RES_VAL:
-        read_hs_str(buf, &res->data, &res->data_sz);
+        ok = decode_res_value(buf, r, res);
         break;
     default:
-        LOG_ERROR("unknown result flag, expect '0' '1' '2', get %d", res->type);
-        return false;
+        LOG_ERROR("unknown result flag, expect 0 - 5, get %d", flag + (with_attach ? DUBBO_RES_FLAG_WITH_ATTACH : 0));
+        ok = false;
+        break;
+    }
+    if (ok && with_attach)
+    {
+        ok = read_hs_json(r, &res->attach, &res->attach_sz);
     }
+    hs_reader_release(r);
 
     res->type = flag;
-    return true;
+    return ok;
 }
 
 void dubbo_res_release(struct dubbo_res *res)
 {
-    if (res->desc)
-    {
-        free(res->desc);
-    }
-    if (res->data)
+    if (res->owned)
     {
-        free(res->data);
+        free((char *)res->data);
     }
     if (res->attach)
     {
@@ -335,78 +387,118 @@ static bool encode_req(struct buffer *buf, const struct dubbo_req *req)
 static bool decode_res(struct buffer *buf, const struct dubbo_hdr *hdr, struct dubbo_res *res)
 {
     res->is_evt = hdr->flag & DUBBO_FLAG_EVT;
-    res->desc = strdup(get_res_status_desc(hdr->status));
+    res->is_req = hdr->flag & DUBBO_FLAG_REQ;
+    res->desc = get_res_status_desc(hdr->status);
+
+    if (res->is_evt)
+    {
+        // 心跳的数据为 hessian null, 只读事件为字符串 "R", 都不需要解析; 请求没有状态
+        res->ok = res->is_req || hdr->status == DUBBO_RES_T_OK;
+        return true;
+    }
 
     if (hdr->status == DUBBO_RES_T_OK)
     {
         res->ok = true;
-        if (res->is_evt)
+        if (!decode_res_data(buf, hdr, res))
         {
-            // decode evt
-        }
-        else
-        {
-            if (!decode_res_data(buf, hdr, res))
-            {
-                LOG_ERROR("failed to decode response data");
-                return false;
-            }
+            LOG_ERROR("failed to decode response data");
+            return false;
         }
     }
     else
     {
         res->ok = false;
-        read_hs_str(buf, &res->data, &res->data_sz);
+        read_hs_str(buf, res);
     }
 
-    // fixme read attach
-
     return true;
 }
 
-struct dubbo_req *dubbo_req_create(const char *service, const char *method, const char *json_args, const char *json_attach)
+struct dubbo_req *dubbo_req_create(const char *service, const char *method, const char *types, const char *json_args, const char *json_attach)
 {
     struct dubbo_req *req = calloc(1, sizeof(*req));
     assert(req);
-    req->reqid = next_reqid();
+    req->reqid = dubbo_next_reqid();
     req->is_twoway = true;
     req->is_evt = false;
-    req->service = strdup(service);
-    req->method = strdup(method);
+    req->service = intern_cstr(service);
+    req->method = intern_cstr(method);
 
-    char *args = rebuild_json_args(json_args);
-    if (args == NULL)
+    size_t args_sz = strlen(json_args);
+    // 泛化调用的 jsonArgs 为 ASCII 时编码后不超过此大小 (每 0x8000 字节一个 chunk 头)
+    req->args = buf_create_ex(args_sz + args_sz / 0x8000 * 3 + 64, 0);
+    if (types)
     {
-        LOG_ERROR("invalid json args %s", json_args);
-        return NULL;
+        const char *err = NULL;
+        if (!json2hs_typed(req->args, types, json_args, args_sz, &req->desc, &err))
+        {
+            LOG_ERROR("invalid typed args: %s, types %s, args %s", err ? err : "unknown", types, json_args);
+            goto fail;
+        }
     }
+    else
+    {
+        // $invokeWithJsonArgs(method, null, jsonArgs), 参数类型 NULL, 不支持重载方法
+        struct hs_encoder *enc = hs_encoder_create(req->args);
+        bool ok = hs_write_string(enc, req->method, strlen(req->method));
+        hs_write_null(enc);
+        hs_encoder_release(enc);
+        if (!ok)
+        {
+            LOG_ERROR("invalid method name: %s", method);
+            goto fail;
+        }
 
-    req->argc = DUBBO_GENERIC_METHOD_ARGC;
-    req->argv = calloc(3, sizeof(void *));
-    assert(req->argv);
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX] = strdup(method);
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX] = NULL;
-    req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX] = args;
+        struct json2hs *t = json2hs_create(req->args);
+        if (!json2hs_feed(t, json_args, args_sz) || !json2hs_finish(t))
+        {
+            size_t pos;
+            const char *err = json2hs_error(t, &pos);
+            LOG_ERROR("invalid json args: %s at %zu, %s", err, pos, json_args);
+            json2hs_release(t);
+            goto fail;
+        }
+        json2hs_release(t);
+    }
 
-    // fixme 要处理成 hessian map
-    if (json_attach)
+    req->attach = buf_create_ex(64, 0);
+    if (!json2hs_attach(req->attach, json_attach ? json_attach : "{}", json_attach ? strlen(json_attach) : 2))
     {
-        req->attach = strdup(json_attach);
+        LOG_ERROR("invalid json attach: %s", json_attach);
+        goto fail;
     }
+    return req;
 
+fail:
+    dubbo_req_release(req);
+    return NULL;
+}
+
+struct dubbo_req *dubbo_heartbeat_create()
+{
+    struct dubbo_req *req = calloc(1, sizeof(*req));
+    assert(req);
+    req->reqid = dubbo_next_reqid();
+    req->is_twoway = true;
+    req->is_evt = true;
+    req->data = (char *)DUBBO_HEARTBEAT_DATA;
+    req->data_sz = 1;
     return req;
 }
 
 void dubbo_req_release(struct dubbo_req *req)
 {
-    free(req->argv[DUBBO_GENERIC_METHOD_ARGV_METHOD_IDX]);
-    // free(req->argv[DUBBO_GENERIC_METHOD_ARGV_TYPES_IDX]);
-    free(req->argv[DUBBO_GENERIC_METHOD_ARGV_ARGS_IDX]);
-    free(req->argv);
+    // service, method 为驻留字符串; 事件请求的 data 为静态数据
+    if (req->args)
+    {
+        buf_release(req->args);
+    }
     if (req->attach)
     {
-        free(req->attach);
+        buf_release(req->attach);
     }
+    free(req->desc);
     free(req);
 }
 
@@ -417,7 +509,9 @@ int64_t dubbo_req_getid(struct dubbo_req *req)
 
 struct buffer *dubbo_encode(const struct dubbo_req *req)
 {
-    struct buffer *buf = buf_create_ex(DUBBO_BUF_LEN, DUBBO_HDR_LEN);
+    // 请求体大小已知, 一次分配, 不再扩容
+    size_t sz = req->is_evt ? req->data_sz : req_body_size(req);
+    struct buffer *buf = buf_create_ex(sz > 0 ? sz : 1, DUBBO_HDR_LEN);
     if (encode_req(buf, req))
     {
         return buf;
@@ -429,6 +523,40 @@ struct buffer *dubbo_encode(const struct dubbo_req *req)
     }
 }
 
+struct buffer *dubbo_encode_heartbeat_res(int64_t reqid)
+{
+    struct buffer *buf = buf_create_ex(1, DUBBO_HDR_LEN);
+    struct dubbo_hdr hdr;
+    hdr.flag = (int8_t)DUBBO_FLAG_EVT | (int8_t)DUBBO_HESSIAN2_SERI_ID;
+    hdr.status = DUBBO_RES_T_OK;
+    hdr.reqid = reqid;
+    hdr.body_sz = 1;
+    buf_append(buf, DUBBO_HEARTBEAT_DATA, 1);
+    encode_req_hdr(buf, &hdr);
+    return buf;
+}
+
+struct buffer *dubbo_encode_res_value(int64_t reqid, const char *str, size_t len)
+{
+    struct buffer *buf = buf_create_ex(len + 8, DUBBO_HDR_LEN);
+    struct hs_encoder *enc = hs_encoder_create(buf);
+    hs_write_int(enc, DUBBO_RES_VAL);
+    bool ok = hs_write_string(enc, str, len);
+    hs_encoder_release(enc);
+    if (!ok)
+    {
+        buf_release(buf);
+        return NULL;
+    }
+    struct dubbo_hdr hdr;
+    hdr.flag = (int8_t)DUBBO_HESSIAN2_SERI_ID;
+    hdr.status = DUBBO_RES_T_OK;
+    hdr.reqid = reqid;
+    hdr.body_sz = buf_readable(buf);
+    encode_req_hdr(buf, &hdr);
+    return buf;
+}
+
 struct dubbo_res *dubbo_decode(struct buffer *buf)
 {
     struct dubbo_hdr hdr;
@@ -440,20 +568,21 @@ struct dubbo_res *dubbo_decode(struct buffer *buf)
         return NULL;
     }
 
-    // 读取所有 body+attach
-    // fixme 做一个 buf_view...
-    struct buffer *body_buf = buf_create(hdr.body_sz);
-
-    buf_append(body_buf, buf_peek(buf), hdr.body_sz);
-    buf_retrieve(buf, hdr.body_sz);
-
     struct dubbo_res *res = calloc(1, sizeof(*res));
     assert(res);
     res->type = -1;
     res->reqid = hdr.reqid;
 
-    bool ok = decode_res(body_buf, &hdr, res);
-    buf_release(body_buf);
+    // body+attach 的只读视图, 不复制
+    bool ok = true;
+    if (hdr.body_sz > 0)
+    {
+        struct buffer *body_buf = buf_readonlyView(buf, hdr.body_sz);
+        assert(body_buf);
+        ok = decode_res(body_buf, &hdr, res);
+        buf_release(body_buf);
+    }
+    buf_retrieve(buf, hdr.body_sz);
 
     if (ok)
     {
@@ -461,17 +590,37 @@ struct dubbo_res *dubbo_decode(struct buffer *buf)
     }
     else
     {
-        free(res);
+        dubbo_res_release(res);
         return NULL;
     }
 }
 
+void dubbo_set_reqid(char *frame, int64_t reqid)
+{
+    int64_t be64 = htobe64(reqid);
+    memcpy(frame + DUBBO_REQID_OFFSET, &be64, sizeof(be64));
+}
+
 bool is_dubbo_pkt(const struct buffer *buf)
 {
     return buf_readable(buf) >= DUBBO_HDR_LEN && (uint16_t)buf_peekInt16(buf) == DUBBO_MAGIC;
 }
 
-// remaining 0: completed,  < 0, not completed
+int dubbo_frame_len(const struct buffer *buf)
+{
+    if (buf_readable(buf) < DUBBO_HDR_LEN)
+    {
+        return 0;
+    }
+    int remaining;
+    if (!is_completed_dubbo_pkt(buf, &remaining))
+    {
+        return -1;
+    }
+    return remaining > 0 ? 0 : (int)(buf_readable(buf) + remaining);
+}
+
+// remaining > 0: 还差的字节数, <= 0: 完整 (-remaining 为之后多出的字节数)
 bool is_completed_dubbo_pkt(const struct buffer *buf, int *remaining)
 {
     if (!is_dubbo_pkt(buf))
@@ -48,26 +48,46 @@ struct dubbo_res
 {
     int64_t reqid;
     bool is_evt;
+    bool is_req; // 对端发来的事件请求 (心跳), 须以 dubbo_encode_heartbeat_res 回复
     bool ok;
     dubbo_res_type type;
-    char *desc;
-    char *data;
+    const char *desc;
+    // owned 为 false 时 data 指向 dubbo_decode 传入的 buf, 在 buf 下次写入前有效
+    // 字符串返回值原样, 其它返回值 (按类型调用) 与异常对象转为 JSON
+    const char *data;
     size_t data_sz;
-    char *attach;
+    bool owned;
+    char *attach; // 响应 attachments 的 JSON, 没有时为 NULL
     size_t attach_sz;
 };
 
-struct dubbo_req *dubbo_req_create(const char *service, const char *method, const char *json_args, const char *json_attach);
+// types 为 NULL 时走泛化调用 $invokeWithJsonArgs, 否则为逗号分隔的 java 参数类型, 按类型直接调用
+struct dubbo_req *dubbo_req_create(const char *service, const char *method, const char *types, const char *json_args, const char *json_attach);
+// 心跳: twoway 事件请求, 对端以同一 reqid 的事件响应回复
+struct dubbo_req *dubbo_heartbeat_create();
 void dubbo_req_release(struct dubbo_req *);
 int64_t dubbo_req_getid(struct dubbo_req *);
 void dubbo_res_release(struct dubbo_res *);
 
 struct buffer *dubbo_encode(const struct dubbo_req *);
+// 回复对端的心跳请求
+struct buffer *dubbo_encode_heartbeat_res(int64_t reqid);
+// 字符串返回值的响应, 供模拟 provider 与测试使用; str 非法 UTF-8 返回 NULL
+struct buffer *dubbo_encode_res_value(int64_t reqid, const char *str, size_t len);
+
+// 同一请求的帧只有 reqid 不同: 编码一次作为模板, 每次发送复制后原地改写 reqid (magic 2, flag 1, status 1 之后的 8 字节)
+#define DUBBO_REQID_OFFSET 4
+int64_t dubbo_next_reqid();
+void dubbo_set_reqid(char *frame, int64_t reqid);
 struct dubbo_res *dubbo_decode(struct buffer *);
 
 bool is_dubbo_pkt(const struct buffer *);
 
-// remaining   0: completed,  < 0, not completed, > 0 overflow
+// remaining > 0: 还差的字节数, <= 0: 完整 (-remaining 为之后多出的字节数)
 bool is_completed_dubbo_pkt(const struct buffer *buf, int *remaining);
 
+// 分帧: buf 开头完整帧的字节数 (含头部), 数据不足返回 0, 非 dubbo 帧或长度非法返回 -1
+// 之后可能还有下一帧, 调用方循环 dubbo_decode 直到返回 0
+int dubbo_frame_len(const struct buffer *buf);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,606 @@
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h> /* PRId64 */
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "dubbo_codec.h"
+#include "dubbo_conn.h"
+
+#include "ae.h"
+#include "socket.h"
+#include "sa.h"
+#include "buffer.h"
+#include "queue.h"
+#include "khash.h"
+#include "timewheel.h"
+#include "log.h"
+#include "dbg.h"
+
+#define CONN_INIT_BUF_SZ 1024
+// 超时检查间隔, ae 定时器为毫秒精度
+#define CONN_TICK_MS 10
+// 时间轮一轮 512 * 10ms, 常见超时在一轮之内
+#define CONN_WHEEL_SLOTS 512
+
+enum conn_state
+{
+    CONN_CLOSED,
+    CONN_CONNECTING,
+    CONN_CONNECTED,
+};
+
+// 在途调用, 带超时的同时以 reqid 登记在 wheel 上, 完成后放回 free_list 复用
+struct pending
+{
+    QUEUE node;
+    int64_t reqid;
+    dubbo_call_cb cb;
+    void *ud;
+};
+
+KHASH_MAP_INIT_INT64(pending, struct pending *)
+
+struct dubbo_conn
+{
+    struct aeEventLoop *el;
+    char *host;
+    char *port;
+    union sockaddr_all addr;
+    int connect_timeout_ms;
+    int keepalive_sec;
+
+    int fd;
+    enum conn_state state;
+    struct buffer *rcv_buf;
+    struct buffer *snd_buf;
+    bool writing; // 已注册可写事件
+
+    khash_t(pending) * pending;
+    struct timewheel *wheel;
+    QUEUE free_list;
+
+    long long connect_timerid;
+    long long tick_timerid;
+
+    // 心跳: 读或写空闲 heartbeat_ms 后发一次, 读空闲达到 heartbeat_miss 个间隔判定连接已死
+    int heartbeat_ms;
+    int heartbeat_miss;
+    struct buffer *heartbeat; // 预编码的心跳帧, 发送时改写 reqid
+    int64_t last_read_ns;
+    int64_t last_write_ns;
+    long long heartbeat_timerid;
+};
+
+static void conn_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask);
+static void conn_on_read(struct aeEventLoop *el, int fd, void *ud, int mask);
+static void conn_on_write(struct aeEventLoop *el, int fd, void *ud, int mask);
+static void conn_close(struct dubbo_conn *conn, const char *reason);
+static void conn_send(struct dubbo_conn *conn);
+
+static inline int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct pending *pending_alloc(struct dubbo_conn *conn)
+{
+    if (QUEUE_EMPTY(&conn->free_list))
+    {
+        struct pending *p = malloc(sizeof(*p));
+        assert(p);
+        return p;
+    }
+    QUEUE *q = QUEUE_HEAD(&conn->free_list);
+    QUEUE_REMOVE(q);
+    return QUEUE_DATA(q, struct pending, node);
+}
+
+static void pending_add(struct dubbo_conn *conn, struct pending *p)
+{
+    int ret;
+    khiter_t k = kh_put(pending, conn->pending, p->reqid, &ret);
+    assert(ret > 0);
+    kh_value(conn->pending, k) = p;
+}
+
+static struct pending *pending_take(struct dubbo_conn *conn, int64_t reqid)
+{
+    khiter_t k = kh_get(pending, conn->pending, reqid);
+    if (k == kh_end(conn->pending))
+    {
+        return NULL;
+    }
+    struct pending *p = kh_value(conn->pending, k);
+    kh_del(pending, conn->pending, k);
+    tw_del(conn->wheel, reqid);
+    return p;
+}
+
+// 回调前先放回 free_list, 回调中的 dubbo_call 可直接复用
+static void pending_done(struct dubbo_conn *conn, struct pending *p, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    dubbo_call_cb cb = p->cb;
+    void *ud = p->ud;
+    QUEUE_INSERT_HEAD(&conn->free_list, &p->node);
+    cb(ud, status, res);
+}
+
+// 整体摘下再逐个回调, 回调中新发起的调用进入新的连接
+static void pending_fail_all(struct dubbo_conn *conn, enum dubbo_call_status status)
+{
+    QUEUE failed;
+    QUEUE_INIT(&failed);
+    struct pending *p;
+    kh_foreach_value(conn->pending, p, QUEUE_INSERT_TAIL(&failed, &p->node));
+    kh_clear(pending, conn->pending);
+    tw_clear(conn->wheel);
+    while (!QUEUE_EMPTY(&failed))
+    {
+        QUEUE *q = QUEUE_HEAD(&failed);
+        QUEUE_REMOVE(q);
+        pending_done(conn, QUEUE_DATA(q, struct pending, node), status, NULL);
+    }
+}
+
+static void conn_on_expire(void *ud, int64_t reqid)
+{
+    struct dubbo_conn *conn = ud;
+    struct pending *p = pending_take(conn, reqid);
+    assert(p);
+    pending_done(conn, p, DUBBO_CALL_TIMEOUT, NULL);
+}
+
+static int conn_on_tick(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_conn *conn = ud;
+    tw_advance(conn->wheel, now_ns() / 1000000, conn_on_expire, conn);
+    // 没有带超时的在途调用时停止检查, 下一个带超时的调用再启动
+    if (tw_size(conn->wheel) == 0)
+    {
+        conn->tick_timerid = AE_NOMORE;
+        return AE_NOMORE;
+    }
+    return CONN_TICK_MS;
+}
+
+static void conn_clear_timer(struct dubbo_conn *conn, long long *timerid)
+{
+    if (*timerid != AE_NOMORE)
+    {
+        aeDeleteTimeEvent(conn->el, *timerid);
+        *timerid = AE_NOMORE;
+    }
+}
+
+// 写出 snd_buf, 写不完注册可写事件, 出错返回 false
+static bool conn_flush(struct dubbo_conn *conn)
+{
+    struct buffer *buf = conn->snd_buf;
+    while (buf_readable(buf))
+    {
+        ssize_t n = send(conn->fd, buf_peek(buf), buf_readable(buf), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN)
+            {
+                return false;
+            }
+            if (!conn->writing)
+            {
+                if (AE_ERR == aeCreateFileEvent(conn->el, conn->fd, AE_WRITABLE, conn_on_write, conn))
+                {
+                    return false;
+                }
+                conn->writing = true;
+            }
+            return true;
+        }
+        buf_retrieve(buf, n);
+        conn->last_write_ns = now_ns();
+    }
+    if (conn->writing)
+    {
+        aeDeleteFileEvent(conn->el, conn->fd, AE_WRITABLE);
+        conn->writing = false;
+    }
+    return true;
+}
+
+static void conn_send_heartbeat(struct dubbo_conn *conn)
+{
+    size_t sz = buf_readable(conn->heartbeat);
+    buf_ensureWritable(conn->snd_buf, sz);
+    char *frame = buf_beginWrite(conn->snd_buf);
+    memcpy(frame, buf_peek(conn->heartbeat), sz);
+    dubbo_set_reqid(frame, dubbo_next_reqid());
+    buf_has_written(conn->snd_buf, sz);
+    conn_send(conn);
+}
+
+// 心跳的响应不对应任何调用, 只用于刷新 last_read_ns
+static int conn_on_heartbeat(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_conn *conn = ud;
+    int64_t now = now_ns();
+    int64_t interval_ns = (int64_t)conn->heartbeat_ms * 1000000;
+    if (now - conn->last_read_ns >= interval_ns * conn->heartbeat_miss)
+    {
+        conn->heartbeat_timerid = AE_NOMORE;
+        conn_close(conn, "心跳超时");
+        return AE_NOMORE;
+    }
+    if (now - conn->last_read_ns >= interval_ns || now - conn->last_write_ns >= interval_ns)
+    {
+        conn_send_heartbeat(conn);
+    }
+    return conn->heartbeat_ms;
+}
+
+// 写出错时交给可写事件处理断开, 保证不在 dubbo_call 与读事件的处理中途回调
+static void conn_send(struct dubbo_conn *conn)
+{
+    if (conn->state == CONN_CONNECTED && !conn->writing && !conn_flush(conn))
+    {
+        if (AE_ERR != aeCreateFileEvent(conn->el, conn->fd, AE_WRITABLE, conn_on_write, conn))
+        {
+            conn->writing = true;
+        }
+    }
+}
+
+static void conn_connected(struct dubbo_conn *conn)
+{
+    conn->state = CONN_CONNECTED;
+    conn_clear_timer(conn, &conn->connect_timerid);
+    if (AE_ERR == aeCreateFileEvent(conn->el, conn->fd, AE_READABLE, conn_on_read, conn))
+    {
+        conn_close(conn, "创建可读事件失败");
+        return;
+    }
+    conn->last_read_ns = conn->last_write_ns = now_ns();
+    if (conn->heartbeat_ms > 0)
+    {
+        conn->heartbeat_timerid = aeCreateTimeEvent(conn->el, conn->heartbeat_ms, conn_on_heartbeat, conn, NULL);
+        assert(conn->heartbeat_timerid != AE_ERR);
+    }
+    // 连接期间积压的请求
+    if (!conn_flush(conn))
+    {
+        conn_close(conn, strerror(errno));
+    }
+}
+
+static int conn_on_connect_timeout(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_conn *conn = ud;
+    conn->connect_timerid = AE_NOMORE;
+    conn_close(conn, "连接超时");
+    return AE_NOMORE;
+}
+
+static bool conn_connect(struct dubbo_conn *conn)
+{
+    int fd = socket_create();
+    if (fd < 0)
+    {
+        return false;
+    }
+    conn->fd = fd;
+    conn->state = CONN_CONNECTING;
+    if (conn->keepalive_sec > 0)
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &conn->keepalive_sec, sizeof(conn->keepalive_sec));
+#endif
+    }
+
+    if (socket_connect(fd, &conn->addr, sizeof(conn->addr.s)) == 0)
+    {
+        conn_connected(conn);
+        return conn->state == CONN_CONNECTED;
+    }
+    if (errno != EINPROGRESS)
+    {
+        goto fail;
+    }
+    if (AE_ERR == aeCreateFileEvent(conn->el, fd, AE_WRITABLE, conn_on_connect, conn))
+    {
+        goto fail;
+    }
+    conn->connect_timerid = aeCreateTimeEvent(conn->el, conn->connect_timeout_ms, conn_on_connect_timeout, conn, NULL);
+    if (AE_ERR == conn->connect_timerid)
+    {
+        conn->connect_timerid = AE_NOMORE;
+        aeDeleteFileEvent(conn->el, fd, AE_WRITABLE);
+        goto fail;
+    }
+    return true;
+
+fail:
+    LOG_ERROR("连接 %s:%s 失败: %s", conn->host, conn->port, strerror(errno));
+    close(fd);
+    conn->fd = -1;
+    conn->state = CONN_CLOSED;
+    return false;
+}
+
+// 断开并以 CLOSED 结束所有在途调用, 下一次 dubbo_call 重连
+static void conn_close(struct dubbo_conn *conn, const char *reason)
+{
+    if (conn->state == CONN_CLOSED)
+    {
+        return;
+    }
+    if (reason)
+    {
+        LOG_ERROR("dubbo 连接 %s:%s 断开: %s", conn->host, conn->port, reason);
+    }
+    conn_clear_timer(conn, &conn->connect_timerid);
+    conn_clear_timer(conn, &conn->heartbeat_timerid);
+    aeDeleteFileEvent(conn->el, conn->fd, AE_READABLE | AE_WRITABLE);
+    close(conn->fd);
+    conn->fd = -1;
+    conn->state = CONN_CLOSED;
+    conn->writing = false;
+    buf_retrieveAll(conn->rcv_buf);
+    buf_retrieveAll(conn->snd_buf);
+    pending_fail_all(conn, DUBBO_CALL_CLOSED);
+}
+
+static void conn_on_connect(struct aeEventLoop *el, int fd, void *ud, int mask)
+{
+    UNUSED(mask);
+    struct dubbo_conn *conn = ud;
+    aeDeleteFileEvent(el, fd, AE_WRITABLE);
+    // ae 把 err 与 hup 也报告为可写, 以 SO_ERROR 为准
+    int err = socket_getError(fd);
+    if (err)
+    {
+        conn_close(conn, strerror(err));
+        return;
+    }
+    conn_connected(conn);
+}
+
+static void conn_on_write(struct aeEventLoop *el, int fd, void *ud, int mask)
+{
+    UNUSED(el);
+    UNUSED(fd);
+    UNUSED(mask);
+    struct dubbo_conn *conn = ud;
+    if (!conn_flush(conn))
+    {
+        conn_close(conn, strerror(errno));
+    }
+}
+
+static void conn_on_read(struct aeEventLoop *el, int fd, void *ud, int mask)
+{
+    UNUSED(el);
+    UNUSED(mask);
+    struct dubbo_conn *conn = ud;
+
+    for (;;)
+    {
+        int errno_ = 0;
+        ssize_t recv_n = buf_readFd(conn->rcv_buf, fd, &errno_);
+        if (recv_n < 0)
+        {
+            if (errno_ == EINTR)
+            {
+                continue;
+            }
+            if (errno_ != EAGAIN)
+            {
+                conn_close(conn, strerror(errno_));
+                return;
+            }
+        }
+        else if (recv_n == 0)
+        {
+            conn_close(conn, "服务端关闭连接");
+            return;
+        }
+        break;
+    }
+    conn->last_read_ns = now_ns();
+
+    // 处理读到的所有完整帧; 回调中可能断开连接, 之后不再访问 fd
+    while (conn->fd == fd)
+    {
+        int len = dubbo_frame_len(conn->rcv_buf);
+        if (len == 0)
+        {
+            break;
+        }
+        if (len < 0)
+        {
+            conn_close(conn, "接收到非 dubbo 数据包");
+            return;
+        }
+        struct dubbo_res *res = dubbo_decode(conn->rcv_buf);
+        if (res == NULL)
+        {
+            conn_close(conn, "响应解码失败");
+            return;
+        }
+        if (res->is_evt)
+        {
+            // provider 的心跳请求须回复, 否则它会断开空闲连接; 心跳响应只刷新读时间
+            if (res->is_req)
+            {
+                struct buffer *reply = dubbo_encode_heartbeat_res(res->reqid);
+                buf_append(conn->snd_buf, buf_peek(reply), buf_readable(reply));
+                buf_release(reply);
+                conn_send(conn);
+            }
+            dubbo_res_release(res);
+            continue;
+        }
+        // 超时之后才到的响应没有对应的调用, 丢弃
+        struct pending *p = pending_take(conn, res->reqid);
+        if (p)
+        {
+            pending_done(conn, p, DUBBO_CALL_OK, res);
+        }
+        dubbo_res_release(res);
+    }
+}
+
+struct dubbo_conn *dubbo_conn_create(struct aeEventLoop *el, const char *host, const char *port, int connect_timeout_ms)
+{
+    union sockaddr_all addr;
+    if (!sa_resolve((char *)host, &addr))
+    {
+        LOG_ERROR("%s DNS解析失败", host);
+        return NULL;
+    }
+    addr.v4.sin_port = htons(atoi(port));
+
+    struct dubbo_conn *conn = calloc(1, sizeof(*conn));
+    assert(conn);
+    conn->el = el;
+    conn->host = strdup(host);
+    conn->port = strdup(port);
+    assert(conn->host && conn->port);
+    conn->addr = addr;
+    conn->connect_timeout_ms = connect_timeout_ms > 0 ? connect_timeout_ms : 3000;
+    conn->fd = -1;
+    conn->state = CONN_CLOSED;
+    conn->rcv_buf = buf_create(CONN_INIT_BUF_SZ);
+    conn->snd_buf = buf_create(CONN_INIT_BUF_SZ);
+    conn->pending = kh_init(pending);
+    assert(conn->pending);
+    conn->wheel = tw_create(CONN_TICK_MS, CONN_WHEEL_SLOTS);
+    QUEUE_INIT(&conn->free_list);
+    conn->connect_timerid = AE_NOMORE;
+    conn->tick_timerid = AE_NOMORE;
+    conn->heartbeat_timerid = AE_NOMORE;
+    return conn;
+}
+
+void dubbo_conn_release(struct dubbo_conn *conn)
+{
+    conn_close(conn, NULL);
+    conn_clear_timer(conn, &conn->tick_timerid);
+    while (!QUEUE_EMPTY(&conn->free_list))
+    {
+        QUEUE *q = QUEUE_HEAD(&conn->free_list);
+        QUEUE_REMOVE(q);
+        free(QUEUE_DATA(q, struct pending, node));
+    }
+    kh_destroy(pending, conn->pending);
+    tw_release(conn->wheel);
+    if (conn->heartbeat)
+    {
+        buf_release(conn->heartbeat);
+    }
+    buf_release(conn->rcv_buf);
+    buf_release(conn->snd_buf);
+    free(conn->host);
+    free(conn->port);
+    free(conn);
+}
+
+int64_t dubbo_call(struct dubbo_conn *conn, const struct dubbo_req *req, dubbo_call_cb cb, void *ud, int timeout_ms)
+{
+    struct buffer *frame_buf = dubbo_encode(req);
+    if (frame_buf == NULL)
+    {
+        return 0;
+    }
+    int64_t reqid = dubbo_conn_send_frame(conn, frame_buf, cb, ud, timeout_ms);
+    buf_release(frame_buf);
+    return reqid;
+}
+
+int64_t dubbo_conn_send_frame(struct dubbo_conn *conn, const struct buffer *frame_buf, dubbo_call_cb cb, void *ud, int timeout_ms)
+{
+    if (conn->state == CONN_CLOSED && !conn_connect(conn))
+    {
+        return 0;
+    }
+
+    // 复制到 snd_buf 后改写 reqid, 同一个帧可以反复发送
+    int64_t reqid = dubbo_next_reqid();
+    size_t sz = buf_readable(frame_buf);
+    buf_ensureWritable(conn->snd_buf, sz);
+    char *frame = buf_beginWrite(conn->snd_buf);
+    memcpy(frame, buf_peek(frame_buf), sz);
+    dubbo_set_reqid(frame, reqid);
+    buf_has_written(conn->snd_buf, sz);
+
+    struct pending *p = pending_alloc(conn);
+    p->reqid = reqid;
+    p->cb = cb;
+    p->ud = ud;
+    pending_add(conn, p);
+
+    if (timeout_ms > 0)
+    {
+        tw_add(conn->wheel, reqid, now_ns() / 1000000 + timeout_ms);
+    }
+    if (timeout_ms > 0 && conn->tick_timerid == AE_NOMORE)
+    {
+        conn->tick_timerid = aeCreateTimeEvent(conn->el, CONN_TICK_MS, conn_on_tick, conn, NULL);
+        assert(conn->tick_timerid != AE_ERR);
+    }
+
+    conn_send(conn);
+    return reqid;
+}
+
+int dubbo_conn_pending(const struct dubbo_conn *conn)
+{
+    return kh_size(conn->pending);
+}
+
+bool dubbo_conn_connected(const struct dubbo_conn *conn)
+{
+    return conn->state == CONN_CONNECTED;
+}
+
+void dubbo_conn_close(struct dubbo_conn *conn)
+{
+    conn_close(conn, NULL);
+}
+
+void dubbo_conn_set_keepalive(struct dubbo_conn *conn, int idle_sec)
+{
+    conn->keepalive_sec = idle_sec;
+}
+
+void dubbo_conn_set_heartbeat(struct dubbo_conn *conn, int interval_ms, int max_missed)
+{
+    conn->heartbeat_ms = interval_ms > 0 ? interval_ms : 0;
+    conn->heartbeat_miss = max_missed > 0 ? max_missed : 3;
+    if (conn->heartbeat_ms > 0 && conn->heartbeat == NULL)
+    {
+        struct dubbo_req *req = dubbo_heartbeat_create();
+        conn->heartbeat = dubbo_encode(req);
+        dubbo_req_release(req);
+        assert(conn->heartbeat);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef DUBBO_CONN_H
+#define DUBBO_CONN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ae.h"
+#include "dubbo_codec.h"
+
+// 异步 dubbo 连接: 一个 TCP 连接上多路复用任意多个调用, 运行在调用方的 aeEventLoop 上
+// 每个请求帧带新的 reqid, 响应按 reqid 找回各自的回调, 可乱序完成; 每个调用单独超时
+// 非线程安全, 只能在 el 所在线程使用
+
+enum dubbo_call_status
+{
+    DUBBO_CALL_OK,      // 收到响应, 服务端异常也是 OK, 看 res->ok
+    DUBBO_CALL_TIMEOUT, // 超时, 之后到达的响应丢弃
+    DUBBO_CALL_CLOSED,  // 连接失败, 断开, 或 release 时仍未完成
+};
+
+// status 非 OK 时 res 为 NULL; res 只在回调内有效 (data 可能指向接收缓冲)
+// 回调中可以再 dubbo_call, 不能 dubbo_conn_release 本连接
+typedef void (*dubbo_call_cb)(void *ud, enum dubbo_call_status status, const struct dubbo_res *res);
+
+struct dubbo_conn;
+
+// 只解析地址, 第一次调用时才连接; 断开后下一次调用重连
+struct dubbo_conn *dubbo_conn_create(struct aeEventLoop *el, const char *host, const char *port, int connect_timeout_ms);
+// 未完成的调用以 DUBBO_CALL_CLOSED 回调
+void dubbo_conn_release(struct dubbo_conn *);
+
+// 编码 req 并以新的 reqid 发出 (req 可重复使用), timeout_ms 为 0 不超时
+// 成功返回 reqid, 之后 cb 恰好回调一次, 且不会在 dubbo_call 内同步回调
+// 编码或发起连接失败返回 0, 不回调
+int64_t dubbo_call(struct dubbo_conn *, const struct dubbo_req *req, dubbo_call_cb cb, void *ud, int timeout_ms);
+// 同 dubbo_call, 发送 dubbo_encode 预编码的帧 (不修改), 只在发起连接失败时返回 0
+int64_t dubbo_conn_send_frame(struct dubbo_conn *, const struct buffer *frame, dubbo_call_cb cb, void *ud, int timeout_ms);
+
+// 在途 (已发出未完成) 的调用数
+int dubbo_conn_pending(const struct dubbo_conn *);
+bool dubbo_conn_connected(const struct dubbo_conn *);
+
+// 主动断开, 未完成的调用立即以 DUBBO_CALL_CLOSED 回调; 之后的调用重连
+void dubbo_conn_close(struct dubbo_conn *);
+// 之后建立的连接开启 TCP keepalive, 空闲 idle_sec 秒开始探测, 0 关闭
+void dubbo_conn_set_keepalive(struct dubbo_conn *, int idle_sec);
+// 之后建立的连接读或写空闲 interval_ms 后发 dubbo 心跳, 连续 max_missed 个间隔 (缺省 3) 读不到数据判定连接已死并断开
+// provider 发来的心跳请求总是回复; interval_ms 为 0 不主动发心跳
+void dubbo_conn_set_heartbeat(struct dubbo_conn *, int interval_ms, int max_missed);
+
+#endif
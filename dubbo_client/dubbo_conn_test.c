@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+
+#include "ae.h"
+#include "dubbo_codec.h"
+#include "dubbo_conn.h"
+#include "dubbo_fake_provider.h"
+
+#define TEST_PORT "20886"
+
+static struct fake_provider P;
+
+struct call
+{
+    int idx;
+    int64_t reqid;
+    enum dubbo_call_status status;
+    bool done;
+};
+
+static int done_n;
+static int order[8];
+static int wait_n;
+
+static void on_call(void *ud, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    struct call *c = ud;
+    assert(!c->done);
+    c->done = true;
+    c->status = status;
+    if (status == DUBBO_CALL_OK)
+    {
+        assert(res && res->ok);
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%" PRId64, c->reqid);
+        assert(res->data_sz == strlen(expected) && memcmp(res->data, expected, res->data_sz) == 0);
+    }
+    else
+    {
+        assert(res == NULL);
+    }
+    order[done_n++] = c->idx;
+    if (done_n == wait_n)
+    {
+        aeStop(P.el);
+    }
+}
+
+static int on_guard(struct aeEventLoop *el, long long id, void *ud)
+{
+    fprintf(stderr, "timeout\n");
+    assert(0);
+    return AE_NOMORE;
+}
+
+static int on_stop(struct aeEventLoop *el, long long id, void *ud)
+{
+    aeStop(el);
+    return AE_NOMORE;
+}
+
+// 跑到 n 个回调完成
+static void run_until(struct aeEventLoop *el, int n)
+{
+    done_n = 0;
+    wait_n = n;
+    long long guard = aeCreateTimeEvent(el, 3000, on_guard, NULL, NULL);
+    aeMain(el);
+    aeDeleteTimeEvent(el, guard);
+}
+
+static void run_for(struct aeEventLoop *el, int ms)
+{
+    aeCreateTimeEvent(el, ms, on_stop, NULL, NULL);
+    aeMain(el);
+}
+
+static struct dubbo_req *new_req()
+{
+    struct dubbo_req *req = dubbo_req_create("com.youzan.Demo", "hello", NULL, "[1]", NULL);
+    assert(req);
+    return req;
+}
+
+void test_Conn_out_of_order(struct aeEventLoop *el, struct dubbo_conn *conn)
+{
+    struct dubbo_req *req = new_req();
+    struct call calls[3];
+    memset(calls, 0, sizeof(calls));
+    P.batch = 3;
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        calls[i].idx = i;
+        calls[i].reqid = dubbo_call(conn, req, on_call, &calls[i], 1000);
+        assert(calls[i].reqid > 0);
+    }
+    // 同一个 req 每次都是新的 reqid
+    assert(calls[0].reqid != calls[1].reqid && calls[1].reqid != calls[2].reqid);
+    assert(dubbo_conn_pending(conn) == 3);
+    run_until(el, 3);
+    for (i = 0; i < 3; i++)
+    {
+        assert(calls[i].done && calls[i].status == DUBBO_CALL_OK);
+        assert(order[i] == 2 - i);
+    }
+    assert(dubbo_conn_pending(conn) == 0);
+    dubbo_req_release(req);
+}
+
+void test_Conn_timeout(struct aeEventLoop *el, struct dubbo_conn *conn)
+{
+    struct dubbo_req *req = new_req();
+    struct call calls[2];
+    memset(calls, 0, sizeof(calls));
+    P.batch = 2;
+    P.drop_first = true;
+    P.late_ms = 150;
+    calls[0].reqid = dubbo_call(conn, req, on_call, &calls[0], 50);
+    calls[1].reqid = dubbo_call(conn, req, on_call, &calls[1], 1000);
+    run_until(el, 2);
+    assert(calls[0].status == DUBBO_CALL_TIMEOUT);
+    assert(calls[1].status == DUBBO_CALL_OK);
+    assert(dubbo_conn_pending(conn) == 0);
+
+    // 超时之后到达的响应丢弃, 连接仍可用
+    run_for(el, 200);
+    P.batch = 1;
+    P.drop_first = false;
+    struct call c;
+    memset(&c, 0, sizeof(c));
+    c.reqid = dubbo_call(conn, req, on_call, &c, 1000);
+    run_until(el, 1);
+    assert(c.status == DUBBO_CALL_OK);
+    dubbo_req_release(req);
+}
+
+void test_Conn_closed(struct aeEventLoop *el, struct dubbo_conn *conn)
+{
+    struct dubbo_req *req = new_req();
+    struct call calls[2];
+    memset(calls, 0, sizeof(calls));
+    P.close_on_req = true;
+    calls[0].reqid = dubbo_call(conn, req, on_call, &calls[0], 0);
+    calls[1].reqid = dubbo_call(conn, req, on_call, &calls[1], 1000);
+    run_until(el, 2);
+    assert(calls[0].status == DUBBO_CALL_CLOSED && calls[1].status == DUBBO_CALL_CLOSED);
+    assert(dubbo_conn_pending(conn) == 0);
+
+    // 下一次调用重连
+    P.close_on_req = false;
+    struct call c;
+    memset(&c, 0, sizeof(c));
+    c.reqid = dubbo_call(conn, req, on_call, &c, 1000);
+    assert(c.reqid > 0);
+    run_until(el, 1);
+    assert(c.status == DUBBO_CALL_OK);
+    dubbo_req_release(req);
+}
+
+// 回调里接着发下一个调用
+struct chain
+{
+    struct dubbo_conn *conn;
+    struct dubbo_req *req;
+    struct call call;
+    int left;
+};
+
+static void on_chain(void *ud, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    struct chain *ch = ud;
+    assert(status == DUBBO_CALL_OK && res->ok);
+    if (--ch->left == 0)
+    {
+        aeStop(P.el);
+        return;
+    }
+    ch->call.reqid = dubbo_call(ch->conn, ch->req, on_chain, ch, 1000);
+    assert(ch->call.reqid > 0);
+}
+
+void test_Conn_chain(struct aeEventLoop *el, struct dubbo_conn *conn)
+{
+    struct chain ch;
+    memset(&ch, 0, sizeof(ch));
+    ch.conn = conn;
+    ch.req = new_req();
+    ch.left = 1000;
+    P.batch = 1;
+    ch.call.reqid = dubbo_call(conn, ch.req, on_chain, &ch, 1000);
+    assert(ch.call.reqid > 0);
+    long long guard = aeCreateTimeEvent(el, 3000, on_guard, NULL, NULL);
+    aeMain(el);
+    aeDeleteTimeEvent(el, guard);
+    assert(ch.left == 0 && dubbo_conn_pending(conn) == 0);
+    dubbo_req_release(ch.req);
+}
+
+void test_Conn_release(struct aeEventLoop *el)
+{
+    // release 时未完成的调用以 CLOSED 回调
+    struct dubbo_conn *conn = dubbo_conn_create(el, "127.0.0.1", TEST_PORT, 1000);
+    struct dubbo_req *req = new_req();
+    struct call c;
+    memset(&c, 0, sizeof(c));
+    done_n = 0;
+    wait_n = -1;
+    c.reqid = dubbo_call(conn, req, on_call, &c, 1000);
+    assert(c.reqid > 0 && !c.done);
+    dubbo_conn_release(conn);
+    assert(c.done && c.status == DUBBO_CALL_CLOSED);
+    dubbo_req_release(req);
+}
+
+void test_Conn_heartbeat(struct aeEventLoop *el)
+{
+    // 先处理完上一个连接的断开
+    run_for(el, 10);
+    struct dubbo_conn *conn = dubbo_conn_create(el, "127.0.0.1", TEST_PORT, 1000);
+    dubbo_conn_set_heartbeat(conn, 20, 0);
+    struct dubbo_req *req = new_req();
+    struct call c;
+    memset(&c, 0, sizeof(c));
+    P.batch = 1;
+    P.hb_n = 0;
+    c.reqid = dubbo_call(conn, req, on_call, &c, 1000);
+    run_until(el, 1);
+    assert(c.status == DUBBO_CALL_OK);
+
+    // 空闲连接定期发心跳, 有响应则保持连接
+    run_for(el, 200);
+    assert(P.hb_n >= 3);
+    assert(dubbo_conn_connected(conn) && dubbo_conn_pending(conn) == 0);
+
+    // provider 的心跳请求按原 reqid 回复, 不影响调用
+    fake_provider_heartbeat(&P, 12345);
+    run_for(el, 10);
+    assert(P.hb_res_reqid == 12345);
+    assert(dubbo_conn_connected(conn));
+
+    // 对端不再响应, 连续 3 个间隔读不到数据即断开, 在途调用以 CLOSED 结束
+    P.mute = true;
+    memset(&c, 0, sizeof(c));
+    c.reqid = dubbo_call(conn, req, on_call, &c, 0);
+    run_until(el, 1);
+    assert(c.status == DUBBO_CALL_CLOSED);
+    assert(!dubbo_conn_connected(conn));
+    P.mute = false;
+
+    dubbo_conn_release(conn);
+    dubbo_req_release(req);
+}
+
+int main(void)
+{
+    struct aeEventLoop *el = aeCreateEventLoop(1024);
+    bool ok = fake_provider_start(&P, el, TEST_PORT);
+    assert(ok);
+
+    struct dubbo_conn *conn = dubbo_conn_create(el, "127.0.0.1", TEST_PORT, 1000);
+    assert(conn);
+    test_Conn_out_of_order(el, conn);
+    test_Conn_timeout(el, conn);
+    test_Conn_closed(el, conn);
+    test_Conn_chain(el, conn);
+    dubbo_conn_release(conn);
+    test_Conn_release(el);
+    test_Conn_heartbeat(el);
+
+    fake_provider_stop(&P);
+    aeDeleteEventLoop(el);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "socket.h"
+#include "buffer.h"
+#include "endian.h"
+#include "dubbo_codec.h"
+#include "dubbo_fake_provider.h"
+
+// 请求头 flag: 请求, 事件 (心跳)
+#define FLAG_REQ 0x80
+#define FLAG_EVT 0x20
+
+struct peer
+{
+    QUEUE node;
+    struct fake_provider *p;
+    int fd;
+    struct buffer *in;
+    int64_t reqids[FAKE_PROVIDER_BATCH_MAX];
+    int n;
+};
+
+static void send_frame(int fd, struct buffer *frame)
+{
+    assert(frame);
+    ssize_t n = write(fd, buf_peek(frame), buf_readable(frame));
+    assert(n == (ssize_t)buf_readable(frame));
+    buf_release(frame);
+}
+
+static void reply(int fd, int64_t reqid)
+{
+    char data[32];
+    int data_sz = snprintf(data, sizeof(data), "%" PRId64, reqid);
+    send_frame(fd, dubbo_encode_res_value(reqid, data, data_sz));
+}
+
+static void peer_close(struct peer *peer)
+{
+    struct fake_provider *p = peer->p;
+    p->close_n++;
+    aeDeleteFileEvent(p->el, peer->fd, AE_READABLE);
+    close(peer->fd);
+    if (p->fd == peer->fd)
+    {
+        p->fd = -1;
+    }
+    QUEUE_REMOVE(&peer->node);
+    buf_release(peer->in);
+    free(peer);
+}
+
+static int on_late(struct aeEventLoop *el, long long id, void *ud)
+{
+    struct fake_provider *p = ud;
+    if (p->fd >= 0)
+    {
+        reply(p->fd, p->late_reqid);
+    }
+    return AE_NOMORE;
+}
+
+static void on_read(struct aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct peer *peer = ud;
+    struct fake_provider *p = peer->p;
+    int errno_ = 0;
+    if (buf_readFd(peer->in, fd, &errno_) <= 0 || p->close_on_req)
+    {
+        peer_close(peer);
+        return;
+    }
+    int len;
+    while ((len = dubbo_frame_len(peer->in)) > 0)
+    {
+        uint8_t flag = (uint8_t)buf_peek(peer->in)[2];
+        int64_t be64;
+        memcpy(&be64, buf_peek(peer->in) + DUBBO_REQID_OFFSET, 8);
+        int64_t reqid = be64toh(be64);
+        buf_retrieve(peer->in, len);
+        if (!(flag & FLAG_EVT))
+        {
+            p->req_n++;
+            if (!p->mute)
+            {
+                assert(peer->n < FAKE_PROVIDER_BATCH_MAX);
+                peer->reqids[peer->n++] = reqid;
+            }
+        }
+        else if (flag & FLAG_REQ)
+        {
+            p->hb_n++;
+            if (!p->mute)
+            {
+                send_frame(fd, dubbo_encode_heartbeat_res(reqid));
+            }
+        }
+        else
+        {
+            p->hb_res_reqid = reqid;
+        }
+    }
+    if (peer->n == 0 || peer->n < p->batch)
+    {
+        return;
+    }
+    int i;
+    for (i = peer->n - 1; i >= 0; i--)
+    {
+        if (i == 0 && p->drop_first)
+        {
+            p->late_reqid = peer->reqids[0];
+            aeCreateTimeEvent(el, p->late_ms, on_late, p, NULL);
+            continue;
+        }
+        reply(fd, peer->reqids[i]);
+    }
+    peer->n = 0;
+}
+
+static void on_accept(struct aeEventLoop *el, int fd, void *ud, int mask)
+{
+    struct fake_provider *p = ud;
+    union sockaddr_all addr;
+    socklen_t addrlen = sizeof(addr);
+    int cfd = socket_accept(fd, &addr, &addrlen);
+    assert(cfd >= 0);
+    struct peer *peer = calloc(1, sizeof(*peer));
+    assert(peer);
+    peer->p = p;
+    peer->fd = cfd;
+    peer->in = buf_create(1024);
+    int rc = aeCreateFileEvent(el, cfd, AE_READABLE, on_read, peer);
+    assert(rc != AE_ERR);
+    QUEUE_INSERT_TAIL(&p->peers, &peer->node);
+    p->fd = cfd;
+    p->accept_n++;
+}
+
+bool fake_provider_start(struct fake_provider *p, struct aeEventLoop *el, const char *port)
+{
+    memset(p, 0, sizeof(*p));
+    p->el = el;
+    p->fd = -1;
+    QUEUE_INIT(&p->peers);
+    fake_provider_reset(p);
+    p->listen_fd = socket_server(port);
+    if (p->listen_fd < 0)
+    {
+        return false;
+    }
+    if (!socket_listen(p->listen_fd) || aeCreateFileEvent(el, p->listen_fd, AE_READABLE, on_accept, p) == AE_ERR)
+    {
+        close(p->listen_fd);
+        return false;
+    }
+    return true;
+}
+
+void fake_provider_stop(struct fake_provider *p)
+{
+    aeDeleteFileEvent(p->el, p->listen_fd, AE_READABLE);
+    close(p->listen_fd);
+    while (!QUEUE_EMPTY(&p->peers))
+    {
+        peer_close(QUEUE_DATA(QUEUE_HEAD(&p->peers), struct peer, node));
+    }
+}
+
+void fake_provider_reset(struct fake_provider *p)
+{
+    p->batch = 1;
+    p->drop_first = false;
+    p->late_ms = 0;
+    p->close_on_req = false;
+    p->mute = false;
+    p->accept_n = 0;
+    p->close_n = 0;
+    p->req_n = 0;
+    p->hb_n = 0;
+    p->hb_res_reqid = 0;
+}
+
+void fake_provider_heartbeat(struct fake_provider *p, int64_t reqid)
+{
+    assert(p->fd >= 0);
+    struct dubbo_req *hb = dubbo_heartbeat_create();
+    struct buffer *frame = dubbo_encode(hb);
+    dubbo_req_release(hb);
+    assert(frame);
+    dubbo_set_reqid((char *)buf_peek(frame), reqid);
+    send_frame(p->fd, frame);
+}
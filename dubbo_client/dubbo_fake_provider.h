@@ -0,0 +1,49 @@
+#ifndef DUBBO_FAKE_PROVIDER_H
+#define DUBBO_FAKE_PROVIDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ae.h"
+#include "queue.h"
+
+// 同一事件循环里的假 provider, 供 dubbo_conn / dubbo_pool 的测试使用
+// 每个请求回复字符串返回值, 内容为 reqid 的十进制; 心跳请求立即回复
+// 行为与统计字段由测试直接读写
+
+#define FAKE_PROVIDER_BATCH_MAX 64
+
+struct fake_provider
+{
+    struct aeEventLoop *el;
+    int listen_fd;
+    int fd;      // 最近接入的连接, 断开后为 -1
+    QUEUE peers; // 已接入的连接
+
+    // 行为
+    int batch;         // 同一连接收齐 batch 个请求后倒序回复
+    bool drop_first;   // 每批第一个请求延迟 late_ms 再回复 (发往最近接入的连接)
+    int late_ms;
+    bool close_on_req; // 收到数据即断开
+    bool mute;         // 只收不回, 心跳也不回
+
+    // 统计
+    int accept_n;
+    int close_n;
+    int req_n;            // 收到的调用请求, 不含心跳
+    int hb_n;             // 收到的心跳请求
+    int64_t hb_res_reqid; // 最近收到的心跳响应
+
+    int64_t late_reqid;
+};
+
+// 监听 port, 失败返回 false
+bool fake_provider_start(struct fake_provider *, struct aeEventLoop *el, const char *port);
+// 关闭监听与所有连接
+void fake_provider_stop(struct fake_provider *);
+// 行为恢复默认, 统计清零, 已有连接不受影响
+void fake_provider_reset(struct fake_provider *);
+// 向最近接入的连接发心跳请求
+void fake_provider_heartbeat(struct fake_provider *, int64_t reqid);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdio.h>
 #include <inttypes.h>
 #include <unistd.h>
 #include <string.h>
@@ -8,373 +9,1633 @@
 #include "dubbo_hessian.h"
 #include "endian.h"
 #include "buffer.h"
-#include "utf8_decode.h"
+#include "utf8.h"
 
-static const char digits[] = "0123456789abcdef";
+// string/binary 单个 chunk 的最大字符数/字节数
+#define HS_CHUNK 0x8000
 
-// 非法 utf8 返回 null, 正常返回 null 结尾 char*
-char *utf82ascii(char *s)
+int hs_encode_null(uint8_t *out)
+{
+    out[0] = 'N';
+    return 1;
+}
+
+bool hs_decode_null(const uint8_t *buf, size_t sz)
+{
+    return sz == 1 && buf[0] == 'N';
+}
+
+int hs_encode_int(int32_t val, uint8_t *out)
+{
+    if (-0x10 <= val && val <= 0x2f)
+    {
+        out[0] = val + 0x90;
+        return 1;
+    }
+    else if (-0x800 <= val && val <= 0x7ff)
+    {
+        out[0] = (val >> 8) + 0xc8;
+        out[1] = val & 0xff;
+        return 2;
+    }
+    else if (-0x40000 <= val && val <= 0x3ffff)
+    {
+        out[0] = (val >> 16) + 0xd4;
+        out[1] = (val >> 8) & 0xff;
+        out[2] = val & 0xff;
+        return 3;
+    }
+    else
+    {
+        out[0] = 'I';
+        *(int32_t *)(out + 1) = htobe32(val);
+        return 5;
+    }
+}
+
+bool hs_decode_int(const uint8_t *buf, size_t sz, int32_t *out)
+{
+    bool r = true;
+    uint8_t code = buf[0];
+    if (sz >= 1 && code >= 0x80 && code <= 0xbf)
+    {
+        *out = code - 0x90;
+    }
+    else if (sz >= 2 && code >= 0xc0 && code <= 0xcf)
+    {
+        *out = ((code - 0xc8) << 8) + buf[1];
+    }
+    else if (sz >= 3 && code >= 0xd0 && code <= 0xd7)
+    {
+        *out = ((code - 0xd4) << 16) + (buf[1] << 8) + buf[2];
+    }
+    else if (sz >= 5 && code == 'I')
+    {
+        *out = be32toh(*(uint32_t *)&buf[1]);
+    }
+    else
+    {
+        r = false;
+    }
+    return r;
+}
+
+// java 的 String 以 UTF-16 码元 (char) 计长度, 补充平面字符 (4 字节 utf8) 占 2 个码元
+// java 把它写成两个 3 字节的代理 (U+D800..U+DFFF), 编码时同样写出, 解码时把成对的代理还原为 4 字节 utf8
+
+// 解析 string chunk 头, 返回头长度, 非法或数据不足返回 0
+// !!!!! 注意: 头中的长度是 UTF-16 码元数, 而非字节数
+static int decode_chunk_hdr(const uint8_t *buf, size_t sz, size_t *units, bool *last)
+{
+    if (sz < 1)
+    {
+        return 0;
+    }
+    uint8_t code = buf[0];
+    if (code <= 0x1f)
+    {
+        *units = code;
+        *last = true;
+        return 1;
+    }
+    else if (code >= 0x30 && code <= 0x33)
+    {
+        if (sz < 2)
+        {
+            return 0;
+        }
+        *units = ((code - 0x30) << 8) + buf[1];
+        *last = true;
+        return 2;
+    }
+    else if (code == 'S' || code == 'R')
+    {
+        if (sz < 3)
+        {
+            return 0;
+        }
+        *units = (buf[1] << 8) + buf[2];
+        *last = code == 'S';
+        return 3;
+    }
+    return 0;
+}
+
+// 最后一个 chunk 的头部字节数
+static size_t str_tail_hdr(size_t units)
+{
+    return units <= 0x1f ? 1 : units <= 0x3ff ? 2 : 3;
+}
+
+static size_t put_tail_hdr(uint8_t *p, size_t units)
+{
+    if (units <= 0x1f)
+    {
+        p[0] = units;
+        return 1;
+    }
+    else if (units <= 0x3ff)
+    {
+        p[0] = 0x30 + (units >> 8);
+        p[1] = units & 0xff;
+        return 2;
+    }
+    p[0] = 'S';
+    p[1] = units >> 8;
+    p[2] = units & 0xff;
+    return 3;
+}
+
+static inline void put_surrogate(uint8_t *p, uint32_t u)
+{
+    p[0] = 0xe0 | (u >> 12);
+    p[1] = 0x80 | ((u >> 6) & 0x3f);
+    p[2] = 0x80 | (u & 0x3f);
+}
+
+// 从 str 取至多 max 个码元写入 out (为 NULL 时只计算), 4 字节字符转为代理对, 代理对不拆到两个 chunk
+// 返回消耗的 str 字节数, *units 与 *wire 为写出的码元数与字节数
+static size_t chunk_body(uint8_t *out, const char *str, size_t len, size_t max, size_t *units, size_t *wire)
+{
+    const uint8_t *s = (const uint8_t *)str;
+    size_t i = 0, u = 0, w = 0;
+    while (i < len && u < max)
+    {
+        if (s[i] < 0xf0)
+        {
+            size_t k = s[i] < 0x80 ? 1 : s[i] < 0xe0 ? 2 : 3;
+            if (out)
+            {
+                memcpy(out + w, s + i, k);
+            }
+            i += k;
+            w += k;
+            u++;
+            continue;
+        }
+        if (u + 2 > max)
+        {
+            break;
+        }
+        uint32_t cp = ((s[i] & 0x07) << 18) | ((s[i + 1] & 0x3f) << 12) | ((s[i + 2] & 0x3f) << 6) | (s[i + 3] & 0x3f);
+        cp -= 0x10000;
+        if (out)
+        {
+            put_surrogate(out + w, 0xd800 + (cp >> 10));
+            put_surrogate(out + w + 3, 0xdc00 + (cp & 0x3ff));
+        }
+        i += 4;
+        w += 6;
+        u += 2;
+    }
+    *units = u;
+    *wire = w;
+    return i;
+}
+
+// 含补充平面字符时逐字符转码, out 为 NULL 时只计算编码后的字节数
+static size_t encode_string_supp(uint8_t *out, const char *str, size_t len, size_t units)
+{
+    size_t total = 0, n, u, w;
+    while (units > HS_CHUNK)
+    {
+        n = chunk_body(out ? out + total + 3 : NULL, str, len, HS_CHUNK, &u, &w);
+        if (out)
+        {
+            out[total] = 'R';
+            out[total + 1] = u >> 8;
+            out[total + 2] = u & 0xff;
+        }
+        total += 3 + w;
+        str += n;
+        len -= n;
+        units -= u;
+    }
+    size_t hdr = out ? put_tail_hdr(out + total, units) : str_tail_hdr(units);
+    n = chunk_body(out ? out + total + hdr : NULL, str, len, units, &u, &w);
+    assert(n == len && u == units);
+    return total + hdr + w;
+}
+
+// chars 个字符, units 个码元, len 字节的合法 utf8 编码后的字节数
+static size_t string_size(const char *str, size_t len, size_t chars, size_t units)
+{
+    if (units != chars)
+    {
+        return encode_string_supp(NULL, str, len, units);
+    }
+    size_t full = chars ? (chars - 1) / HS_CHUNK : 0;
+    return full * 3 + str_tail_hdr(chars - full * HS_CHUNK) + len;
+}
+
+size_t hs_string_size(const char *str, size_t len)
+{
+    size_t chars, units = utf8_count_utf16(str, len, &chars);
+    // 非法 utf8 随后编码会失败, 只需不按首字节越界读
+    if (units != chars && !utf8_valid(str, len))
+    {
+        units = chars;
+    }
+    return string_size(str, len, chars, units);
+}
+
+// str 已校验, out 至少 string_size 字节, 返回写入的字节数
+static size_t encode_string(uint8_t *out, const char *str, size_t len, size_t chars, size_t units)
+{
+    if (units != chars)
+    {
+        return encode_string_supp(out, str, len, units);
+    }
+    // 只有 BMP 字符: 字符数即码元数, 原样复制
+    uint8_t *p = out;
+    while (chars > HS_CHUNK)
+    {
+        ssize_t n = utf8_skip(str, len, HS_CHUNK);
+        assert(n > 0);
+        *p++ = 'R';
+        *p++ = HS_CHUNK >> 8;
+        *p++ = HS_CHUNK & 0xff;
+        memcpy(p, str, n);
+        p += n;
+        str += n;
+        len -= n;
+        chars -= HS_CHUNK;
+    }
+    p += put_tail_hdr(p, chars);
+    memcpy(p, str, len);
+    return p + len - out;
+}
+
+int hs_encode_string(const char *str, uint8_t *out)
+{
+    size_t bytes = strlen(str);
+    if (!utf8_valid(str, bytes))
+    {
+        return -1;
+    }
+    size_t chars, units = utf8_count_utf16(str, bytes, &chars);
+    return encode_string(out, str, bytes, chars, units);
+}
+
+bool hs_buf_write_string(struct buffer *out, const char *str, size_t len)
+{
+    if (!utf8_valid(str, len))
+    {
+        return false;
+    }
+    size_t chars, units = utf8_count_utf16(str, len, &chars);
+    buf_ensureWritable(out, string_size(str, len, chars, units));
+    buf_has_written(out, encode_string((uint8_t *)buf_beginWrite(out), str, len, chars, units));
+    return true;
+}
+
+// 3 字节编码的高代理后紧跟低代理
+static bool is_surrogate_pair(const uint8_t *p, size_t len)
+{
+    return len >= 6 && p[0] == 0xed && p[1] >= 0xa0 && p[1] <= 0xaf && (p[2] & 0xc0) == 0x80 &&
+           p[3] == 0xed && p[4] >= 0xb0 && p[4] <= 0xbf && (p[5] & 0xc0) == 0x80;
+}
+
+// 跳过 units 个码元并校验, 代理须成对; 4 字节 utf8 (非 java 的写入方) 同样计 2 个码元
+// 返回字节数, 非法或数据不足返回 -1; *utf8_sz 为代理对还原后的字节数
+static ssize_t skip_units(const uint8_t *s, size_t len, size_t units, size_t *utf8_sz)
+{
+    // 常见情况: 只有 BMP 字符, 码元数即字符数
+    ssize_t n = utf8_skip((const char *)s, len, units);
+    if (n >= 0 && utf8_count_utf16((const char *)s, n, NULL) == units)
+    {
+        *utf8_sz = n;
+        return n;
+    }
+    size_t i = 0, sz = 0;
+    while (units > 0)
+    {
+        uint32_t cp;
+        int k = utf8_decode((const char *)s + i, len - i, &cp);
+        if (k > 0)
+        {
+            size_t u = k == 4 ? 2 : 1;
+            if (u > units)
+            {
+                return -1;
+            }
+            units -= u;
+            i += k;
+            sz += k;
+        }
+        else if (units >= 2 && is_surrogate_pair(s + i, len - i))
+        {
+            units -= 2;
+            i += 6;
+            sz += 4;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    *utf8_sz = sz;
+    return i;
+}
+
+// 复制 n 字节已经 skip_units 校验的数据, 代理对还原为 4 字节 utf8, 返回写入的字节数
+static size_t copy_units(char *dst, const uint8_t *s, size_t n)
+{
+    size_t i = 0, w = 0;
+    while (i < n)
+    {
+        const uint8_t *e = memchr(s + i, 0xed, n - i);
+        size_t run = e ? (size_t)(e - (s + i)) : n - i;
+        memcpy(dst + w, s + i, run);
+        i += run;
+        w += run;
+        if (i == n)
+        {
+            break;
+        }
+        if (s[i + 1] < 0xa0)
+        {
+            // U+D000..U+D7FF
+            dst[w++] = s[i++];
+            continue;
+        }
+        uint32_t cp = 0x10000 + ((((s[i + 1] & 0x0f) << 6) | (s[i + 2] & 0x3f)) << 10) + (((s[i + 4] & 0x0f) << 6) | (s[i + 5] & 0x3f));
+        dst[w++] = 0xf0 | (cp >> 18);
+        dst[w++] = 0x80 | ((cp >> 12) & 0x3f);
+        dst[w++] = 0x80 | ((cp >> 6) & 0x3f);
+        dst[w++] = 0x80 | (cp & 0x3f);
+        i += 6;
+    }
+    return w;
+}
+
+bool hs_decode_string_view(const uint8_t *buf, size_t sz, const char **out, size_t *out_sz, size_t *consumed, bool *owned)
+{
+    size_t off = 0, total = 0, units, usz;
+    int chunks = 0, hdr;
+    bool last = false, converted = false;
+    ssize_t n;
+
+    // 第一遍: 校验并计算总字节数
+    while (!last)
+    {
+        hdr = decode_chunk_hdr(buf + off, sz - off, &units, &last);
+        if (hdr == 0)
+        {
+            return false;
+        }
+        n = skip_units(buf + off + hdr, sz - off - hdr, units, &usz);
+        if (n < 0)
+        {
+            return false;
+        }
+        off += hdr + n;
+        total += usz;
+        converted |= usz != (size_t)n;
+        chunks++;
+    }
+
+    *consumed = off;
+    *out_sz = total;
+    if (chunks == 1 && !converted)
+    {
+        *out = (const char *)buf + off - total;
+        *owned = false;
+        return true;
+    }
+
+    // 多 chunk 或含代理对: 一次分配, 拼接
+    char *str = malloc(total ? total : 1);
+    if (str == NULL)
+    {
+        return false;
+    }
+    size_t pos = 0, w = 0;
+    last = false;
+    while (!last)
+    {
+        hdr = decode_chunk_hdr(buf + pos, sz - pos, &units, &last);
+        n = skip_units(buf + pos + hdr, sz - pos - hdr, units, &usz);
+        if (usz == (size_t)n)
+        {
+            memcpy(str + w, buf + pos + hdr, n);
+            w += n;
+        }
+        else
+        {
+            w += copy_units(str + w, buf + pos + hdr, n);
+        }
+        pos += hdr + n;
+    }
+    *out = str;
+    *owned = true;
+    return true;
+}
+
+// !! FREE
+bool hs_decode_string(const uint8_t *buf, size_t sz, char **out, size_t *out_sz)
+{
+    const char *str;
+    size_t consumed;
+    bool owned;
+    if (!hs_decode_string_view(buf, sz, &str, out_sz, &consumed, &owned))
+    {
+        return false;
+    }
+    if (owned)
+    {
+        *out = (char *)str;
+        return true;
+    }
+    *out = malloc(*out_sz ? *out_sz : 1);
+    if (*out == NULL)
+    {
+        return false;
+    }
+    memcpy(*out, str, *out_sz);
+    return true;
+}
+
+// ****************************************************************************************************
+// 流式编码
+
+#define HS_MAX_DEPTH 512
+
+struct hs_class_def
+{
+    char *name;
+    char **fields;
+    int n;
+};
+
+struct hs_encoder
+{
+    struct buffer *out;
+    char **types;
+    int types_n;
+    int types_cap;
+    struct hs_class_def *classes;
+    int classes_n;
+    int classes_cap;
+};
+
+struct hs_encoder *hs_encoder_create(struct buffer *out)
+{
+    struct hs_encoder *enc = calloc(1, sizeof(*enc));
+    assert(enc);
+    enc->out = out;
+    return enc;
+}
+
+static void encoder_clear(struct hs_encoder *enc)
+{
+    int i, j;
+    for (i = 0; i < enc->types_n; i++)
+    {
+        free(enc->types[i]);
+    }
+    for (i = 0; i < enc->classes_n; i++)
+    {
+        for (j = 0; j < enc->classes[i].n; j++)
+        {
+            free(enc->classes[i].fields[j]);
+        }
+        free(enc->classes[i].fields);
+        free(enc->classes[i].name);
+    }
+    enc->types_n = 0;
+    enc->classes_n = 0;
+}
+
+void hs_encoder_release(struct hs_encoder *enc)
+{
+    encoder_clear(enc);
+    free(enc->types);
+    free(enc->classes);
+    free(enc);
+}
+
+void hs_encoder_reset(struct hs_encoder *enc, struct buffer *out)
+{
+    encoder_clear(enc);
+    enc->out = out;
+}
+
+static inline void put8(struct hs_encoder *enc, uint8_t c)
+{
+    buf_appendInt8(enc->out, c);
+}
+
+static void put_be(struct hs_encoder *enc, uint64_t v, int n)
+{
+    uint8_t tmp[8];
+    int i;
+    for (i = n - 1; i >= 0; i--)
+    {
+        tmp[i] = v & 0xff;
+        v >>= 8;
+    }
+    buf_append(enc->out, (const char *)tmp, n);
+}
+
+void hs_write_null(struct hs_encoder *enc)
+{
+    put8(enc, 'N');
+}
+
+void hs_write_bool(struct hs_encoder *enc, bool b)
+{
+    put8(enc, b ? 'T' : 'F');
+}
+
+void hs_write_int(struct hs_encoder *enc, int32_t i)
+{
+    uint8_t tmp[5];
+    buf_append(enc->out, (const char *)tmp, hs_encode_int(i, tmp));
+}
+
+void hs_write_long(struct hs_encoder *enc, int64_t l)
+{
+    if (-0x08 <= l && l <= 0x0f)
+    {
+        put8(enc, l + 0xe0);
+    }
+    else if (-0x800 <= l && l <= 0x7ff)
+    {
+        put8(enc, (l >> 8) + 0xf8);
+        put8(enc, l & 0xff);
+    }
+    else if (-0x40000 <= l && l <= 0x3ffff)
+    {
+        put8(enc, (l >> 16) + 0x3c);
+        put_be(enc, l, 2);
+    }
+    else if (INT32_MIN <= l && l <= INT32_MAX)
+    {
+        put8(enc, 0x59);
+        put_be(enc, (uint32_t)l, 4);
+    }
+    else
+    {
+        put8(enc, 'L');
+        put_be(enc, (uint64_t)l, 8);
+    }
+}
+
+void hs_write_double(struct hs_encoder *enc, double d)
+{
+    // 与 java Hessian2Output 相同的紧凑形式
+    if (d >= INT32_MIN && d <= INT32_MAX && (int32_t)d == d)
+    {
+        int32_t i = (int32_t)d;
+        if (i == 0)
+        {
+            put8(enc, 0x5b);
+            return;
+        }
+        else if (i == 1)
+        {
+            put8(enc, 0x5c);
+            return;
+        }
+        else if (-0x80 <= i && i < 0x80)
+        {
+            put8(enc, 0x5d);
+            put8(enc, i & 0xff);
+            return;
+        }
+        else if (-0x8000 <= i && i < 0x8000)
+        {
+            put8(enc, 0x5e);
+            put_be(enc, i, 2);
+            return;
+        }
+    }
+    if (d * 1000 >= INT32_MIN && d * 1000 <= INT32_MAX)
+    {
+        int32_t mills = (int32_t)(d * 1000);
+        if (0.001 * mills == d)
+        {
+            put8(enc, 0x5f);
+            put_be(enc, (uint32_t)mills, 4);
+            return;
+        }
+    }
+    union
+    {
+        double d;
+        uint64_t u;
+    } u = {d};
+    put8(enc, 'D');
+    put_be(enc, u.u, 8);
+}
+
+void hs_write_date(struct hs_encoder *enc, int64_t ms)
+{
+    if (ms % 60000 == 0 && ms / 60000 >= INT32_MIN && ms / 60000 <= INT32_MAX)
+    {
+        put8(enc, 0x4b);
+        put_be(enc, (uint32_t)(ms / 60000), 4);
+    }
+    else
+    {
+        put8(enc, 0x4a);
+        put_be(enc, (uint64_t)ms, 8);
+    }
+}
+
+bool hs_write_string(struct hs_encoder *enc, const char *str, size_t len)
+{
+    return hs_buf_write_string(enc->out, str, len);
+}
+
+void hs_write_binary(struct hs_encoder *enc, const void *data, size_t len)
+{
+    // 一次预留全部空间
+    size_t full = len ? (len - 1) / HS_CHUNK : 0, tail = len - full * HS_CHUNK;
+    buf_ensureWritable(enc->out, full * 3 + (tail <= 0x0f ? 1 : tail <= 0x3ff ? 2 : 3) + len);
+
+    const char *p = data;
+    uint8_t *w = (uint8_t *)buf_beginWrite(enc->out), *beg = w;
+    while (len > HS_CHUNK)
+    {
+        *w++ = 'A';
+        *w++ = HS_CHUNK >> 8;
+        *w++ = HS_CHUNK & 0xff;
+        memcpy(w, p, HS_CHUNK);
+        w += HS_CHUNK;
+        p += HS_CHUNK;
+        len -= HS_CHUNK;
+    }
+    if (len <= 0x0f)
+    {
+        *w++ = 0x20 + len;
+    }
+    else if (len <= 0x3ff)
+    {
+        *w++ = 0x34 + (len >> 8);
+        *w++ = len & 0xff;
+    }
+    else
+    {
+        *w++ = 'B';
+        *w++ = len >> 8;
+        *w++ = len & 0xff;
+    }
+    memcpy(w, p, len);
+    buf_has_written(enc->out, w + len - beg);
+}
+
+// 类型名第一次出现写字符串, 之后写序号
+static void write_type(struct hs_encoder *enc, const char *type)
+{
+    int i;
+    for (i = 0; i < enc->types_n; i++)
+    {
+        if (strcmp(enc->types[i], type) == 0)
+        {
+            hs_write_int(enc, i);
+            return;
+        }
+    }
+    if (enc->types_n == enc->types_cap)
+    {
+        enc->types_cap = enc->types_cap ? enc->types_cap * 2 : 8;
+        enc->types = realloc(enc->types, enc->types_cap * sizeof(char *));
+        assert(enc->types);
+    }
+    enc->types[enc->types_n] = strdup(type);
+    assert(enc->types[enc->types_n]);
+    enc->types_n++;
+    hs_write_string(enc, type, strlen(type));
+}
+
+void hs_write_list_begin(struct hs_encoder *enc, const char *type, int len)
+{
+    if (type)
+    {
+        if (0 <= len && len <= 7)
+        {
+            put8(enc, 0x70 + len);
+            write_type(enc, type);
+        }
+        else if (len >= 0)
+        {
+            put8(enc, 'V');
+            write_type(enc, type);
+            hs_write_int(enc, len);
+        }
+        else
+        {
+            put8(enc, 0x55);
+            write_type(enc, type);
+        }
+    }
+    else
+    {
+        if (0 <= len && len <= 7)
+        {
+            put8(enc, 0x78 + len);
+        }
+        else if (len >= 0)
+        {
+            put8(enc, 0x58);
+            hs_write_int(enc, len);
+        }
+        else
+        {
+            put8(enc, 0x57);
+        }
+    }
+}
+
+void hs_write_map_begin(struct hs_encoder *enc, const char *type)
+{
+    if (type)
+    {
+        put8(enc, 'M');
+        write_type(enc, type);
+    }
+    else
+    {
+        put8(enc, 'H');
+    }
+}
+
+void hs_write_end(struct hs_encoder *enc)
+{
+    put8(enc, 'Z');
+}
+
+static int find_class(struct hs_encoder *enc, const char *cls, const char *const *fields, int n)
+{
+    int i, j;
+    for (i = 0; i < enc->classes_n; i++)
+    {
+        struct hs_class_def *def = &enc->classes[i];
+        if (def->n != n || strcmp(def->name, cls) != 0)
+        {
+            continue;
+        }
+        for (j = 0; j < n && strcmp(def->fields[j], fields[j]) == 0; j++)
+        {
+        }
+        if (j == n)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void hs_write_object_begin(struct hs_encoder *enc, const char *cls, const char *const *fields, int n)
+{
+    int idx = find_class(enc, cls, fields, n), i;
+    if (idx < 0)
+    {
+        if (enc->classes_n == enc->classes_cap)
+        {
+            enc->classes_cap = enc->classes_cap ? enc->classes_cap * 2 : 8;
+            enc->classes = realloc(enc->classes, enc->classes_cap * sizeof(*enc->classes));
+            assert(enc->classes);
+        }
+        struct hs_class_def *def = &enc->classes[enc->classes_n];
+        def->name = strdup(cls);
+        def->fields = malloc((n ? n : 1) * sizeof(char *));
+        assert(def->name && def->fields);
+        def->n = n;
+
+        put8(enc, 'C');
+        hs_write_string(enc, cls, strlen(cls));
+        hs_write_int(enc, n);
+        for (i = 0; i < n; i++)
+        {
+            def->fields[i] = strdup(fields[i]);
+            assert(def->fields[i]);
+            hs_write_string(enc, fields[i], strlen(fields[i]));
+        }
+        idx = enc->classes_n++;
+    }
+
+    if (idx <= 0x0f)
+    {
+        put8(enc, 0x60 + idx);
+    }
+    else
+    {
+        put8(enc, 'O');
+        hs_write_int(enc, idx);
+    }
+}
+
+void hs_write_ref(struct hs_encoder *enc, int ref)
+{
+    put8(enc, 0x51);
+    hs_write_int(enc, ref);
+}
+
+// ****************************************************************************************************
+// 流式解码
+
+struct hs_frame
+{
+    int remaining; // -1 直到 'Z'
+};
+
+struct hs_reader
+{
+    struct buffer *in;
+    char *scratch; // 多 chunk 拼接的内存, 下一次 hs_read 时释放
+
+    char **types;
+    size_t *type_lens;
+    int types_n;
+    int types_cap;
+
+    struct hs_class **classes; // 逐个分配, 扩容时地址不变, hs_value.cls 一直有效
+    int classes_n;
+    int classes_cap;
+
+    struct hs_frame stack[HS_MAX_DEPTH];
+    int depth;
+
+    const char *err;
+};
+
+struct hs_reader *hs_reader_create(struct buffer *in)
+{
+    struct hs_reader *r = calloc(1, sizeof(*r));
+    assert(r);
+    r->in = in;
+    return r;
+}
+
+void hs_reader_release(struct hs_reader *r)
+{
+    int i, j;
+    free(r->scratch);
+    for (i = 0; i < r->types_n; i++)
+    {
+        free(r->types[i]);
+    }
+    free(r->types);
+    free(r->type_lens);
+    for (i = 0; i < r->classes_n; i++)
+    {
+        struct hs_class *cls = r->classes[i];
+        for (j = 0; j < cls->n; j++)
+        {
+            free((char *)cls->fields[j]);
+        }
+        free(cls->fields);
+        free(cls->field_lens);
+        free((char *)cls->name);
+        free(cls);
+    }
+    free(r->classes);
+    free(r);
+}
+
+const char *hs_reader_error(const struct hs_reader *r)
+{
+    return r->err ? r->err : "ok";
+}
+
+static bool rfail(struct hs_reader *r, const char *err)
+{
+    if (r->err == NULL)
+    {
+        r->err = err;
+    }
+    return false;
+}
+
+static inline const uint8_t *rpeek(struct hs_reader *r)
 {
-    struct buffer *buf = buf_create(strlen(s) * 2);
+    return (const uint8_t *)buf_peek(r->in);
+}
 
-    utf8_decode_init(s, strlen(s));
-    int c = utf8_decode_next();
-    while (c != UTF8_END)
-    {
-        if (c == UTF8_ERROR)
-        {
-            buf_release(buf);
-            return NULL;
-        }
+static inline bool need(struct hs_reader *r, size_t n)
+{
+    return buf_readable(r->in) >= n || rfail(r, "truncated");
+}
 
-        if (c >= 0 && c <= 127)
-        {
-            buf_appendInt8(buf, c);
-        }
-        else
-        {
-            /* From http://en.wikipedia.org/wiki/UTF16 */
-            if (c >= 0x10000)
-            {
-                unsigned int next_c;
-                c -= 0x10000;
-                next_c = (unsigned short)((c & 0x3ff) | 0xdc00);
-                c = (unsigned short)((c >> 10) | 0xd800);
-
-                buf_append(buf, "\\u", 2);
-                buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
-                buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
-                buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
-                buf_appendInt8(buf, digits[(c & 0xf)]);
-                c = next_c;
-            }
+static uint64_t get_be(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+    for (i = 0; i < n; i++)
+    {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
 
-            buf_append(buf, "\\u", 2);
-            buf_appendInt8(buf, digits[(c & 0xf000) >> 12]);
-            buf_appendInt8(buf, digits[(c & 0xf00) >> 8]);
-            buf_appendInt8(buf, digits[(c & 0xf0) >> 4]);
-            buf_appendInt8(buf, digits[(c & 0xf)]);
-        }
-        c = utf8_decode_next();
+static bool read_int(struct hs_reader *r, int32_t *out)
+{
+    if (!need(r, 1))
+    {
+        return false;
+    }
+    uint8_t code = rpeek(r)[0];
+    int n = code >= 0x80 && code <= 0xbf ? 1 : code >= 0xc0 && code <= 0xcf ? 2 : code >= 0xd0 && code <= 0xd7 ? 3 : code == 'I' ? 5 : 0;
+    if (n == 0)
+    {
+        return rfail(r, "expect int");
     }
+    if (!need(r, n) || !hs_decode_int(rpeek(r), n, out))
+    {
+        return false;
+    }
+    buf_retrieve(r->in, n);
+    return true;
+}
 
-    char *ret = malloc(buf_readable(buf) + 1);
-    assert(ret);
-    buf_retrieveAsString(buf, buf_readable(buf), ret);
-    buf_release(buf);
-    return ret;
+static bool is_string_code(uint8_t code)
+{
+    return code <= 0x1f || (code >= 0x30 && code <= 0x33) || code == 'S' || code == 'R';
 }
 
-size_t utf8len(const char *s, size_t sz)
+static bool read_string(struct hs_reader *r, const char **str, size_t *len)
 {
-    size_t len = 0;
-    size_t i = 0;
-    // for (; *s; ++s)
-    for (; i < sz; i++)
+    size_t consumed;
+    bool owned;
+    if (!hs_decode_string_view(rpeek(r), buf_readable(r->in), str, len, &consumed, &owned))
     {
-        if ((*s & 0xC0) != 0x80)
-        {
-            ++len;
-        }
+        return rfail(r, "invalid string");
+    }
+    if (owned)
+    {
+        free(r->scratch);
+        r->scratch = (char *)*str;
     }
-    return len;
+    buf_retrieve(r->in, consumed);
+    return true;
 }
 
-// 复制 size 个 utf8 字符, 返回实际复制字节数, 遇到非法 utf8 字符返回 -1
-int utf8cpy(uint8_t *dst, const uint8_t *src, size_t sz)
+// 读字符串并复制一份 (类型名/类定义跨越多次 hs_read 使用)
+static bool read_string_dup(struct hs_reader *r, char **out, size_t *len)
 {
-    int i = 0;
-    uint8_t c;
+    const char *str;
+    if (!need(r, 1) || !is_string_code(rpeek(r)[0]) || !read_string(r, &str, len))
+    {
+        return rfail(r, "expect string");
+    }
+    *out = malloc(*len + 1);
+    assert(*out);
+    memcpy(*out, str, *len);
+    (*out)[*len] = '\0';
+    return true;
+}
 
-    while (sz--)
+static bool read_binary(struct hs_reader *r, const char **data, size_t *len)
+{
+    // 第一遍计算总长度
+    const uint8_t *p = rpeek(r);
+    size_t sz = buf_readable(r->in), off = 0, total = 0, n;
+    int chunks = 0;
+    bool last = false;
+    while (!last)
     {
-        c = src[i];
-        if (c <= 0x80)
+        if (off >= sz)
         {
-            i += 1;
+            return rfail(r, "truncated");
         }
-        else if ((c & 0xE0) == 0xC0)
+        uint8_t code = p[off];
+        size_t hdr;
+        if (code >= 0x20 && code <= 0x2f)
         {
-            i += 2;
+            hdr = 1;
+            n = code - 0x20;
+            last = true;
         }
-        else if ((c & 0xF0) == 0xE0)
+        else if (code >= 0x34 && code <= 0x37)
         {
-            i += 3;
+            hdr = 2;
+            if (off + hdr > sz)
+            {
+                return rfail(r, "truncated");
+            }
+            n = ((code - 0x34) << 8) + p[off + 1];
+            last = true;
         }
-        else if ((c & 0xF8) == 0xF0)
+        else if (code == 'A' || code == 'B')
         {
-            i += 4;
+            hdr = 3;
+            if (off + hdr > sz)
+            {
+                return rfail(r, "truncated");
+            }
+            n = get_be(p + off + 1, 2);
+            last = code == 'B';
         }
         else
         {
-            // invalid utf8
-            return -1;
+            return rfail(r, "invalid binary chunk");
+        }
+        if (off + hdr + n > sz)
+        {
+            return rfail(r, "truncated");
         }
+        off += hdr + n;
+        total += n;
+        chunks++;
     }
 
-    if (i)
+    if (chunks == 1)
     {
-        memcpy(dst, src, i);
+        *data = (const char *)p + off - total;
     }
-
-    return i;
+    else
+    {
+        char *out = malloc(total ? total : 1);
+        assert(out);
+        size_t pos = 0, w = 0;
+        while (w < total)
+        {
+            n = get_be(p + pos + 1, 2);
+            size_t hdr = 3;
+            if (p[pos] < 'A')
+            {
+                hdr = p[pos] <= 0x2f ? 1 : 2;
+                n = hdr == 1 ? p[pos] - 0x20 : ((p[pos] - 0x34) << 8) + p[pos + 1];
+            }
+            memcpy(out + w, p + pos + hdr, n);
+            w += n;
+            pos += hdr + n;
+        }
+        free(r->scratch);
+        r->scratch = out;
+        *data = out;
+    }
+    *len = total;
+    buf_retrieve(r->in, off);
+    return true;
 }
 
-// http://hessian.caucho.com/doc/hessian-serialization.html
-
-int hs_encode_null(uint8_t *out)
+// 类型: 字符串, 或之前出现过的类型序号
+static bool read_type(struct hs_reader *r, const char **type, size_t *len)
 {
-    out[0] = 'N';
-    return 1;
-}
+    if (!need(r, 1))
+    {
+        return false;
+    }
+    if (!is_string_code(rpeek(r)[0]))
+    {
+        int32_t idx;
+        if (!read_int(r, &idx))
+        {
+            return false;
+        }
+        if (idx < 0 || idx >= r->types_n)
+        {
+            return rfail(r, "invalid type ref");
+        }
+        *type = r->types[idx];
+        *len = r->type_lens[idx];
+        return true;
+    }
 
-bool hs_decode_null(const uint8_t *buf, size_t sz)
-{
-    return sz == 1 && buf[0] == 'N';
+    if (r->types_n == r->types_cap)
+    {
+        r->types_cap = r->types_cap ? r->types_cap * 2 : 8;
+        r->types = realloc(r->types, r->types_cap * sizeof(char *));
+        r->type_lens = realloc(r->type_lens, r->types_cap * sizeof(size_t));
+        assert(r->types && r->type_lens);
+    }
+    if (!read_string_dup(r, &r->types[r->types_n], &r->type_lens[r->types_n]))
+    {
+        return false;
+    }
+    *type = r->types[r->types_n];
+    *len = r->type_lens[r->types_n];
+    r->types_n++;
+    return true;
 }
 
-int hs_encode_int(int32_t val, uint8_t *out)
+static bool read_class_def(struct hs_reader *r)
 {
-    if (-0x10 <= val && val <= 0x2f)
+    char *name;
+    size_t name_len;
+    int32_t n, i;
+    if (!read_string_dup(r, &name, &name_len))
     {
-        out[0] = val + 0x90;
-        return 1;
+        return false;
     }
-    else if (-0x800 <= val + 0xc8 && val <= 0x7ff)
+    if (!read_int(r, &n) || n < 0 || (size_t)n > buf_readable(r->in))
     {
-        out[1] = val & 0xff;
-        out[0] = (val >> 8) + 0xc8;
-        return 2;
+        free(name);
+        return rfail(r, "invalid class definition");
     }
-    else if (-0x40000 <= val && val <= 0x3ffff)
+    if (r->classes_n == r->classes_cap)
     {
-        out[0] = (val >> 16) + 0xd4;
-        *(uint16_t *)(out + 1) = htobe16(val & 0xffff);
-        return 3;
+        r->classes_cap = r->classes_cap ? r->classes_cap * 2 : 8;
+        r->classes = realloc(r->classes, r->classes_cap * sizeof(*r->classes));
+        assert(r->classes);
     }
-    else
+    struct hs_class *cls = malloc(sizeof(*cls));
+    assert(cls);
+    r->classes[r->classes_n] = cls;
+    cls->name = name;
+    cls->name_len = name_len;
+    cls->n = 0;
+    cls->fields = malloc((n ? n : 1) * sizeof(char *));
+    cls->field_lens = malloc((n ? n : 1) * sizeof(size_t));
+    assert(cls->fields && cls->field_lens);
+    // 先登记, 出错时由 release 统一释放
+    r->classes_n++;
+    for (i = 0; i < n; i++)
     {
-        out[0] = 'I';
-        *(int32_t *)(out + 1) = htobe32(val);
-        return 5;
+        if (!read_string_dup(r, (char **)&cls->fields[i], &cls->field_lens[i]))
+        {
+            return false;
+        }
+        cls->n++;
     }
-    return -1;
+    return true;
 }
 
-bool hs_decode_int(const uint8_t *buf, size_t sz, int32_t *out)
+static bool push(struct hs_reader *r, int remaining)
 {
-    bool r = true;
-    uint8_t code = buf[0];
-    if (sz >= 1 && code >= 0x80 && code <= 0xbf)
+    if (r->depth == HS_MAX_DEPTH)
     {
-        *out = code - 0x90;
+        return rfail(r, "nested too deep");
     }
-    else if (sz >= 2 && code >= 0xc0 && code <= 0xcf)
+    r->stack[r->depth++].remaining = remaining;
+    return true;
+}
+
+static bool read_value(struct hs_reader *r, struct hs_value *v)
+{
+    // 类定义不是值, 连续的类定义依次读完再读下一个值
+    while (need(r, 1) && rpeek(r)[0] == 'C')
     {
-        *out = ((code - 0xc8) << 8) + buf[1];
+        buf_retrieve(r->in, 1);
+        if (!read_class_def(r))
+        {
+            return false;
+        }
     }
-    else if (sz >= 3 && code >= 0xd0 && code <= 0xd7)
+    if (!need(r, 1))
     {
-        *out = ((code - 0xd4) << 16) + (buf[1] << 8) + buf[2];
+        return false;
     }
-    else if (sz >= 5 && code == 'I')
+    const uint8_t *p = rpeek(r);
+    uint8_t code = p[0];
+    int32_t i32;
+
+    v->str = NULL;
+    v->len = 0;
+    v->cls = NULL;
+
+    if (code <= 0x1f || (code >= 0x30 && code <= 0x33) || code == 'S' || code == 'R')
     {
-        *out = be32toh(*(uint32_t *)&buf[1]);
+        v->type = HS_STRING;
+        return read_string(r, &v->str, &v->len);
     }
-    else
+    if ((code >= 0x20 && code <= 0x2f) || (code >= 0x34 && code <= 0x37) || code == 'A' || code == 'B')
     {
-        r = false;
+        v->type = HS_BINARY;
+        return read_binary(r, &v->str, &v->len);
+    }
+    if (code >= 0x80 && code <= 0xd7)
+    {
+        v->type = HS_INT;
+        return read_int(r, &v->i);
+    }
+    if (code >= 0xd8 && code <= 0xef)
+    {
+        v->type = HS_LONG;
+        v->l = code - 0xe0;
+        buf_retrieve(r->in, 1);
+        return true;
+    }
+    if (code >= 0xf0)
+    {
+        if (!need(r, 2))
+        {
+            return false;
+        }
+        v->type = HS_LONG;
+        v->l = ((code - 0xf8) << 8) + p[1];
+        buf_retrieve(r->in, 2);
+        return true;
+    }
+    if (code >= 0x38 && code <= 0x3f)
+    {
+        if (!need(r, 3))
+        {
+            return false;
+        }
+        v->type = HS_LONG;
+        v->l = ((code - 0x3c) << 16) + (p[1] << 8) + p[2];
+        buf_retrieve(r->in, 3);
+        return true;
+    }
+    if (code >= 0x60 && code <= 0x6f)
+    {
+        buf_retrieve(r->in, 1);
+        i32 = code - 0x60;
+        goto object;
+    }
+    if (code >= 0x70 && code <= 0x77)
+    {
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        v->n = code - 0x70;
+        return read_type(r, &v->str, &v->len) && push(r, v->n);
+    }
+    if (code >= 0x78 && code <= 0x7f)
+    {
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        v->n = code - 0x78;
+        return push(r, v->n);
     }
-    return r;
-}
-
-// !!!!! 注意: 这里读出来的长度是指 UTF8 字符长度, 而非字节长度
-// out_length 修改为返回 字节数, 而非字符数
-static bool internal_decode_string(const uint8_t *buf, size_t buf_length, uint8_t *out_str, size_t *out_length, short *is_last_chunk)
-{
-    uint8_t code = buf[0];
-    size_t delta_length;
-    short result;
-    int sz;
 
     switch (code)
     {
-    case 0x00:
-    case 0x01:
-    case 0x02:
-    case 0x03:
-    case 0x04:
-    case 0x05:
-    case 0x06:
-    case 0x07:
-    case 0x08:
-    case 0x09:
-    case 0x0a:
-    case 0x0b:
-    case 0x0c:
-    case 0x0d:
-    case 0x0e:
-    case 0x0f:
-
-    case 0x10:
-    case 0x11:
-    case 0x12:
-    case 0x13:
-    case 0x14:
-    case 0x15:
-    case 0x16:
-    case 0x17:
-    case 0x18:
-    case 0x19:
-    case 0x1a:
-    case 0x1b:
-    case 0x1c:
-    case 0x1d:
-    case 0x1e:
-    case 0x1f:
-        *is_last_chunk = 1;
-        delta_length = code - 0x00;
-        if (buf_length < 1 + delta_length)
+    case 'N':
+        v->type = HS_NULL;
+        buf_retrieve(r->in, 1);
+        return true;
+    case 'T':
+    case 'F':
+        v->type = HS_BOOL;
+        v->b = code == 'T';
+        buf_retrieve(r->in, 1);
+        return true;
+    case 'I':
+        v->type = HS_INT;
+        return read_int(r, &v->i);
+    case 0x59:
+        if (!need(r, 5))
         {
             return false;
         }
-        sz = utf8cpy(out_str + *out_length, buf + 1, delta_length);
-        if (sz == -1)
+        v->type = HS_LONG;
+        v->l = (int32_t)get_be(p + 1, 4);
+        buf_retrieve(r->in, 5);
+        return true;
+    case 'L':
+        if (!need(r, 9))
         {
             return false;
         }
-        *out_length = *out_length + sz;
+        v->type = HS_LONG;
+        v->l = (int64_t)get_be(p + 1, 8);
+        buf_retrieve(r->in, 9);
         return true;
-
-    case 0x30:
-    case 0x31:
-    case 0x32:
-    case 0x33:
-        *is_last_chunk = 1;
-        if (buf_length < 2)
+    case 0x5b:
+    case 0x5c:
+        v->type = HS_DOUBLE;
+        v->d = code - 0x5b;
+        buf_retrieve(r->in, 1);
+        return true;
+    case 0x5d:
+        if (!need(r, 2))
         {
             return false;
         }
-        delta_length = (code - 0x30) * 256 + buf[1];
-        if (buf_length < 2 + delta_length)
+        v->type = HS_DOUBLE;
+        v->d = (int8_t)p[1];
+        buf_retrieve(r->in, 2);
+        return true;
+    case 0x5e:
+        if (!need(r, 3))
         {
             return false;
         }
-        sz = utf8cpy(out_str + *out_length, buf + 2, delta_length);
-        if (sz == -1)
+        v->type = HS_DOUBLE;
+        v->d = (int16_t)get_be(p + 1, 2);
+        buf_retrieve(r->in, 3);
+        return true;
+    case 0x5f:
+        if (!need(r, 5))
         {
             return false;
         }
-        *out_length = *out_length + sz;
+        v->type = HS_DOUBLE;
+        v->d = 0.001 * (int32_t)get_be(p + 1, 4);
+        buf_retrieve(r->in, 5);
         return true;
-
-    case 0x53:
-        *is_last_chunk = 1;
-        if (buf_length < 3)
+    case 'D':
+    {
+        if (!need(r, 9))
         {
             return false;
         }
-        delta_length = be16toh(*(uint16_t *)(buf + 1));
-        if (buf_length < 3 + delta_length)
+        union
+        {
+            uint64_t u;
+            double d;
+        } u = {get_be(p + 1, 8)};
+        v->type = HS_DOUBLE;
+        v->d = u.d;
+        buf_retrieve(r->in, 9);
+        return true;
+    }
+    case 0x4a:
+        if (!need(r, 9))
         {
             return false;
         }
-        sz = utf8cpy(out_str + *out_length, buf + 3, delta_length);
-        if (sz == -1)
+        v->type = HS_DATE;
+        v->l = (int64_t)get_be(p + 1, 8);
+        buf_retrieve(r->in, 9);
+        return true;
+    case 0x4b:
+        if (!need(r, 5))
         {
             return false;
         }
-        *out_length = *out_length + sz;
+        v->type = HS_DATE;
+        v->l = (int64_t)(int32_t)get_be(p + 1, 4) * 60000;
+        buf_retrieve(r->in, 5);
         return true;
-
-    case 0x52:
-        *is_last_chunk = 0;
-        if (buf_length < 3)
+    case 0x55:
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        v->n = -1;
+        return read_type(r, &v->str, &v->len) && push(r, -1);
+    case 'V':
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        if (!read_type(r, &v->str, &v->len) || !read_int(r, &i32))
         {
             return false;
         }
-        delta_length = be16toh(*(uint16_t *)(buf + 1));
-        if (buf_length < 3 + delta_length)
+        if (i32 < 0)
+        {
+            return rfail(r, "invalid list length");
+        }
+        v->n = i32;
+        return push(r, v->n);
+    case 0x57:
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        v->n = -1;
+        return push(r, -1);
+    case 0x58:
+        buf_retrieve(r->in, 1);
+        v->type = HS_LIST;
+        if (!read_int(r, &i32))
         {
             return false;
         }
-        sz = utf8cpy(out_str + *out_length, buf + 3, delta_length);
-        if (sz == -1)
+        if (i32 < 0)
+        {
+            return rfail(r, "invalid list length");
+        }
+        v->n = i32;
+        return push(r, v->n);
+    case 'M':
+        buf_retrieve(r->in, 1);
+        v->type = HS_MAP;
+        return read_type(r, &v->str, &v->len) && push(r, -1);
+    case 'H':
+        buf_retrieve(r->in, 1);
+        v->type = HS_MAP;
+        return push(r, -1);
+    case 'O':
+        buf_retrieve(r->in, 1);
+        if (!read_int(r, &i32))
         {
             return false;
         }
-        *out_length = *out_length + sz;
-        while (!*is_last_chunk)
+        goto object;
+    case 0x51:
+        buf_retrieve(r->in, 1);
+        v->type = HS_REF;
+        if (!read_int(r, &i32))
         {
-            result = internal_decode_string(buf, buf_length, out_str, out_length, is_last_chunk);
-            if (!result)
-            {
-                return false;
-            }
+            return false;
         }
-        break;
+        v->n = i32;
+        return true;
+    default:
+        return rfail(r, "unsupported hessian code");
     }
-    return false;
+
+object:
+    if (i32 < 0 || i32 >= r->classes_n)
+    {
+        return rfail(r, "invalid class ref");
+    }
+    v->type = HS_OBJECT;
+    v->cls = r->classes[i32];
+    return push(r, v->cls->n);
 }
 
-int hs_encode_string(const char *str, uint8_t *out)
+bool hs_read(struct hs_reader *r, struct hs_value *v)
 {
-    size_t index = 0;
-    int length = strlen(str);
-
-    // TODO
-    if (length > 0x8000)
+    if (r->err)
     {
-        return -1;
+        return false;
     }
+    free(r->scratch);
+    r->scratch = NULL;
 
-    if (length <= 31)
+    if (r->depth > 0)
     {
-        out[index++] = (uint8_t)(length);
+        struct hs_frame *f = &r->stack[r->depth - 1];
+        if (f->remaining == 0)
+        {
+            r->depth--;
+            v->type = HS_END;
+            return true;
+        }
+        if (f->remaining < 0)
+        {
+            if (!need(r, 1))
+            {
+                return false;
+            }
+            if (rpeek(r)[0] == 'Z')
+            {
+                buf_retrieve(r->in, 1);
+                r->depth--;
+                v->type = HS_END;
+                return true;
+            }
+        }
+        else
+        {
+            f->remaining--;
+        }
     }
-    else if (length <= 1023)
+    return read_value(r, v);
+}
+
+// ****************************************************************************************************
+// hessian -> json
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void binary_to_json(struct jsonw *jw, const uint8_t *p, size_t len)
+{
+    char *out = malloc((len + 2) / 3 * 4 + 1), *o = out;
+    assert(out);
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3)
     {
-        out[index++] = (uint8_t)(48 + (length >> 8));
-        // Integer overflow and wrapping assumed
-        out[index++] = (uint8_t)(length);
+        *o++ = b64[p[i] >> 2];
+        *o++ = b64[((p[i] & 3) << 4) | (p[i + 1] >> 4)];
+        *o++ = b64[((p[i + 1] & 0xf) << 2) | (p[i + 2] >> 6)];
+        *o++ = b64[p[i + 2] & 0x3f];
     }
-    else
+    if (i < len)
     {
-        out[index++] = 'S';
-        out[index++] = (uint8_t)((length >> 8));
-        // Integer overflow and wrapping assumed
-        out[index++] = (uint8_t)(length);
+        *o++ = b64[p[i] >> 2];
+        if (i + 1 < len)
+        {
+            *o++ = b64[((p[i] & 3) << 4) | (p[i + 1] >> 4)];
+            *o++ = b64[(p[i + 1] & 0xf) << 2];
+        }
+        else
+        {
+            *o++ = b64[(p[i] & 3) << 4];
+            *o++ = '=';
+        }
+        *o++ = '=';
     }
-
-    memcpy(out + index, str, length);
-    return index + length;
+    jw_string(jw, out, o - out);
+    free(out);
 }
 
-// !! FREE
-bool hs_decode_string(const uint8_t *buf, size_t sz, char **out, size_t *out_sz)
+static bool value_to_json(struct hs_reader *r, struct jsonw *jw, struct hs_value *v);
+
+static bool key_to_json(struct hs_reader *r, struct jsonw *jw, struct hs_value *k)
 {
-    short is_last_chunk = 0;
-    size_t out_length = 0;
-    uint8_t *out_str = (uint8_t *)malloc(sz);
-    if (NULL == out_str)
+    char tmp[24];
+    switch (k->type)
     {
-        return false;
+    case HS_STRING:
+        jw_key(jw, k->str, k->len);
+        return true;
+    case HS_INT:
+        jw_key(jw, tmp, snprintf(tmp, sizeof(tmp), "%" PRId32, k->i));
+        return true;
+    case HS_LONG:
+        jw_key(jw, tmp, snprintf(tmp, sizeof(tmp), "%" PRId64, k->l));
+        return true;
+    default:
+    {
+        // 其它类型的 key 用其 JSON 文本
+        struct buffer *kbuf = buf_create(64);
+        struct jsonw *kw = jw_create(kbuf, 0);
+        bool ok = value_to_json(r, kw, k);
+        jw_release(kw);
+        if (ok)
+        {
+            jw_key(jw, buf_peek(kbuf), buf_readable(kbuf));
+        }
+        buf_release(kbuf);
+        return ok;
+    }
     }
+}
 
-    if (internal_decode_string(buf, sz, out_str, &out_length, &is_last_chunk))
+static bool value_to_json(struct hs_reader *r, struct jsonw *jw, struct hs_value *v)
+{
+    struct hs_value e;
+    int i;
+    switch (v->type)
+    {
+    case HS_NULL:
+        jw_null(jw);
+        return true;
+    case HS_BOOL:
+        jw_bool(jw, v->b);
+        return true;
+    case HS_INT:
+        jw_int(jw, v->i);
+        return true;
+    case HS_LONG:
+    case HS_DATE:
+        jw_int(jw, v->l);
+        return true;
+    case HS_DOUBLE:
+        jw_double(jw, v->d);
+        return true;
+    case HS_STRING:
+        jw_string(jw, v->str, v->len);
+        return true;
+    case HS_BINARY:
+        binary_to_json(jw, (const uint8_t *)v->str, v->len);
+        return true;
+    case HS_REF:
+        jw_object_begin(jw);
+        jw_key(jw, "$ref", 4);
+        jw_int(jw, v->n);
+        jw_object_end(jw);
+        return true;
+    case HS_LIST:
+        jw_array_begin(jw);
+        for (;;)
+        {
+            if (!hs_read(r, &e))
+            {
+                return false;
+            }
+            if (e.type == HS_END)
+            {
+                break;
+            }
+            if (!value_to_json(r, jw, &e))
+            {
+                return false;
+            }
+        }
+        jw_array_end(jw);
+        return true;
+    case HS_MAP:
+        jw_object_begin(jw);
+        for (;;)
+        {
+            if (!hs_read(r, &e))
+            {
+                return false;
+            }
+            if (e.type == HS_END)
+            {
+                break;
+            }
+            if (!key_to_json(r, jw, &e) || !hs_read(r, &e) || e.type == HS_END || !value_to_json(r, jw, &e))
+            {
+                return rfail(r, "invalid map entry");
+            }
+        }
+        jw_object_end(jw);
+        return true;
+    case HS_OBJECT:
     {
-        uint8_t *new_out = (uint8_t *)realloc(out_str, out_length);
-        if (NULL != new_out)
+        const struct hs_class *cls = v->cls;
+        jw_object_begin(jw);
+        jw_key(jw, "$class", 6);
+        jw_string(jw, cls->name, cls->name_len);
+        for (i = 0; i < cls->n; i++)
+        {
+            jw_key(jw, cls->fields[i], cls->field_lens[i]);
+            if (!hs_read(r, &e) || e.type == HS_END || !value_to_json(r, jw, &e))
+            {
+                return rfail(r, "invalid object field");
+            }
+        }
+        if (!hs_read(r, &e) || e.type != HS_END)
         {
-            out_str = new_out;
+            return false;
         }
-        *out = (char *)out_str;
-        *out_sz = out_length;
+        jw_object_end(jw);
         return true;
     }
-    else
-    {
-        free(out_str);
-        return false;
+    default:
+        return rfail(r, "unexpected end");
     }
-}
\ No newline at end of file
+}
+
+bool hs_to_json(struct hs_reader *r, struct jsonw *jw)
+{
+    struct hs_value v;
+    return hs_read(r, &v) && value_to_json(r, jw, &v);
+}
@@ -4,10 +4,10 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include "buffer.h"
+#include "jsonw.h"
 
-char *utf82ascii(char *s);
-size_t utf8len(const char *s, size_t sz);
-int utf8cpy(uint8_t *dst, const uint8_t *src, size_t sz);
+// http://hessian.caucho.com/doc/hessian-serialization.html
 
 int hs_encode_null(uint8_t *out);
 bool hs_decode_null(const uint8_t *buf, size_t sz);
@@ -15,6 +15,106 @@ bool hs_decode_null(const uint8_t *buf, size_t sz);
 int hs_encode_int(int32_t val, uint8_t *out);
 bool hs_decode_int(const uint8_t *buf, size_t sz, int32_t *out);
 
+// 长度同 java 为 UTF-16 码元数, 补充平面字符写为代理对 (两个 3 字节序列), 解码时还原为 4 字节 utf8
+// 超过 0x8000 码元分 chunk ('R' ... 末尾 chunk), 代理对不跨 chunk; out 至少 hs_string_size 字节, 非法 utf8 返回 -1
 int hs_encode_string(const char *str, uint8_t *out);
+// 合法 utf8 字符串编码后的字节数 (含各 chunk 头), 非法 utf8 时不越界但结果无意义
+size_t hs_string_size(const char *str, size_t len);
+// 一次计算编码长度, 一次 buf_ensureWritable 后直接写入 out; 非法 utf8 返回 false, 不写入
+bool hs_buf_write_string(struct buffer *out, const char *str, size_t len);
 bool hs_decode_string(const uint8_t *buf, size_t sz, char **out, size_t *out_sz);
-#endif
\ No newline at end of file
+// 不复制: 单 chunk 时 *out 指向 buf 内部 (*owned = false), 多 chunk 时拼接到一次精确分配的内存 (*owned = true, 需 free)
+// *out_sz 为字节数, *consumed 为编码占用的字节数
+bool hs_decode_string_view(const uint8_t *buf, size_t sz, const char **out, size_t *out_sz, size_t *consumed, bool *owned);
+
+// ****************************************************************************************************
+// 流式编码, 直接写入 struct buffer
+// 一个 encoder 对应一个 hessian 流: 类定义与类型名只在第一次出现时写出, 之后写引用序号
+
+struct hs_encoder;
+
+struct hs_encoder *hs_encoder_create(struct buffer *out);
+void hs_encoder_release(struct hs_encoder *);
+// 开始新的流 (如新的 dubbo 请求体), 清空类定义与类型表
+void hs_encoder_reset(struct hs_encoder *, struct buffer *out);
+
+void hs_write_null(struct hs_encoder *);
+void hs_write_bool(struct hs_encoder *, bool b);
+void hs_write_int(struct hs_encoder *, int32_t i);
+void hs_write_long(struct hs_encoder *, int64_t l);
+void hs_write_double(struct hs_encoder *, double d);
+// 毫秒时间戳
+void hs_write_date(struct hs_encoder *, int64_t ms);
+// 长度前缀为字符数, 超过 0x8000 字符分 chunk; 非法 utf8 返回 false, 不写入
+bool hs_write_string(struct hs_encoder *, const char *str, size_t len);
+void hs_write_binary(struct hs_encoder *, const void *data, size_t len);
+
+// type 为 NULL 表示无类型; len < 0 为变长, 以 hs_write_end 结束
+void hs_write_list_begin(struct hs_encoder *, const char *type, int len);
+// 之后交替写 key, value, 以 hs_write_end 结束
+void hs_write_map_begin(struct hs_encoder *, const char *type);
+void hs_write_end(struct hs_encoder *);
+// 之后按 fields 顺序写 n 个字段值, 无结束符
+void hs_write_object_begin(struct hs_encoder *, const char *cls, const char *const *fields, int n);
+// 引用之前写出的第 ref 个 list/map/object
+void hs_write_ref(struct hs_encoder *, int ref);
+
+// ****************************************************************************************************
+// 流式解码, 从 struct buffer 读并 retrieve 已解码部分
+// 字符串/二进制/类型名/类名为指向 buffer 的视图 (多 chunk 时为 reader 持有的内存), 在下一次 hs_read 前有效
+
+enum hs_type
+{
+    HS_NULL,
+    HS_BOOL,
+    HS_INT,
+    HS_LONG,
+    HS_DOUBLE,
+    HS_DATE,
+    HS_STRING,
+    HS_BINARY,
+    HS_LIST,
+    HS_MAP,
+    HS_OBJECT,
+    HS_REF,
+    HS_END, // 当前 list/map/object 结束
+};
+
+struct hs_class
+{
+    const char *name;
+    size_t name_len;
+    int n;
+    const char **fields;
+    size_t *field_lens;
+};
+
+struct hs_value
+{
+    enum hs_type type;
+    bool b;
+    int32_t i;
+    int64_t l; // HS_LONG, HS_DATE (毫秒)
+    double d;
+    const char *str; // HS_STRING, HS_BINARY; HS_LIST/HS_MAP 的类型名 (无类型时长度为 0)
+    size_t len;
+    int n;                      // HS_LIST 长度 (-1 变长), HS_REF 引用序号
+    const struct hs_class *cls; // HS_OBJECT, reader 释放前一直有效
+};
+
+struct hs_reader;
+
+struct hs_reader *hs_reader_create(struct buffer *in);
+void hs_reader_release(struct hs_reader *);
+
+// 读取下一个值
+// list/map/object 只读出头部, 之后依次读其元素 (map 为 key/value 交替, object 为各字段值), 读完返回 HS_END
+// 数据不足或非法返回 false
+bool hs_read(struct hs_reader *, struct hs_value *);
+const char *hs_reader_error(const struct hs_reader *);
+
+// 读取一个完整的值并转为 JSON
+// date 为毫秒数, binary 为 base64 字符串, object 带 "$class", 引用为 {"$ref":n}, map 的非字符串 key 转为其 JSON 文本
+bool hs_to_json(struct hs_reader *, struct jsonw *);
+
+#endif
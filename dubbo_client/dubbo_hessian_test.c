@@ -0,0 +1,868 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "buffer.h"
+#include "jsonw.h"
+#include "dubbo_hessian.h"
+#include "dubbo_codec.h"
+
+void test_Hessian_string_view()
+{
+    const char *str;
+    size_t sz, consumed;
+    bool owned;
+
+    // 短字符串 + 后续字段, 长度为字符数
+    const uint8_t short_str[] = {0x03, 'a', 0xe4, 0xb8, 0xad, 'b', 0x91};
+    assert(hs_decode_string_view(short_str, sizeof(short_str), &str, &sz, &consumed, &owned));
+    assert(!owned && str == (const char *)short_str + 1 && sz == 5 && consumed == 6);
+
+    const uint8_t mid_str[] = {0x30, 0x02, 'x', 'y'};
+    assert(hs_decode_string_view(mid_str, sizeof(mid_str), &str, &sz, &consumed, &owned));
+    assert(!owned && sz == 2 && memcmp(str, "xy", 2) == 0 && consumed == 4);
+
+    // 多 chunk 拼接
+    const uint8_t chunked[] = {'R', 0x00, 0x02, 'a', 'b', 'R', 0x00, 0x01, 0xe4, 0xb8, 0xad, 0x01, 'c', 'N'};
+    assert(hs_decode_string_view(chunked, sizeof(chunked), &str, &sz, &consumed, &owned));
+    assert(owned && sz == 6 && memcmp(str, "ab\xe4\xb8\xad" "c", 6) == 0 && consumed == 13);
+    free((char *)str);
+
+    char *copy;
+    assert(hs_decode_string(short_str, sizeof(short_str), &copy, &sz));
+    assert(sz == 5 && memcmp(copy, "a\xe4\xb8\xad" "b", 5) == 0);
+    free(copy);
+
+    // 截断 / 非法 utf8 / 缺少末尾 chunk
+    const uint8_t truncated[] = {0x03, 'a', 0xe4, 0xb8};
+    assert(!hs_decode_string_view(truncated, sizeof(truncated), &str, &sz, &consumed, &owned));
+    const uint8_t invalid[] = {0x02, 'a', 0xff};
+    assert(!hs_decode_string_view(invalid, sizeof(invalid), &str, &sz, &consumed, &owned));
+    const uint8_t no_final[] = {'R', 0x00, 0x01, 'a'};
+    assert(!hs_decode_string_view(no_final, sizeof(no_final), &str, &sz, &consumed, &owned));
+    const uint8_t not_str[] = {'N'};
+    assert(!hs_decode_string_view(not_str, sizeof(not_str), &str, &sz, &consumed, &owned));
+}
+
+void test_Hessian_string_encode()
+{
+    uint8_t out[64];
+    int n = hs_encode_string("a中b", out);
+    assert(n == 6 && out[0] == 0x03);
+
+    const char *str;
+    size_t sz, consumed;
+    bool owned;
+    assert(hs_decode_string_view(out, n, &str, &sz, &consumed, &owned));
+    assert(sz == 5 && consumed == 6 && memcmp(str, "a中b", 5) == 0);
+}
+
+void test_Hessian_string_supplementary()
+{
+    // 长度为 UTF-16 码元数, 补充平面字符同 java 写为代理对
+    uint8_t out[64];
+    int n = hs_encode_string("a😀", out);
+    assert(n == 8 && memcmp(out, "\x03" "a\xed\xa0\xbd\xed\xb8\x80", 8) == 0);
+    assert(hs_string_size("a😀", 5) == 8);
+    // 截断的 4 字节首字节: 计算不越界, 编码失败
+    hs_string_size("a\xf0", 2);
+    assert(hs_encode_string("a\xf0", out) == -1);
+
+    const char *str;
+    size_t sz, consumed;
+    bool owned;
+    // java 写出的代理对还原为 4 字节 utf8
+    const uint8_t java[] = {0x02, 0xed, 0xa0, 0xbd, 0xed, 0xb8, 0x80, 'N'};
+    assert(hs_decode_string_view(java, sizeof(java), &str, &sz, &consumed, &owned));
+    assert(owned && sz == 4 && consumed == 7 && memcmp(str, "😀", 4) == 0);
+    free((char *)str);
+    // 代理对与 BMP 中 0xed 开头的字符混合
+    const uint8_t mixed[] = {0x04, 0xed, 0x9f, 0xbf, 0xed, 0xa0, 0xbd, 0xed, 0xb8, 0x80, 'b'};
+    assert(hs_decode_string_view(mixed, sizeof(mixed), &str, &sz, &consumed, &owned));
+    assert(owned && sz == 8 && consumed == sizeof(mixed) && memcmp(str, "\xed\x9f\xbf😀b", 8) == 0);
+    free((char *)str);
+    // 直接写 4 字节 utf8 的写入方, 同样计 2 个码元
+    const uint8_t raw[] = {0x03, 0xf0, 0x9f, 0x98, 0x80, 'c'};
+    assert(hs_decode_string_view(raw, sizeof(raw), &str, &sz, &consumed, &owned));
+    assert(!owned && sz == 5 && consumed == 6 && memcmp(str, "😀c", 5) == 0);
+
+    // 落单或次序颠倒的代理, 码元数只够半个代理对
+    const uint8_t lone[] = {0x01, 0xed, 0xa0, 0xbd};
+    assert(!hs_decode_string_view(lone, sizeof(lone), &str, &sz, &consumed, &owned));
+    const uint8_t lone2[] = {0x02, 0xed, 0xa0, 0xbd, 'a'};
+    assert(!hs_decode_string_view(lone2, sizeof(lone2), &str, &sz, &consumed, &owned));
+    const uint8_t swapped[] = {0x02, 0xed, 0xb8, 0x80, 0xed, 0xa0, 0xbd};
+    assert(!hs_decode_string_view(swapped, sizeof(swapped), &str, &sz, &consumed, &owned));
+    const uint8_t half[] = {0x01, 0xf0, 0x9f, 0x98, 0x80};
+    assert(!hs_decode_string_view(half, sizeof(half), &str, &sz, &consumed, &owned));
+
+    // 0x7fff 个 ASCII 之后的代理对不拆开: 第一个 chunk 只有 0x7fff 个码元
+    size_t len = 0x7fff + 4 + 1;
+    char *big = malloc(len + 1);
+    memset(big, 'a', 0x7fff);
+    memcpy(big + 0x7fff, "😀b", 6);
+    struct buffer *buf = buf_create(16);
+    assert(hs_buf_write_string(buf, big, len));
+    const uint8_t *p = (const uint8_t *)buf_peek(buf);
+    assert(buf_readable(buf) == hs_string_size(big, len));
+    assert(buf_readable(buf) == 3 + 0x7fff + 1 + 6 + 1);
+    assert(p[0] == 'R' && p[1] == 0x7f && p[2] == 0xff && p[3 + 0x7fff] == 0x03);
+    assert(hs_decode_string_view(p, buf_readable(buf), &str, &sz, &consumed, &owned));
+    assert(owned && sz == len && consumed == buf_readable(buf) && memcmp(str, big, len) == 0);
+    free((char *)str);
+    free(big);
+    buf_release(buf);
+}
+
+// ****************************************************************************************************
+// 编码: 与 hessian 2.0 规范中的示例逐字节比较
+
+static void dump_hex(const char *bin, size_t sz)
+{
+    size_t i;
+    for (i = 0; i < sz; i++)
+    {
+        fprintf(stderr, "%02x ", (uint8_t)bin[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void expect_bytes(struct buffer *buf, const char *expected, size_t len)
+{
+    if (buf_readable(buf) != len || memcmp(buf_peek(buf), expected, len) != 0)
+    {
+        fprintf(stderr, "got:      ");
+        dump_hex(buf_peek(buf), buf_readable(buf));
+        fprintf(stderr, "expected: ");
+        dump_hex(expected, len);
+        assert(0);
+    }
+    buf_retrieveAll(buf);
+}
+
+#define EXPECT(buf, lit) expect_bytes((buf), (lit), sizeof(lit) - 1)
+
+void test_Hessian_encode_scalar()
+{
+    struct buffer *buf = buf_create(64);
+    struct hs_encoder *enc = hs_encoder_create(buf);
+
+    hs_write_null(enc);
+    EXPECT(buf, "N");
+    hs_write_bool(enc, true);
+    hs_write_bool(enc, false);
+    EXPECT(buf, "TF");
+
+    const struct
+    {
+        int32_t v;
+        const char *b;
+        size_t n;
+    } ints[] = {
+        {0, "\x90", 1},
+        {-16, "\x80", 1},
+        {47, "\xbf", 1},
+        {48, "\xc8\x30", 2},
+        {-2048, "\xc0\x00", 2},
+        {2047, "\xcf\xff", 2},
+        {-262144, "\xd0\x00\x00", 3},
+        {262143, "\xd7\xff\xff", 3},
+        {262144, "I\x00\x04\x00\x00", 5},
+        {INT32_MIN, "I\x80\x00\x00\x00", 5},
+    };
+    size_t i;
+    for (i = 0; i < sizeof(ints) / sizeof(ints[0]); i++)
+    {
+        hs_write_int(enc, ints[i].v);
+        expect_bytes(buf, ints[i].b, ints[i].n);
+    }
+
+    const struct
+    {
+        int64_t v;
+        const char *b;
+        size_t n;
+    } longs[] = {
+        {0, "\xe0", 1},
+        {-8, "\xd8", 1},
+        {15, "\xef", 1},
+        {-2048, "\xf0\x00", 2},
+        {2047, "\xff\xff", 2},
+        {-262144, "\x38\x00\x00", 3},
+        {262143, "\x3f\xff\xff", 3},
+        {INT32_MAX, "\x59\x7f\xff\xff\xff", 5},
+        {(int64_t)INT32_MAX + 1, "L\x00\x00\x00\x00\x80\x00\x00\x00", 9},
+    };
+    for (i = 0; i < sizeof(longs) / sizeof(longs[0]); i++)
+    {
+        hs_write_long(enc, longs[i].v);
+        expect_bytes(buf, longs[i].b, longs[i].n);
+    }
+
+    hs_write_double(enc, 0.0);
+    EXPECT(buf, "\x5b");
+    hs_write_double(enc, 1.0);
+    EXPECT(buf, "\x5c");
+    hs_write_double(enc, -128.0);
+    EXPECT(buf, "\x5d\x80");
+    hs_write_double(enc, 127.0);
+    EXPECT(buf, "\x5d\x7f");
+    hs_write_double(enc, -32768.0);
+    EXPECT(buf, "\x5e\x80\x00");
+    hs_write_double(enc, 12.25);
+    EXPECT(buf, "\x5f\x00\x00\x2f\xda");
+    hs_write_double(enc, 1e300);
+    EXPECT(buf, "D\x7e\x37\xe4\x3c\x88\x00\x75\x9c");
+
+    // 09:51:31 May 8, 1998 UTC
+    hs_write_date(enc, 894621091000LL);
+    EXPECT(buf, "\x4a\x00\x00\x00\xd0\x4b\x92\x84\xb8");
+    // 09:51:00 May 8, 1998 UTC
+    hs_write_date(enc, 894621060000LL);
+    EXPECT(buf, "\x4b\x00\xe3\x83\x8f");
+
+    assert(hs_write_string(enc, "", 0));
+    EXPECT(buf, "\x00");
+    assert(hs_write_string(enc, "hello", 5));
+    EXPECT(buf, "\x05hello");
+    assert(hs_write_string(enc, "\xc3\x83", 2));
+    EXPECT(buf, "\x01\xc3\x83");
+    assert(!hs_write_string(enc, "a\xff", 2));
+    assert(buf_readable(buf) == 0);
+
+    hs_write_binary(enc, "", 0);
+    EXPECT(buf, "\x20");
+    hs_write_binary(enc, "\x01\x02\x03", 3);
+    EXPECT(buf, "\x23\x01\x02\x03");
+
+    hs_encoder_release(enc);
+    buf_release(buf);
+}
+
+void test_Hessian_encode_chunked()
+{
+    struct buffer *buf = buf_create(64);
+    struct hs_encoder *enc = hs_encoder_create(buf);
+
+    // 0x8000 + 1 个字符: 一个 'R' chunk 加一个单字符的末尾 chunk
+    size_t n = 0x8000 + 1, i;
+    char *str = malloc(n * 2);
+    for (i = 0; i < n; i++)
+    {
+        memcpy(str + i * 2, "\xc3\x83", 2);
+    }
+    assert(hs_write_string(enc, str, n * 2));
+    const uint8_t *p = (const uint8_t *)buf_peek(buf);
+    assert(buf_readable(buf) == 3 + 0x8000 * 2 + 1 + 2);
+    assert(p[0] == 'R' && p[1] == 0x80 && p[2] == 0x00 && p[3 + 0x10000] == 0x01);
+
+    const char *view;
+    size_t sz, consumed;
+    bool owned;
+    assert(hs_decode_string_view(p, buf_readable(buf), &view, &sz, &consumed, &owned));
+    assert(owned && sz == n * 2 && consumed == buf_readable(buf) && memcmp(view, str, sz) == 0);
+    free((char *)view);
+    buf_retrieveAll(buf);
+
+    hs_write_binary(enc, str, 0x8000 + 16);
+    p = (const uint8_t *)buf_peek(buf);
+    assert(buf_readable(buf) == 3 + 0x8000 + 2 + 16);
+    assert(p[0] == 'A' && p[3 + 0x8000] == 0x34 && p[4 + 0x8000] == 16);
+
+    free(str);
+    hs_encoder_release(enc);
+    buf_release(buf);
+}
+
+void test_Hessian_string_large()
+{
+    // 4MB, ASCII 与 3 字节字符混合, chunk 边界落在多字节字符的字节中间之后
+    size_t n = 4 * 1024 * 1024, len = 0, chars = 0;
+    char *str = malloc(n + 3);
+    while (len < n)
+    {
+        if (chars % 7 == 0)
+        {
+            memcpy(str + len, "\xe4\xb8\xad", 3);
+            len += 3;
+        }
+        else
+        {
+            str[len++] = 'a' + chars % 26;
+        }
+        chars++;
+    }
+
+    struct buffer *buf = buf_create(16);
+    assert(hs_buf_write_string(buf, str, len));
+    size_t sz = hs_string_size(str, len);
+    assert(buf_readable(buf) == sz);
+    // 只扩容一次, 恰好够用
+    assert(buf_internalCapacity(buf) == BufCheapPrepend + sz);
+
+    const char *view;
+    size_t out_sz, consumed;
+    bool owned;
+    assert(hs_decode_string_view((const uint8_t *)buf_peek(buf), buf_readable(buf), &view, &out_sz, &consumed, &owned));
+    assert(owned && out_sz == len && consumed == sz && memcmp(view, str, len) == 0);
+    free((char *)view);
+
+    // 与写入裸内存的结果一致
+    str[len] = '\0';
+    uint8_t *raw = malloc(sz);
+    assert(hs_encode_string(str, raw) == (int)sz && memcmp(raw, buf_peek(buf), sz) == 0);
+    free(raw);
+    buf_release(buf);
+
+    // 恰好 0x8000 个字符不分 chunk
+    buf = buf_create(16);
+    memset(str, 'x', 0x8000);
+    assert(hs_buf_write_string(buf, str, 0x8000));
+    assert(buf_readable(buf) == 3 + 0x8000 && (uint8_t)buf_peek(buf)[0] == 'S');
+    buf_release(buf);
+
+    // 多 MB 泛化调用参数
+    len = 0;
+    memcpy(str, "[\"", 2);
+    len = 2;
+    while (len < n)
+    {
+        str[len++] = 'x';
+    }
+    memcpy(str + len, "\"]", 3);
+    struct dubbo_req *req = dubbo_req_create("com.youzan.Demo", "hello", NULL, str, "{\"k\":\"v\"}");
+    assert(req);
+    buf = dubbo_encode(req);
+    assert(buf && buf_readable(buf) > n && buf_internalCapacity(buf) == buf_readable(buf));
+    buf_release(buf);
+    dubbo_req_release(req);
+
+    free(str);
+}
+
+void test_Hessian_encode_container()
+{
+    struct buffer *buf = buf_create(64);
+    struct hs_encoder *enc = hs_encoder_create(buf);
+
+    // int[] {0, 1}, 第二次类型名写为引用
+    hs_write_list_begin(enc, "[int", 2);
+    hs_write_int(enc, 0);
+    hs_write_int(enc, 1);
+    hs_write_list_begin(enc, "[int", 1);
+    hs_write_int(enc, 2);
+    EXPECT(buf, "\x72\x04[int\x90\x91\x71\x90\x92");
+
+    hs_write_list_begin(enc, NULL, 2);
+    hs_write_int(enc, 0);
+    hs_write_int(enc, 1);
+    EXPECT(buf, "\x7a\x90\x91");
+    hs_write_list_begin(enc, NULL, -1);
+    hs_write_int(enc, 0);
+    hs_write_end(enc);
+    EXPECT(buf, "\x57\x90Z");
+    hs_write_list_begin(enc, NULL, 8);
+    EXPECT(buf, "\x58\x98");
+    hs_write_list_begin(enc, "[string", 8);
+    EXPECT(buf, "V\x07[string\x98");
+
+    hs_write_map_begin(enc, NULL);
+    hs_write_int(enc, 1);
+    hs_write_string(enc, "fee", 3);
+    hs_write_end(enc);
+    EXPECT(buf, "H\x91\x03" "feeZ");
+    hs_write_map_begin(enc, "com.caucho.test.Car");
+    hs_write_end(enc);
+    EXPECT(buf, "M\x13" "com.caucho.test.CarZ");
+
+    // 类定义只写一次
+    const char *fields[] = {"color", "model"};
+    hs_write_object_begin(enc, "example.Car", fields, 2);
+    hs_write_string(enc, "red", 3);
+    hs_write_string(enc, "corvette", 8);
+    hs_write_object_begin(enc, "example.Car", fields, 2);
+    hs_write_string(enc, "green", 5);
+    hs_write_string(enc, "civic", 5);
+    EXPECT(buf, "C\x0b" "example.Car\x92\x05" "color\x05model"
+                "\x60\x03red\x08" "corvette"
+                "\x60\x05green\x05" "civic");
+
+    hs_write_ref(enc, 0);
+    EXPECT(buf, "\x51\x90");
+
+    // 新的流重新写类定义
+    hs_encoder_reset(enc, buf);
+    hs_write_object_begin(enc, "example.Car", fields, 0);
+    EXPECT(buf, "C\x0b" "example.Car\x90\x60");
+
+    hs_encoder_release(enc);
+    buf_release(buf);
+}
+
+// ****************************************************************************************************
+// 解码: 规范示例与 java 端录制的字节 -> JSON
+
+static void expect_json(const char *bin, size_t len, const char *expected)
+{
+    struct buffer *in = buf_create(len + 1);
+    buf_append(in, bin, len);
+    struct buffer *out = buf_create(64);
+    struct jsonw *jw = jw_create(out, 0);
+    struct hs_reader *r = hs_reader_create(in);
+    bool ok = hs_to_json(r, jw);
+    if (!ok || buf_readable(in) != 0 || buf_readable(out) != strlen(expected) || memcmp(buf_peek(out), expected, buf_readable(out)) != 0)
+    {
+        fprintf(stderr, "got %s (%s, %zu left): %.*s\nexpected: %s\n", ok ? "ok" : "fail", hs_reader_error(r), buf_readable(in),
+                (int)buf_readable(out), buf_peek(out), expected);
+        assert(0);
+    }
+    hs_reader_release(r);
+    jw_release(jw);
+    buf_release(out);
+    buf_release(in);
+}
+
+static void expect_invalid(const char *bin, size_t len)
+{
+    struct buffer *in = buf_create(len + 1);
+    buf_append(in, bin, len);
+    struct buffer *out = buf_create(64);
+    struct jsonw *jw = jw_create(out, 0);
+    struct hs_reader *r = hs_reader_create(in);
+    assert(!hs_to_json(r, jw));
+    hs_reader_release(r);
+    jw_release(jw);
+    buf_release(out);
+    buf_release(in);
+}
+
+#define EXPECT_JSON(lit, json) expect_json((lit), sizeof(lit) - 1, (json))
+#define EXPECT_INVALID(lit) expect_invalid((lit), sizeof(lit) - 1)
+
+void test_Hessian_decode()
+{
+    EXPECT_JSON("N", "null");
+    EXPECT_JSON("T", "true");
+    EXPECT_JSON("\x90", "0");
+    EXPECT_JSON("\xc8\x30", "48");
+    EXPECT_JSON("\xd0\x00\x00", "-262144");
+    EXPECT_JSON("I\x80\x00\x00\x00", "-2147483648");
+    EXPECT_JSON("\xd8", "-8");
+    EXPECT_JSON("\xf0\x00", "-2048");
+    EXPECT_JSON("\x3f\xff\xff", "262143");
+    EXPECT_JSON("\x59\x80\x00\x00\x00", "-2147483648");
+    EXPECT_JSON("L\x7f\xff\xff\xff\xff\xff\xff\xff", "9223372036854775807");
+    EXPECT_JSON("\x5b", "0");
+    EXPECT_JSON("\x5d\x80", "-128");
+    EXPECT_JSON("\x5e\x80\x00", "-32768");
+    EXPECT_JSON("\x5f\x00\x00\x2f\xda", "12.25");
+    EXPECT_JSON("D\x40\x28\x80\x00\x00\x00\x00\x00", "12.25");
+    EXPECT_JSON("\x4a\x00\x00\x00\xd0\x4b\x92\x84\xb8", "894621091000");
+    EXPECT_JSON("\x4b\x00\xe3\x83\x8f", "894621060000");
+    EXPECT_JSON("\x05hello", "\"hello\"");
+    EXPECT_JSON("R\x00\x01" "a\x01\xc3\x83", "\"a\xc3\x83\"");
+    EXPECT_JSON("\x23\x01\x02\x03", "\"AQID\"");
+    EXPECT_JSON("A\x00\x01\xff\x20", "\"/w==\"");
+
+    EXPECT_JSON("\x72\x04[int\x90\x91", "[0,1]");
+    EXPECT_JSON("V\x04[int\x92\x90\x91", "[0,1]");
+    EXPECT_JSON("\x55\x04[int\x90\x91Z", "[0,1]");
+    EXPECT_JSON("\x57\x90\x91Z", "[0,1]");
+    EXPECT_JSON("\x58\x92\x90\x91", "[0,1]");
+    EXPECT_JSON("\x7a\x90\x91", "[0,1]");
+    EXPECT_JSON("\x78", "[]");
+    // 第二个 list 的类型为引用
+    EXPECT_JSON("\x7a\x71\x04[int\x90\x71\x90\x91", "[[0],[1]]");
+
+    EXPECT_JSON("H\x91\x03" "fee\xa0\x03" "fieZ", "{\"1\":\"fee\",\"16\":\"fie\"}");
+    EXPECT_JSON("M\x13" "com.caucho.test.Car\x05" "color\x03redZ", "{\"color\":\"red\"}");
+    EXPECT_JSON("H\x79\x90\x01xZ", "{\"[0]\":\"x\"}");
+
+    EXPECT_JSON("\x7a"
+                "C\x0b" "example.Car\x92\x05" "color\x05model"
+                "O\x90\x03red\x08" "corvette"
+                "\x60\x05green\x05" "civic",
+                "[{\"$class\":\"example.Car\",\"color\":\"red\",\"model\":\"corvette\"},"
+                "{\"$class\":\"example.Car\",\"color\":\"green\",\"model\":\"civic\"}]");
+    // 循环链表
+    EXPECT_JSON("C\x0aLinkedList\x92\x04head\x04tail\x60\x91\x51\x90",
+                "{\"$class\":\"LinkedList\",\"head\":1,\"tail\":{\"$ref\":0}}");
+
+    EXPECT_INVALID("");
+    EXPECT_INVALID("I\x00\x00");
+    EXPECT_INVALID("\x72\x04[int\x90");
+    EXPECT_INVALID("\x57\x90");
+    EXPECT_INVALID("H\x90Z");
+    EXPECT_INVALID("\x60\x90");
+    EXPECT_INVALID("\x71\x91\x90");
+    EXPECT_INVALID("\x51");
+    EXPECT_INVALID("\x40");
+}
+
+void test_Hessian_reader()
+{
+    const char bin[] = "\x7a\x03" "abc\x55\x04[int\x90Z";
+    struct buffer *in = buf_create(64);
+    buf_append(in, bin, sizeof(bin) - 1);
+    struct hs_reader *r = hs_reader_create(in);
+    struct hs_value v;
+
+    assert(hs_read(r, &v) && v.type == HS_LIST && v.n == 2 && v.len == 0);
+    assert(hs_read(r, &v) && v.type == HS_STRING && v.len == 3 && memcmp(v.str, "abc", 3) == 0);
+    assert(hs_read(r, &v) && v.type == HS_LIST && v.n == -1 && v.len == 4 && memcmp(v.str, "[int", 4) == 0);
+    assert(hs_read(r, &v) && v.type == HS_INT && v.i == 0);
+    assert(hs_read(r, &v) && v.type == HS_END);
+    assert(hs_read(r, &v) && v.type == HS_END);
+    assert(buf_readable(in) == 0);
+    assert(!hs_read(r, &v));
+    assert(strcmp(hs_reader_error(r), "truncated") == 0);
+
+    hs_reader_release(r);
+    buf_release(in);
+}
+
+// ****************************************************************************************************
+// 编码后再解码
+
+void test_Hessian_roundtrip()
+{
+    struct buffer *buf = buf_create(64);
+    struct hs_encoder *enc = hs_encoder_create(buf);
+    const char *fields[] = {"id", "name", "tags", "score", "born"};
+
+    hs_write_list_begin(enc, NULL, -1);
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        hs_write_object_begin(enc, "com.youzan.User", fields, 5);
+        hs_write_long(enc, 10000000000LL + i);
+        hs_write_string(enc, "张三", strlen("张三"));
+        hs_write_list_begin(enc, "[string", 2);
+        hs_write_string(enc, "a\"b", 3);
+        hs_write_string(enc, "", 0);
+        hs_write_double(enc, 0.1 * i);
+        hs_write_null(enc);
+    }
+    hs_write_map_begin(enc, "java.util.HashMap");
+    hs_write_string(enc, "k", 1);
+    hs_write_bool(enc, false);
+    hs_write_end(enc);
+    hs_write_end(enc);
+
+    struct buffer *out = buf_create(256);
+    struct jsonw *jw = jw_create(out, 0);
+    struct hs_reader *r = hs_reader_create(buf);
+    assert(hs_to_json(r, jw) && jw_ok(jw) && buf_readable(buf) == 0);
+    const char *expected =
+        "[{\"$class\":\"com.youzan.User\",\"id\":10000000000,\"name\":\"张三\",\"tags\":[\"a\\\"b\",\"\"],\"score\":0,\"born\":null},"
+        "{\"$class\":\"com.youzan.User\",\"id\":10000000001,\"name\":\"张三\",\"tags\":[\"a\\\"b\",\"\"],\"score\":0.1,\"born\":null},"
+        "{\"$class\":\"com.youzan.User\",\"id\":10000000002,\"name\":\"张三\",\"tags\":[\"a\\\"b\",\"\"],\"score\":0.2,\"born\":null},"
+        "{\"k\":false}]";
+    if (buf_readable(out) != strlen(expected) || memcmp(buf_peek(out), expected, buf_readable(out)) != 0)
+    {
+        fprintf(stderr, "%.*s\n", (int)buf_readable(out), buf_peek(out));
+        assert(0);
+    }
+
+    hs_reader_release(r);
+    jw_release(jw);
+    buf_release(out);
+    hs_encoder_release(enc);
+    buf_release(buf);
+}
+
+// ****************************************************************************************************
+// dubbo 响应帧
+
+static struct dubbo_res *decode_frame(uint8_t status, const char *body, size_t body_sz)
+{
+    struct buffer *buf = buf_create(body_sz + 16);
+    buf_appendInt16(buf, (int16_t)0xdabb);
+    buf_appendInt8(buf, 0x02); // 响应, hessian2
+    buf_appendInt8(buf, status);
+    buf_appendInt64(buf, 42);
+    buf_appendInt32(buf, body_sz);
+    buf_append(buf, body, body_sz);
+    struct dubbo_res *res = dubbo_decode(buf);
+    assert(buf_readable(buf) == 0 || res == NULL);
+    if (res && !res->owned && res->data)
+    {
+        // 视图指向 buf, 复制后再释放 buf
+        char *copy = malloc(res->data_sz + 1);
+        memcpy(copy, res->data, res->data_sz);
+        res->data = copy;
+        res->owned = true;
+    }
+    buf_release(buf);
+    return res;
+}
+
+#define DECODE_FRAME(status, lit) decode_frame((status), (lit), sizeof(lit) - 1)
+
+static void expect_data(const struct dubbo_res *res, const char *data)
+{
+    assert(res && res->reqid == 42);
+    if (res->data_sz != strlen(data) || memcmp(res->data, data, res->data_sz) != 0)
+    {
+        fprintf(stderr, "%.*s\nexpected: %s\n", (int)res->data_sz, res->data, data);
+        assert(0);
+    }
+}
+
+void test_Dubbo_response()
+{
+    struct dubbo_res *res;
+
+    // 泛化调用返回 JSON 字符串
+    res = DECODE_FRAME(20, "\x91\x07{\"a\":1}");
+    expect_data(res, "{\"a\":1}");
+    assert(res->ok && res->type == DUBBO_RES_VAL && res->attach == NULL);
+    dubbo_res_release(res);
+
+    // java 写出的补充平面字符 (代理对), 字符串与对象字段中都还原为 utf8
+    res = DECODE_FRAME(20, "\x91\x04\"\xed\xa0\xbd\xed\xb8\x80\"");
+    expect_data(res, "\"😀\"");
+    dubbo_res_release(res);
+    res = DECODE_FRAME(20, "\x91" "H\x01k\x02\xed\xa0\xbd\xed\xb8\x80Z");
+    expect_data(res, "{\"k\":\"😀\"}");
+    dubbo_res_release(res);
+
+    res = DECODE_FRAME(20, "\x92");
+    assert(res && res->type == DUBBO_RES_NULL && res->data_sz == 0);
+    dubbo_res_release(res);
+
+    // 按类型调用返回对象, 带 attachments
+    res = DECODE_FRAME(20, "\x94"
+                           "C\x0b" "example.Car\x91\x05" "color\x60\x03red"
+                           "H\x05" "dubbo\x05" "2.0.2Z");
+    expect_data(res, "{\"$class\":\"example.Car\",\"color\":\"red\"}");
+    assert(res->type == DUBBO_RES_VAL && res->attach);
+    assert(res->attach_sz == strlen("{\"dubbo\":\"2.0.2\"}") && memcmp(res->attach, "{\"dubbo\":\"2.0.2\"}", res->attach_sz) == 0);
+    dubbo_res_release(res);
+
+    res = DECODE_FRAME(20, "\x94\xc8\x30H\x05" "dubbo\x05" "2.0.2Z");
+    expect_data(res, "48");
+    dubbo_res_release(res);
+
+    res = DECODE_FRAME(20, "\x95H\x05" "dubbo\x05" "2.0.2Z");
+    assert(res && res->type == DUBBO_RES_NULL && res->data_sz == 0 && res->attach);
+    dubbo_res_release(res);
+
+    // 异常对象
+    res = DECODE_FRAME(20, "\x93"
+                           "C\x1a" "java.lang.RuntimeException\x91\x0d" "detailMessage\x60\x04" "boom"
+                           "HZ");
+    expect_data(res, "{\"$class\":\"java.lang.RuntimeException\",\"detailMessage\":\"boom\"}");
+    assert(res->type == DUBBO_RES_EX);
+    dubbo_res_release(res);
+
+    // 非 OK 状态为错误描述字符串
+    res = DECODE_FRAME(70, "\x04oops");
+    expect_data(res, "oops");
+    assert(!res->ok);
+    dubbo_res_release(res);
+
+    assert(DECODE_FRAME(20, "\x96") == NULL);
+    assert(DECODE_FRAME(20, "\x94\x90") == NULL);
+    assert(DECODE_FRAME(20, "\x91\x72\x04[int\x90") == NULL);
+}
+
+// 父对象的字段里首次出现的类在字段值之前内联定义, 超过 8 个类时类表扩容
+void test_Dubbo_response_nested_classes()
+{
+    struct dubbo_res *res = DECODE_FRAME(20, "\x91" "C\x0e" "example.Parent\x99\x02" "f0\x02" "f1\x02" "f2\x02" "f3\x02" "f4\x02" "f5\x02" "f6\x02" "f7\x02" "f8`"
+                                             "C\x0a" "example.N0\x91\x01" "va\x90"
+                                             "C\x0a" "example.N1\x91\x01" "vb\x91"
+                                             "C\x0a" "example.N2\x91\x01" "vc\x92"
+                                             "C\x0a" "example.N3\x91\x01" "vd\x93"
+                                             "C\x0a" "example.N4\x91\x01" "ve\x94"
+                                             "C\x0a" "example.N5\x91\x01" "vf\x95"
+                                             "C\x0a" "example.N6\x91\x01" "vg\x96"
+                                             "C\x0a" "example.N7\x91\x01" "vh\x97"
+                                             "C\x0a" "example.N8\x91\x01" "vi\x98");
+    char expected[1024];
+    int n = snprintf(expected, sizeof(expected), "{\"$class\":\"example.Parent\"");
+    int i;
+    for (i = 0; i < 9; i++)
+    {
+        n += snprintf(expected + n, sizeof(expected) - n, ",\"f%d\":{\"$class\":\"example.N%d\",\"v\":%d}", i, i, i);
+    }
+    snprintf(expected + n, sizeof(expected) - n, "}");
+    expect_data(res, expected);
+    dubbo_res_release(res);
+}
+
+// hs_read 返回的 cls 在之后的类定义扩容类表后仍然有效; 连续的类定义不递归
+void test_Hessian_reader_classes()
+{
+    struct buffer *in = buf_create(64);
+    int i;
+    for (i = 0; i < 1000; i++)
+    {
+        char def[16];
+        int n = snprintf(def, sizeof(def), "C%cK%03d\x91\x01v", 4, i);
+        buf_append(in, def, n);
+    }
+    // 第一个对象用类 0, 第二个用类 999
+    buf_append(in, "\x60\x90O\xcb\xe7\x91", 6);
+    struct hs_reader *r = hs_reader_create(in);
+    struct hs_value v, obj;
+
+    assert(hs_read(r, &obj) && obj.type == HS_OBJECT && obj.cls->n == 1);
+    assert(obj.cls->name_len == 4 && memcmp(obj.cls->name, "K000", 4) == 0);
+    assert(hs_read(r, &v) && v.type == HS_INT && v.i == 0);
+    assert(hs_read(r, &v) && v.type == HS_END);
+    assert(hs_read(r, &v) && v.type == HS_OBJECT && memcmp(v.cls->name, "K999", 4) == 0);
+    assert(hs_read(r, &v) && v.type == HS_INT && v.i == 1);
+    assert(hs_read(r, &v) && v.type == HS_END);
+    assert(buf_readable(in) == 0);
+    assert(memcmp(obj.cls->name, "K000", 4) == 0 && obj.cls->field_lens[0] == 1);
+
+    hs_reader_release(r);
+    buf_release(in);
+}
+
+static void append_frame(struct buffer *buf, int64_t reqid, const char *body, size_t body_sz)
+{
+    buf_appendInt16(buf, (int16_t)0xdabb);
+    buf_appendInt8(buf, 0x02);
+    buf_appendInt8(buf, 20);
+    buf_appendInt64(buf, reqid);
+    buf_appendInt32(buf, body_sz);
+    buf_append(buf, body, body_sz);
+}
+
+void test_Dubbo_frame_split()
+{
+    // 一次读到两个完整帧和第三帧的一部分
+    struct buffer *buf = buf_create(64);
+    append_frame(buf, 1, "\x91\x01" "a", 3);
+    append_frame(buf, 2, "\x92", 1);
+    append_frame(buf, 3, "\x91\x02" "bc", 4);
+    buf_unwrite(buf, 2);
+
+    int64_t ids[2];
+    int n = 0, len;
+    while ((len = dubbo_frame_len(buf)) > 0)
+    {
+        size_t before = buf_readable(buf);
+        struct dubbo_res *res = dubbo_decode(buf);
+        assert(res && before - buf_readable(buf) == (size_t)len);
+        ids[n++] = res->reqid;
+        dubbo_res_release(res);
+    }
+    assert(len == 0 && n == 2 && ids[0] == 1 && ids[1] == 2);
+    assert(buf_readable(buf) == 16 + 2);
+
+    // 补齐剩余字节
+    buf_append(buf, "bc", 2);
+    assert(dubbo_frame_len(buf) == 16 + 4);
+    buf_retrieveAll(buf);
+
+    // 头部不足 / 非 dubbo 数据
+    buf_append(buf, "\xda\xbb", 2);
+    assert(dubbo_frame_len(buf) == 0);
+    buf_retrieveAll(buf);
+    buf_append(buf, "HTTP/1.1 200 OK\r\n\r\n", 19);
+    assert(dubbo_frame_len(buf) == -1);
+    buf_release(buf);
+}
+
+void test_Dubbo_reqid_patch()
+{
+    struct dubbo_req *req = dubbo_req_create("com.youzan.Demo", "hello", "int", "[1]", NULL);
+    assert(req);
+    struct buffer *tpl = dubbo_encode(req);
+    assert(tpl);
+
+    // 改写 reqid 后只有这 8 字节不同
+    size_t sz = buf_readable(tpl);
+    char *frame = malloc(sz);
+    memcpy(frame, buf_peek(tpl), sz);
+    dubbo_set_reqid(frame, 0x0102030405060708LL);
+    assert(memcmp(frame + DUBBO_REQID_OFFSET, "\x01\x02\x03\x04\x05\x06\x07\x08", 8) == 0);
+    assert(memcmp(frame, buf_peek(tpl), DUBBO_REQID_OFFSET) == 0);
+    assert(memcmp(frame + DUBBO_REQID_OFFSET + 8, buf_peek(tpl) + DUBBO_REQID_OFFSET + 8, sz - DUBBO_REQID_OFFSET - 8) == 0);
+
+    int64_t id = dubbo_next_reqid();
+    assert(id > 0 && dubbo_next_reqid() == id + 1);
+
+    free(frame);
+    buf_release(tpl);
+    dubbo_req_release(req);
+}
+
+// ****************************************************************************************************
+
+void test_Hessian_bench()
+{
+    struct buffer *buf = buf_create(1024 * 1024);
+    struct buffer *out = buf_create(1024 * 1024);
+    const char *fields[] = {"id", "name", "price", "tags"};
+    int n = 10000, loops = 20, i, j;
+
+    clock_t start = clock();
+    size_t bytes = 0;
+    for (j = 0; j < loops; j++)
+    {
+        buf_retrieveAll(buf);
+        struct hs_encoder *enc = hs_encoder_create(buf);
+        hs_write_list_begin(enc, NULL, n);
+        for (i = 0; i < n; i++)
+        {
+            hs_write_object_begin(enc, "com.youzan.Item", fields, 4);
+            hs_write_long(enc, i);
+            hs_write_string(enc, "商品 item name", strlen("商品 item name"));
+            hs_write_double(enc, i * 0.01);
+            hs_write_list_begin(enc, "[string", 2);
+            hs_write_string(enc, "hot", 3);
+            hs_write_string(enc, "new", 3);
+        }
+        hs_encoder_release(enc);
+        bytes += buf_readable(buf);
+    }
+    double enc_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    size_t json = 0;
+    for (j = 0; j < loops; j++)
+    {
+        struct buffer *in = buf_readonlyView(buf, buf_readable(buf));
+        buf_retrieveAll(out);
+        struct jsonw *jw = jw_create(out, 0);
+        struct hs_reader *r = hs_reader_create(in);
+        assert(hs_to_json(r, jw) && jw_ok(jw));
+        hs_reader_release(r);
+        jw_release(jw);
+        buf_release(in);
+        json += buf_readable(out);
+    }
+    double dec_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("hessian encode: %.1f MB/s, decode to json: %.1f MB/s (%zu bytes -> %zu bytes json)\n",
+           bytes / 1e6 / enc_s, bytes / 1e6 / dec_s, bytes / loops, json / loops);
+    buf_release(out);
+    buf_release(buf);
+}
+
+int main(void)
+{
+    test_Hessian_string_view();
+    test_Hessian_string_encode();
+    test_Hessian_string_supplementary();
+    test_Hessian_encode_scalar();
+    test_Hessian_encode_chunked();
+    test_Hessian_string_large();
+    test_Hessian_encode_container();
+    test_Hessian_decode();
+    test_Hessian_reader();
+    test_Hessian_roundtrip();
+    test_Dubbo_response();
+    test_Dubbo_response_nested_classes();
+    test_Hessian_reader_classes();
+    test_Dubbo_frame_split();
+    test_Dubbo_reqid_patch();
+    test_Hessian_bench();
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h> /* PRId64 */
+
+#include "dubbo_conn.h"
+#include "dubbo_pool.h"
+
+#include "ae.h"
+#include "buffer.h"
+#include "queue.h"
+#include "log.h"
+#include "dbg.h"
+
+// 摘除时长翻倍的上限 (2^5 = 32 倍)
+#define POOL_EJECT_MAX_SHIFT 5
+// provider 列表的分隔符
+#define POOL_EP_DELIM ", "
+
+struct pool_conn
+{
+    struct dubbo_conn *conn;
+    int64_t last_ns; // 最近一次发出或完成调用的时间
+};
+
+struct endpoint
+{
+    char *addr; // host:port
+    struct pool_conn *conns;
+    int conn_n;
+    int next;    // 连接轮转起点
+    int pending; // 本 provider 的在途调用数
+    int fails;   // 连续失败次数
+    int ejects;  // 连续摘除次数, 成功一次清零
+    int64_t down_until_ns;
+    unsigned tried; // 本次 dubbo_pool_call 已尝试过 (等于 pool->call_seq)
+};
+
+// 包装调用方的回调, 完成时更新 provider 的计数与健康状态
+struct pool_call
+{
+    QUEUE node;
+    struct dubbo_pool *pool;
+    struct endpoint *ep;
+    struct pool_conn *pc;
+    dubbo_call_cb cb;
+    void *ud;
+};
+
+struct dubbo_pool
+{
+    struct aeEventLoop *el;
+    struct dubbo_pool_opts opts;
+    struct endpoint *eps;
+    int ep_n;
+    int *cand; // 选择时的候选下标
+    int rr;
+    uint64_t rnd; // xorshift 状态
+    unsigned call_seq; // 回绕后跳过 0, 0 为未尝试过的 tried
+    bool closing;
+    QUEUE free_calls;
+    long long idle_timerid;
+};
+
+static inline int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint64_t pool_rand(struct dubbo_pool *pool)
+{
+    pool->rnd ^= pool->rnd << 13;
+    pool->rnd ^= pool->rnd >> 7;
+    pool->rnd ^= pool->rnd << 17;
+    return pool->rnd;
+}
+
+static void ep_fail(struct dubbo_pool *pool, struct endpoint *ep)
+{
+    int64_t now = now_ns();
+    if (now < ep->down_until_ns)
+    {
+        // 已摘除, 同一次断开的其它调用不再累计
+        return;
+    }
+    // 摘除到期后的试探调用失败一次即再次摘除
+    int threshold = ep->ejects ? 1 : pool->opts.max_fails;
+    if (++ep->fails < threshold)
+    {
+        return;
+    }
+    int shift = ep->ejects < POOL_EJECT_MAX_SHIFT ? ep->ejects : POOL_EJECT_MAX_SHIFT;
+    int64_t eject_ms = (int64_t)pool->opts.eject_ms << shift;
+    ep->down_until_ns = now + eject_ms * 1000000;
+    ep->ejects++;
+    ep->fails = 0;
+    LOG_ERROR("provider %s 连续失败, 摘除 %" PRId64 "ms", ep->addr, eject_ms);
+}
+
+static void ep_ok(struct endpoint *ep)
+{
+    if (ep->ejects)
+    {
+        LOG_INFO("provider %s 恢复", ep->addr);
+    }
+    ep->fails = 0;
+    ep->ejects = 0;
+}
+
+static void pool_on_call(void *ud, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    struct pool_call *pc = ud;
+    struct dubbo_pool *pool = pc->pool;
+    struct endpoint *ep = pc->ep;
+    dubbo_call_cb cb = pc->cb;
+    void *cb_ud = pc->ud;
+
+    ep->pending--;
+    pc->pc->last_ns = now_ns();
+    if (!pool->closing)
+    {
+        if (status == DUBBO_CALL_OK)
+        {
+            ep_ok(ep);
+        }
+        else
+        {
+            ep_fail(pool, ep);
+        }
+    }
+    QUEUE_INSERT_HEAD(&pool->free_calls, &pc->node);
+    cb(cb_ud, status, res);
+}
+
+static inline bool ep_available(const struct dubbo_pool *pool, const struct endpoint *ep, int64_t now)
+{
+    return ep->tried != pool->call_seq && now >= ep->down_until_ns;
+}
+
+// 全部摘除时仍要发出, 选最早到期的那个
+static struct endpoint *pool_pick_fallback(struct dubbo_pool *pool)
+{
+    struct endpoint *best = NULL;
+    int i;
+    for (i = 0; i < pool->ep_n; i++)
+    {
+        struct endpoint *ep = &pool->eps[i];
+        if (ep->tried != pool->call_seq && (best == NULL || ep->down_until_ns < best->down_until_ns))
+        {
+            best = ep;
+        }
+    }
+    return best;
+}
+
+static struct endpoint *pool_pick(struct dubbo_pool *pool)
+{
+    int64_t now = now_ns();
+    // 从轮转位置开始收集候选, 在途数相同时也能轮流选到
+    int n = 0, i;
+    for (i = 0; i < pool->ep_n; i++)
+    {
+        int k = (pool->rr + i) % pool->ep_n;
+        if (ep_available(pool, &pool->eps[k], now))
+        {
+            pool->cand[n++] = k;
+        }
+    }
+    if (n == 0)
+    {
+        return pool_pick_fallback(pool);
+    }
+    pool->rr = (pool->rr + 1) % pool->ep_n;
+
+    int pick = pool->cand[0];
+    switch (pool->opts.lb)
+    {
+    case DUBBO_LB_ROUND_ROBIN:
+        break;
+    case DUBBO_LB_LEAST_PENDING:
+        for (i = 1; i < n; i++)
+        {
+            if (pool->eps[pool->cand[i]].pending < pool->eps[pick].pending)
+            {
+                pick = pool->cand[i];
+            }
+        }
+        break;
+    case DUBBO_LB_P2C:
+        if (n > 1)
+        {
+            // 两个不同的候选
+            uint64_t r = pool_rand(pool);
+            int x = (int)((r >> 32) % n);
+            int y = (int)((r & 0xffffffff) % (n - 1));
+            if (y >= x)
+            {
+                y++;
+            }
+            int a = pool->cand[x], b = pool->cand[y];
+            pick = pool->eps[b].pending < pool->eps[a].pending ? b : a;
+        }
+        break;
+    }
+    return &pool->eps[pick];
+}
+
+// provider 内选在途最少的连接
+static struct pool_conn *ep_pick_conn(struct endpoint *ep)
+{
+    struct pool_conn *best = NULL;
+    int best_pending = INT_MAX, i;
+    for (i = 0; i < ep->conn_n; i++)
+    {
+        struct pool_conn *pc = &ep->conns[(ep->next + i) % ep->conn_n];
+        int pending = dubbo_conn_pending(pc->conn);
+        if (pending < best_pending)
+        {
+            best = pc;
+            best_pending = pending;
+        }
+    }
+    ep->next = (ep->next + 1) % ep->conn_n;
+    return best;
+}
+
+static int pool_on_idle_check(struct aeEventLoop *el, long long id, void *ud)
+{
+    UNUSED(el);
+    UNUSED(id);
+    struct dubbo_pool *pool = ud;
+    int64_t now = now_ns();
+    int64_t max_idle_ns = (int64_t)pool->opts.max_idle_ms * 1000000;
+    int i, j;
+    for (i = 0; i < pool->ep_n; i++)
+    {
+        struct endpoint *ep = &pool->eps[i];
+        for (j = 0; j < ep->conn_n; j++)
+        {
+            struct pool_conn *pc = &ep->conns[j];
+            if (dubbo_conn_connected(pc->conn) && dubbo_conn_pending(pc->conn) == 0 && now - pc->last_ns >= max_idle_ns)
+            {
+                dubbo_conn_close(pc->conn);
+            }
+        }
+    }
+    return pool->opts.max_idle_ms < 1000 ? pool->opts.max_idle_ms : 1000;
+}
+
+static bool ep_init(struct dubbo_pool *pool, struct endpoint *ep, char *addr)
+{
+    char *colon = strrchr(addr, ':');
+    if (colon == NULL || colon == addr || colon[1] == '\0')
+    {
+        LOG_ERROR("provider 地址 %s 应为 host:port", addr);
+        return false;
+    }
+    ep->addr = strdup(addr);
+    assert(ep->addr);
+    *colon = '\0';
+    ep->conns = calloc(pool->opts.conn_n, sizeof(struct pool_conn));
+    assert(ep->conns);
+    int i;
+    for (i = 0; i < pool->opts.conn_n; i++)
+    {
+        struct dubbo_conn *conn = dubbo_conn_create(pool->el, addr, colon + 1, pool->opts.connect_timeout_ms);
+        if (conn == NULL)
+        {
+            return false;
+        }
+        dubbo_conn_set_keepalive(conn, pool->opts.keepalive_sec);
+        dubbo_conn_set_heartbeat(conn, pool->opts.heartbeat_ms, 0);
+        ep->conns[ep->conn_n++].conn = conn;
+    }
+    return true;
+}
+
+struct dubbo_pool *dubbo_pool_create(struct aeEventLoop *el, const char *endpoints, const struct dubbo_pool_opts *opts)
+{
+    struct dubbo_pool *pool = calloc(1, sizeof(*pool));
+    assert(pool);
+    pool->el = el;
+    if (opts)
+    {
+        pool->opts = *opts;
+    }
+    if (pool->opts.conn_n <= 0)
+    {
+        pool->opts.conn_n = 1;
+    }
+    if (pool->opts.connect_timeout_ms <= 0)
+    {
+        pool->opts.connect_timeout_ms = 3000;
+    }
+    if (pool->opts.max_fails <= 0)
+    {
+        pool->opts.max_fails = 3;
+    }
+    if (pool->opts.eject_ms <= 0)
+    {
+        pool->opts.eject_ms = 1000;
+    }
+    pool->rnd = (uint64_t)now_ns() ^ ((uint64_t)(uintptr_t)pool << 16) ^ 0x9E3779B97F4A7C15ULL;
+    QUEUE_INIT(&pool->free_calls);
+    pool->idle_timerid = AE_NOMORE;
+
+    // 按与 strtok_r 相同的分隔符数出地址个数
+    int cap = 0;
+    const char *p;
+    for (p = endpoints; *p; p++)
+    {
+        cap += !strchr(POOL_EP_DELIM, *p) && (p == endpoints || strchr(POOL_EP_DELIM, p[-1]));
+    }
+    if (cap == 0)
+    {
+        cap = 1;
+    }
+    pool->eps = calloc(cap, sizeof(struct endpoint));
+    pool->cand = calloc(cap, sizeof(int));
+    assert(pool->eps && pool->cand);
+
+    char *list = strdup(endpoints);
+    assert(list);
+    char *save = NULL, *tok;
+    for (tok = strtok_r(list, POOL_EP_DELIM, &save); tok; tok = strtok_r(NULL, POOL_EP_DELIM, &save))
+    {
+        if (!ep_init(pool, &pool->eps[pool->ep_n++], tok))
+        {
+            free(list);
+            dubbo_pool_release(pool);
+            return NULL;
+        }
+    }
+    assert(pool->ep_n <= cap);
+    free(list);
+    if (pool->ep_n == 0)
+    {
+        LOG_ERROR("没有 provider: %s", endpoints);
+        dubbo_pool_release(pool);
+        return NULL;
+    }
+
+    if (pool->opts.max_idle_ms > 0)
+    {
+        int period = pool->opts.max_idle_ms < 1000 ? pool->opts.max_idle_ms : 1000;
+        pool->idle_timerid = aeCreateTimeEvent(el, period, pool_on_idle_check, pool, NULL);
+        assert(pool->idle_timerid != AE_ERR);
+    }
+    return pool;
+}
+
+void dubbo_pool_release(struct dubbo_pool *pool)
+{
+    pool->closing = true;
+    if (pool->idle_timerid != AE_NOMORE)
+    {
+        aeDeleteTimeEvent(pool->el, pool->idle_timerid);
+    }
+    int i, j;
+    for (i = 0; i < pool->ep_n; i++)
+    {
+        struct endpoint *ep = &pool->eps[i];
+        for (j = 0; j < ep->conn_n; j++)
+        {
+            dubbo_conn_release(ep->conns[j].conn);
+        }
+        free(ep->conns);
+        free(ep->addr);
+    }
+    while (!QUEUE_EMPTY(&pool->free_calls))
+    {
+        QUEUE *q = QUEUE_HEAD(&pool->free_calls);
+        QUEUE_REMOVE(q);
+        free(QUEUE_DATA(q, struct pool_call, node));
+    }
+    free(pool->eps);
+    free(pool->cand);
+    free(pool);
+}
+
+int64_t dubbo_pool_call(struct dubbo_pool *pool, const struct dubbo_req *req, dubbo_call_cb cb, void *ud, int timeout_ms)
+{
+    // 请求本身有误与 provider 无关, 不计失败; 编码一次, 换 provider 时复用
+    struct buffer *frame = dubbo_encode(req);
+    if (frame == NULL)
+    {
+        return 0;
+    }
+    struct pool_call *pc;
+    if (QUEUE_EMPTY(&pool->free_calls))
+    {
+        pc = malloc(sizeof(*pc));
+        assert(pc);
+    }
+    else
+    {
+        QUEUE *q = QUEUE_HEAD(&pool->free_calls);
+        QUEUE_REMOVE(q);
+        pc = QUEUE_DATA(q, struct pool_call, node);
+    }
+    pc->pool = pool;
+    pc->cb = cb;
+    pc->ud = ud;
+
+    // 发起连接失败的 provider 记一次失败, 本次不再选它
+    if (++pool->call_seq == 0)
+    {
+        pool->call_seq = 1;
+    }
+    int i;
+    for (i = 0; i < pool->ep_n; i++)
+    {
+        struct endpoint *ep = pool_pick(pool);
+        if (ep == NULL)
+        {
+            break;
+        }
+        ep->tried = pool->call_seq;
+        pc->ep = ep;
+        pc->pc = ep_pick_conn(ep);
+        int64_t reqid = dubbo_conn_send_frame(pc->pc->conn, frame, pool_on_call, pc, timeout_ms);
+        if (reqid)
+        {
+            ep->pending++;
+            pc->pc->last_ns = now_ns();
+            buf_release(frame);
+            return reqid;
+        }
+        ep_fail(pool, ep);
+    }
+    QUEUE_INSERT_HEAD(&pool->free_calls, &pc->node);
+    buf_release(frame);
+    return 0;
+}
+
+int dubbo_pool_size(const struct dubbo_pool *pool)
+{
+    return pool->ep_n;
+}
+
+bool dubbo_pool_healthy(const struct dubbo_pool *pool, int i)
+{
+    assert(i >= 0 && i < pool->ep_n);
+    return now_ns() >= pool->eps[i].down_until_ns;
+}
@@ -0,0 +1,48 @@
+#ifndef DUBBO_POOL_H
+#define DUBBO_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ae.h"
+#include "dubbo_conn.h"
+
+// 按 provider 分组的 dubbo_conn 连接池, 连接复用, 在静态的 provider 列表间负载均衡
+// 连续失败的 provider 摘除一段时间 (指数退避), 到期后重新参与选择, 成功一次即恢复
+// 与 dubbo_conn 一样只能在 el 所在线程使用
+
+enum dubbo_lb
+{
+    DUBBO_LB_ROUND_ROBIN,
+    DUBBO_LB_LEAST_PENDING, // 在途调用最少
+    DUBBO_LB_P2C,           // 随机选两个, 取在途调用少的
+};
+
+// 各项为 0 时取缺省值
+struct dubbo_pool_opts
+{
+    enum dubbo_lb lb;
+    int conn_n;             // 每个 provider 的连接数, 缺省 1
+    int connect_timeout_ms; // 缺省 3000
+    int keepalive_sec;      // TCP keepalive 空闲探测秒数, 缺省不开启
+    int heartbeat_ms;       // dubbo 心跳间隔, 保持空闲连接并探测死连接, 缺省不发 (见 dubbo_conn_set_heartbeat)
+    int max_idle_ms;        // 连接空闲 (无在途调用) 超过该时长后断开, 缺省不断开
+    int max_fails;          // 连续失败 (断开或超时) 次数达到后摘除, 缺省 3
+    int eject_ms;           // 首次摘除时长, 之后每次翻倍, 最长 32 倍, 缺省 1000
+};
+
+struct dubbo_pool;
+
+// endpoints 为逗号分隔的 host:port, 如 "10.0.0.1:20880,10.0.0.2:20880", opts 可为 NULL
+struct dubbo_pool *dubbo_pool_create(struct aeEventLoop *el, const char *endpoints, const struct dubbo_pool_opts *opts);
+// 未完成的调用以 DUBBO_CALL_CLOSED 回调
+void dubbo_pool_release(struct dubbo_pool *);
+
+// 选一个 provider 的连接发出, 语义同 dubbo_call; 发起连接失败时换下一个 provider
+// req 编码失败直接返回 0, 不计入任何 provider 的失败
+int64_t dubbo_pool_call(struct dubbo_pool *, const struct dubbo_req *req, dubbo_call_cb cb, void *ud, int timeout_ms);
+
+int dubbo_pool_size(const struct dubbo_pool *);
+// 第 i 个 provider 当前是否可用 (未被摘除)
+bool dubbo_pool_healthy(const struct dubbo_pool *, int i);
+
+#endif
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ae.h"
+#include "dubbo_codec.h"
+#include "dubbo_pool.h"
+#include "dubbo_fake_provider.h"
+
+#define PROVIDER_N 3
+// 没有监听的端口, 连接被拒绝
+#define DEAD_PORT "20899"
+
+static const char *ports[PROVIDER_N] = {"20887", "20888", "20889"};
+
+static struct aeEventLoop *el;
+static struct fake_provider providers[PROVIDER_N];
+
+static int on_stop(struct aeEventLoop *el, long long id, void *ud)
+{
+    aeStop(el);
+    return AE_NOMORE;
+}
+
+static void run_for(int ms)
+{
+    aeCreateTimeEvent(el, ms, on_stop, NULL, NULL);
+    aeMain(el);
+}
+
+// 先处理完上一个测试遗留的断开再清零计数
+static void providers_reset()
+{
+    run_for(10);
+    int i;
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        fake_provider_reset(&providers[i]);
+    }
+}
+
+static void providers_start()
+{
+    int i;
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        bool ok = fake_provider_start(&providers[i], el, ports[i]);
+        assert(ok);
+    }
+}
+
+static void providers_stop()
+{
+    int i;
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        fake_provider_stop(&providers[i]);
+    }
+}
+
+static int on_guard(struct aeEventLoop *el, long long id, void *ud)
+{
+    fprintf(stderr, "timeout\n");
+    assert(0);
+    return AE_NOMORE;
+}
+
+// 回调里接着发下一个, 共 left 个
+struct chain
+{
+    struct dubbo_pool *pool;
+    struct dubbo_req *req;
+    int left;
+    int ok_n;
+    int closed_n;
+};
+
+static void on_chain(void *ud, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    struct chain *ch = ud;
+    if (ch->left == 0)
+    {
+        // 已结束, release 时仍在途的调用
+        assert(status == DUBBO_CALL_CLOSED);
+        return;
+    }
+    if (status == DUBBO_CALL_OK)
+    {
+        assert(res->ok && res->data_sz > 0);
+        ch->ok_n++;
+    }
+    else
+    {
+        assert(status == DUBBO_CALL_CLOSED);
+        ch->closed_n++;
+    }
+    if (--ch->left == 0)
+    {
+        aeStop(el);
+        return;
+    }
+    int64_t reqid = dubbo_pool_call(ch->pool, ch->req, on_chain, ch, 1000);
+    assert(reqid > 0);
+}
+
+static void run_chain(struct chain *ch, int n)
+{
+    ch->left = n;
+    int64_t reqid = dubbo_pool_call(ch->pool, ch->req, on_chain, ch, 1000);
+    assert(reqid > 0);
+    long long guard = aeCreateTimeEvent(el, 5000, on_guard, NULL, NULL);
+    aeMain(el);
+    aeDeleteTimeEvent(el, guard);
+}
+
+static const char *all_endpoints = "127.0.0.1:20887, 127.0.0.1:20888, 127.0.0.1:20889";
+
+static struct dubbo_req *new_req()
+{
+    struct dubbo_req *req = dubbo_req_create("com.youzan.Demo", "hello", NULL, "[1]", NULL);
+    assert(req);
+    return req;
+}
+
+void test_Pool_round_robin()
+{
+    providers_reset();
+    struct dubbo_pool_opts opts = {.lb = DUBBO_LB_ROUND_ROBIN, .conn_n = 2};
+    struct dubbo_pool *pool = dubbo_pool_create(el, all_endpoints, &opts);
+    assert(pool && dubbo_pool_size(pool) == 3);
+    struct chain ch = {pool, new_req()};
+    run_chain(&ch, 300);
+    assert(ch.ok_n == 300);
+    int i;
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        assert(providers[i].req_n == 100);
+        // 连接复用, 不是每次调用新建
+        assert(providers[i].accept_n <= 2);
+    }
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+static void on_probe(void *ud, enum dubbo_call_status status, const struct dubbo_res *res)
+{
+    // 发往 provider 0 的在 release 时以 CLOSED 结束
+    assert(status == DUBBO_CALL_OK || status == DUBBO_CALL_CLOSED);
+}
+
+// provider 0 只收不回: 先让它有一个在途调用, 之后在途数更少的另外两个总是更优
+static void test_Pool_avoid_slow(enum dubbo_lb lb)
+{
+    providers_reset();
+    providers[0].mute = true;
+    struct dubbo_pool_opts opts = {.lb = lb};
+    struct dubbo_pool *pool = dubbo_pool_create(el, all_endpoints, &opts);
+    struct chain ch = {pool, new_req()};
+    while (providers[0].req_n == 0)
+    {
+        int64_t reqid = dubbo_pool_call(pool, ch.req, on_probe, NULL, 0);
+        assert(reqid > 0);
+        run_for(5);
+    }
+    providers_reset();
+    providers[0].mute = true;
+    run_chain(&ch, 200);
+    assert(ch.ok_n == 200);
+    assert(providers[0].req_n == 0);
+    assert(providers[1].req_n + providers[2].req_n == 200);
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+void test_Pool_least_pending()
+{
+    test_Pool_avoid_slow(DUBBO_LB_LEAST_PENDING);
+}
+
+void test_Pool_p2c()
+{
+    test_Pool_avoid_slow(DUBBO_LB_P2C);
+}
+
+void test_Pool_eject()
+{
+    providers_reset();
+    struct dubbo_pool_opts opts = {.lb = DUBBO_LB_ROUND_ROBIN, .max_fails = 2, .eject_ms = 60000};
+    struct dubbo_pool *pool = dubbo_pool_create(el, "127.0.0.1:" DEAD_PORT ",127.0.0.1:20887,127.0.0.1:20888", &opts);
+    assert(pool && dubbo_pool_healthy(pool, 0));
+    struct chain ch = {pool, new_req()};
+    run_chain(&ch, 100);
+    // 连接被拒绝同步或异步失败, 至多 max_fails 次之后摘除, 之后全部发往其它 provider
+    assert(ch.closed_n <= 2 && ch.ok_n >= 98);
+    assert(!dubbo_pool_healthy(pool, 0));
+    assert(dubbo_pool_healthy(pool, 1) && dubbo_pool_healthy(pool, 2));
+    assert(providers[0].req_n + providers[1].req_n == ch.ok_n);
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+void test_Pool_max_idle()
+{
+    providers_reset();
+    struct dubbo_pool_opts opts = {.max_idle_ms = 50};
+    struct dubbo_pool *pool = dubbo_pool_create(el, "127.0.0.1:20887", &opts);
+    struct chain ch = {pool, new_req()};
+    run_chain(&ch, 10);
+    assert(providers[0].accept_n == 1 && providers[0].close_n == 0);
+    run_for(200);
+    assert(providers[0].close_n == 1);
+    // 之后的调用重新连接
+    run_chain(&ch, 10);
+    assert(ch.ok_n == 20 && providers[0].accept_n == 2);
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+// 编码失败的请求与 provider 无关, 不应摘除健康的 provider
+void test_Pool_bad_request()
+{
+    providers_reset();
+    struct dubbo_pool_opts opts = {.max_fails = 1};
+    struct dubbo_pool *pool = dubbo_pool_create(el, all_endpoints, &opts);
+    // 按类型调用时方法名在 dubbo_encode 里才编码, 非法 UTF-8 编码失败
+    struct dubbo_req *bad = dubbo_req_create("com.youzan.Demo", "he\xffllo", "int", "[1]", NULL);
+    assert(bad);
+    int i;
+    for (i = 0; i < 10; i++)
+    {
+        int64_t reqid = dubbo_pool_call(pool, bad, on_probe, NULL, 0);
+        assert(reqid == 0);
+    }
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        assert(dubbo_pool_healthy(pool, i) && providers[i].accept_n == 0);
+    }
+    dubbo_req_release(bad);
+
+    struct chain ch = {pool, new_req()};
+    run_chain(&ch, 30);
+    assert(ch.ok_n == 30);
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+// 地址也可以只用空格分隔, 连续的分隔符视为一个
+void test_Pool_space_separated()
+{
+    providers_reset();
+    struct dubbo_pool_opts opts = {.lb = DUBBO_LB_ROUND_ROBIN};
+    struct dubbo_pool *pool = dubbo_pool_create(el, "127.0.0.1:20887 127.0.0.1:20888  127.0.0.1:20889 ", &opts);
+    assert(pool && dubbo_pool_size(pool) == 3);
+    struct chain ch = {pool, new_req()};
+    run_chain(&ch, 30);
+    assert(ch.ok_n == 30);
+    int i;
+    for (i = 0; i < PROVIDER_N; i++)
+    {
+        assert(providers[i].req_n == 10);
+    }
+    dubbo_pool_release(pool);
+    dubbo_req_release(ch.req);
+}
+
+void test_Pool_invalid()
+{
+    struct dubbo_pool *pool = dubbo_pool_create(el, "127.0.0.1", NULL);
+    assert(pool == NULL);
+    pool = dubbo_pool_create(el, "", NULL);
+    assert(pool == NULL);
+    pool = dubbo_pool_create(el, " , ", NULL);
+    assert(pool == NULL);
+}
+
+int main(void)
+{
+    el = aeCreateEventLoop(1024);
+    providers_start();
+
+    test_Pool_round_robin();
+    test_Pool_least_pending();
+    test_Pool_p2c();
+    test_Pool_eject();
+    test_Pool_max_idle();
+    test_Pool_bad_request();
+    test_Pool_space_separated();
+    test_Pool_invalid();
+
+    // 处理完剩余的断开
+    run_for(10);
+    providers_stop();
+
+    aeDeleteEventLoop(el);
+    return 0;
+}
@@ -0,0 +1,1255 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "buffer.h"
+#include "utf8.h"
+#include "arena.h"
+#include "cJSON.h"
+#include "jsonw.h"
+#include "dubbo_hessian.h"
+#include "dubbo_transcode.h"
+
+// hessian string chunk 字符数上限, 输出全为 ASCII, 字符数即字节数
+#define HS_CHUNK 0x8000
+#define HS_CHUNK_HDR 3
+#define MAX_DEPTH 512
+#define STAGE_SZ 1024
+
+enum
+{
+    S_START,     // 期待顶层 '[' '{'
+    S_VALUE,     // 期待值
+    S_ARR_FIRST, // '[' 之后, 值或 ']'
+    S_OBJ_FIRST, // '{' 之后, key 或 '}'
+    S_KEY,       // ',' 之后期待 key
+    S_COLON,
+    S_AFTER, // 值之后, ',' 或闭合
+    S_STR,
+    S_STR_ESC,
+    S_STR_HEX,
+    S_NUM,
+    S_LIT,
+    S_DONE,
+    S_ERROR,
+};
+
+// 数字子状态: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+enum
+{
+    N_SIGN,
+    N_ZERO,
+    N_INT,
+    N_DOT,
+    N_FRAC,
+    N_E,
+    N_ESIGN,
+    N_EXP,
+};
+
+struct json2hs
+{
+    struct buffer *out;
+    size_t start;   // 开始时 out 的可读长度, 失败回滚到此处
+    size_t hdr_off; // 当前 chunk 头相对 buf_peek 的偏移
+    int chunk_len;
+
+    char stage[STAGE_SZ];
+    int stage_n;
+
+    int state;
+    char stack[MAX_DEPTH]; // '[' '{'
+    int depth;
+    bool top_obj;
+    bool mute; // 顶层对象的 key 不输出
+    bool is_key;
+
+    int sub;         // 数字子状态 / \u 已读位数
+    const char *lit; // true false null
+    int lit_i;
+
+    // utf8 多字节序列
+    uint32_t cp;
+    int need;
+    uint32_t min;
+
+    size_t pos;
+    const char *err;
+};
+
+// ****************************************************************************************************
+// 输出
+
+static void chunk_open(struct json2hs *t)
+{
+    t->hdr_off = buf_readable(t->out);
+    buf_append(t->out, "\0\0\0", HS_CHUNK_HDR);
+    t->chunk_len = 0;
+}
+
+static void chunk_patch(struct json2hs *t, char code)
+{
+    uint8_t *hdr = (uint8_t *)buf_peek(t->out) + t->hdr_off;
+    hdr[0] = code;
+    hdr[1] = (t->chunk_len >> 8) & 0xff;
+    hdr[2] = t->chunk_len & 0xff;
+}
+
+static void stage_flush(struct json2hs *t)
+{
+    const char *p = t->stage;
+    int n = t->stage_n;
+    // 空间不足时按已写入大小倍增预留, 多 MB 参数不逐段扩容 (buf 扩容只扩到恰好够用)
+    if (buf_writable(t->out) < (size_t)n + HS_CHUNK_HDR)
+    {
+        buf_ensureWritable(t->out, buf_readable(t->out) + n + HS_CHUNK_HDR);
+    }
+    while (n > 0)
+    {
+        // 满了且还有后续数据才确定为非末尾 chunk
+        if (t->chunk_len == HS_CHUNK)
+        {
+            chunk_patch(t, 'R');
+            chunk_open(t);
+        }
+        int k = HS_CHUNK - t->chunk_len;
+        if (k > n)
+        {
+            k = n;
+        }
+        buf_append(t->out, p, k);
+        t->chunk_len += k;
+        p += k;
+        n -= k;
+    }
+    t->stage_n = 0;
+}
+
+static inline void emit(struct json2hs *t, char c)
+{
+    if (t->mute)
+    {
+        return;
+    }
+    if (t->stage_n == STAGE_SZ)
+    {
+        stage_flush(t);
+    }
+    t->stage[t->stage_n++] = c;
+}
+
+static void emit_n(struct json2hs *t, const char *p, size_t n)
+{
+    if (t->mute)
+    {
+        return;
+    }
+    while (n > 0)
+    {
+        if (t->stage_n == STAGE_SZ)
+        {
+            stage_flush(t);
+        }
+        size_t k = STAGE_SZ - t->stage_n;
+        if (k > n)
+        {
+            k = n;
+        }
+        memcpy(t->stage + t->stage_n, p, k);
+        t->stage_n += k;
+        p += k;
+        n -= k;
+    }
+}
+
+static const char hex[] = "0123456789abcdef";
+
+static void emit_u16(struct json2hs *t, uint32_t u)
+{
+    emit(t, '\\');
+    emit(t, 'u');
+    emit(t, hex[(u >> 12) & 0xf]);
+    emit(t, hex[(u >> 8) & 0xf]);
+    emit(t, hex[(u >> 4) & 0xf]);
+    emit(t, hex[u & 0xf]);
+}
+
+static void emit_cp(struct json2hs *t, uint32_t cp)
+{
+    if (cp >= 0x10000)
+    {
+        cp -= 0x10000;
+        emit_u16(t, 0xd800 | (cp >> 10));
+        emit_u16(t, 0xdc00 | (cp & 0x3ff));
+    }
+    else
+    {
+        emit_u16(t, cp);
+    }
+}
+
+// ****************************************************************************************************
+// 解析
+
+static bool fail(struct json2hs *t, const char *err)
+{
+    t->err = err;
+    t->state = S_ERROR;
+    return false;
+}
+
+static inline bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_hex(char c)
+{
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static void value_done(struct json2hs *t)
+{
+    t->state = t->depth == 0 ? S_DONE : S_AFTER;
+}
+
+static bool push(struct json2hs *t, char c)
+{
+    if (t->depth == MAX_DEPTH)
+    {
+        return fail(t, "nesting too deep");
+    }
+    t->stack[t->depth++] = c;
+    // 顶层对象输出为数组
+    emit(t, t->depth == 1 && c == '{' ? '[' : c);
+    t->state = c == '[' ? S_ARR_FIRST : S_OBJ_FIRST;
+    return true;
+}
+
+static bool pop(struct json2hs *t, char c)
+{
+    char open = c == ']' ? '[' : '{';
+    if (t->depth == 0 || t->stack[t->depth - 1] != open)
+    {
+        return fail(t, "mismatched bracket");
+    }
+    t->depth--;
+    emit(t, t->depth == 0 ? ']' : c);
+    value_done(t);
+    return true;
+}
+
+static void begin_str(struct json2hs *t, bool is_key)
+{
+    t->is_key = is_key;
+    // 顶层对象的 key 连同引号整体不输出
+    t->mute = is_key && t->top_obj && t->depth == 1;
+    emit(t, '"');
+    t->state = S_STR;
+}
+
+static bool begin_value(struct json2hs *t, char c)
+{
+    switch (c)
+    {
+    case '[':
+    case '{':
+        return push(t, c);
+    case '"':
+        begin_str(t, false);
+        return true;
+    case 't':
+        t->lit = "true";
+        break;
+    case 'f':
+        t->lit = "false";
+        break;
+    case 'n':
+        t->lit = "null";
+        break;
+    default:
+        if (c == '-' || is_digit(c))
+        {
+            emit(t, c);
+            t->sub = c == '-' ? N_SIGN : c == '0' ? N_ZERO : N_INT;
+            t->state = S_NUM;
+            return true;
+        }
+        return fail(t, "unexpected character");
+    }
+    emit(t, c);
+    t->lit_i = 1;
+    t->state = S_LIT;
+    return true;
+}
+
+// 数字结束返回 false (c 需重新处理), 出错时置 S_ERROR
+static bool num_step(struct json2hs *t, char c)
+{
+    int s = t->sub;
+    if (is_digit(c))
+    {
+        switch (s)
+        {
+        case N_SIGN:
+            t->sub = c == '0' ? N_ZERO : N_INT;
+            break;
+        case N_ZERO:
+            fail(t, "leading zero");
+            return true;
+        case N_DOT:
+            t->sub = N_FRAC;
+            break;
+        case N_E:
+        case N_ESIGN:
+            t->sub = N_EXP;
+            break;
+        default:
+            break;
+        }
+    }
+    else if (c == '.' && (s == N_ZERO || s == N_INT))
+    {
+        t->sub = N_DOT;
+    }
+    else if ((c == 'e' || c == 'E') && (s == N_ZERO || s == N_INT || s == N_FRAC))
+    {
+        t->sub = N_E;
+    }
+    else if ((c == '+' || c == '-') && s == N_E)
+    {
+        t->sub = N_ESIGN;
+    }
+    else
+    {
+        if (s == N_SIGN || s == N_DOT || s == N_E || s == N_ESIGN)
+        {
+            fail(t, "invalid number");
+            return true;
+        }
+        value_done(t);
+        return false;
+    }
+    emit(t, c);
+    return true;
+}
+
+static bool str_end(struct json2hs *t)
+{
+    emit(t, '"');
+    t->mute = false;
+    if (t->is_key)
+    {
+        t->state = S_COLON;
+    }
+    else
+    {
+        value_done(t);
+    }
+    return true;
+}
+
+static bool utf8_step(struct json2hs *t, uint8_t c)
+{
+    if ((c & 0xc0) != 0x80)
+    {
+        return fail(t, "invalid utf8");
+    }
+    t->cp = (t->cp << 6) | (c & 0x3f);
+    if (--t->need == 0)
+    {
+        if (t->cp < t->min || t->cp > 0x10ffff || (t->cp >= 0xd800 && t->cp <= 0xdfff))
+        {
+            return fail(t, "invalid utf8");
+        }
+        emit_cp(t, t->cp);
+    }
+    return true;
+}
+
+static bool str_step(struct json2hs *t, uint8_t c)
+{
+    if (t->need)
+    {
+        return utf8_step(t, c);
+    }
+    if (c == '"')
+    {
+        return str_end(t);
+    }
+    if (c == '\\')
+    {
+        emit(t, c);
+        t->state = S_STR_ESC;
+        return true;
+    }
+    if (c < 0x20)
+    {
+        return fail(t, "control character in string");
+    }
+    if (c < 0x80)
+    {
+        emit(t, c);
+        return true;
+    }
+    if ((c & 0xe0) == 0xc0)
+    {
+        t->cp = c & 0x1f;
+        t->need = 1;
+        t->min = 0x80;
+    }
+    else if ((c & 0xf0) == 0xe0)
+    {
+        t->cp = c & 0x0f;
+        t->need = 2;
+        t->min = 0x800;
+    }
+    else if ((c & 0xf8) == 0xf0)
+    {
+        t->cp = c & 0x07;
+        t->need = 3;
+        t->min = 0x10000;
+    }
+    else
+    {
+        return fail(t, "invalid utf8");
+    }
+    return true;
+}
+
+// 字符串内无需转义的 ASCII 前缀长度 (非 '"' '\\' 控制字符与非 ASCII)
+static size_t plain_span(const char *s, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i));
+        // 有符号比较, >= 0x80 也小于 0x20
+        __m128i m = _mm_cmplt_epi8(b, _mm_set1_epi8(0x20));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(b, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(b, _mm_set1_epi8('\\')));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++)
+    {
+        uint8_t c = s[i];
+        if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\')
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+// 字符串内的快速路径: 无需转义的 ASCII 整段写入, 完整的多字节字符直接解码
+// 遇到特殊字符, 跨 feed 截断或非法的 utf8 时停下, 交给逐字节状态机 (出错位置由状态机给出)
+static size_t str_fast(struct json2hs *t, const char *s, size_t len)
+{
+    size_t i = plain_span(s, len);
+    emit_n(t, s, i);
+    while (i < len && (uint8_t)s[i] >= 0x80)
+    {
+        uint32_t cp;
+        int k = utf8_decode(s + i, len - i, &cp);
+        if (k == 0)
+        {
+            break;
+        }
+        emit_cp(t, cp);
+        i += k;
+    }
+    return i;
+}
+
+static bool step(struct json2hs *t, char c)
+{
+    switch (t->state)
+    {
+    case S_STR:
+        return str_step(t, c);
+    case S_STR_ESC:
+        if (c == 'u')
+        {
+            t->sub = 0;
+            t->state = S_STR_HEX;
+        }
+        else if (c && strchr("\"\\/bfnrt", c))
+        {
+            t->state = S_STR;
+        }
+        else
+        {
+            return fail(t, "invalid escape");
+        }
+        emit(t, c);
+        return true;
+    case S_STR_HEX:
+        if (!is_hex(c))
+        {
+            return fail(t, "invalid \\u escape");
+        }
+        emit(t, c);
+        if (++t->sub == 4)
+        {
+            t->state = S_STR;
+        }
+        return true;
+    case S_NUM:
+        if (num_step(t, c))
+        {
+            return t->state != S_ERROR;
+        }
+        // 数字之后的字符按 S_AFTER / S_DONE 处理
+        return step(t, c);
+    case S_LIT:
+        if (c != t->lit[t->lit_i])
+        {
+            return fail(t, "invalid literal");
+        }
+        emit(t, c);
+        if (t->lit[++t->lit_i] == '\0')
+        {
+            value_done(t);
+        }
+        return true;
+    default:
+        break;
+    }
+
+    if (is_ws(c))
+    {
+        return true;
+    }
+
+    switch (t->state)
+    {
+    case S_START:
+        if (c != '[' && c != '{')
+        {
+            return fail(t, "arguments must be a json array or object");
+        }
+        t->top_obj = c == '{';
+        return push(t, c);
+    case S_ARR_FIRST:
+        if (c == ']')
+        {
+            return pop(t, c);
+        }
+        return begin_value(t, c);
+    case S_VALUE:
+        return begin_value(t, c);
+    case S_OBJ_FIRST:
+        if (c == '}')
+        {
+            return pop(t, c);
+        }
+        // fallthrough
+    case S_KEY:
+        if (c != '"')
+        {
+            return fail(t, "expect object key");
+        }
+        begin_str(t, true);
+        return true;
+    case S_COLON:
+        if (c != ':')
+        {
+            return fail(t, "expect ':'");
+        }
+        if (!(t->top_obj && t->depth == 1))
+        {
+            emit(t, c);
+        }
+        t->state = S_VALUE;
+        return true;
+    case S_AFTER:
+        if (c == ',')
+        {
+            emit(t, c);
+            t->state = t->stack[t->depth - 1] == '[' ? S_VALUE : S_KEY;
+            return true;
+        }
+        if (c == ']' || c == '}')
+        {
+            return pop(t, c);
+        }
+        return fail(t, "expect ',' or closing bracket");
+    case S_DONE:
+        return fail(t, "trailing characters");
+    default:
+        return false;
+    }
+}
+
+// ****************************************************************************************************
+
+struct json2hs *json2hs_create(struct buffer *out)
+{
+    struct json2hs *t = calloc(1, sizeof(*t));
+    assert(t);
+    t->state = S_START;
+    t->out = out;
+    t->start = buf_readable(out);
+    chunk_open(t);
+    return t;
+}
+
+void json2hs_release(struct json2hs *t)
+{
+    free(t);
+}
+
+static void rollback(struct json2hs *t)
+{
+    buf_unwrite(t->out, buf_readable(t->out) - t->start);
+}
+
+bool json2hs_feed(struct json2hs *t, const char *data, size_t sz)
+{
+    if (t->state == S_ERROR)
+    {
+        return false;
+    }
+    size_t i = 0;
+    while (i < sz)
+    {
+        if (t->state == S_STR && t->need == 0)
+        {
+            size_t n = str_fast(t, data + i, sz - i);
+            i += n;
+            t->pos += n;
+            if (i == sz)
+            {
+                break;
+            }
+        }
+        if (!step(t, data[i]))
+        {
+            if (t->err == NULL)
+            {
+                fail(t, "invalid json");
+            }
+            rollback(t);
+            return false;
+        }
+        i++;
+        t->pos++;
+    }
+    return true;
+}
+
+bool json2hs_finish(struct json2hs *t)
+{
+    if (t->state == S_ERROR)
+    {
+        return false;
+    }
+    if (t->state != S_DONE)
+    {
+        fail(t, "unexpected end of json");
+        rollback(t);
+        return false;
+    }
+    stage_flush(t);
+    chunk_patch(t, 'S');
+    return true;
+}
+
+const char *json2hs_error(const struct json2hs *t, size_t *pos)
+{
+    if (pos)
+    {
+        *pos = t->pos;
+    }
+    return t->err;
+}
+
+bool json2hs(struct buffer *out, const char *json, size_t sz)
+{
+    struct json2hs *t = json2hs_create(out);
+    bool ok = json2hs_feed(t, json, sz) && json2hs_finish(t);
+    json2hs_release(t);
+    return ok;
+}
+
+// ****************************************************************************************************
+// 按类型转码
+
+#define TYPE_MAX_ARGS 255
+
+struct type_conv
+{
+    struct hs_encoder *enc;
+    struct arena *arena;
+    const char *err;
+};
+
+static bool conv_fail(struct type_conv *c, const char *err)
+{
+    if (c->err == NULL)
+    {
+        c->err = err;
+    }
+    return false;
+}
+
+static bool type_is(const char *type, size_t len, const char *name)
+{
+    return strlen(name) == len && memcmp(type, name, len) == 0;
+}
+
+// 基本类型的描述符字符, 非基本类型返回 0
+static char prim_desc(const char *type, size_t len)
+{
+    static const char *const names[] = {"boolean", "byte", "char", "short", "int", "long", "float", "double"};
+    static const char descs[] = "ZBCSIJFD";
+    size_t i;
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (type_is(type, len, names[i]))
+        {
+            return descs[i];
+        }
+    }
+    return 0;
+}
+
+static bool desc_append(struct buffer *desc, const char *type, size_t len)
+{
+    while (len > 2 && type[len - 2] == '[' && type[len - 1] == ']')
+    {
+        buf_append(desc, "[", 1);
+        len -= 2;
+    }
+    if (len == 0)
+    {
+        return false;
+    }
+    char d = prim_desc(type, len);
+    if (d)
+    {
+        buf_append(desc, &d, 1);
+        return true;
+    }
+    size_t i;
+    buf_append(desc, "L", 1);
+    for (i = 0; i < len; i++)
+    {
+        char ch = type[i] == '.' ? '/' : type[i];
+        if (ch == ' ' || ch == '[' || ch == ']')
+        {
+            return false;
+        }
+        buf_append(desc, &ch, 1);
+    }
+    buf_append(desc, ";", 1);
+    return true;
+}
+
+// hessian list 的类型名, 同 java Hessian2Output: [int [string [object [com.foo.Bar
+static const char *list_type(struct type_conv *c, const char *elem, size_t len)
+{
+    const char *name = elem;
+    if (type_is(elem, len, "java.lang.String"))
+    {
+        name = "string", len = 6;
+    }
+    else if (type_is(elem, len, "java.lang.Object"))
+    {
+        name = "object", len = 6;
+    }
+    char *t = arena_alloc(c->arena, len + 2);
+    assert(t);
+    t[0] = '[';
+    memcpy(t + 1, name, len);
+    t[len + 1] = '\0';
+    return t;
+}
+
+// 编码为无类型 hessian map 的类型名
+static bool is_map_type(const char *type, size_t len)
+{
+    return type_is(type, len, "java.util.Map") || type_is(type, len, "java.util.HashMap") || type_is(type, len, "java.lang.Object");
+}
+
+static bool conv_value(struct type_conv *c, const char *type, size_t len, const cJSON *v);
+
+// 无类型: 按 JSON 值本身编码, 对象带 "$class" 时编码为该类的 object
+// "$class" 为 Map/HashMap/Object 时仍编码为 map, 不写 "$class"
+static bool conv_any(struct type_conv *c, const cJSON *v)
+{
+    struct hs_encoder *enc = c->enc;
+    const cJSON *e;
+    if (cJSON_IsNull(v))
+    {
+        hs_write_null(enc);
+    }
+    else if (cJSON_IsBool(v))
+    {
+        hs_write_bool(enc, cJSON_IsTrue(v));
+    }
+    else if (cJSON_IsNumber(v))
+    {
+        double d = v->valuedouble;
+        if (d >= INT32_MIN && d <= INT32_MAX && (int32_t)d == d)
+        {
+            hs_write_int(enc, (int32_t)d);
+        }
+        else if (d >= -9007199254740992.0 && d <= 9007199254740992.0 && (int64_t)d == d)
+        {
+            hs_write_long(enc, (int64_t)d);
+        }
+        else
+        {
+            hs_write_double(enc, d);
+        }
+    }
+    else if (cJSON_IsString(v))
+    {
+        if (!hs_write_string(enc, v->valuestring, strlen(v->valuestring)))
+        {
+            return conv_fail(c, "invalid utf8 string");
+        }
+    }
+    else if (cJSON_IsArray(v))
+    {
+        hs_write_list_begin(enc, NULL, cJSON_GetArraySize(v));
+        cJSON_ArrayForEach(e, v)
+        {
+            if (!conv_any(c, e))
+            {
+                return false;
+            }
+        }
+    }
+    else if (cJSON_IsObject(v))
+    {
+        const cJSON *cls = cJSON_GetObjectItemCaseSensitive(v, "$class");
+        if (cJSON_IsString(cls) && !is_map_type(cls->valuestring, strlen(cls->valuestring)))
+        {
+            return conv_value(c, cls->valuestring, strlen(cls->valuestring), v);
+        }
+        hs_write_map_begin(enc, NULL);
+        cJSON_ArrayForEach(e, v)
+        {
+            if (e == cls && cJSON_IsString(cls))
+            {
+                continue;
+            }
+            if (!hs_write_string(enc, e->string, strlen(e->string)) || !conv_any(c, e))
+            {
+                return conv_fail(c, "invalid map entry");
+            }
+        }
+        hs_write_end(enc);
+    }
+    else
+    {
+        return conv_fail(c, "unsupported json value");
+    }
+    return true;
+}
+
+static bool conv_integer(struct type_conv *c, const cJSON *v, int64_t min, int64_t max, int64_t *out)
+{
+    if (cJSON_IsString(v))
+    {
+        // 超过 2^53 的 long 用字符串传递
+        char *end;
+        errno = 0;
+        long long l = strtoll(v->valuestring, &end, 10);
+        if (errno || end == v->valuestring || *end || l < min || l > max)
+        {
+            return conv_fail(c, "invalid integer");
+        }
+        *out = l;
+        return true;
+    }
+    if (!cJSON_IsNumber(v))
+    {
+        return conv_fail(c, "expect integer");
+    }
+    double d = v->valuedouble;
+    if (d < -9223372036854775808.0 || d >= 9223372036854775808.0 || (int64_t)d != d || (int64_t)d < min || (int64_t)d > max)
+    {
+        return conv_fail(c, "integer out of range");
+    }
+    *out = (int64_t)d;
+    return true;
+}
+
+static bool conv_value(struct type_conv *c, const char *type, size_t len, const cJSON *v)
+{
+    struct hs_encoder *enc = c->enc;
+    const cJSON *e;
+    int64_t l;
+
+    if (cJSON_IsNull(v))
+    {
+        if (prim_desc(type, len))
+        {
+            return conv_fail(c, "null for primitive type");
+        }
+        hs_write_null(enc);
+        return true;
+    }
+
+    if (type_is(type, len, "boolean") || type_is(type, len, "java.lang.Boolean"))
+    {
+        if (!cJSON_IsBool(v))
+        {
+            return conv_fail(c, "expect boolean");
+        }
+        hs_write_bool(enc, cJSON_IsTrue(v));
+    }
+    else if (type_is(type, len, "byte") || type_is(type, len, "java.lang.Byte"))
+    {
+        if (!conv_integer(c, v, INT8_MIN, INT8_MAX, &l))
+        {
+            return false;
+        }
+        hs_write_int(enc, l);
+    }
+    else if (type_is(type, len, "short") || type_is(type, len, "java.lang.Short"))
+    {
+        if (!conv_integer(c, v, INT16_MIN, INT16_MAX, &l))
+        {
+            return false;
+        }
+        hs_write_int(enc, l);
+    }
+    else if (type_is(type, len, "int") || type_is(type, len, "java.lang.Integer"))
+    {
+        if (!conv_integer(c, v, INT32_MIN, INT32_MAX, &l))
+        {
+            return false;
+        }
+        hs_write_int(enc, l);
+    }
+    else if (type_is(type, len, "long") || type_is(type, len, "java.lang.Long"))
+    {
+        if (!conv_integer(c, v, INT64_MIN, INT64_MAX, &l))
+        {
+            return false;
+        }
+        hs_write_long(enc, l);
+    }
+    else if (type_is(type, len, "java.util.Date"))
+    {
+        if (!conv_integer(c, v, INT64_MIN, INT64_MAX, &l))
+        {
+            return false;
+        }
+        hs_write_date(enc, l);
+    }
+    else if (type_is(type, len, "float") || type_is(type, len, "double") ||
+             type_is(type, len, "java.lang.Float") || type_is(type, len, "java.lang.Double"))
+    {
+        if (!cJSON_IsNumber(v))
+        {
+            return conv_fail(c, "expect number");
+        }
+        hs_write_double(enc, v->valuedouble);
+    }
+    else if (type_is(type, len, "char") || type_is(type, len, "java.lang.Character") || type_is(type, len, "java.lang.String"))
+    {
+        if (!cJSON_IsString(v))
+        {
+            return conv_fail(c, "expect string");
+        }
+        size_t sz = strlen(v->valuestring);
+        if (!type_is(type, len, "java.lang.String") && utf8_count_utf16(v->valuestring, sz, NULL) != 1)
+        {
+            return conv_fail(c, "expect single char");
+        }
+        if (!hs_write_string(enc, v->valuestring, sz))
+        {
+            return conv_fail(c, "invalid utf8 string");
+        }
+    }
+    else if (type_is(type, len, "byte[]"))
+    {
+        // 字节数组为 hessian binary, JSON 中为数字数组
+        if (!cJSON_IsArray(v))
+        {
+            return conv_fail(c, "expect byte array");
+        }
+        int n = cJSON_GetArraySize(v), i = 0;
+        uint8_t *bytes = arena_alloc(c->arena, n + 1);
+        assert(bytes);
+        cJSON_ArrayForEach(e, v)
+        {
+            if (!conv_integer(c, e, INT8_MIN, UINT8_MAX, &l))
+            {
+                return false;
+            }
+            bytes[i++] = (uint8_t)l;
+        }
+        hs_write_binary(enc, bytes, n);
+    }
+    else if (len > 2 && type[len - 2] == '[' && type[len - 1] == ']')
+    {
+        if (!cJSON_IsArray(v))
+        {
+            return conv_fail(c, "expect array");
+        }
+        hs_write_list_begin(enc, list_type(c, type, len - 2), cJSON_GetArraySize(v));
+        cJSON_ArrayForEach(e, v)
+        {
+            if (!conv_value(c, type, len - 2, e))
+            {
+                return false;
+            }
+        }
+    }
+    else if (type_is(type, len, "java.util.List") || type_is(type, len, "java.util.ArrayList") ||
+             type_is(type, len, "java.util.Set") || type_is(type, len, "java.util.HashSet") ||
+             type_is(type, len, "java.util.Collection"))
+    {
+        if (!cJSON_IsArray(v))
+        {
+            return conv_fail(c, "expect array");
+        }
+        return conv_any(c, v);
+    }
+    else if (is_map_type(type, len))
+    {
+        return conv_any(c, v);
+    }
+    else
+    {
+        // POJO: 字段取 JSON key 顺序, 字段值无类型
+        if (!cJSON_IsObject(v))
+        {
+            return conv_fail(c, "expect object");
+        }
+        int n = 0, i = 0;
+        cJSON_ArrayForEach(e, v)
+        {
+            n += strcmp(e->string, "$class") != 0;
+        }
+        const char **fields = arena_alloc(c->arena, (n + 1) * sizeof(char *));
+        assert(fields);
+        cJSON_ArrayForEach(e, v)
+        {
+            if (strcmp(e->string, "$class") != 0)
+            {
+                fields[i++] = e->string;
+            }
+        }
+        hs_write_object_begin(enc, arena_strndup(c->arena, type, len), fields, n);
+        cJSON_ArrayForEach(e, v)
+        {
+            if (strcmp(e->string, "$class") != 0 && !conv_any(c, e))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 逗号分隔类型, 跳过泛型参数 (其中也有逗号)
+static bool next_type(const char **p, const char **type, size_t *len)
+{
+    const char *s = *p;
+    while (*s == ' ' || *s == ',')
+    {
+        s++;
+    }
+    if (*s == '\0')
+    {
+        return false;
+    }
+    const char *beg = s;
+    int depth = 0;
+    while (*s && (depth > 0 || *s != ','))
+    {
+        depth += *s == '<';
+        depth -= *s == '>';
+        s++;
+    }
+    *p = s;
+    *type = beg;
+    *len = s - beg;
+    return true;
+}
+
+// 去掉泛型参数与空白, 复制到 arena
+static char *plain_type(struct arena *arena, const char *type, size_t len, size_t *out_len)
+{
+    char *t = arena_alloc(arena, len + 1);
+    assert(t);
+    size_t i, n = 0;
+    int depth = 0;
+    for (i = 0; i < len; i++)
+    {
+        char ch = type[i];
+        if (ch == '<')
+        {
+            depth++;
+        }
+        else if (ch == '>')
+        {
+            depth--;
+        }
+        else if (depth == 0 && ch != ' ')
+        {
+            t[n++] = ch;
+        }
+    }
+    t[n] = '\0';
+    *out_len = n;
+    return t;
+}
+
+static void *conv_alloc(void *ud, size_t sz)
+{
+    return arena_alloc(ud, sz);
+}
+
+bool json2hs_typed(struct buffer *out, const char *types, const char *json, size_t sz, char **desc, const char **err)
+{
+    struct type_conv c;
+    c.err = NULL;
+    c.arena = arena_create(4096);
+    c.enc = hs_encoder_create(out);
+    size_t start = buf_readable(out);
+    struct buffer *d = buf_create(64);
+
+    const char *tv[TYPE_MAX_ARGS];
+    size_t tl[TYPE_MAX_ARGS];
+    int n = 0;
+    const char *p = types, *t;
+    size_t len;
+    while (next_type(&p, &t, &len))
+    {
+        if (n == TYPE_MAX_ARGS)
+        {
+            conv_fail(&c, "too many argument types");
+            goto fail;
+        }
+        tv[n] = plain_type(c.arena, t, len, &tl[n]);
+        if (!desc_append(d, tv[n], tl[n]))
+        {
+            conv_fail(&c, "invalid java type");
+            goto fail;
+        }
+        n++;
+    }
+
+    // cJSON 需要 '\0' 结尾
+    char *src = arena_strndup(c.arena, json, sz);
+    assert(src);
+    cJSON *args = cJSON_ParseInArena(src, conv_alloc, c.arena);
+    if (args == NULL || !(cJSON_IsArray(args) || cJSON_IsObject(args)))
+    {
+        conv_fail(&c, "invalid json args");
+        goto fail;
+    }
+    if (cJSON_GetArraySize(args) != n)
+    {
+        conv_fail(&c, "argument count mismatch");
+        goto fail;
+    }
+    // 顶层对象按值顺序
+    int i = 0;
+    const cJSON *v;
+    cJSON_ArrayForEach(v, args)
+    {
+        if (!conv_value(&c, tv[i], tl[i], v))
+        {
+            goto fail;
+        }
+        i++;
+    }
+
+    *desc = buf_dupStr(d, buf_readable(d));
+    buf_release(d);
+    hs_encoder_release(c.enc);
+    arena_release(c.arena);
+    return true;
+
+fail:
+    if (err)
+    {
+        *err = c.err;
+    }
+    buf_unwrite(out, buf_readable(out) - start);
+    buf_release(d);
+    hs_encoder_release(c.enc);
+    arena_release(c.arena);
+    return false;
+}
+
+bool json2hs_attach(struct buffer *out, const char *json, size_t sz)
+{
+    struct arena *arena = arena_create(1024);
+    struct hs_encoder *enc = hs_encoder_create(out);
+    size_t start = buf_readable(out);
+    bool ok = true;
+
+    char *src = arena_strndup(arena, json, sz);
+    assert(src);
+    cJSON *attach = cJSON_ParseInArena(src, conv_alloc, arena);
+    if (!cJSON_IsObject(attach))
+    {
+        ok = false;
+        goto end;
+    }
+
+    const cJSON *e;
+    hs_write_map_begin(enc, NULL);
+    cJSON_ArrayForEach(e, attach)
+    {
+        if (!hs_write_string(enc, e->string, strlen(e->string)))
+        {
+            ok = false;
+            goto end;
+        }
+        if (cJSON_IsString(e))
+        {
+            ok = hs_write_string(enc, e->valuestring, strlen(e->valuestring));
+        }
+        else
+        {
+            struct buffer *tmp = buf_create(64);
+            struct jsonw *jw = jw_create(tmp, 0);
+            jw_cjson(jw, e);
+            jw_release(jw);
+            ok = hs_write_string(enc, buf_peek(tmp), buf_readable(tmp));
+            buf_release(tmp);
+        }
+        if (!ok)
+        {
+            goto end;
+        }
+    }
+    hs_write_end(enc);
+
+end:
+    if (!ok)
+    {
+        buf_unwrite(out, buf_readable(out) - start);
+    }
+    hs_encoder_release(enc);
+    arena_release(arena);
+    return ok;
+}
@@ -0,0 +1,41 @@
+#ifndef DUBBO_TRANSCODE_H
+#define DUBBO_TRANSCODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "buffer.h"
+
+// 用户 JSON 参数 -> 泛化调用 jsonArgs (hessian2 string) 的单遍流式转码, 不建解析树
+// 校验 JSON, 去掉空白, 顶层对象按值顺序转为数组, 非 ASCII 字符转为 \uXXXX
+// 结果直接以 hessian string chunk ('R' ... 'S') 写入 out, 只保留嵌套栈与当前 token 的少量状态, 内存与输入大小无关
+// 输入可分段 feed (可在任意字节处切分)
+// feed/finish 失败时回滚已写入 out 的内容
+
+struct json2hs;
+
+struct json2hs *json2hs_create(struct buffer *out);
+void json2hs_release(struct json2hs *);
+
+bool json2hs_feed(struct json2hs *, const char *data, size_t sz);
+// 输入结束, 补写最后一个 chunk 头
+bool json2hs_finish(struct json2hs *);
+// 失败原因与出错的输入偏移
+const char *json2hs_error(const struct json2hs *, size_t *pos);
+
+// 一次性转码
+bool json2hs(struct buffer *out, const char *json, size_t sz);
+
+// ****************************************************************************************************
+// 按声明的 java 参数类型把 JSON 参数直接转为 hessian 值序列, 服务端无需 JSON 反序列化
+// types 为逗号分隔的 java 类型, 如 "int,java.lang.String,java.util.List<java.lang.Long>", 泛型参数忽略
+// 基本类型及其包装类按类型编码 (long 可用数字字符串避免精度丢失, java.util.Date 为毫秒数)
+// X[] 为带类型的 list, List/Set/Collection 为无类型 list, Map 为 hessian map, 其它类名为该类的 object (字段取 JSON key)
+// 无类型位置的 JSON 对象可用 "$class" 指定类名, 为 Map/HashMap/Object 时仍为 hessian map
+// 成功时 *desc 为 JVM 方法描述符 (需 free), 失败时 *err 为原因, 回滚 out
+
+bool json2hs_typed(struct buffer *out, const char *types, const char *json, size_t sz, char **desc, const char **err);
+
+// JSON 对象 -> hessian map<String, String> (dubbo attachments), 非字符串值取其 JSON 文本
+bool json2hs_attach(struct buffer *out, const char *json, size_t sz);
+
+#endif
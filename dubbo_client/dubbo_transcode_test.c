@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "buffer.h"
+#include "dubbo_hessian.h"
+#include "dubbo_transcode.h"
+
+// 拼接 hessian string chunk, 返回 chunk 个数
+static int hs_unchunk(struct buffer *buf, char *out)
+{
+    const uint8_t *p = (const uint8_t *)buf_peek(buf);
+    const uint8_t *end = p + buf_readable(buf);
+    int n = 0;
+    for (;;)
+    {
+        assert(p + 3 <= end);
+        assert(p[0] == 'R' || p[0] == 'S');
+        int len = (p[1] << 8) | p[2];
+        assert(p + 3 + len <= end);
+        memcpy(out, p + 3, len);
+        out += len;
+        n++;
+        if (p[0] == 'S')
+        {
+            assert(p + 3 + len == end);
+            break;
+        }
+        p += 3 + len;
+    }
+    *out = '\0';
+    return n;
+}
+
+static void expect(const char *json, const char *expected)
+{
+    struct buffer *buf = buf_create(64);
+    assert(json2hs(buf, json, strlen(json)));
+    char out[256];
+    hs_unchunk(buf, out);
+    if (strcmp(out, expected) != 0)
+    {
+        fprintf(stderr, "%s => %s, expected %s\n", json, out, expected);
+        assert(0);
+    }
+    buf_release(buf);
+}
+
+static void expect_fail(const char *json)
+{
+    struct buffer *buf = buf_create(64);
+    buf_append(buf, "xx", 2);
+    if (json2hs(buf, json, strlen(json)))
+    {
+        fprintf(stderr, "%s should fail\n", json);
+        assert(0);
+    }
+    // 回滚
+    assert(buf_readable(buf) == 2);
+    buf_release(buf);
+}
+
+void test_Transcode_basic()
+{
+    expect("[]", "[]");
+    expect(" [ 1 , -2.5e+3 , true , false , null , \"a b\" ] ", "[1,-2.5e+3,true,false,null,\"a b\"]");
+    expect("{\"arg0\": 1, \"arg1\": {\"k\": [1, {}]}, \"arg2\": \"s\"}", "[1,{\"k\":[1,{}]},\"s\"]");
+    expect("{}", "[]");
+    expect("[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u4E2d\"]", "[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u4E2d\"]");
+    // 非 ASCII 转义, 4 字节字符转代理对
+    expect("[\"中文\", \"é\", \"😀\"]", "[\"\\u4e2d\\u6587\",\"\\u00e9\",\"\\ud83d\\ude00\"]");
+    // 顶层对象的 key 含非 ASCII 与转义也整体丢弃
+    expect("{\"名\\\"字\": 0}", "[0]");
+    expect("[0, 0.5, -0, 10E2]", "[0,0.5,-0,10E2]");
+}
+
+void test_Transcode_invalid()
+{
+    expect_fail("");
+    expect_fail("1");
+    expect_fail("\"s\"");
+    expect_fail("[1,]");
+    expect_fail("[1 2]");
+    expect_fail("[01]");
+    expect_fail("[1.]");
+    expect_fail("[-]");
+    expect_fail("[1e]");
+    expect_fail("[tru]");
+    expect_fail("[nul1]");
+    expect_fail("{\"a\"}");
+    expect_fail("{\"a\":1,}");
+    expect_fail("{1:1}");
+    expect_fail("[}");
+    expect_fail("[1]]");
+    expect_fail("[1] x");
+    expect_fail("[\"\\x\"]");
+    expect_fail("[\"\\u12g4\"]");
+    expect_fail("[\"a\nb\"]");
+    expect_fail("[\"\xc3\"]");
+    expect_fail("[\"\xc0\x80\"]");     // overlong
+    expect_fail("[\"\xed\xa0\x80\"]"); // 代理
+    expect_fail("[\"\xff\"]");
+    expect_fail("[\"abc");
+}
+
+void test_Transcode_stream()
+{
+    // 逐字节 feed 结果与一次性相同
+    const char *json = "{\"a\": [1, 2.5, \"中文\\u0041\"], \"b\": {\"c\": null}}";
+    struct buffer *buf = buf_create(64);
+    struct json2hs *t = json2hs_create(buf);
+    size_t i;
+    for (i = 0; i < strlen(json); i++)
+    {
+        assert(json2hs_feed(t, json + i, 1));
+    }
+    assert(json2hs_finish(t));
+    json2hs_release(t);
+    char out[256];
+    hs_unchunk(buf, out);
+    assert(strcmp(out, "[[1,2.5,\"\\u4e2d\\u6587\\u0041\"],{\"c\":null}]") == 0);
+    buf_release(buf);
+
+    // 出错位置
+    buf = buf_create(64);
+    t = json2hs_create(buf);
+    assert(!json2hs_feed(t, "[1, x]", 6));
+    size_t pos;
+    assert(json2hs_error(t, &pos) != NULL);
+    assert(pos == 4);
+    assert(!json2hs_finish(t));
+    json2hs_release(t);
+    buf_release(buf);
+}
+
+void test_Transcode_large()
+{
+    // 超过单个 chunk, 拆分为多个 'R' + 最后 'S'
+    int n = 50000, i;
+    struct buffer *in = buf_create(1024);
+    buf_append(in, "[", 1);
+    for (i = 0; i < n; i++)
+    {
+        buf_append(in, i ? ", \"中\"" : "\"中\"", i ? 7 : 5);
+    }
+    buf_append(in, "]", 1);
+
+    struct buffer *buf = buf_create(64);
+    assert(json2hs(buf, buf_peek(in), buf_readable(in)));
+
+    size_t expect_len = 2 + n * 8 + (n - 1);
+    char *out = malloc(expect_len + 1);
+    int chunks = hs_unchunk(buf, out);
+    assert(strlen(out) == expect_len);
+    assert(chunks == (int)((expect_len + 0x7fff) / 0x8000));
+    assert(strncmp(out, "[\"\\u4e2d\",\"\\u4e2d\"", 18) == 0);
+    free(out);
+    buf_release(buf);
+    buf_release(in);
+
+    // 恰好填满一个 chunk 时只有一个 'S'
+    in = buf_create(0x8000);
+    buf_append(in, "[\"", 2);
+    for (i = 0; i < 0x8000 - 4; i++)
+    {
+        buf_append(in, "a", 1);
+    }
+    buf_append(in, "\"]", 2);
+    buf = buf_create(64);
+    assert(json2hs(buf, buf_peek(in), buf_readable(in)));
+    assert(buf_readable(buf) == 0x8000 + 3);
+    assert(buf_peek(buf)[0] == 'S');
+    buf_release(buf);
+    buf_release(in);
+}
+
+// 按类型编码的结果与 expected 中手写的 hessian 一致
+static void expect_typed(const char *types, const char *json, struct buffer *expected)
+{
+    struct buffer *buf = buf_create(64);
+    char *desc = NULL;
+    const char *err = NULL;
+    bool ok = json2hs_typed(buf, types, json, strlen(json), &desc, &err);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", json, err);
+        assert(0);
+    }
+    assert(buf_readable(buf) == buf_readable(expected));
+    assert(memcmp(buf_peek(buf), buf_peek(expected), buf_readable(buf)) == 0);
+    free(desc);
+    buf_release(buf);
+    buf_release(expected);
+}
+
+void test_Transcode_typed_map()
+{
+    // "$class" 为 Map/HashMap/Object 时编码为 map, 不写 "$class"
+    struct buffer *expected = buf_create(64);
+    struct hs_encoder *enc = hs_encoder_create(expected);
+    hs_write_map_begin(enc, NULL);
+    hs_write_string(enc, "a", 1);
+    hs_write_int(enc, 1);
+    hs_write_end(enc);
+    expect_typed("java.lang.Object", "[{\"$class\":\"java.util.HashMap\",\"a\":1}]", expected);
+
+    expected = buf_create(64);
+    hs_encoder_reset(enc, expected);
+    hs_write_map_begin(enc, NULL);
+    hs_write_string(enc, "k", 1);
+    hs_write_map_begin(enc, NULL);
+    hs_write_string(enc, "a", 1);
+    hs_write_string(enc, "b", 1);
+    hs_write_end(enc);
+    hs_write_end(enc);
+    expect_typed("java.util.Map", "[{\"$class\":\"java.util.Map\",\"k\":{\"$class\":\"java.lang.Object\",\"a\":\"b\"}}]", expected);
+
+    // 其它类名仍编码为 object
+    expected = buf_create(64);
+    hs_encoder_reset(enc, expected);
+    const char *fields[] = {"color"};
+    hs_write_object_begin(enc, "example.Car", fields, 1);
+    hs_write_string(enc, "red", 3);
+    expect_typed("java.lang.Object", "[{\"$class\":\"example.Car\",\"color\":\"red\"}]", expected);
+    hs_encoder_release(enc);
+}
+
+int main(void)
+{
+    test_Transcode_basic();
+    test_Transcode_invalid();
+    test_Transcode_stream();
+    test_Transcode_large();
+    test_Transcode_typed_map();
+    return 0;
+}
@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "dubbo_workload.h"
+#include "dubbo_codec.h"
+#include "arena.h"
+#include "buffer.h"
+#include "cJSON.h"
+#include "jsonw.h"
+#include "log.h"
+
+#define WL_CHUNK_SZ (64 * 1024)
+#define WL_MAX_WEIGHT 1000000
+// 权重按千分之一取整累计, 支持小数权重
+#define WL_WEIGHT_SCALE 1000
+
+struct wl_call
+{
+    uint64_t weight_end; // 累计权重, 选调用时二分查找
+    const char **frames;
+    uint32_t *lens;
+    uint32_t n;
+};
+
+struct dubbo_workload
+{
+    struct arena *arena; // 所有预编码的帧
+    struct wl_call *calls;
+    int call_n;
+    uint64_t total_weight;
+};
+
+// 数据集的一行, 值已转义, 可直接替换进模板
+struct wl_row
+{
+    int n;
+    const char **keys;
+    const char **vals;
+};
+
+struct wl_dataset
+{
+    struct arena *arena;
+    struct wl_row *rows;
+    size_t n;
+    size_t cap;
+};
+
+static char *read_file(const char *path, size_t *sz)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        LOG_ERROR("打开 %s 失败", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(len + 1);
+    assert(buf);
+    if (len < 0 || fread(buf, 1, len, f) != (size_t)len)
+    {
+        LOG_ERROR("读取 %s 失败", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[len] = '\0';
+    fclose(f);
+    *sz = len;
+    return buf;
+}
+
+// 借 jsonw 转义后去掉两侧引号
+static const char *escape_value(struct arena *a, const char *s, size_t len)
+{
+    struct buffer *tmp = buf_create(len + 16);
+    struct jsonw *jw = jw_create(tmp, 0);
+    jw_string(jw, s, len);
+    jw_release(jw);
+    const char *v = arena_strndup(a, buf_peek(tmp) + 1, buf_readable(tmp) - 2);
+    buf_release(tmp);
+    return v;
+}
+
+static struct wl_row *ds_add_row(struct wl_dataset *ds, int n)
+{
+    if (ds->n == ds->cap)
+    {
+        ds->cap = ds->cap ? ds->cap * 2 : 64;
+        ds->rows = realloc(ds->rows, ds->cap * sizeof(struct wl_row));
+        assert(ds->rows);
+    }
+    struct wl_row *row = &ds->rows[ds->n++];
+    row->n = n;
+    row->keys = arena_alloc(ds->arena, n * sizeof(char *));
+    row->vals = arena_alloc(ds->arena, n * sizeof(char *));
+    assert(row->keys && row->vals);
+    return row;
+}
+
+// 解析一行 CSV, 引号内可含逗号, 换行与 "" 转义; 字段存入 fields (arena 中), 返回下一行起始
+static const char *csv_row(struct arena *a, const char *p, const char *end, const char ***fields, int *n, int *cap)
+{
+    struct buffer *field = buf_create(64);
+    *n = 0;
+    for (;;)
+    {
+        buf_retrieveAll(field);
+        if (p < end && *p == '"')
+        {
+            p++;
+            while (p < end)
+            {
+                if (*p == '"')
+                {
+                    if (p + 1 < end && p[1] == '"')
+                    {
+                        buf_append(field, "\"", 1);
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                buf_append(field, p++, 1);
+            }
+        }
+        const char *s = p;
+        while (p < end && *p != ',' && *p != '\n' && *p != '\r')
+        {
+            p++;
+        }
+        buf_append(field, s, p - s);
+
+        if (*n == *cap)
+        {
+            *cap = *cap ? *cap * 2 : 16;
+            *fields = realloc(*fields, *cap * sizeof(char *));
+            assert(*fields);
+        }
+        (*fields)[(*n)++] = arena_strndup(a, buf_peek(field), buf_readable(field));
+
+        if (p < end && *p == ',')
+        {
+            p++;
+            continue;
+        }
+        break;
+    }
+    while (p < end && (*p == '\r' || *p == '\n'))
+    {
+        p++;
+    }
+    buf_release(field);
+    return p;
+}
+
+static bool load_csv(struct wl_dataset *ds, const char *path, const char *text, size_t sz)
+{
+    const char *p = text, *end = text + sz;
+    const char **header = NULL, **fields = NULL;
+    int header_n = 0, header_cap = 0, n = 0, cap = 0;
+
+    p = csv_row(ds->arena, p, end, &header, &header_n, &header_cap);
+    while (p < end)
+    {
+        p = csv_row(ds->arena, p, end, &fields, &n, &cap);
+        if (n != header_n)
+        {
+            LOG_ERROR("%s 第 %zu 行有 %d 列, 表头 %d 列", path, ds->n + 2, n, header_n);
+            free(header);
+            free(fields);
+            return false;
+        }
+        struct wl_row *row = ds_add_row(ds, n);
+        int i;
+        for (i = 0; i < n; i++)
+        {
+            row->keys[i] = header[i];
+            row->vals[i] = escape_value(ds->arena, fields[i], strlen(fields[i]));
+        }
+    }
+    free(header);
+    free(fields);
+    return true;
+}
+
+static bool load_jsonl(struct wl_dataset *ds, const char *path, char *text, size_t sz)
+{
+    size_t line_no = 0;
+    char *p = text, *end = text + sz;
+    while (p < end)
+    {
+        char *nl = memchr(p, '\n', end - p);
+        char *line_end = nl ? nl : end;
+        line_no++;
+        *line_end = '\0';
+        char *s = p;
+        p = line_end + 1;
+        while (*s == ' ' || *s == '\t' || *s == '\r')
+        {
+            s++;
+        }
+        if (*s == '\0')
+        {
+            continue;
+        }
+
+        cJSON *obj = cJSON_Parse(s);
+        if (obj == NULL || !cJSON_IsObject(obj))
+        {
+            LOG_ERROR("%s 第 %zu 行不是 JSON 对象", path, line_no);
+            cJSON_Delete(obj);
+            return false;
+        }
+        struct wl_row *row = ds_add_row(ds, cJSON_GetArraySize(obj));
+        int i = 0;
+        cJSON *item;
+        for (item = obj->child; item; item = item->next, i++)
+        {
+            row->keys[i] = arena_strndup(ds->arena, item->string, strlen(item->string));
+            if (cJSON_IsString(item))
+            {
+                row->vals[i] = escape_value(ds->arena, item->valuestring, strlen(item->valuestring));
+            }
+            else
+            {
+                char *txt = cJSON_PrintUnformatted(item);
+                row->vals[i] = arena_strndup(ds->arena, txt, strlen(txt));
+                free(txt);
+            }
+        }
+        cJSON_Delete(obj);
+    }
+    return true;
+}
+
+static bool ends_with(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static bool load_dataset(struct wl_dataset *ds, const char *dir, const char *file)
+{
+    char path[4096];
+    if (file[0] == '/' || dir == NULL)
+    {
+        snprintf(path, sizeof(path), "%s", file);
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, file);
+    }
+
+    size_t sz;
+    char *text = read_file(path, &sz);
+    if (text == NULL)
+    {
+        return false;
+    }
+    bool ok;
+    if (ends_with(path, ".csv"))
+    {
+        ok = load_csv(ds, path, text, sz);
+    }
+    else if (ends_with(path, ".jsonl"))
+    {
+        ok = load_jsonl(ds, path, text, sz);
+    }
+    else
+    {
+        LOG_ERROR("%s: 数据集只支持 .csv 与 .jsonl", path);
+        ok = false;
+    }
+    free(text);
+    if (ok && ds->n == 0)
+    {
+        LOG_ERROR("%s: 数据集为空", path);
+        ok = false;
+    }
+    return ok;
+}
+
+// 按 row 展开 ${col}
+static bool expand(struct buffer *out, const char *tpl, const struct wl_row *row, size_t row_no)
+{
+    buf_retrieveAll(out);
+    const char *p = tpl;
+    for (;;)
+    {
+        const char *open = strstr(p, "${");
+        if (open == NULL)
+        {
+            buf_append(out, p, strlen(p));
+            break;
+        }
+        const char *close = strchr(open + 2, '}');
+        if (close == NULL)
+        {
+            LOG_ERROR("参数模板中 ${ 未闭合: %s", tpl);
+            return false;
+        }
+        buf_append(out, p, open - p);
+
+        const char *name = open + 2;
+        size_t name_len = close - name;
+        int i;
+        for (i = 0; i < row->n; i++)
+        {
+            if (strlen(row->keys[i]) == name_len && memcmp(row->keys[i], name, name_len) == 0)
+            {
+                buf_append(out, row->vals[i], strlen(row->vals[i]));
+                break;
+            }
+        }
+        if (i == row->n)
+        {
+            LOG_ERROR("数据第 %zu 行没有 %.*s", row_no, (int)name_len, name);
+            return false;
+        }
+        p = close + 1;
+    }
+    buf_append(out, "", 1);
+    return true;
+}
+
+// 编码一帧追加到 call, frame 的 reqid 发送时改写
+static bool add_frame(struct dubbo_workload *wl, struct wl_call *call, uint32_t cap,
+                      const char *service, const char *method, const char *types, const char *args, const char *attach)
+{
+    cJSON *check = cJSON_Parse(args);
+    bool valid = check && (cJSON_IsArray(check) || cJSON_IsObject(check));
+    cJSON_Delete(check);
+    if (!valid)
+    {
+        LOG_ERROR("%s.%s 参数不是 JSON 数组或对象: %s", service, method, args);
+        return false;
+    }
+
+    struct dubbo_req *req = dubbo_req_create(service, method, types, args, attach);
+    if (req == NULL)
+    {
+        return false;
+    }
+    struct buffer *buf = dubbo_encode(req);
+    dubbo_req_release(req);
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    assert(call->n < cap);
+    size_t len = buf_readable(buf);
+    char *frame = arena_alloc(wl->arena, len);
+    assert(frame);
+    memcpy(frame, buf_peek(buf), len);
+    call->frames[call->n] = frame;
+    call->lens[call->n] = len;
+    call->n++;
+    buf_release(buf);
+    return true;
+}
+
+static struct dubbo_workload *wl_create(int call_n)
+{
+    struct dubbo_workload *wl = calloc(1, sizeof(*wl));
+    assert(wl);
+    wl->arena = arena_create(WL_CHUNK_SZ);
+    assert(wl->arena);
+    wl->calls = calloc(call_n, sizeof(struct wl_call));
+    assert(wl->calls);
+    wl->call_n = call_n;
+    return wl;
+}
+
+static void call_alloc(struct wl_call *call, uint32_t n)
+{
+    call->frames = malloc(n * sizeof(char *));
+    call->lens = malloc(n * sizeof(uint32_t));
+    assert(call->frames && call->lens);
+}
+
+static const char *json_str(const cJSON *obj, const char *key)
+{
+    const cJSON *item = cJSON_GetObjectItem(obj, key);
+    return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+static bool load_call(struct dubbo_workload *wl, struct wl_call *call, const cJSON *conf, const char *dir, int idx)
+{
+    const char *full = json_str(conf, "method");
+    const char *dot = full ? strrchr(full, '.') : NULL;
+    if (dot == NULL)
+    {
+        LOG_ERROR("第 %d 个调用缺少 method (${service}.${method})", idx + 1);
+        return false;
+    }
+    char *service = strndup(full, dot - full);
+    const char *method = dot + 1;
+    const char *types = json_str(conf, "types");
+    const char *data = json_str(conf, "data");
+
+    const cJSON *weight = cJSON_GetObjectItem(conf, "weight");
+    double w = weight ? (cJSON_IsNumber(weight) ? weight->valuedouble : -1) : 1;
+    if (w < 0 || w > WL_MAX_WEIGHT)
+    {
+        LOG_ERROR("%s: weight 须在 0 到 %d 之间", full, WL_MAX_WEIGHT);
+        free(service);
+        return false;
+    }
+    wl->total_weight += (uint64_t)(w * WL_WEIGHT_SCALE + 0.5);
+    call->weight_end = wl->total_weight;
+
+    char *attach = NULL;
+    const cJSON *attach_conf = cJSON_GetObjectItem(conf, "attach");
+    if (attach_conf && !cJSON_IsObject(attach_conf))
+    {
+        LOG_ERROR("%s: attach 须为对象", full);
+        free(service);
+        return false;
+    }
+    attach = attach_conf ? cJSON_PrintUnformatted(attach_conf) : strdup("{}");
+
+    bool ok = true;
+    const cJSON *args = cJSON_GetObjectItem(conf, "args");
+    if (args == NULL)
+    {
+        LOG_ERROR("%s: 缺少 args", full);
+        ok = false;
+    }
+    else if (!cJSON_IsString(args) || data == NULL)
+    {
+        char *txt = cJSON_IsString(args) ? strdup(args->valuestring) : cJSON_PrintUnformatted(args);
+        call_alloc(call, 1);
+        ok = add_frame(wl, call, 1, service, method, types, txt, attach);
+        free(txt);
+    }
+    else
+    {
+        struct wl_dataset ds;
+        memset(&ds, 0, sizeof(ds));
+        ds.arena = arena_create(WL_CHUNK_SZ);
+        assert(ds.arena);
+        ok = load_dataset(&ds, dir, data);
+        if (ok)
+        {
+            call_alloc(call, ds.n);
+            struct buffer *expanded = buf_create(256);
+            size_t i;
+            for (i = 0; i < ds.n && ok; i++)
+            {
+                ok = expand(expanded, args->valuestring, &ds.rows[i], i + 1) &&
+                     add_frame(wl, call, ds.n, service, method, types, buf_peek(expanded), attach);
+            }
+            buf_release(expanded);
+        }
+        free(ds.rows);
+        arena_release(ds.arena);
+    }
+
+    free(attach);
+    free(service);
+    return ok;
+}
+
+struct dubbo_workload *dubbo_workload_load(const char *path)
+{
+    size_t sz;
+    char *text = read_file(path, &sz);
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    cJSON *root = cJSON_Parse(text);
+    free(text);
+    const cJSON *calls = root ? cJSON_GetObjectItem(root, "calls") : NULL;
+    if (!cJSON_IsArray(calls) || cJSON_GetArraySize(calls) == 0)
+    {
+        LOG_ERROR("%s: 须为 {\"calls\": [...]} 格式的 JSON", path);
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    char *dir = NULL;
+    const char *slash = strrchr(path, '/');
+    if (slash)
+    {
+        dir = strndup(path, slash - path + (slash == path));
+    }
+
+    struct dubbo_workload *wl = wl_create(cJSON_GetArraySize(calls));
+    bool ok = true;
+    int i = 0;
+    const cJSON *conf;
+    for (conf = calls->child; conf && ok; conf = conf->next, i++)
+    {
+        ok = load_call(wl, &wl->calls[i], conf, dir, i);
+    }
+    if (ok && wl->total_weight == 0)
+    {
+        LOG_ERROR("%s: 权重之和为 0", path);
+        ok = false;
+    }
+    free(dir);
+    cJSON_Delete(root);
+    if (!ok)
+    {
+        dubbo_workload_release(wl);
+        return NULL;
+    }
+
+    size_t frame_n = 0;
+    for (i = 0; i < wl->call_n; i++)
+    {
+        frame_n += wl->calls[i].n;
+    }
+    LOG_INFO("负载 %s: %d 个调用, 预编码 %zu 帧, %zu 字节", path, wl->call_n, frame_n, arena_used(wl->arena));
+    return wl;
+}
+
+struct dubbo_workload *dubbo_workload_single(const struct dubbo_args *args)
+{
+    struct dubbo_workload *wl = wl_create(1);
+    struct wl_call *call = &wl->calls[0];
+    call_alloc(call, 1);
+    wl->total_weight = call->weight_end = 1;
+    if (!add_frame(wl, call, 1, args->service, args->method, args->types, args->args, args->attach))
+    {
+        dubbo_workload_release(wl);
+        return NULL;
+    }
+    return wl;
+}
+
+void dubbo_workload_release(struct dubbo_workload *wl)
+{
+    int i;
+    for (i = 0; i < wl->call_n; i++)
+    {
+        free(wl->calls[i].frames);
+        free(wl->calls[i].lens);
+    }
+    free(wl->calls);
+    arena_release(wl->arena);
+    free(wl);
+}
+
+void dubbo_workload_pick(const struct dubbo_workload *wl, uint64_t rnd, const char **frame, size_t *len)
+{
+    const struct wl_call *call = wl->calls;
+    if (wl->call_n > 1)
+    {
+        // 第一个 weight_end 大于 w 的调用
+        uint64_t w = (uint64_t)(((unsigned __int128)(rnd >> 32) * wl->total_weight) >> 32);
+        int lo = 0, hi = wl->call_n - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (wl->calls[mid].weight_end > w)
+            {
+                hi = mid;
+            }
+            else
+            {
+                lo = mid + 1;
+            }
+        }
+        call = &wl->calls[lo];
+    }
+    uint32_t i = call->n > 1 ? (uint32_t)rnd % call->n : 0;
+    *frame = call->frames[i];
+    *len = call->lens[i];
+}
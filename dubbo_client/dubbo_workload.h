@@ -0,0 +1,31 @@
+#ifndef DUBBO_WORKLOAD_H
+#define DUBBO_WORKLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dubbo_client.h"
+
+// 压测负载: 按权重混合的多个调用, 每个调用的参数模板按数据集 (CSV/JSONL) 逐行展开
+// 启动时全部预编码成 dubbo 帧放进 arena, 发送时只选帧, 复制, 改写 reqid, 单次开销与负载大小无关
+//
+// 负载文件为 JSON:
+// {"calls": [{"method": "com.youzan.DemoService.find", "types": "int,java.lang.String",
+//             "args": "[${id}, \"${name}\"]", "attach": {"k": "v"}, "weight": 3, "data": "users.csv"}]}
+// method 必填; types 缺省为泛化调用; attach 缺省 {}; weight 缺省 1, 可为小数 (精度 0.001), 为 0 不发
+// args 为字符串时是模板, ${col} 替换为数据行中 col 列的值 (CSV 按表头, JSONL 按 key)
+// 字符串值替换为转义后的内容, 不带引号, 由模板自己加; 其它 JSON 值替换为其文本
+// args 不是字符串或没有 data 时只编码一次
+// data 为相对负载文件所在目录的路径, 按扩展名 .csv / .jsonl 解析
+
+struct dubbo_workload;
+
+// 出错时输出原因并返回 NULL
+struct dubbo_workload *dubbo_workload_load(const char *path);
+// 命令行给出的单个调用
+struct dubbo_workload *dubbo_workload_single(const struct dubbo_args *args);
+void dubbo_workload_release(struct dubbo_workload *);
+
+// rnd 为调用方的 64 位随机数: 高 32 位按权重选调用, 低 32 位选数据行
+void dubbo_workload_pick(const struct dubbo_workload *, uint64_t rnd, const char **frame, size_t *len);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "dubbo_codec.h"
+#include "dubbo_workload.h"
+
+static char dir[] = "/tmp/workload_test_XXXXXX";
+
+static void write_file(const char *name, const char *content)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "wb");
+    assert(f);
+    fputs(content, f);
+    fclose(f);
+}
+
+static void remove_file(const char *name)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    unlink(path);
+}
+
+// 写入负载文件并加载
+static struct dubbo_workload *load(const char *json)
+{
+    write_file("wl.json", json);
+    char path[256];
+    snprintf(path, sizeof(path), "%s/wl.json", dir);
+    return dubbo_workload_load(path);
+}
+
+// pick 出的帧与直接编码 args 的帧除 reqid 外一致
+static void expect_frame(const char *frame, size_t len, const char *service, const char *method, const char *types, const char *args)
+{
+    struct dubbo_req *req = dubbo_req_create(service, method, types, args, "{}");
+    assert(req);
+    struct buffer *expected = dubbo_encode(req);
+    assert(expected);
+    char *got = malloc(len);
+    memcpy(got, frame, len);
+    dubbo_set_reqid(got, 0);
+    dubbo_set_reqid((char *)buf_peek(expected), 0);
+    if (len != buf_readable(expected) || memcmp(got, buf_peek(expected), len) != 0)
+    {
+        fprintf(stderr, "frame mismatch, expected args %s\n", args);
+        assert(0);
+    }
+    free(got);
+    buf_release(expected);
+    dubbo_req_release(req);
+}
+
+// 低 32 位选第 row 行
+static void expect_row(const struct dubbo_workload *wl, uint32_t row, const char *args)
+{
+    const char *frame;
+    size_t len;
+    dubbo_workload_pick(wl, row, &frame, &len);
+    expect_frame(frame, len, "com.youzan.Demo", "find", NULL, args);
+}
+
+void test_Workload_csv()
+{
+    // 引号内的逗号, 换行与 "" 转义; CRLF 行尾
+    write_file("users.csv", "id,name\r\n"
+                            "1,plain\r\n"
+                            "2,\"a,b\"\r\n"
+                            "3,\"line1\nline2\"\r\n"
+                            "4,\"say \"\"hi\"\"\"\r\n");
+    struct dubbo_workload *wl = load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\","
+                                     "\"args\":\"[${id}, \\\"${name}\\\"]\",\"data\":\"users.csv\"}]}");
+    assert(wl);
+    expect_row(wl, 0, "[1, \"plain\"]");
+    expect_row(wl, 1, "[2, \"a,b\"]");
+    expect_row(wl, 2, "[3, \"line1\\nline2\"]");
+    expect_row(wl, 3, "[4, \"say \\\"hi\\\"\"]");
+    expect_row(wl, 4, "[1, \"plain\"]");
+    dubbo_workload_release(wl);
+
+    // 列数与表头不符
+    write_file("bad.csv", "id,name\n1\n");
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id}]\",\"data\":\"bad.csv\"}]}") == NULL);
+    remove_file("users.csv");
+    remove_file("bad.csv");
+}
+
+void test_Workload_jsonl()
+{
+    // 字符串值转义后替换, 其它值替换为 JSON 文本; 空行跳过
+    write_file("rows.jsonl", "{\"id\": 7, \"tags\": [\"x\", 1], \"name\": \"q\\\"z\"}\n"
+                             "\n"
+                             "{\"id\": 8, \"tags\": {\"k\": null}, \"name\": \"\"}\n");
+    struct dubbo_workload *wl = load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\","
+                                     "\"args\":\"[${id}, ${tags}, \\\"${name}\\\"]\",\"data\":\"rows.jsonl\"}]}");
+    assert(wl);
+    expect_row(wl, 0, "[7, [\"x\",1], \"q\\\"z\"]");
+    expect_row(wl, 1, "[8, {\"k\":null}, \"\"]");
+    dubbo_workload_release(wl);
+
+    write_file("bad.jsonl", "{\"id\": 1}\n[1]\n");
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id}]\",\"data\":\"bad.jsonl\"}]}") == NULL);
+    remove_file("rows.jsonl");
+    remove_file("bad.jsonl");
+}
+
+void test_Workload_template_error()
+{
+    write_file("rows.jsonl", "{\"id\": 1}\n");
+    // ${ 未闭合
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id]\",\"data\":\"rows.jsonl\"}]}") == NULL);
+    // 数据中没有该列
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${nope}]\",\"data\":\"rows.jsonl\"}]}") == NULL);
+    // 展开后不是 JSON
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id}\",\"data\":\"rows.jsonl\"}]}") == NULL);
+    // 数据文件不存在, 扩展名不支持
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id}]\",\"data\":\"none.csv\"}]}") == NULL);
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.find\",\"args\":\"[${id}]\",\"data\":\"wl.json\"}]}") == NULL);
+    assert(load("{\"calls\":[{\"args\":\"[1]\"}]}") == NULL);
+    assert(load("{\"calls\":[]}") == NULL);
+    remove_file("rows.jsonl");
+}
+
+// 高 32 位取 n 等分区间的中点, 统计各方法被选中的次数
+static void pick_counts(const struct dubbo_workload *wl, int n, const char *const *methods, int *counts, int m)
+{
+    int k, i;
+    memset(counts, 0, m * sizeof(int));
+    for (k = 0; k < n; k++)
+    {
+        uint64_t rnd = ((uint64_t)(2 * k + 1) << 32) / (2 * n) << 32;
+        const char *frame;
+        size_t len;
+        dubbo_workload_pick(wl, rnd, &frame, &len);
+        for (i = 0; i < m; i++)
+        {
+            if (memmem(frame, len, methods[i], strlen(methods[i])))
+            {
+                counts[i]++;
+                break;
+            }
+        }
+        assert(i < m);
+    }
+}
+
+void test_Workload_weight()
+{
+    // 0 权重不选, 小数权重按比例
+    struct dubbo_workload *wl = load("{\"calls\":["
+                                     "{\"method\":\"com.youzan.Demo.aaa\",\"args\":[1],\"weight\":3},"
+                                     "{\"method\":\"com.youzan.Demo.bbb\",\"args\":[2],\"weight\":0},"
+                                     "{\"method\":\"com.youzan.Demo.ccc\",\"args\":[3],\"weight\":1.5},"
+                                     "{\"method\":\"com.youzan.Demo.ddd\",\"args\":{\"k\":4},\"weight\":0.5}]}");
+    assert(wl);
+    const char *methods[] = {"aaa", "bbb", "ccc", "ddd"};
+    int counts[4];
+    pick_counts(wl, 10000, methods, counts, 4);
+    assert(counts[0] == 6000 && counts[1] == 0 && counts[2] == 3000 && counts[3] == 1000);
+
+    const char *frame;
+    size_t len;
+    dubbo_workload_pick(wl, 0, &frame, &len);
+    expect_frame(frame, len, "com.youzan.Demo", "aaa", NULL, "[1]");
+    dubbo_workload_pick(wl, UINT64_MAX, &frame, &len);
+    expect_frame(frame, len, "com.youzan.Demo", "ddd", NULL, "{\"k\":4}");
+    dubbo_workload_release(wl);
+
+    // 只有小数权重
+    wl = load("{\"calls\":["
+              "{\"method\":\"com.youzan.Demo.aaa\",\"args\":[1],\"weight\":0.25},"
+              "{\"method\":\"com.youzan.Demo.bbb\",\"args\":[2],\"weight\":0.75}]}");
+    assert(wl);
+    pick_counts(wl, 1000, methods, counts, 2);
+    assert(counts[0] == 250 && counts[1] == 750);
+    dubbo_workload_release(wl);
+
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.aaa\",\"args\":[1],\"weight\":0}]}") == NULL);
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.aaa\",\"args\":[1],\"weight\":-1}]}") == NULL);
+    assert(load("{\"calls\":[{\"method\":\"com.youzan.Demo.aaa\",\"args\":[1],\"weight\":\"1\"}]}") == NULL);
+}
+
+void test_Workload_single()
+{
+    struct dubbo_args args = {.service = "com.youzan.Demo", .method = "find", .args = "[1,\"x\"]", .attach = "{}"};
+    struct dubbo_workload *wl = dubbo_workload_single(&args);
+    assert(wl);
+    const char *frame;
+    size_t len;
+    dubbo_workload_pick(wl, 12345, &frame, &len);
+    expect_frame(frame, len, "com.youzan.Demo", "find", NULL, "[1,\"x\"]");
+    dubbo_workload_release(wl);
+}
+
+int main(void)
+{
+    char *tmp = mkdtemp(dir);
+    assert(tmp);
+
+    test_Workload_csv();
+    test_Workload_jsonl();
+    test_Workload_template_error();
+    test_Workload_weight();
+    test_Workload_single();
+
+    remove_file("wl.json");
+    rmdir(dir);
+    return 0;
+}
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include "endian.h"
 #include "buffer.h"
+#include "intern.h"
 #include "codec.h"
 
 struct nova_hdr;
@@ -20,8 +21,6 @@ struct nova_hdr *nova_hdr_create()
 void nova_hdr_release(struct nova_hdr *hdr)
 {
     assert(hdr != NULL);
-    free(hdr->method_name);
-    free(hdr->service_name);
     free(hdr->attach);
     free(hdr);
 }
@@ -86,12 +85,12 @@ bool nova_unpack(struct buffer *buf, struct nova_hdr *hdr)
     hdr->port = (uint32_t)buf_readInt32(buf);
 
     hdr->service_len = buf_readInt32(buf);
-    hdr->service_name = malloc(hdr->service_len + 1);
-    buf_retrieveAsString(buf, hdr->service_len, hdr->service_name);
+    hdr->service_name = intern_lookup(buf_peek(buf), hdr->service_len);
+    buf_retrieve(buf, hdr->service_len);
 
     hdr->method_len = buf_readInt32(buf);
-    hdr->method_name = malloc(hdr->method_len + 1);
-    buf_retrieveAsString(buf, hdr->method_len, hdr->method_name);
+    hdr->method_name = intern_lookup(buf_peek(buf), hdr->method_len);
+    buf_retrieve(buf, hdr->method_len);
 
     hdr->seq_no = buf_readInt64(buf);
 
@@ -17,9 +17,9 @@ struct nova_hdr
     uint32_t ip;
     uint32_t port;
     int32_t service_len;
-    char *service_name;
+    const char *service_name; /* 驻留字符串, 不释放; 解包时只查不驻留, 未驻留为 NULL */
     int32_t method_len;
-    char *method_name;
+    const char *method_name;  /* 同 service_name */
     int64_t seq_no;
     int32_t attach_len;
     char *attach;
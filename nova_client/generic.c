@@ -7,6 +7,7 @@
 #include "generic.h"
 #include "codec.h"
 #include "buffer.h"
+#include "intern.h"
 
 #define GENERIC_SERVICE "com.youzan.nova.framework.generic.service.GenericService"
 #define GENERIC_SERVICE_LEN 56
@@ -101,14 +102,13 @@ bool thrift_generic_unpack(struct buffer *buf, char **out)
     }
 
     uint32_t method_len = (uint32_t)buf_readInt32(buf);
-    char *method = malloc(method_len + 1);
-    buf_retrieveAsString(buf, method_len, method);
-    if (strncmp(method, GENERIC_METHOD, GENERIC_COMMON_LEN) != 0)
+    // 收到的名字只查不驻留
+    if (intern_lookup(buf_peek(buf), method_len) != intern(GENERIC_METHOD, GENERIC_METHOD_LEN))
     {
-        fprintf(stderr, "unexpected generic method name:%.*s\n", GENERIC_COMMON_LEN, method);
+        fprintf(stderr, "unexpected generic method name:%.*s\n", (int)method_len, buf_peek(buf));
         return false;
     }
-    free(method);
+    buf_retrieve(buf, method_len);
 
     uint32_t seq = (uint32_t)buf_readInt32(buf);
     (void)seq;
@@ -151,15 +151,8 @@ struct nova_hdr *create_nova_generic(const char *attach)
     }
 
     hdr->head_size = (int16_t)head_sz;
-    hdr->service_name = malloc(hdr->service_len + 1);
-    assert(hdr->service_name != NULL);
-    memcpy(hdr->service_name, GENERIC_SERVICE, hdr->service_len);
-    hdr->service_name[hdr->service_len] = 0;
-
-    hdr->method_name = malloc(hdr->method_len + 1);
-    assert(hdr->method_name != NULL);
-    memcpy(hdr->method_name, GENERIC_METHOD, hdr->method_len);
-    hdr->method_name[hdr->method_len] = 0;
+    hdr->service_name = intern(GENERIC_SERVICE, GENERIC_SERVICE_LEN);
+    hdr->method_name = intern(GENERIC_METHOD, GENERIC_METHOD_LEN);
     hdr->seq_no = 1;
 
     hdr->attach = malloc(hdr->attach_len + 1);
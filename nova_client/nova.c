@@ -6,15 +6,21 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 #include <ctype.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <assert.h>
 #include "cJSON.h"
+#include "jscan.h"
+#include "jsonw.h"
 #include "generic.h"
 #include "codec.h"
 #include "socket.h"
 #include "buffer.h"
+#include "intern.h"
+#include "hdr.h"
 
 extern char *optarg;
 
@@ -27,9 +33,10 @@ struct globalArgs_t
     const char *args;   /* JSON */
     const char *attach; /* JSON */
     struct timeval timeout;
+    int repeat; /* 调用次数 */
 } globalArgs;
 
-static const char *optString = "h:p:m:a:e:t:?s!";
+static const char *optString = "h:p:m:a:e:t:n:?s!";
 
 #define INVALID_OPT(reason, ...)                                     \
     fprintf(stderr, "\x1B[1;31m" reason "\x1B[0m\n", ##__VA_ARGS__); \
@@ -39,14 +46,15 @@ static void usage()
 {
     static const char *usage =
         "\nUsage:\n"
-        "   nova -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5>]\n"
+        "   nova -h<HOST> -p<PORT> -m<METHOD> -a<JSON_ARGUMENTS> [-e<JSON_ATTACHMENT='{}'> -t<TIMEOUT_SEC=5> -n<REPEAT=1>]\n"
         "   nova -h<HOST> -p<PORT> -s [-t<TIMEOUT_SEC=5>] doc: https://github.com/youzan/zan/issues/18 \n\n"
         "Example:\n"
         "   nova -h127.0.0.1 -p8050 -s\n"
         "   nova -h127.0.0.1 -p8050 -m=com.youzan.material.general.service.TokenService.getToken -a='{\"xxxId\":1,\"scope\":\"\"}'\n"
         "   nova -h127.0.0.1 -p8050 -m=com.youzan.material.general.service.TokenService.getToken -a='{\"xxxId\":1,\"scope\":\"\"}' -e='{\"xxxId\":1}'\n"
         "   nova -h127.0.0.1 -p8050 -m=com.youzan.material.general.service.MediaService.getMediaList -a='{\"query\":{\"categoryId\":2,\"xxxId\":1,\"pageNo\":1,\"pageSize\":5}}'\n"
-        "   nova -hqabb-dev-scrm-test0 -p8100 -mcom.youzan.scrm.customer.service.customerService.getByYzUid -a '{\"xxxId\":1, \"yzUid\": 1}'\n";
+        "   nova -hqabb-dev-scrm-test0 -p8100 -mcom.youzan.scrm.customer.service.customerService.getByYzUid -a '{\"xxxId\":1, \"yzUid\": 1}'\n\n"
+        "-n: 顺序调用 n 次 (每次新建连接), 只输出第一次的响应, 最后输出延迟分位数\n";
     puts(usage);
     exit(1);
 }
@@ -77,7 +85,15 @@ static char *trim_opt(char *opt)
     return opt;
 }
 
-static int nova_invoke()
+static int64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 建连到收完响应的耗时 (us) 记录到 lat, print 为 false 时不输出响应
+static int nova_invoke(bool print, struct hdr *lat)
 {
     int ret = 1;
     char *resp_json = NULL;
@@ -85,12 +101,13 @@ static int nova_invoke()
     struct buffer *nova_buf = buf_create(1024);
 
     struct buffer *generic_buf = thrift_generic_pack(0,
-                                                     globalArgs.service, strlen(globalArgs.service),
-                                                     globalArgs.method, strlen(globalArgs.method),
+                                                     globalArgs.service, intern_len(globalArgs.service),
+                                                     globalArgs.method, intern_len(globalArgs.method),
                                                      globalArgs.args, strlen(globalArgs.args));
     nova_pack(nova_buf, nova_hdr, buf_peek(generic_buf), buf_readable(generic_buf));
     buf_release(generic_buf);
 
+    int64_t start = now_us();
     int sockfd = socket_clientSync(globalArgs.host, globalArgs.port);
     if (sockfd == -1)
     {
@@ -163,6 +180,7 @@ static int nova_invoke()
             }
         }
     }
+    hdr_record(lat, now_us() - start);
 
     if (!nova_detect(buf_peek(nova_buf), buf_readable(nova_buf)))
     {
@@ -186,46 +204,69 @@ static int nova_invoke()
         goto fail;
     }
 
+    if (!print)
+    {
+        ret = 0;
+        goto fail;
+    }
+
     // print json attach
+    // 只检查结构后原样输出, 不建树
     {
-        nova_hdr->attach[nova_hdr->attach_len] = 0;
-        if (nova_hdr->attach_len && strcmp(nova_hdr->attach, "{}") != 0)
+        const char *val;
+        size_t len;
+        if (nova_hdr->attach_len &&
+            jscan_lookup(nova_hdr->attach, nova_hdr->attach_len, "", &val, &len) &&
+            !(len == 2 && memcmp(val, "{}", 2) == 0))
         {
-            cJSON *root = cJSON_Parse(nova_hdr->attach);
-            if (root)
-            {
-                printf("Nova Attachment: %s\n", cJSON_PrintUnformatted(root));
-                cJSON_Delete(root);
-            }
+            printf("Nova Attachment: %.*s\n", (int)len, val);
         }
     }
 
     // print json resp
+    // 只定位 error_response/response, 仅对取出的片段建树格式化
     {
-        cJSON *resp;
-        cJSON *root = cJSON_Parse(resp_json);
-        if (root == NULL || !cJSON_IsObject(root))
+        const char *val;
+        size_t len;
+        const char *color = NULL;
+        struct jscan *scan = jscan_create(resp_json, strlen(resp_json));
+        if (scan == NULL || !jscan_get(scan, "", &val, &len) || *val != '{')
         {
+            if (scan)
+            {
+                jscan_release(scan);
+            }
             fprintf(stderr, "\x1B[1;31m"
                             "Invalid JSON Response"
                             "\x1B[0m\n");
             printf("%s", resp_json);
             goto fail;
         }
-        else if ((resp = cJSON_GetObjectItem(root, "error_response")))
+        else if (jscan_get(scan, "/error_response", &val, &len))
         {
-            printf("\x1B[1;31m%s\x1B[0m\n", cJSON_Print(resp));
+            color = "\x1B[1;31m";
         }
-        else if ((resp = cJSON_GetObjectItem(root, "response")))
+        else if (jscan_get(scan, "/response", &val, &len))
         {
-            printf("\x1B[1;32m%s\x1B[0m\n", cJSON_Print(resp));
+            color = "\x1B[1;32m";
+        }
+        jscan_release(scan);
+
+        struct buffer *out = buf_create(len * 2);
+        cJSON *resp = cJSON_ParseWithOpts(val, NULL, 0);
+        if (resp)
+        {
+            struct jsonw *jw = jw_create(out, JW_PRETTY);
+            jw_cjson(jw, resp);
+            jw_release(jw);
+            cJSON_Delete(resp);
         }
         else
         {
-            printf("%s\n", cJSON_Print(root));
+            buf_append(out, resp_json, strlen(resp_json));
         }
-
-        cJSON_Delete(root);
+        printf("%s%.*s%s\n", color ? color : "", (int)buf_readable(out), buf_peek(out), color ? "\x1B[0m" : "");
+        buf_release(out);
     }
     ret = 0;
 
@@ -254,6 +295,7 @@ int main(int argc, char **argv)
     globalArgs.attach = "{}";
     globalArgs.timeout.tv_sec = 5;
     globalArgs.timeout.tv_usec = 0;
+    globalArgs.repeat = 1;
 
     opt = getopt(argc, argv, optString);
     optarg = trim_opt(optarg);
@@ -266,8 +308,8 @@ int main(int argc, char **argv)
             {
                 globalArgs.host = "127.0.0.1";
             }
-            globalArgs.service = "com.youzan.service.test";
-            globalArgs.method = "stats";
+            globalArgs.service = intern_cstr("com.youzan.service.test");
+            globalArgs.method = intern_cstr("stats");
             globalArgs.args = "{}";
             break;
 
@@ -288,11 +330,8 @@ int main(int argc, char **argv)
 
             service_len = ret - optarg;
             method_len = strlen(optarg) - service_len - 1;
-            *ret = 0;
-            globalArgs.service = malloc(service_len + 1);
-            globalArgs.method = malloc(method_len + 1);
-            memcpy((void *)globalArgs.service, optarg, service_len + 1);
-            memcpy((void *)globalArgs.method, ret + 1, method_len + 1);
+            globalArgs.service = intern(optarg, service_len);
+            globalArgs.method = intern(ret + 1, method_len);
             break;
 
         case 'a':
@@ -307,6 +346,10 @@ int main(int argc, char **argv)
             globalArgs.timeout.tv_sec = atoi(optarg) > 0 ? atoi(optarg) : 5;
             break;
 
+        case 'n':
+            globalArgs.repeat = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+
         case '?':
             usage();
             break;
@@ -356,18 +399,41 @@ int main(int argc, char **argv)
         else
         {
             // 泛化调用参数为扁平KV结构, 非标量参数要二次打包
+            struct buffer *out = buf_create(strlen(globalArgs.args) * 2);
+            struct buffer *nested = buf_create(256);
+            struct jsonw *jw = jw_create(out, 0);
+            jw_object_begin(jw);
             cJSON *cur = root->child;
             while (cur)
             {
+                jw_key(jw, cur->string, strlen(cur->string));
                 if (cJSON_IsArray(cur) || cJSON_IsObject(cur))
                 {
-                    cJSON_ReplaceItemInObject(root, cur->string, cJSON_CreateString(cJSON_PrintUnformatted(cur)));
+                    buf_retrieveAll(nested);
+                    struct jsonw *njw = jw_create(nested, 0);
+                    jw_cjson(njw, cur);
+                    jw_release(njw);
+                    jw_string(jw, buf_peek(nested), buf_readable(nested));
+                }
+                else
+                {
+                    jw_cjson(jw, cur);
                 }
 
                 cur = cur->next;
             }
+            jw_object_end(jw);
+            // cJSON 不校验 utf8, 非法 utf8 在这里才失败
+            if (!jw_ok(jw))
+            {
+                INVALID_OPT("Invalid Arguments JSON Format (invalid UTF-8) : %s", globalArgs.args);
+            }
+            jw_release(jw);
 
-            globalArgs.args = cJSON_PrintUnformatted(root);
+            globalArgs.args = buf_dupStr(out, buf_readable(out));
+            buf_release(nested);
+            buf_release(out);
+            cJSON_Delete(root);
         }
     }
 
@@ -392,5 +458,19 @@ int main(int argc, char **argv)
             globalArgs.args,
             globalArgs.attach);
 
-    return nova_invoke();
+    int i, status = 0;
+    struct hdr *lat = hdr_create(3600LL * 1000 * 1000, 3);
+    for (i = 0; i < globalArgs.repeat && status == 0; i++)
+    {
+        status = nova_invoke(i == 0, lat);
+    }
+    if (globalArgs.repeat > 1)
+    {
+        fprintf(stderr, "[LATENCY] N %" PRId64 ", MIN %.3fms, P50 %.3fms, P90 %.3fms, P99 %.3fms, P99.9 %.3fms, MAX %.3fms, MEAN %.3fms\n",
+                hdr_count(lat), hdr_min(lat) / 1000.0, hdr_value_at_percentile(lat, 50) / 1000.0,
+                hdr_value_at_percentile(lat, 90) / 1000.0, hdr_value_at_percentile(lat, 99) / 1000.0,
+                hdr_value_at_percentile(lat, 99.9) / 1000.0, hdr_max(lat) / 1000.0, hdr_mean(lat) / 1000.0);
+    }
+    hdr_release(lat);
+    return status;
 }